@@ -62,6 +62,10 @@ int FX_Init(int numvoices, int numchannels, int mixrate, void *initdata);
 void FX_InitCvars(void);
 int FX_Shutdown(void);
 int FX_GetDevice(void);
+// selects the PCM driver used by the next FX_Init(), ASS_AutoDetect for the platform default
+void FX_SetDevice(int device);
+// mixes the next length bytes of output into ptr; only valid while the ASS_Null driver is in use
+int FX_Render(char *ptr, int length);
 
 /* returns true only after program startup */
 static FORCE_INLINE int FX_WarmedUp(void)
@@ -74,6 +78,10 @@ int FX_Play(char *ptr, uint32_t ptrlength, int loopstart, int loopend, int pitch
                       int vol, int left, int right, int priority, fix16_t volume, intptr_t callbackval);
 int FX_Play3D(char *ptr, uint32_t ptrlength, int loophow, int pitchoffset, int angle,
                   int distance, int priority, fix16_t volume, intptr_t callbackval);
+// decodes an Ogg Vorbis or FLAC sound into a WAV image the caller releases with Xfree()
+int FX_DecodeToWAV(char const *ptr, uint32_t ptrlength, char **wavptr, uint32_t *wavlength, uint32_t maxlength);
+// whether the sound is in a format FX_DecodeToWAV() takes, without looking past the header
+bool FX_IsDecodable(char const *ptr, uint32_t ptrlength);
 int FX_PlayRaw(char *ptr, uint32_t ptrlength, int rate, int pitchoffset, int vol,
     int left, int right, int priority, fix16_t volume, intptr_t callbackval);
 int FX_PlayLoopedRaw(char *ptr, uint32_t ptrlength, char *loopstart, char *loopend, int rate,
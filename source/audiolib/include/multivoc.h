@@ -124,6 +124,13 @@ decltype(MV_PlayVOC)   MV_PlayXA;
 decltype(MV_PlayVOC3D) MV_PlayXMP3D;
 decltype(MV_PlayVOC)   MV_PlayXMP;
 
+// Decodes a whole sound into an in-memory 16-bit WAV image allocated with
+// Xmalloc(), for playback without running the decoder every time.  Sounds with
+// loop tags, a format change between chained streams or a decoded size above
+// maxlength bytes are refused with MV_InvalidFile.
+int MV_DecodeVorbis(char const *ptr, uint32_t length, char **wavptr, uint32_t *wavlength, uint32_t maxlength);
+decltype(MV_DecodeVorbis) MV_DecodeFLAC;
+
 int MV_PlayRAW(char *ptr, uint32_t length, int rate, char *loopstart, char *loopend, int pitchoffset, int vol,
                int left, int right, int priority, fix16_t volume, intptr_t callbackval);
 
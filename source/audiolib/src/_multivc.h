@@ -55,7 +55,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 extern struct VoiceNode *MV_Voices;
 extern struct VoiceNode  VoiceList;
-extern struct VoiceNode  VoicePool;
 
 extern fix16_t MV_GlobalVolume;
 extern fix16_t MV_VolumeSmoothFactor;
@@ -173,12 +172,32 @@ typedef struct VoiceNode
     uint32_t SamplingRate;
     uint32_t RateScale;
     uint32_t position;
+
+    float LastFrame[2];  // last frame of the previous block, see MV_MixVoice()
     std::atomic<int> Paused;
 
     int handle;
     int priority;
 
     async::task<int> task;
+
+    // the game and decoder tasks never touch a playing voice's mixer state
+    // directly; they leave the new values here and post MV_CMD_* bits for
+    // MV_ServiceVoc() to apply, see MV_PostCommand()
+    struct VoiceNode *m_next;
+    std::atomic<uint32_t> Commands;
+
+    struct
+    {
+        std::atomic<fix16_t> Left;
+        std::atomic<fix16_t> Right;
+    } PendingVolume;
+
+    std::atomic<int> PendingPitch;
+    std::atomic<uint32_t> PendingFrequency;
+
+    std::atomic<bool> Stopped;  // set once by whoever ends the voice first, game or mixer
+    std::atomic<bool> Retired;  // the mixer is done with the voice and it can go back to the pool
 } VoiceNode;
 
 typedef struct
@@ -212,6 +231,11 @@ typedef struct
     uint32_t size;
 } data_header;
 
+#define MV_WAVHEADERSIZE (sizeof(riff_header) + sizeof(format_header) + sizeof(data_header))
+
+// fills in the MV_WAVHEADERSIZE bytes in front of datalength bytes of 16-bit PCM
+void MV_WriteWAVHeader(char *ptr, int channels, uint32_t rate, uint32_t datalength);
+
 extern Pan MV_PanTable[MV_NUMPANPOSITIONS][MV_MAXVOLUME + 1];
 extern int MV_ErrorCode;
 extern int MV_Installed;
@@ -234,6 +258,14 @@ static FORCE_INLINE int MV_SetErrorCode(int status)
     return MV_Error;
 }
 
+// Moves the position the mixer has reached past the end of the last block to the start of the next
+// one.  MV_Mix() asks for a new block once the position is within voice->channels of the end, so it
+// can come up short by that much; that is treated as the end.
+static FORCE_INLINE void MV_CarryPosition(VoiceNode *voice)
+{
+    voice->position = voice->position > voice->length ? voice->position - voice->length : 0;
+}
+
 void MV_PlayVoice(VoiceNode *voice);
 
 VoiceNode *MV_AllocVoice(int priority, uint32_t allocsize = 0);
@@ -265,6 +297,18 @@ template <typename S, typename D> uint32_t MV_MixMono(struct VoiceNode * const v
 template <typename S, typename D> uint32_t MV_MixStereo(struct VoiceNode * const voice, uint32_t length);
 template <typename T> void MV_Reverb(char const *src, char * const dest, const fix16_t volume, int count);
 
+// Voices are mixed into a float bus holding one buffer's worth of samples,
+// which is clipped to the int16 output once after the last voice instead of
+// after every sample of every voice.
+extern float MV_MixBus[MV_MIXBUFFERSIZE * 2];
+
+void MV_MixBusLoad(float *dest, int16_t const *src, int count);
+void MV_MixBusStore(int16_t *dest, float const *src, int count);
+// dest[i] += src[i] * gain[i]
+void MV_MixAccumulate(float *dest, float const *src, float const *gain, int count);
+// dest[i] += src[i] * (i & 1 ? right : left)
+void MV_MixAccumulateConst(float *dest, float const *src, float left, float right, int count);
+
 // implemented in mixst.c
 template <typename S, typename D> uint32_t MV_MixMonoStereo(struct VoiceNode * const voice, uint32_t length);
 template <typename S, typename D> uint32_t MV_MixStereoStereo(struct VoiceNode * const voice, uint32_t length);
@@ -273,6 +317,110 @@ extern char *MV_MixDestination;  // pointer to the next output sample
 extern int MV_SampleSize;
 extern int MV_RightChannelOffset;
 
+#define MV_MIXBLOCKSIZE 64
+
+/*
+ Mixes length frames of voice into the bus at MV_MixDestination.  Source
+ frames are linearly interpolated for fractional rates, and the volume
+ smoothing is stepped per frame like before, except that a block is mixed
+ with a constant gain once the panned volume has reached its goal.
+
+ A position between frames n and n+1 plays the interpolation between frames
+ n-1 and n, one frame late, so that the first frame of a block is blended
+ with the last one of the previous block, which is kept in
+ voice->LastFrame, instead of holding the last frame of each block: the
+ next block isn't there yet when a block ends, and after a loop it starts
+ at the loop start.  A new voice starts from silence.
+ */
+template <typename S, typename D, int SrcChannels, int DstChannels>
+static inline uint32_t MV_MixVoice(struct VoiceNode * const voice, uint32_t length)
+{
+    auto const * __restrict source = (S const *)voice->sound;
+    auto       * __restrict dest   = (float *)MV_MixDestination;
+
+    uint32_t       position = voice->position;
+    uint32_t const rate     = voice->RateScale;
+    uint32_t const last     = max<uint32_t>(voice->length >> 16, 1) - 1;
+    fix16_t const  volume   = fix16_fast_trunc_mul(voice->volume, MV_GlobalVolume);
+
+    auto &     panned = voice->PannedVolume;
+    auto const goal   = voice->GoalVolume;
+
+    float frames[MV_MIXBLOCKSIZE * DstChannels];
+    float gains[MV_MIXBLOCKSIZE * DstChannels];
+
+    do
+    {
+        int const  count  = min<uint32_t>(length, MV_MIXBLOCKSIZE);
+        bool const steady = SMOOTH_VOLUME(panned.Left, goal.Left) == panned.Left
+                            && (DstChannels == 1 || SMOOTH_VOLUME(panned.Right, goal.Right) == panned.Right);
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t const frame = position >> 16;
+            uint32_t const idx   = frame * SrcChannels;
+            float const    frac  = (position & 0xffff) * (1.f / 65536.f);
+
+            position += rate;
+
+            float const s0 = frame ? CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[idx - SrcChannels]) : voice->LastFrame[0];
+            float const l  = s0 + (CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[idx]) - s0) * frac;
+            float       r  = l;
+
+            if (SrcChannels == 2)
+            {
+                float const s1 = frame ? CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[idx - 1]) : voice->LastFrame[1];
+                r = s1 + (CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[idx + 1]) - s1) * frac;
+            }
+
+            if (DstChannels == 1)
+                frames[i] = (SrcChannels == 2) ? (l + r) * 0.5f : l;
+            else
+            {
+                frames[i << 1]       = l;
+                frames[(i << 1) + 1] = r;
+            }
+
+            if (steady)
+                continue;
+
+            if (DstChannels == 1)
+            {
+                gains[i]    = fix16_to_float(fix16_fast_trunc_mul(volume, panned.Left));
+                panned.Left = SMOOTH_VOLUME(panned.Left, goal.Left);
+            }
+            else
+            {
+                gains[i << 1]       = fix16_to_float(fix16_fast_trunc_mul(volume, panned.Left));
+                gains[(i << 1) + 1] = fix16_to_float(fix16_fast_trunc_mul(volume, panned.Right));
+                panned = { SMOOTH_VOLUME(panned.Left, goal.Left), SMOOTH_VOLUME(panned.Right, goal.Right) };
+            }
+        }
+
+        if (steady)
+            MV_MixAccumulateConst(dest, frames, fix16_to_float(fix16_fast_trunc_mul(volume, panned.Left)),
+                                  fix16_to_float(fix16_fast_trunc_mul(volume, DstChannels == 1 ? panned.Left : panned.Right)), count * DstChannels);
+        else
+            MV_MixAccumulate(dest, frames, gains, count * DstChannels);
+
+        dest   += count * DstChannels;
+        length -= count;
+    }
+    while (length);
+
+    // MV_Mix() gets the next block once the position passes the last frame; until then, the
+    // first frame of this block still needs the last one of the previous block
+    if (position >= voice->length - voice->channels)
+    {
+        voice->LastFrame[0] = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[last * SrcChannels]);
+        voice->LastFrame[1] = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[last * SrcChannels + SrcChannels - 1]);
+    }
+
+    MV_MixDestination = (char *)dest;
+
+    return position;
+}
+
 #define loopStartTagCount 3
 extern const char *loopStartTags[loopStartTagCount];
 #define loopEndTagCount 2
@@ -280,6 +428,9 @@ extern const char *loopEndTags[loopEndTagCount];
 #define loopLengthTagCount 2
 extern const char *loopLengthTags[loopLengthTagCount];
 
+// true if the vorbis comment "entry" (NAME=value) names one of the loop start tags
+bool MV_IsLoopStartComment(char const *entry);
+
 #if defined __POWERPC__ || defined GEKKO
 # define BIGENDIAN
 #endif
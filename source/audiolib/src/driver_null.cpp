@@ -0,0 +1,149 @@
+/*
+ Copyright (C) EDuke32 developers and contributors
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ See the GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+/**
+ * Null output driver for MultiVoc
+ *
+ * Nothing is sent to a device: the mix buffers are only pulled when
+ * NullDrv_PCM_Render() asks for them, as fast as the caller wants them,
+ * which makes it possible to run the mixer on a machine without audio
+ * hardware and capture its exact output.  Rendering happens on the calling
+ * thread, so locking is a no-op.
+ */
+
+#include "driver_null.h"
+
+#include "compat.h"
+
+enum
+{
+    NullErr_Error   = -1,
+    NullErr_Ok      = 0,
+    NullErr_Uninitialised,
+    NullErr_Format,
+};
+
+static int ErrorCode = NullErr_Ok;
+static int Initialised;
+static int Playing;
+
+static char *MixBuffer;
+static int MixBufferSize;
+static int MixBufferCount;
+static int MixBufferCurrent;
+static int MixBufferUsed;
+static void (*MixCallBack)(void);
+
+int NullDrv_GetError(void) { return ErrorCode; }
+
+const char *NullDrv_ErrorString(int ErrorNumber)
+{
+    switch (ErrorNumber)
+    {
+        case NullErr_Error:         return NullDrv_ErrorString(ErrorCode);
+        case NullErr_Ok:            return "Null output ok.";
+        case NullErr_Uninitialised: return "Null output uninitialized.";
+        case NullErr_Format:        return "Null output: unsupported sample format.";
+        default:                    return "Unknown null output error code.";
+    }
+}
+
+int NullDrv_PCM_Init(int *mixrate, int *numchannels, void *initdata)
+{
+    UNREFERENCED_PARAMETER(initdata);
+
+    if (*mixrate <= 0 || (*numchannels != 1 && *numchannels != 2))
+    {
+        ErrorCode = NullErr_Format;
+        return NullErr_Error;
+    }
+
+    Initialised = 1;
+    return NullErr_Ok;
+}
+
+void NullDrv_PCM_Shutdown(void)
+{
+    NullDrv_PCM_StopPlayback();
+    Initialised = 0;
+}
+
+int NullDrv_PCM_BeginPlayback(char *BufferStart, int BufferSize, int NumDivisions, void (*CallBackFunc)(void))
+{
+    if (!Initialised)
+    {
+        ErrorCode = NullErr_Uninitialised;
+        return NullErr_Error;
+    }
+
+    MixBuffer = BufferStart;
+    MixBufferSize = BufferSize;
+    MixBufferCount = NumDivisions;
+    MixBufferCurrent = 0;
+    MixBufferUsed = 0;
+    MixCallBack = CallBackFunc;
+
+    // prime the buffer, same as the SDL driver
+    MixCallBack();
+
+    Playing = 1;
+
+    return NullErr_Ok;
+}
+
+void NullDrv_PCM_StopPlayback(void)
+{
+    Playing = 0;
+    MixCallBack = nullptr;
+}
+
+void NullDrv_PCM_Lock(void) {}
+void NullDrv_PCM_Unlock(void) {}
+
+int NullDrv_PCM_Render(char *ptr, int remaining)
+{
+    if (!Playing)
+    {
+        ErrorCode = NullErr_Uninitialised;
+        return NullErr_Error;
+    }
+
+    while (remaining > 0)
+    {
+        if (MixBufferUsed == MixBufferSize)
+        {
+            MixCallBack();
+            MixBufferUsed = 0;
+
+            if (++MixBufferCurrent >= MixBufferCount)
+                MixBufferCurrent -= MixBufferCount;
+        }
+
+        int const len = min(remaining, MixBufferSize - MixBufferUsed);
+
+        memcpy(ptr, MixBuffer + (MixBufferCurrent * MixBufferSize) + MixBufferUsed, len);
+
+        ptr += len;
+        MixBufferUsed += len;
+        remaining -= len;
+    }
+
+    return NullErr_Ok;
+}
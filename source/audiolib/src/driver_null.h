@@ -0,0 +1,36 @@
+/*
+ Copyright (C) EDuke32 developers and contributors
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ See the GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+ */
+
+#ifndef driver_null_h__
+#define driver_null_h__
+
+const char *NullDrv_ErrorString(int ErrorNumber);
+
+int  NullDrv_GetError(void);
+int  NullDrv_PCM_Init(int *mixrate, int *numchannels, void *initdata);
+void NullDrv_PCM_Shutdown(void);
+int  NullDrv_PCM_BeginPlayback(char *BufferStart, int BufferSize, int NumDivisions, void (*CallBackFunc)(void));
+void NullDrv_PCM_StopPlayback(void);
+void NullDrv_PCM_Lock(void);
+void NullDrv_PCM_Unlock(void);
+
+int  NullDrv_PCM_Render(char *ptr, int length);
+
+#endif // driver_null_h__
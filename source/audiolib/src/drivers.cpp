@@ -27,6 +27,7 @@
 #include "drivers.h"
 
 #include "driver_adlib.h"
+#include "driver_null.h"
 #include "driver_sf2.h"
 #include "_midi.h"
 
@@ -195,6 +196,20 @@ static struct
         UNSUPPORTED_COMPLETELY
     #endif
     },
+
+    // Offline rendering, no device
+    {
+        "Null output",
+        NullDrv_GetError,
+        NullDrv_ErrorString,
+        NullDrv_PCM_Init,
+        NullDrv_PCM_Shutdown,
+        NullDrv_PCM_BeginPlayback,
+        NullDrv_PCM_StopPlayback,
+        NullDrv_PCM_Lock,
+        NullDrv_PCM_Unlock,
+        UNSUPPORTED_MIDI,
+    },
 };
 
 
@@ -235,7 +235,8 @@ FLAC__StreamDecoderWriteStatus write_flac_stream(const FLAC__StreamDecoder *deco
 
     size_t const size = samples * voice->channels * (voice->bits >> 3);
 
-    voice->position = 0;
+    // a seek lands here in the middle of a block, which starts the new one afresh
+    MV_CarryPosition(voice);
     // CODEDUP multivoc.c MV_SetVoicePitch
     voice->RateScale = divideu64((uint64_t)voice->SamplingRate * voice->PitchScale, MV_MixRate);
     voice->FixedPointBufferSize = (voice->RateScale * MV_MIXBUFFERSIZE) - voice->RateScale;
@@ -605,6 +606,139 @@ int MV_PlayFLAC(char *ptr, uint32_t length, int loopstart, int loopend, int pitc
     return voice->handle;
 }
 
+// MV_DecodeFLAC() state; the stream callbacks above only see the flac_data at its start
+typedef struct
+{
+    flac_data data;
+
+    char *wav;
+    uint32_t wavsize;
+    uint32_t pos;
+    uint32_t maxlength;
+
+    uint32_t channels;
+    uint32_t rate;
+    bool refused;
+} flac_decode;
+
+static void metadata_flac_decode(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
+{
+    auto fd = (flac_decode *)client_data;
+
+    UNREFERENCED_PARAMETER(decoder);
+
+    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+    {
+        auto info = &metadata->data.stream_info;
+
+        fd->channels = info->channels;
+        fd->rate     = info->sample_rate;
+
+        // only 16-bit sources can be stored as is
+        if ((info->channels != 1 && info->channels != 2) || info->bits_per_sample != 16
+            || (uint64_t)info->total_samples * info->channels * 2 > fd->maxlength - MV_WAVHEADERSIZE)
+            fd->refused = true;
+        else if (info->total_samples > 0)
+        {
+            fd->wavsize = MV_WAVHEADERSIZE + (uint32_t)info->total_samples * info->channels * 2;
+            fd->wav     = (char *)Xmalloc(fd->wavsize);
+        }
+    }
+    else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+    {
+        // loop points would be lost along with the stream, so only plain sounds are decoded
+        for (FLAC__uint32 i = 0; i < metadata->data.vorbis_comment.num_comments; ++i)
+            if (MV_IsLoopStartComment((char const *)metadata->data.vorbis_comment.comments[i].entry))
+                fd->refused = true;
+    }
+}
+
+static FLAC__StreamDecoderWriteStatus write_flac_decode(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame,
+                                                        const FLAC__int32 *const ibuffer[], void *client_data)
+{
+    auto fd = (flac_decode *)client_data;
+
+    UNREFERENCED_PARAMETER(decoder);
+
+    if (fd->refused || frame->header.channels != fd->channels || frame->header.sample_rate != fd->rate
+        || frame->header.bits_per_sample != 16)
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    uint32_t const samples = frame->header.blocksize;
+    uint32_t const size    = samples * fd->channels * 2;
+
+    if (size > fd->maxlength - MV_WAVHEADERSIZE - fd->pos)
+    {
+        fd->refused = true;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    if (MV_WAVHEADERSIZE + fd->pos + size > fd->wavsize)
+    {
+        fd->wavsize = min<uint32_t>(max<uint32_t>(fd->wavsize * 2, MV_WAVHEADERSIZE + fd->pos + size), fd->maxlength);
+        fd->wav     = (char *)Xrealloc(fd->wav, fd->wavsize);
+    }
+
+    auto data = (int16_t *)(fd->wav + MV_WAVHEADERSIZE + fd->pos);
+
+    for (uint32_t sample = 0; sample < samples; ++sample)
+        for (uint32_t channel = 0; channel < fd->channels; ++channel)
+            *data++ = B_LITTLE16((int16_t)ibuffer[channel][sample]);
+
+    fd->pos += size;
+
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+int MV_DecodeFLAC(char const *ptr, uint32_t length, char **wavptr, uint32_t *wavlength, uint32_t maxlength)
+{
+    if (maxlength < MV_WAVHEADERSIZE)
+        return MV_SetErrorCode(MV_InvalidFile);
+
+    flac_decode fd = {};
+
+    fd.data.ptr    = (void *)(intptr_t)ptr;
+    fd.data.length = length;
+    fd.data.stream = FLAC__stream_decoder_new();
+    fd.maxlength   = maxlength;
+
+    if (fd.data.stream == nullptr)
+        return MV_SetErrorCode(MV_InvalidFile);
+
+    FLAC__stream_decoder_set_metadata_respond(fd.data.stream, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+
+    bool success = false;
+
+    if (FLAC__stream_decoder_init_stream(fd.data.stream, read_flac_stream, seek_flac_stream, tell_flac_stream,
+                                         length_flac_stream, eof_flac_stream, write_flac_decode,
+                                         metadata_flac_decode, error_flac_stream,
+                                         (void *)&fd) == FLAC__STREAM_DECODER_INIT_STATUS_OK)
+    {
+        success = FLAC__stream_decoder_process_until_end_of_stream(fd.data.stream) && !fd.refused
+                  && FLAC__stream_decoder_get_state(fd.data.stream) == FLAC__STREAM_DECODER_END_OF_STREAM;
+        FLAC__stream_decoder_finish(fd.data.stream);
+    }
+    else
+        LOG_F(ERROR, "MV_DecodeFLAC: error in FLAC__stream_decoder_init_stream: %s", FLAC__stream_decoder_get_resolved_state_string(fd.data.stream));
+
+    FLAC__stream_decoder_delete(fd.data.stream);
+
+    if (!success)
+    {
+        Xfree(fd.wav);
+        return MV_SetErrorCode(MV_InvalidFile);
+    }
+
+    if (fd.wav == nullptr)
+        fd.wav = (char *)Xmalloc(MV_WAVHEADERSIZE);
+
+    MV_WriteWAVHeader(fd.wav, fd.channels, fd.rate, fd.pos);
+
+    *wavptr    = fd.wav;
+    *wavlength = MV_WAVHEADERSIZE + fd.pos;
+
+    return MV_Ok;
+}
 
 void MV_ReleaseFLACVoice(VoiceNode *voice)
 {
@@ -643,4 +777,9 @@ int MV_PlayFLAC3D(char *, uint32_t, int, int, int, int, int, fix16_t, intptr_t)
     LOG_F(ERROR, "MV_PlayFLAC: FLAC support not included in this binary.");
     return -1;
 }
+
+int MV_DecodeFLAC(char const *, uint32_t, char **, uint32_t *, uint32_t)
+{
+    return MV_SetErrorCode(MV_InvalidFile);
+}
 #endif  // HAVE_FLAC
@@ -39,12 +39,10 @@ static playbackstatus MV_GetNextWAVBlock(VoiceNode *voice)
 
         voice->BlockLength = voice->Loop.Size;
         voice->NextBlock   = voice->Loop.Start;
-        voice->length      = 0;
-        voice->position    = 0;
     }
 
     voice->sound        = voice->NextBlock;
-    voice->position    -= voice->length;
+    MV_CarryPosition(voice);
     voice->length       = min(voice->BlockLength, 0x8000u);
     voice->NextBlock   += voice->length * ((voice->channels * voice->bits) >> 3);
     voice->BlockLength -= voice->length;
@@ -64,7 +62,7 @@ static playbackstatus MV_GetNextVOCBlock(VoiceNode *voice)
 
     if (voice->BlockLength > 0)
     {
-        voice->position    -= voice->length;
+        MV_CarryPosition(voice);
         voice->sound       += (voice->length >> 16) * ((voice->channels * voice->bits) >> 3);
         voice->length       = min(voice->BlockLength, 0x8000u);
         voice->BlockLength -= voice->length;
@@ -310,12 +308,10 @@ static playbackstatus MV_GetNextRAWBlock(VoiceNode *voice)
 
         voice->BlockLength = voice->Loop.Size;
         voice->NextBlock   = voice->Loop.Start;
-        voice->length      = 0;
-        voice->position    = 0;
     }
 
     voice->sound        = voice->NextBlock;
-    voice->position    -= voice->length;
+    MV_CarryPosition(voice);
     voice->length       = min(voice->BlockLength, 0x8000u);
     voice->NextBlock   += voice->length * (voice->channels * voice->bits / 8);
     voice->BlockLength -= voice->length;
@@ -324,6 +320,19 @@ static playbackstatus MV_GetNextRAWBlock(VoiceNode *voice)
     return KeepPlaying;
 }
 
+void MV_WriteWAVHeader(char *ptr, int channels, uint32_t rate, uint32_t datalength)
+{
+    riff_header riff = { { 'R', 'I', 'F', 'F' }, B_LITTLE32((uint32_t)(MV_WAVHEADERSIZE - 8 + datalength)),
+                         { 'W', 'A', 'V', 'E' }, { 'f', 'm', 't', ' ' }, B_LITTLE32((uint32_t)sizeof(format_header)) };
+    format_header format = { B_LITTLE16(1), B_LITTLE16((uint16_t)channels), B_LITTLE32(rate),
+                             B_LITTLE32(rate * channels * 2), B_LITTLE16((uint16_t)(channels * 2)), B_LITTLE16(16) };
+    data_header data = { { 'd', 'a', 't', 'a' }, B_LITTLE32(datalength) };
+
+    memcpy(ptr, &riff, sizeof(riff_header));
+    memcpy(ptr + sizeof(riff_header), &format, sizeof(format_header));
+    memcpy(ptr + sizeof(riff_header) + sizeof(format_header), &data, sizeof(data_header));
+}
+
 int MV_PlayWAV3D(char *ptr, uint32_t length, int loophow, int pitchoffset, int angle, int distance,
                      int priority, fix16_t volume, intptr_t callbackval)
 {
@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "compat.h"
 #include "drivers.h"
 #include "driver_adlib.h"
+#include "driver_null.h"
 #include "driver_sf2.h"
 #include "midi.h"
 #include "multivoc.h"
@@ -49,6 +50,8 @@ int FX_ErrorCode = FX_Ok;
 int FX_Installed;
 int FX_MixRate;
 
+static int FX_PCMDevice = ASS_AutoDetect;
+
 const char *FX_ErrorString(int const ErrorNumber)
 {
     switch (ErrorNumber)
@@ -161,6 +164,9 @@ int FX_Init(int numvoices, int numchannels, int mixrate, void* initdata)
     int SoundCard = ASS_DirectSound;
 #endif
 
+    if (FX_PCMDevice != ASS_AutoDetect)
+        SoundCard = FX_PCMDevice;
+
     VLOG_F(LOG_ASS, "Initializing Apogee Sound System");
 
     if (SoundDriver_IsPCMSupported(SoundCard) == 0)
@@ -209,6 +215,18 @@ int FX_Shutdown(void)
 }
 
 int FX_GetDevice(void) { return ASS_PCMSoundDriver; }
+void FX_SetDevice(int device) { FX_PCMDevice = device; }
+
+int FX_Render(char *ptr, int length)
+{
+    if (!FX_Installed || ASS_PCMSoundDriver != ASS_Null)
+        return FX_SetErrorCode(FX_InvalidCard);
+
+    if (NullDrv_PCM_Render(ptr, length) != MV_Ok)
+        return FX_SetErrorCode(FX_MultiVocError);
+
+    return FX_Ok;
+}
 
 
 #define FMT_MAGIC(i, j, k, l) (i + (j << 8) + (k << 16) + (l << 24))
@@ -242,6 +260,29 @@ static wavefmt_t FX_ReadFmt(char const * const ptr, uint32_t length)
     return FMT_UNKNOWN;
 }
 
+bool FX_IsDecodable(char const *ptr, uint32_t ptrlength)
+{
+    auto const fmt = FX_ReadFmt(ptr, ptrlength);
+    return fmt == FMT_VORBIS || fmt == FMT_FLAC;
+}
+
+int FX_DecodeToWAV(char const *ptr, uint32_t ptrlength, char **wavptr, uint32_t *wavlength, uint32_t maxlength)
+{
+    int status;
+
+    switch (FX_ReadFmt(ptr, ptrlength))
+    {
+        case FMT_VORBIS: status = MV_DecodeVorbis(ptr, ptrlength, wavptr, wavlength, maxlength); break;
+        case FMT_FLAC:   status = MV_DecodeFLAC(ptr, ptrlength, wavptr, wavlength, maxlength); break;
+        default:         status = MV_SetErrorCode(MV_InvalidFile); break;
+    }
+
+    if (status != MV_Ok)
+        return FX_SetErrorCode(FX_MultiVocError);
+
+    return FX_Ok;
+}
+
 static int FX_BadFmt(char *, uint32_t, int, int, int, int, int, int, int, fix16_t, intptr_t) { return MV_SetErrorCode(MV_InvalidFile); }
 static int FX_BadFmt3D(char *, uint32_t, int, int, int, int, int, fix16_t, intptr_t)         { return MV_SetErrorCode(MV_InvalidFile); }
 
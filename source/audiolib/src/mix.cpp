@@ -20,6 +20,14 @@
 
 #include "_multivc.h"
 
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define MV_MIX_SSE2
+# include <emmintrin.h>
+#elif defined __aarch64__ || defined _M_ARM64
+# define MV_MIX_NEON
+# include <arm_neon.h>
+#endif
+
 template uint32_t MV_MixMono<uint8_t, int16_t>(struct VoiceNode * const voice, uint32_t length);
 template uint32_t MV_MixStereo<uint8_t, int16_t>(struct VoiceNode * const voice, uint32_t length);
 template uint32_t MV_MixMono<int16_t, int16_t>(struct VoiceNode * const voice, uint32_t length);
@@ -37,60 +45,14 @@ template void MV_Reverb<int16_t>(char const *src, char * const dest, const fix16
 template <typename S, typename D>
 uint32_t MV_MixMono(struct VoiceNode * const voice, uint32_t length)
 {
-    auto const * __restrict source = (S const *)voice->sound;
-    auto       * __restrict dest   = (D *)MV_MixDestination;
-
-    uint32_t       position = voice->position;
-    uint32_t const rate     = voice->RateScale;
-    fix16_t const  volume   = fix16_fast_trunc_mul(voice->volume, MV_GlobalVolume);
-
-    do
-    {
-        auto const isample0 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[position >> 16]);
-
-        position += rate;
-
-        *dest = MIX_SAMPLES<D>(SCALE_SAMPLE(isample0, fix16_fast_trunc_mul(volume, voice->PannedVolume.Left)), *dest);
-        dest++;
-
-        voice->PannedVolume.Left = SMOOTH_VOLUME(voice->PannedVolume.Left, voice->GoalVolume.Left);
-    }
-    while (--length);
-
-    MV_MixDestination = (char *)dest;
-
-    return position;
+    return MV_MixVoice<S, D, 1, 1>(voice, length);
 }
 
 // mono source, stereo output
 template <typename S, typename D>
 uint32_t MV_MixStereo(struct VoiceNode * const voice, uint32_t length)
 {
-    auto const * __restrict source = (S const *)voice->sound;
-    auto       * __restrict dest   = (D *)MV_MixDestination;
-
-    uint32_t       position = voice->position;
-    uint32_t const rate     = voice->RateScale;
-    fix16_t  const volume   = fix16_fast_trunc_mul(voice->volume, MV_GlobalVolume);
-
-    do
-    {
-        auto const isample0 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[position >> 16]);
-
-        position += rate;
-
-        *dest = MIX_SAMPLES<D>(SCALE_SAMPLE(isample0, fix16_fast_trunc_mul(volume, voice->PannedVolume.Left)), *dest);
-        *(dest + (MV_RightChannelOffset / sizeof(*dest)))
-            = MIX_SAMPLES<D>(SCALE_SAMPLE(isample0, fix16_fast_trunc_mul(volume, voice->PannedVolume.Right)), *(dest + (MV_RightChannelOffset / sizeof(*dest))));
-        dest += 2;
-
-        voice->PannedVolume = { SMOOTH_VOLUME(voice->PannedVolume.Left, voice->GoalVolume.Left), SMOOTH_VOLUME(voice->PannedVolume.Right, voice->GoalVolume.Right) };
-    }
-    while (--length);
-
-    MV_MixDestination = (char *)dest;
-
-    return position;
+    return MV_MixVoice<S, D, 1, 2>(voice, length);
 }
 
 template <typename T>
@@ -106,3 +68,73 @@ void MV_Reverb(char const *src, char * const dest, const fix16_t volume, int cou
     }
     while (--count > 0);
 }
+
+float MV_MixBus[MV_MIXBUFFERSIZE * 2];
+
+void MV_MixBusLoad(float *dest, int16_t const *src, int count)
+{
+    for (int i = 0; i < count; i++)
+        dest[i] = src[i];
+}
+
+// rounds and saturates the bus to int16
+void MV_MixBusStore(int16_t *dest, float const *src, int count)
+{
+    int i = 0;
+
+#if defined MV_MIX_SSE2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i const lo = _mm_cvtps_epi32(_mm_loadu_ps(src + i));
+        __m128i const hi = _mm_cvtps_epi32(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packs_epi32(lo, hi));
+    }
+#elif defined MV_MIX_NEON
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x4_t const lo = vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(src + i)));
+        int16x4_t const hi = vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(src + i + 4)));
+        vst1q_s16(dest + i, vcombine_s16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++)
+        dest[i] = clamp(Blrintf(src[i]), INT16_MIN, INT16_MAX);
+}
+
+void MV_MixAccumulate(float *dest, float const *src, float const *gain, int count)
+{
+    int i = 0;
+
+#if defined MV_MIX_SSE2
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(gain + i))));
+#elif defined MV_MIX_NEON
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmlaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), vld1q_f32(gain + i)));
+#endif
+
+    for (; i < count; i++)
+        dest[i] += src[i] * gain[i];
+}
+
+void MV_MixAccumulateConst(float *dest, float const *src, float left, float right, int count)
+{
+    int i = 0;
+
+#if defined MV_MIX_SSE2
+    __m128 const g = _mm_setr_ps(left, right, left, right);
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+#elif defined MV_MIX_NEON
+    float const gv[4] = { left, right, left, right };
+    float32x4_t const g = vld1q_f32(gv);
+
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmlaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), g));
+#endif
+
+    for (; i < count; i++)
+        dest[i] += src[i] * ((i & 1) ? right : left);
+}
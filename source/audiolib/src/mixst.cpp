@@ -36,60 +36,12 @@ template uint32_t MV_MixStereoStereo<int16_t, int16_t>(struct VoiceNode * const
 template <typename S, typename D>
 uint32_t MV_MixMonoStereo(struct VoiceNode * const voice, uint32_t length)
 {
-    auto const * __restrict source = (S const *)voice->sound;
-    auto       * __restrict dest   = (D *)MV_MixDestination;
-
-    uint32_t       position = voice->position;
-    uint32_t const rate     = voice->RateScale;
-    fix16_t const  volume   = fix16_fast_trunc_mul(voice->volume, MV_GlobalVolume);
-
-    do
-    {
-        auto const isample0 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[(position >> 16) << 1]);
-        auto const isample1 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[((position >> 16) << 1) + 1]);
-
-        position += rate;
-
-        *dest = MIX_SAMPLES<D>((SCALE_SAMPLE((isample0 + isample1) >> 1, fix16_fast_trunc_mul(volume, voice->PannedVolume.Left))), *dest);
-        dest++;
-
-        voice->PannedVolume.Left = SMOOTH_VOLUME(voice->PannedVolume.Left, voice->GoalVolume.Left);
-    }
-    while (--length);
-
-    MV_MixDestination = (char *)dest;
-
-    return position;
+    return MV_MixVoice<S, D, 2, 1>(voice, length);
 }
 
 // stereo source, stereo output
 template <typename S, typename D>
 uint32_t MV_MixStereoStereo(struct VoiceNode * const voice, uint32_t length)
 {
-    auto const * __restrict source = (S const *)voice->sound;
-    auto       * __restrict dest   = (D *)MV_MixDestination;
-
-    uint32_t       position = voice->position;
-    uint32_t const rate     = voice->RateScale;
-    fix16_t const  volume   = fix16_fast_trunc_mul(voice->volume, MV_GlobalVolume);
-
-    do
-    {
-        auto const isample0 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[(position >> 16) << 1]);
-        auto const isample1 = CONVERT_LE_SAMPLE_TO_SIGNED<S, D>(source[((position >> 16) << 1) + 1]);
-
-        position += rate;
-
-        *dest = MIX_SAMPLES<D>(SCALE_SAMPLE(isample0, fix16_fast_trunc_mul(volume, voice->PannedVolume.Left)), *dest);
-        *(dest + (MV_RightChannelOffset / sizeof(*dest)))
-            = MIX_SAMPLES<D>(SCALE_SAMPLE(isample1, fix16_fast_trunc_mul(volume, voice->PannedVolume.Right)), *(dest + (MV_RightChannelOffset / sizeof(*dest))));
-        dest += 2;
-
-        voice->PannedVolume = { SMOOTH_VOLUME(voice->PannedVolume.Left, voice->GoalVolume.Left), SMOOTH_VOLUME(voice->PannedVolume.Right, voice->GoalVolume.Right) };
-    }
-    while (--length);
-
-    MV_MixDestination = (char *)dest;
-
-    return position;
+    return MV_MixVoice<S, D, 2, 2>(voice, length);
 }
@@ -39,6 +39,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "drivers.h"
 #include "fx_man.h"
 #include "libasync_config.h"
+#include "atomiclist.h"
 #include "linklist.h"
 #include "osd.h"
 #include "pitch.h"
@@ -54,6 +55,7 @@ int MV_XMPInterpolation = XMP_INTERP_NEAREST;
 
 static void MV_StopVoice(VoiceNode *voice, bool useCallBack = true);
 static void MV_ServiceVoc(void);
+static void MV_ProcessCommands(void);
 
 static VoiceNode *MV_GetVoice(int handle);
 
@@ -71,6 +73,7 @@ static int MV_BufferLength;
 static int MV_NumberOfBuffers = MV_NUMBEROFBUFFERS;
 
 int MV_MaxVoices = 1;
+static int MV_NumVoiceNodes = 1;
 int MV_Channels = 1;
 int MV_MixRate;
 void *MV_InitDataPtr;
@@ -86,7 +89,10 @@ char *MV_MixBuffer[(MV_NUMBEROFBUFFERS << 1) + 1];
 
 VoiceNode *MV_Voices;
 VoiceNode  VoiceList;
-VoiceNode  VoicePool;
+
+// only ever touched by the game thread: voices go back here once the mixer
+// has retired them, see MV_ReclaimVoices()
+static VoiceNode VoicePool;
 
 static int MV_MixPage;
 
@@ -107,7 +113,26 @@ static void (*MV_MusicCallback)(void);
 
 static VoiceNode **MV_Handles;
 
-static bool MV_Mix(VoiceNode * const voice, int const buffer)
+// voices that have been handed out and not stopped yet, capped at MV_MaxVoices
+static std::atomic<int> MV_ActiveVoices;
+
+// voices with commands for the mixer, see MV_PostCommand()
+static AtomicSList64<VoiceNode> MV_Commands;
+
+// odd while MV_ServiceVoc() is running, see MV_WaitForService()
+static std::atomic<uint32_t> MV_ServiceSerial;
+
+enum
+{
+    MV_CMD_PLAY      = 1u << 0,
+    MV_CMD_PAN       = 1u << 1,
+    MV_CMD_FREQUENCY = 1u << 2,
+    MV_CMD_PITCH     = 1u << 3,
+    MV_CMD_ENDLOOP   = 1u << 4,
+    MV_CMD_KILL      = 1u << 5,
+};
+
+static bool MV_Mix(VoiceNode * const voice)
 {
     if (voice->task.valid())
     {
@@ -135,7 +160,7 @@ static bool MV_Mix(VoiceNode * const voice, int const buffer)
     uint32_t       bufsiz = voice->FixedPointBufferSize;
     uint32_t const rate   = voice->RateScale;
 
-    MV_MixDestination = MV_MixBuffer[buffer];
+    MV_MixDestination = (char *)MV_MixBus;
 
     // Add this voice to the mix
     do
@@ -184,26 +209,73 @@ static bool MV_Mix(VoiceNode * const voice, int const buffer)
     return true;
 }
 
+/*---------------------------------------------------------------------
+   Every change to a voice that may be playing goes through here
+   instead of MV_Lock(): the caller stores the new values in the
+   voice's Pending fields and sets the matching MV_CMD_* bits, and the
+   mixer applies them at the start of its next pass.  A voice sits in
+   MV_Commands at most once, pushed by whoever set the first bit, so
+   commands to the same voice coalesce and nobody ever waits on the
+   mixer.  Decoder tasks post MV_CMD_PLAY as well, so there can be
+   more than one producer.
+---------------------------------------------------------------------*/
+static void MV_PostCommand(VoiceNode *voice, uint32_t command)
+{
+    if (voice->Commands.fetch_or(command, std::memory_order_acq_rel) == 0)
+        MV_Commands.push(voice);
+}
+
+/*---------------------------------------------------------------------
+   Returns once the mixer can no longer be reading from a voice that
+   was stopped before the call: a pass that is already running may
+   still be mixing it, but the next one drains MV_CMD_KILL first.
+---------------------------------------------------------------------*/
+static void MV_WaitForService(void)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint32_t const serial = MV_ServiceSerial.load(std::memory_order_relaxed);
+
+    if (serial & 1)
+    {
+        while (MV_ServiceSerial.load(std::memory_order_acquire) == serial)
+            std::this_thread::yield();
+    }
+}
+
 void MV_PlayVoice(VoiceNode *voice)
 {
-    MV_Lock();
-    LL::SortedInsert(&VoiceList, voice, &VoiceNode::priority);
-    voice->PannedVolume = voice->GoalVolume;
     voice->Paused.store(false, std::memory_order_release);
-    MV_Unlock();
+    MV_PostCommand(voice, MV_CMD_PLAY);
 }
 
-static void MV_FreeHandle(VoiceNode* voice)
+// called by the mixer, or by the game once the driver has stopped
+static void MV_RetireVoice(VoiceNode *voice)
 {
-    if (voice->handle < MV_MINVOICEHANDLE)
-        return;
+    if (voice->next != nullptr)
+        LL::Unlink(voice);
 
-    MV_Handles[voice->handle - MV_MINVOICEHANDLE] = nullptr;
-    voice->handle = 0;
+    voice->next = voice->prev = nullptr;
     voice->length = 0;
     voice->sound = nullptr;
     voice->wavetype = FMT_UNKNOWN;
-    LL::Move(voice, &VoicePool);
+    voice->Retired.store(true, std::memory_order_release);
+}
+
+// puts every voice the mixer is done with back into the pool
+static void MV_ReclaimVoices(void)
+{
+    for (int i = 0; i < MV_NumVoiceNodes; i++)
+    {
+        auto voice = MV_Handles[i];
+
+        if (voice == nullptr || !voice->Retired.load(std::memory_order_acquire) || voice->Commands.load(std::memory_order_acquire) != 0)
+            continue;
+
+        MV_Handles[i] = nullptr;
+        voice->handle = 0;
+        LL::Insert(&VoicePool, voice);
+    }
 }
 
 static void MV_CleanupVoice(VoiceNode* voice, bool useCallBack = true)
@@ -231,13 +303,104 @@ static void MV_CleanupVoice(VoiceNode* voice, bool useCallBack = true)
     }
 }
 
+// the voice is done playing on its own; called by the mixer
+static void MV_FinishVoice(VoiceNode *voice)
+{
+    bool const stopped = voice->Stopped.exchange(true, std::memory_order_acq_rel);
+
+    if (!stopped)
+        MV_ActiveVoices.fetch_sub(1, std::memory_order_relaxed);
+
+    // the callback has already been made if the game got to it first
+    MV_CleanupVoice(voice, !stopped);
+    MV_RetireVoice(voice);
+}
+
+// stops the voice as far as the game is concerned and tells the mixer to drop it
+static void MV_PostKill(VoiceNode *voice, bool useCallBack)
+{
+    if (voice->Stopped.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    MV_ActiveVoices.fetch_sub(1, std::memory_order_relaxed);
+
+    if (useCallBack && MV_CallBackFunc)
+        MV_CallBackFunc(voice->callbackval);
+
+    MV_PostCommand(voice, MV_CMD_KILL);
+}
+
+// called with the driver stopped, when no mixer is left to retire the voice
 void MV_StopVoice(VoiceNode *voice, bool useCallBack)
 {
-    MV_CleanupVoice(voice, useCallBack);
-    MV_Lock();
-    // move the voice from the play list to the free list
-    MV_FreeHandle(voice);
-    MV_Unlock();
+    bool const stopped = voice->Stopped.exchange(true, std::memory_order_acq_rel);
+
+    if (!stopped)
+        MV_ActiveVoices.fetch_sub(1, std::memory_order_relaxed);
+
+    MV_CleanupVoice(voice, useCallBack && !stopped);
+    MV_RetireVoice(voice);
+}
+
+static void MV_ApplyCommands(VoiceNode *voice, uint32_t const commands)
+{
+    if (commands & MV_CMD_PLAY)
+    {
+        LL::SortedInsert(&VoiceList, voice, &VoiceNode::priority);
+        voice->PannedVolume = voice->GoalVolume;
+    }
+
+    // a voice that has already ended ignores everything else
+    if (voice->Retired.load(std::memory_order_relaxed))
+        return;
+
+    if (voice->next != nullptr)
+    {
+        if (commands & MV_CMD_PAN)
+            voice->GoalVolume = { voice->PendingVolume.Left.load(std::memory_order_relaxed), voice->PendingVolume.Right.load(std::memory_order_relaxed) };
+
+        // MV_SetFrequency() also resets the pending pitch, so this order matches the order of the calls
+        if (commands & MV_CMD_FREQUENCY)
+            MV_SetVoicePitch(voice, voice->PendingFrequency.load(std::memory_order_relaxed), 0);
+
+        if (commands & MV_CMD_PITCH)
+            MV_SetVoicePitch(voice, voice->SamplingRate, voice->PendingPitch.load(std::memory_order_relaxed));
+
+        if (commands & MV_CMD_ENDLOOP)
+            voice->Loop = {};
+    }
+
+    if (commands & MV_CMD_KILL)
+    {
+        MV_CleanupVoice(voice, false);
+        MV_RetireVoice(voice);
+    }
+}
+
+static void MV_ProcessCommands(void)
+{
+    VoiceNode *list = nullptr;
+
+    // restore the order the commands were posted in
+    for (auto voice = MV_Commands.popAll(), next = voice; voice != nullptr; voice = next)
+    {
+        next = voice->m_next;
+        voice->m_next = list;
+        list = voice;
+    }
+
+    for (auto voice = list, next = voice; voice != nullptr; voice = next)
+    {
+        next = voice->m_next;
+
+        uint32_t const commands = voice->Commands.load(std::memory_order_acquire);
+
+        MV_ApplyCommands(voice, commands);
+
+        // anything posted while we were busy goes out with the next pass
+        if ((voice->Commands.fetch_and(~commands, std::memory_order_acq_rel) & ~commands) != 0)
+            MV_Commands.push(voice);
+    }
 }
 
 /*---------------------------------------------------------------------
@@ -249,6 +412,11 @@ void MV_StopVoice(VoiceNode *voice, bool useCallBack)
 ---------------------------------------------------------------------*/
 static void MV_ServiceVoc(void)
 {
+    MV_ServiceSerial.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    MV_ProcessCommands();
+
     // Toggle which buffer we'll mix next
     ++MV_MixPage;
     MV_MixPage &= MV_NumberOfBuffers-1;
@@ -291,6 +459,7 @@ static void MV_ServiceVoc(void)
     {
         auto voice = VoiceList.next;
         VoiceNode *next;
+        bool mixed = false;
 
         do
         {
@@ -305,16 +474,22 @@ static void MV_ServiceVoc(void)
                 continue;
             }
 
+            if (!mixed)
+            {
+                MV_MixBusLoad(MV_MixBus, (int16_t *)MV_MixBuffer[MV_MixPage], MV_BufferSize >> 1);
+                mixed = true;
+            }
+
             MV_BufferEmpty[ MV_MixPage ] = FALSE;
 
             // Is this voice done?
-            if (!MV_Mix(voice, MV_MixPage))
-            {
-                MV_CleanupVoice(voice);
-                MV_FreeHandle(voice);
-            }
+            if (!MV_Mix(voice))
+                MV_FinishVoice(voice);
         }
         while ((voice = next) != &VoiceList);
+
+        if (mixed)
+            MV_MixBusStore((int16_t *)MV_MixBuffer[MV_MixPage], MV_MixBus, MV_BufferSize >> 1);
     }
 
     Bmemcpy(MV_MixBuffer[MV_MixPage+MV_NumberOfBuffers], MV_MixBuffer[MV_MixPage], MV_BufferSize);
@@ -328,29 +503,43 @@ static void MV_ServiceVoc(void)
             *dest = clamp(*dest + *source++,INT16_MIN, INT16_MAX);
     }
 
-    if (MusicVoice && !MV_Mix(MusicVoice, MV_MixPage + MV_NumberOfBuffers))
+    if (MusicVoice)
     {
-        MV_CleanupVoice(MusicVoice);
-        MV_FreeHandle(MusicVoice);
+        auto const musicBuffer = (int16_t *)MV_MixBuffer[MV_MixPage + MV_NumberOfBuffers];
+
+        MV_MixBusLoad(MV_MixBus, musicBuffer, MV_BufferSize >> 1);
+
+        bool const playing = MV_Mix(MusicVoice);
+
+        MV_MixBusStore(musicBuffer, MV_MixBus, MV_BufferSize >> 1);
+
+        if (!playing)
+            MV_FinishVoice(MusicVoice);
     }
+
+    MV_ServiceSerial.fetch_add(1, std::memory_order_release);
 }
 
 static VoiceNode *MV_GetVoice(int handle)
 {
-    if (handle < MV_MINVOICEHANDLE || handle > MV_MaxVoices)
+    if (handle < MV_MINVOICEHANDLE || handle > MV_NumVoiceNodes)
     {
         LOG_F(WARNING, "No voice found for handle 0x%08x", handle);
         return nullptr;
     }
 
-    if (MV_Handles[handle - MV_MINVOICEHANDLE] != nullptr)
-        return MV_Handles[handle - MV_MINVOICEHANDLE];
+    auto voice = MV_Handles[handle - MV_MINVOICEHANDLE];
+
+    // stopped voices keep their handle until they are reclaimed
+    if (voice != nullptr && !voice->Stopped.load(std::memory_order_acquire))
+        return voice;
 
     MV_SetErrorCode(MV_VoiceNotFound);
     return nullptr;
 }
 
-VoiceNode *MV_BeginService(int handle)
+// returns the voice once any decoder task setting it up has posted MV_CMD_PLAY
+static VoiceNode *MV_FindVoice(int handle)
 {
     if (!MV_Installed)
         return nullptr;
@@ -366,7 +555,15 @@ VoiceNode *MV_BeginService(int handle)
     if (voice->task.valid() && !voice->task.ready())
         voice->task.wait();
 
-    MV_Lock();
+    return voice;
+}
+
+VoiceNode *MV_BeginService(int handle)
+{
+    auto voice = MV_FindVoice(handle);
+
+    if (voice != nullptr)
+        MV_Lock();
 
     return voice;
 }
@@ -375,9 +572,9 @@ static inline void MV_EndService(void) { MV_Unlock(); }
 
 int MV_VoicePlaying(int handle)
 {
-    Bassert(handle <= MV_MaxVoices);
+    Bassert(handle <= MV_NumVoiceNodes);
     auto voice = MV_Handles[handle - MV_MINVOICEHANDLE];
-    return MV_Installed && voice != nullptr && !voice->Paused.load(std::memory_order_relaxed);
+    return MV_Installed && voice != nullptr && !voice->Stopped.load(std::memory_order_acquire) && !voice->Paused.load(std::memory_order_relaxed);
 }
 
 int MV_KillAllVoices(bool useCallBack)
@@ -385,43 +582,33 @@ int MV_KillAllVoices(bool useCallBack)
     if (!MV_Installed)
         return MV_Error;
 
-    MV_Lock();
-
-    if (&VoiceList == VoiceList.next)
+    for (int i = 0; i < MV_NumVoiceNodes; i++)
     {
-        MV_Unlock();
-        return MV_Ok;
-    }
-
-    auto voice = VoiceList.prev;
+        auto voice = MV_Handles[i];
 
-    // Remove all the voices from the list
-    while (voice != &VoiceList)
-    {
-        if (voice->priority == MV_MUSIC_PRIORITY)
-        {
-            voice = voice->prev;
+        if (voice == nullptr || voice->priority == MV_MUSIC_PRIORITY || voice->Stopped.load(std::memory_order_acquire))
             continue;
-        }
 
-        MV_Kill(voice->handle, useCallBack);
-        voice = VoiceList.prev;
+        if (voice->task.valid() && !voice->task.ready())
+            voice->task.wait();
+
+        MV_PostKill(voice, useCallBack);
     }
 
-    MV_Unlock();
+    MV_WaitForService();
 
     return MV_Ok;
 }
 
 int MV_Kill(int handle, bool useCallBack)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
-    MV_StopVoice(voice, useCallBack);
-    MV_EndService();
+    MV_PostKill(voice, useCallBack);
+    MV_WaitForService();
 
     return MV_Ok;
 }
@@ -431,27 +618,23 @@ int MV_VoicesPlaying(void)
     if (!MV_Installed)
         return 0;
 
-    MV_Lock();
-
-    int NumVoices = 0;
-
-    for (auto voice = VoiceList.next; voice != &VoiceList; voice = voice->next)
-        NumVoices++;
-
-    MV_Unlock();
-
-    return NumVoices;
+    return MV_ActiveVoices.load(std::memory_order_relaxed);
 }
 
 static inline VoiceNode *MV_GetLowestPriorityVoice(void)
 {
-    auto voice = VoiceList.next;
+    VoiceNode *voice = nullptr;
 
     // find the voice with the lowest priority and volume
-    for (auto node = voice; node != &VoiceList; node = node->next)
+    for (int i = 0; i < MV_NumVoiceNodes; i++)
     {
-        if (node->priority < voice->priority
-            || (node->priority == voice->priority && node->PannedVolume.Left < voice->PannedVolume.Left && node->PannedVolume.Right < voice->PannedVolume.Right))
+        auto node = MV_Handles[i];
+
+        if (node == nullptr || node->Stopped.load(std::memory_order_relaxed))
+            continue;
+
+        if (voice == nullptr || node->priority < voice->priority
+            || (node->priority == voice->priority && node->PendingVolume.Left < voice->PendingVolume.Left && node->PendingVolume.Right < voice->PendingVolume.Right))
             voice = node;
     }
 
@@ -475,24 +658,28 @@ static inline void MV_FinishAllocation(VoiceNode* voice, uint32_t const allocsiz
 
 VoiceNode *MV_AllocVoice(int priority, uint32_t allocsize /* = 0 */)
 {
-    MV_Lock();
-
     // Check if we have any free voices
-    if (LL::Empty(&VoicePool))
+    if (MV_ActiveVoices.load(std::memory_order_relaxed) >= MV_MaxVoices)
     {
         auto voice = MV_GetLowestPriorityVoice();
 
-        if (voice != &VoiceList && voice->priority <= priority && voice->handle >= MV_MINVOICEHANDLE && FX_SoundValidAndActive(voice->handle))
+        if (voice != nullptr && voice->priority <= priority && FX_SoundValidAndActive(voice->handle))
             MV_Kill(voice->handle);
 
-        if (LL::Empty(&VoicePool))
+        if (MV_ActiveVoices.load(std::memory_order_relaxed) >= MV_MaxVoices)
         {
             // No free voices
-            MV_Unlock();
             return nullptr;
         }
     }
 
+    if (LL::Empty(&VoicePool))
+        MV_ReclaimVoices();
+
+    // every voice stopped since the last mixer pass is still waiting to be retired
+    if (LL::Empty(&VoicePool))
+        return nullptr;
+
     auto voice = VoicePool.next;
     LL::Remove(voice);
 
@@ -501,16 +688,19 @@ VoiceNode *MV_AllocVoice(int priority, uint32_t allocsize /* = 0 */)
     // Find a free voice handle
     do
     {
-        if (++handle > MV_MaxVoices)
+        if (++handle > MV_NumVoiceNodes)
             handle = MV_MINVOICEHANDLE;
     } while (MV_Handles[handle - MV_MINVOICEHANDLE] != nullptr);
     MV_Handles[handle - MV_MINVOICEHANDLE] = voice;
 
     voice->length = 0;
     voice->BlockLength = 0;
+    voice->LastFrame[0] = voice->LastFrame[1] = 0.f;
     voice->handle = handle;
     voice->next = voice->prev = nullptr;
-    MV_Unlock();
+    voice->Stopped.store(false, std::memory_order_relaxed);
+    voice->Retired.store(false, std::memory_order_relaxed);
+    MV_ActiveVoices.fetch_add(1, std::memory_order_relaxed);
 
     if (allocsize)
         MV_FinishAllocation(voice, allocsize);
@@ -521,14 +711,12 @@ VoiceNode *MV_AllocVoice(int priority, uint32_t allocsize /* = 0 */)
 int MV_VoiceAvailable(int priority)
 {
     // Check if we have any free voices
-    if (!LL::Empty(&VoicePool))
+    if (MV_ActiveVoices.load(std::memory_order_relaxed) < MV_MaxVoices)
         return TRUE;
 
-    MV_Lock();
     auto const voice = MV_GetLowestPriorityVoice();
-    MV_Unlock();
 
-    return (voice == &VoiceList || voice->priority > priority) ? FALSE : TRUE;
+    return (voice == nullptr || voice->priority > priority) ? FALSE : TRUE;
 }
 
 void MV_SetVoicePitch(VoiceNode *voice, uint32_t rate, int pitchoffset)
@@ -544,26 +732,27 @@ void MV_SetVoicePitch(VoiceNode *voice, uint32_t rate, int pitchoffset)
 
 int MV_SetPitch(int handle, int pitchoffset)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
-    MV_SetVoicePitch(voice, voice->SamplingRate, pitchoffset);
-    MV_EndService();
+    voice->PendingPitch.store(pitchoffset, std::memory_order_relaxed);
+    MV_PostCommand(voice, MV_CMD_PITCH);
 
     return MV_Ok;
 }
 
 int MV_SetFrequency(int handle, int frequency)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
-    MV_SetVoicePitch(voice, frequency, 0);
-    MV_EndService();
+    voice->PendingFrequency.store(frequency, std::memory_order_relaxed);
+    voice->PendingPitch.store(0, std::memory_order_relaxed);
+    MV_PostCommand(voice, MV_CMD_FREQUENCY | MV_CMD_PITCH);
 
     return MV_Ok;
 }
@@ -615,7 +804,8 @@ void MV_SetVoiceMixMode(VoiceNode *voice)
     voice->mix = mixslut[(MV_Channels == 1) | ((voice->bits == 16) << 1) | ((voice->channels == 2) << 2)];
 }
 
-void MV_SetVoiceVolume(VoiceNode *voice, int vol, int left, int right, fix16_t volume)
+// stores the goal volume for the mixer to pick up with MV_CMD_PAN
+static void MV_SetPendingVolume(VoiceNode *voice, int vol, int left, int right)
 {
     if (MV_Channels == 1)
         left = right = vol;
@@ -624,7 +814,15 @@ void MV_SetVoiceVolume(VoiceNode *voice, int vol, int left, int right, fix16_t v
         swap(&left, &right);
 #endif
 
-    voice->GoalVolume = { fix16_smul(fix16_from_int(left), F16(1.f/MV_MAXTOTALVOLUME)), fix16_smul(fix16_from_int(right), F16(1.f/MV_MAXTOTALVOLUME)) };
+    voice->PendingVolume.Left.store(fix16_smul(fix16_from_int(left), F16(1.f/MV_MAXTOTALVOLUME)), std::memory_order_relaxed);
+    voice->PendingVolume.Right.store(fix16_smul(fix16_from_int(right), F16(1.f/MV_MAXTOTALVOLUME)), std::memory_order_relaxed);
+}
+
+void MV_SetVoiceVolume(VoiceNode *voice, int vol, int left, int right, fix16_t volume)
+{
+    MV_SetPendingVolume(voice, vol, left, right);
+
+    voice->GoalVolume = { voice->PendingVolume.Left.load(std::memory_order_relaxed), voice->PendingVolume.Right.load(std::memory_order_relaxed) };
     voice->volume = volume;
 
     MV_SetVoiceMixMode(voice);
@@ -632,13 +830,12 @@ void MV_SetVoiceVolume(VoiceNode *voice, int vol, int left, int right, fix16_t v
 
 int MV_PauseVoice(int handle, int pause)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
     voice->Paused.store(pause, std::memory_order_release);
-    MV_EndService();
 
     return MV_Ok;
 }
@@ -699,27 +896,25 @@ int MV_SetPosition(int handle, int position)
 
 int MV_EndLooping(int handle)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
-    voice->Loop = {};
-
-    MV_EndService();
+    MV_PostCommand(voice, MV_CMD_ENDLOOP);
 
     return MV_Ok;
 }
 
 int MV_SetPan(int handle, int vol, int left, int right)
 {
-    auto voice = MV_BeginService(handle);
+    auto voice = MV_FindVoice(handle);
 
     if (voice == nullptr)
         return MV_Error;
 
-    MV_SetVoiceVolume(voice, vol, left, right, voice->volume);
-    MV_EndService();
+    MV_SetPendingVolume(voice, vol, left, right);
+    MV_PostCommand(voice, MV_CMD_PAN);
     return MV_Ok;
 }
 
@@ -795,6 +990,9 @@ static void MV_StopPlayback(void)
     // Make sure all callbacks are done.
     MV_Lock();
 
+    // with the mixer gone, whatever it had left to do happens here
+    MV_ProcessCommands();
+
     for (VoiceNode *voice = VoiceList.next, *next; voice != &VoiceList; voice = next)
     {
         next = voice->next;
@@ -850,23 +1048,28 @@ int MV_Init(int soundcard, int MixRate, int Voices, int numchannels, void *initd
 
     MV_SetErrorCode(MV_Ok);
 
-    int const totalmem = Voices * sizeof(VoiceNode) + (MV_TOTALBUFFERSIZE * sizeof(int16_t)) + (MV_MIXBUFFERSIZE * numchannels * sizeof(int16_t));
+    // stopped voices stay out of the pool until the mixer has let go of them,
+    // so there are twice as many nodes as voices that can play at once
+    int const numNodes = Voices * 2;
+    int const totalmem = numNodes * sizeof(VoiceNode) + (MV_TOTALBUFFERSIZE * sizeof(int16_t)) + (MV_MIXBUFFERSIZE * numchannels * sizeof(int16_t));
 
     char *ptr = (char *) Xaligned_calloc(16, 1, totalmem);
 
     MV_Voices = (VoiceNode *)ptr;
-    ptr += Voices * sizeof(VoiceNode);
+    ptr += numNodes * sizeof(VoiceNode);
     Bassert(Voices < MV_MAXVOICES);
 
     MV_MaxVoices = Voices;
+    MV_NumVoiceNodes = numNodes;
+    MV_ActiveVoices.store(0, std::memory_order_relaxed);
 
     LL::Reset((VoiceNode*) &VoiceList);
     LL::Reset((VoiceNode*) &VoicePool);
 
-    for (int index = 0; index < Voices; index++)
+    for (int index = 0; index < numNodes; index++)
         LL::Insert(&VoicePool, &MV_Voices[index]);
 
-    MV_Handles = (VoiceNode **)Xaligned_calloc(16, Voices, sizeof(intptr_t));
+    MV_Handles = (VoiceNode **)Xaligned_calloc(16, numNodes, sizeof(intptr_t));
 #ifdef ASS_REVERSESTEREO
     MV_SetReverseStereo(FALSE);
 #endif
@@ -949,6 +1152,7 @@ int MV_Shutdown(void)
     ALIGNED_FREE_AND_NULL(MV_Handles);
 
     MV_MaxVoices = 1;
+    MV_NumVoiceNodes = 1;
 
     // Release the descriptor from our mix buffer
     for (int buffer = 0; buffer < MV_NUMBEROFBUFFERS<<1; buffer++)
@@ -985,6 +1189,22 @@ const char *loopStartTags[loopStartTagCount] = { "LOOP_START", "LOOPSTART", "LOO
 const char *loopEndTags[loopEndTagCount] = { "LOOP_END", "LOOPEND" };
 const char *loopLengthTags[loopLengthTagCount] = { "LOOP_LENGTH", "LOOPLENGTH" };
 
+bool MV_IsLoopStartComment(char const *entry)
+{
+    char const *value = entry ? Bstrchr(entry, '=') : nullptr;
+
+    if (!value)
+        return false;
+
+    size_t const field = value - entry;
+
+    for (int t = 0; t < loopStartTagCount; ++t)
+        if (field == Bstrlen(loopStartTags[t]) && Bstrncasecmp(entry, loopStartTags[t], field) == 0)
+            return true;
+
+    return false;
+}
+
 const char *MV_ErrorString(int ErrorNumber)
 {
     switch (ErrorNumber)
@@ -1012,7 +1232,7 @@ static playbackstatus MV_GetNextDemandFeedBlock(VoiceNode* voice)
 {
     if (voice->BlockLength > 0)
     {
-        voice->position -= voice->length;
+        MV_CarryPosition(voice);
         voice->sound += voice->length >> 16;
         voice->length = min(voice->BlockLength, 0x8000u);
         voice->BlockLength -= voice->length;
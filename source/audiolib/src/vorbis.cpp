@@ -300,7 +300,7 @@ static playbackstatus MV_GetNextVorbisBlock(VoiceNode *voice)
 
     uint32_t const samples = divideu32(bytesread, ((voice->bits>>3) * voice->channels));
 
-    voice->position = 0;
+    MV_CarryPosition(voice);
     voice->sound = vd->block;
     voice->length = samples << 16;
 
@@ -424,6 +424,99 @@ int MV_PlayVorbis(char *ptr, uint32_t length, int loopstart, int loopend, int pi
     return voice->handle;
 }
 
+int MV_DecodeVorbis(char const *ptr, uint32_t length, char **wavptr, uint32_t *wavlength, uint32_t maxlength)
+{
+    auto vd = (vorbis_data *)Xmalloc(sizeof(vorbis_data));
+
+    vd->ptr    = (void *)(intptr_t)ptr;
+    vd->pos    = 0;
+    vd->length = length;
+
+    int status = ov_open_callbacks((void *)vd, &vd->vf, 0, 0, vorbis_callbacks);
+
+    if (status < 0)
+    {
+        LOG_F(ERROR, "MV_DecodeVorbis: error %d in ov_open_callbacks", status);
+        Xfree(vd);
+        return MV_SetErrorCode(MV_InvalidFile);
+    }
+
+    vorbis_info *vi = ov_info(&vd->vf, 0);
+    auto comment    = ov_comment(&vd->vf, 0);
+    bool hasloop    = false;
+
+    for (int i = 0; comment && i < comment->comments && !hasloop; ++i)
+        hasloop = MV_IsLoopStartComment(comment->user_comments[i]);
+
+    // loop points would be lost along with the stream, so only plain sounds are decoded
+    ogg_int64_t const total = ov_pcm_total(&vd->vf, -1);
+
+    if (!vi || vi->channels < 1 || vi->channels > 2 || hasloop || total < 0 || maxlength < MV_WAVHEADERSIZE
+        || (uint64_t)total * vi->channels * 2 > maxlength - MV_WAVHEADERSIZE)
+    {
+        ov_clear(&vd->vf);
+        Xfree(vd);
+        return MV_SetErrorCode(MV_InvalidFile);
+    }
+
+    int const  channels = vi->channels;
+    long const rate     = vi->rate;
+    uint32_t const size = (uint32_t)total * channels * 2;
+
+    auto wav = (char *)Xmalloc(MV_WAVHEADERSIZE + size);
+    char *data = wav + MV_WAVHEADERSIZE;
+    uint32_t pos = 0;
+
+    // ov_pcm_total() is exact for a seekable stream; the probe only exists to catch one that lies
+    for (char probe[4];;)
+    {
+        int bitstream;
+        char * const dest  = pos < size ? data + pos : probe;
+        int const    space = pos < size ? (int)min<uint32_t>(size - pos, INT_MAX) : (int)sizeof(probe);
+#ifdef USING_TREMOR
+        int const bytes = ov_read(&vd->vf, dest, space, &bitstream);
+#else
+        int const bytes = ov_read(&vd->vf, dest, space, 0, 2, 1, &bitstream);
+#endif
+        if (bytes == 0)
+            break;
+        else if (bytes == OV_HOLE)
+            continue;
+
+        vi = (bytes > 0) ? ov_info(&vd->vf, bitstream) : nullptr;
+
+        if (bytes < 0 || dest == probe || !vi || vi->channels != channels || vi->rate != rate)
+        {
+            if (bytes < 0)
+                LOG_F(ERROR, "MV_DecodeVorbis: error %d in ov_read", bytes);
+
+            ov_clear(&vd->vf);
+            Xfree(vd);
+            Xfree(wav);
+            return MV_SetErrorCode(MV_InvalidFile);
+        }
+
+        pos += bytes;
+    }
+
+    ov_clear(&vd->vf);
+    Xfree(vd);
+
+#ifdef GEKKO
+    // see MV_GetNextVorbisBlock()
+    auto samples = (int16_t *)data;
+    for (uint32_t i = 0; i < pos / 2; ++i)
+        samples[i] = (samples[i] & 0xff) << 8 | ((samples[i] & 0xff00) >> 8);
+#endif
+
+    MV_WriteWAVHeader(wav, channels, rate, pos);
+
+    *wavptr    = wav;
+    *wavlength = MV_WAVHEADERSIZE + pos;
+
+    return MV_Ok;
+}
+
 void MV_ReleaseVorbisVoice(VoiceNode *voice)
 {
     Bassert(voice->wavetype == FMT_VORBIS && voice->rawdataptr != nullptr && voice->rawdatasiz == sizeof(vorbis_data));
@@ -454,4 +547,9 @@ int MV_PlayVorbis3D(char *, uint32_t, int, int, int, int, int, fix16_t, intptr_t
     LOG_F(ERROR, "MV_PlayVorbis: OggVorbis support not included in this binary.");
     return -1;
 }
+
+int MV_DecodeVorbis(char const *, uint32_t, char **, uint32_t *, uint32_t)
+{
+    return MV_SetErrorCode(MV_InvalidFile);
+}
 #endif //HAVE_VORBIS
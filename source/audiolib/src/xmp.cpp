@@ -182,9 +182,14 @@ void MV_SetXMPInterpolation(int interp)
     if (!MV_Installed)
         return;
 
+    // the voice list belongs to the mixer
+    MV_Lock();
+
     for (VoiceNode *voice = VoiceList.next; voice != &VoiceList; voice = voice->next)
         if (voice->wavetype == FMT_XMP)
             xmp_set_player(((xmp_data *)voice->rawdataptr)->ctx, XMP_PLAYER_INTERP, interp);
+
+    MV_Unlock();
 }
 
 #else
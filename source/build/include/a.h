@@ -98,6 +98,23 @@ extern void __cdecl stretchhline(int32_t,int32_t,int32_t,int32_t,int32_t,int32_t
 
 #define prevlineasm1 vlineasm1
 
+// Instruction sets the column/span kernels can be run with; see a-c.cpp.
+enum
+{
+    A_C_ISA_SCALAR,
+    A_C_ISA_SSE2,
+    A_C_ISA_NEON,
+    A_C_ISA_AVX2,
+    A_C_ISA_COUNT,
+};
+
+void a_c_init(void);
+int32_t a_c_isasupported(int32_t isa);
+// Returns the selected ISA, or -1 if it is not available on this CPU/build.
+int32_t a_c_setisa(int32_t isa);
+int32_t a_c_getisa(void);
+const char *a_c_isaname(int32_t isa);
+
 void setvlinebpl(int32_t dabpl);
 void fixtransluscence(intptr_t datransoff);
 void settransnormal(void);
@@ -43,7 +43,8 @@ public:
 
     FORCE_INLINE T * pop()
     {
-        T * currHead = m_head.load(std::memory_order_relaxed);
+        // acquire, as currHead->m_next is read below
+        T * currHead = m_head.load(std::memory_order_acquire);
         while (currHead != nullptr)
         {
             if (m_head.compare_exchange_weak(currHead, currHead->m_next,
@@ -56,6 +57,12 @@ public:
         return currHead;
     }
 
+    // Detaches the whole list at once, most recently pushed node first.
+    FORCE_INLINE T * popAll()
+    {
+        return m_head.exchange(nullptr, std::memory_order_acquire);
+    }
+
     // These are non-atomic.
     FORCE_INLINE T * first() const
     {
@@ -595,6 +595,8 @@ enum
 EXTERN int32_t guniqhudid;
 EXTERN int32_t spritesortcnt;
 extern int32_t g_loadedMapVersion;
+// load binary maps from <map>.cache in the working directory when its MD4 matches, see engineLoadBoard()
+extern int32_t g_mapCache;
 
 typedef struct {
     char *mhkfile;
@@ -695,6 +697,16 @@ static FORCE_INLINE void sprite_tracker_hook__(intptr_t const address)
 
     ++spritechanged[spritenum];
 }
+
+// For writes the trackers can't see: through the xy/xyz/vel aliases, pointers
+// to those and whole-struct copies.
+static FORCE_INLINE void sectorMarkChanged(int const sectnum) { ++sectorchanged[sectnum]; }
+static FORCE_INLINE void wallMarkChanged(int const wallnum) { ++wallchanged[wallnum]; }
+static FORCE_INLINE void spriteMarkChanged(int const spritenum) { ++spritechanged[spritenum]; }
+#else
+static FORCE_INLINE void sectorMarkChanged(int const sectnum) { UNREFERENCED_PARAMETER(sectnum); }
+static FORCE_INLINE void wallMarkChanged(int const wallnum) { UNREFERENCED_PARAMETER(wallnum); }
+static FORCE_INLINE void spriteMarkChanged(int const spritenum) { UNREFERENCED_PARAMETER(spritenum); }
 #endif
 
 static inline tspriteptr_t renderMakeTSpriteFromSprite(tspriteptr_t const tspr, uint16_t const spritenum)
@@ -1244,6 +1256,7 @@ void    artClearMapArt(void);
 void    artSetupMapArt(const char *filename);
 bool    tileLoad(int16_t tilenume);
 void    tileLoadData(int16_t tilenume, int32_t dasiz, char *buffer);
+bool    tileReadData(int16_t tilenume, int32_t dasiz, char *buffer, bool canopen);
 intptr_t tileLoadScaled(int const picnum, vec2_16_t* upscale = nullptr);
 int32_t tileGetCRC32(int16_t tileNum);
 vec2_16_t tileGetSize(int16_t tileNum);
@@ -1560,6 +1573,12 @@ int32_t polymost_drawtilescreen(int32_t tilex, int32_t tiley, int32_t tilenum, i
                                 int32_t usehitile, uint8_t *loadedhitile);
 void polymost_glreset(void);
 void polymost_precache(int32_t dapicnum, int32_t dapalnum, int32_t datype);
+// Decodes the replacement texture polymost_precache() with the same arguments is going to load on
+// a worker thread.  Tiles are expected in ascending order, see polymost_prefetchrelease().
+void polymost_prefetch(int32_t dapicnum, int32_t dapalnum, int32_t datype);
+bool polymost_prefetchfull(void);
+// Frees the prefetched textures that no tile after dapicnum needs.
+void polymost_prefetchrelease(int32_t dapicnum);
 
 enum cutsceneflags {
     CUTSCENE_FORCEFILTER = 1,
@@ -21,6 +21,10 @@ struct cpuinfo_t
     struct
     {
         unsigned int invariant_tsc : 1;
+        unsigned int sse2 : 1;
+        unsigned int sse4_1 : 1;
+        unsigned int avx2 : 1;  // only set if the OS saves the YMM registers
+        unsigned int neon : 1;
     } features;
 };
 
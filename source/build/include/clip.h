@@ -71,7 +71,7 @@ typedef struct
     union { struct { int32_t x2, y2; }; vec2_t p2; };
 } linetype;
 
-extern int16_t clipsectorlist[MAXCLIPSECTORS];
+extern thread_local int16_t clipsectorlist[MAXCLIPSECTORS];
 
 int clipinsideboxline(int x, int y, int x1, int y1, int x2, int y2, int walldist);
 int clipinsidebox(vec2_t const vect, int const wallnum, int const walldist);
@@ -82,6 +82,28 @@ int32_t clipmove(vec3_t *const pos, int16_t *const sectnum, int32_t xvect, int32
                  int32_t const flordist, uint32_t const cliptype) ATTRIBUTE((nonnull(1, 2)));
 int32_t clipmovex(vec3_t *const pos, int16_t *const sectnum, int32_t xvect, int32_t yvect, int32_t const walldist, int32_t const ceildist,
                   int32_t const flordist, uint32_t const cliptype, uint8_t const noslidep) ATTRIBUTE((nonnull(1, 2)));
+typedef struct
+{
+    vec3_t *pos;
+    int16_t *sectnum;
+    int32_t xvect, yvect;
+    int32_t walldist, ceildist, flordist;
+    uint32_t cliptype;
+    uint8_t noslide;
+    int32_t retval;  // out: what clipmovex() returns
+} clipmoveitem_t;
+
+extern int32_t clipmove_threads;
+
+// Moves every item as if by clipmovex() in the given order, but runs moves that can't
+// affect each other on up to clipmove_threads threads.  The results are the same as
+// the sequential calls regardless of the number of threads.
+void clipmoveBatch(clipmoveitem_t *items, int32_t numitems);
+
+// moves every sprite on the loaded map in random directions one at a time and batched,
+// checks that the results match and prints the timings
+void clipmoveBenchmark(int32_t numrounds);
+
 int pushmove(vec3_t *const vect, int16_t *const sectnum, int32_t const walldist, int32_t const ceildist, int32_t const flordist,
                  uint32_t const cliptype, bool clear = true) ATTRIBUTE((nonnull(1, 2)));
 
@@ -5,6 +5,10 @@
 
 #include "vfs.h"
 
+// kprender() keeps the decoder state in a context of its own for each picture,
+// so kpgetdim()/kprender() can be called on several threads at once.  The ZIP
+// functions are not thread-safe.
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,12 +38,44 @@ extern void kpzload (const char *, intptr_t *, int32_t *, int32_t *);
 extern void kpgetdim (const char *, int32_t, int32_t *, int32_t *);
 extern int32_t kprender (const char *, int32_t, intptr_t, int32_t, int32_t, int32_t);
 
+	//Decode pictures already in memory to 32-bit pixels, several of them on the thread pool
+	//if the decoders are thread-safe.  pic is allocated with Xcalloc, and is 0 on failure.
+typedef struct
+{
+    const char *buf;
+    int32_t leng;
+    int32_t xsiz, ysiz;
+    intptr_t pic;
+} kpimage_t;
+
+extern void kpdecode (kpimage_t *);
+extern void kpdecodemulti (kpimage_t *, int32_t);
+
+	//SIMD variants of PNG unfiltering, the JPG IDCT and YCbCr->RGB conversion.  They give
+	//exactly the same pixels as the C code.  kpinit() picks the best one the CPU supports,
+	//so sysReadCPUID() has to be called before it.
+enum
+{
+    KPLIB_ISA_SCALAR,
+    KPLIB_ISA_SSE2,
+    KPLIB_ISA_NEON,
+    KPLIB_ISA_AVX2,
+    KPLIB_ISA_COUNT
+};
+
+extern void kpinit (void);
+extern int32_t kpisasupported (int32_t);
+extern int32_t kpsetisa (int32_t); //returns -1 if not supported
+extern int32_t kpgetisa (void);
+extern const char *kpisaname (int32_t);
+
 	//ZIP functions:
 extern int32_t kzaddstack (const char *);
 extern void kzuninit ();
 extern intptr_t kzopen (const char *);
 extern int32_t kzread (void *, int32_t);
 extern int32_t kzseek (int32_t, int32_t);
+extern char const *kzgetarchive (const char *);
 
 static inline int32_t kztell(void) { return kzfs.fil ? kzfs.pos : -1; }
 static inline int32_t kzeof(void) { return kzfs.fil ? kzfs.pos >= kzfs.leng : -1; }
@@ -42,6 +42,11 @@ private:
     int m_tail;
     int m_count;
 
+    // RF_FREE only makes sense for pointers, but the calls
+    // have to compile for queues of any other type too.
+    template <typename U> static void freeItem(U * & item) { DO_FREE_AND_NULL(item); }
+    template <typename U> static void freeItem(U &) {}
+
 public:
 #ifdef USE_MIMALLOC
     CircularQueue() { m_items = (T *)mi_calloc(Capacity, sizeof(T)); clear(); }
@@ -58,7 +63,7 @@ public:
 
         if (ResetItems & RF_FREE)
             for (int i = 0; i < Capacity; i++)
-                DO_FREE_AND_NULL(m_items[i]);
+                freeItem(m_items[i]);
 
         if (ResetItems & RF_INIT)
             for (int i = 0; i < Capacity; i++)
@@ -69,12 +74,12 @@ public:
     {
         if (m_head == (Capacity - 1))
             m_head = -1;
-        else if (m_count < Capacity)
+        if (m_count < Capacity)
             ++m_count;
         if ((++m_head == m_tail) | (m_tail == -1))
         {
             if ((m_tail != -1) & ((ResetItems & RF_FREE) == RF_FREE))
-                Xfree(m_items[m_tail]);
+                freeItem(m_items[m_tail]);
             m_tail = (m_tail + 1) % Capacity;
         }
         m_items[m_head] = item;
@@ -85,7 +90,7 @@ public:
         Bassert(!isEmpty());
 
         if (ResetItems & RF_FREE)
-            Xfree(m_items[m_tail]);
+            freeItem(m_items[m_tail]);
 
         if (ResetItems & RF_INIT)
             m_items[m_tail] = T {};
@@ -135,9 +140,47 @@ template <typename K,      // Key type
 class LruCache final
 {
 private:
-    std::unordered_map<K, V>    m_cache; // Size capped to CacheSize
+    struct Entry
+    {
+        V   value;
+        int refs; // Occurrences of the key in the LRU queue
+    };
+
+    using Map = std::unordered_map<K, Entry>;
+
+    Map                         m_cache; // Size capped to CacheSize
     CircularQueue<K, CacheSize> m_lruQ;  // back=MRU, front=LRU
 
+    // Every access appends the key to the queue, so a key may be in it
+    // more than once; only its last occurrence counts as its position.
+    // When the queue fills up, the earlier ones are squeezed out rather
+    // than letting the queue overwrite its front, which would lose items
+    // that haven't been accessed in a while.
+    void compact(const K * dropKey = nullptr)
+    {
+        for (int n = m_lruQ.size(); n > 0; --n)
+        {
+            K const key = m_lruQ.front();
+            m_lruQ.popFront();
+
+            auto iter = m_cache.find(key);
+            if (iter == m_cache.end() || --iter->second.refs > 0 || (dropKey && key == *dropKey))
+                continue;
+
+            m_lruQ.pushBack(key);
+            iter->second.refs = 1;
+        }
+    }
+
+    void touch(typename Map::iterator iter)
+    {
+        if (m_lruQ.isFull())
+            compact(&iter->first);
+
+        m_lruQ.pushBack(iter->first);
+        iter->second.refs++;
+    }
+
 public:
     using Pair = std::pair<K, V>;
     LruCache() : m_cache { HTPrimeSize } {}
@@ -147,41 +190,55 @@ public:
         auto iter = m_cache.find(key);
         if (iter == m_cache.end())
             return nullptr;
-        m_lruQ.pushBack(iter->first);
-        return &iter->second;
+        touch(iter);
+        return &iter->second.value;
     }
 
     bool insert(const K & key, const V & value, Pair * outOptEvictedEntry = nullptr)
     {
-        Bassert(access(key) == nullptr); // No duplicate keys
+        Bassert(m_cache.find(key) == m_cache.end()); // No duplicate keys
 
-        bool entryEvicted = false;
-        if (m_cache.size() == CacheSize)
+        // Make room for a new item by removing the oldest cached.
+        bool const entryEvicted = (m_cache.size() == CacheSize) && evict(outOptEvictedEntry);
+        Bassert(m_cache.size() < CacheSize);
+
+        touch(m_cache.insert({ key, Entry { value, 0 } }).first);
+        return entryEvicted;
+    }
+
+    // Removes the LRU item, for callers that bound the cache by
+    // something other than the item count (e.g. memory use).
+    bool evict(Pair * outOptEvictedEntry = nullptr)
+    {
+        while (!m_lruQ.isEmpty())
         {
-            // Make room for a new item by removing the oldest cached.
-            // Need to call in a loop because the LRU queue might have
-            // multiple references to the same item, which might have
-            // already been removed from the cache by a previous insert.
-            for (;;)
-            {
-                auto iter = m_cache.find(m_lruQ.front());
-                m_lruQ.popFront();
-
-                if (iter != m_cache.end())
-                {
-                    if (outOptEvictedEntry)
-                        *outOptEvictedEntry = *iter;
-                    m_cache.erase(iter);
-                    entryEvicted = true;
-                    break;
-                }
-            }
-            Bassert(m_cache.size() == CacheSize - 1);
+            auto iter = m_cache.find(m_lruQ.front());
+            m_lruQ.popFront();
+
+            Bassert(iter != m_cache.end());
+            if (--iter->second.refs > 0)
+                continue;
+
+            if (outOptEvictedEntry)
+                *outOptEvictedEntry = { iter->first, iter->second.value };
+            m_cache.erase(iter);
+            return true;
         }
 
-        m_cache.insert({ key, value });
-        m_lruQ.pushBack(key);
-        return entryEvicted;
+        Bassert(m_cache.empty());
+        return false;
+    }
+
+    bool remove(const K & key, V * outOptValue = nullptr)
+    {
+        auto iter = m_cache.find(key);
+        if (iter == m_cache.end())
+            return false;
+        if (outOptValue)
+            *outOptValue = iter->second.value;
+        m_cache.erase(iter);
+        compact();
+        return true;
     }
 
     void clear()
@@ -200,20 +257,34 @@ public:
     Pair mru() const
     {
         Bassert(!isEmpty());
-        return *m_cache.find(m_lruQ.back());
+        auto iter = m_cache.find(m_lruQ.back());
+        return { iter->first, iter->second.value };
     }
 
     Pair lru() const
     {
         Bassert(!isEmpty());
-        return *m_cache.find(m_lruQ.front());
+
+        // The first key in the queue that doesn't occur again later on.
+        std::unordered_map<K, int> seen;
+        Pair result;
+        for (int i = 0, index = m_lruQ.frontIndex(); i < m_lruQ.size(); i++, index = (index + 1) % CacheSize)
+        {
+            auto iter = m_cache.find(m_lruQ[index]);
+            if (++seen[iter->first] == iter->second.refs)
+            {
+                result = { iter->first, iter->second.value };
+                break;
+            }
+        }
+        return result;
     }
 
     int copyContents(std::array<Pair, CacheSize> & dest) const
     {
         int n = 0;
-        for (const Pair & p : m_cache)
-            dest[n++] = p;
+        for (const auto & p : m_cache)
+            dest[n++] = { p.first, p.second.value };
         return n;
     }
 };
@@ -0,0 +1,82 @@
+// Per-sector wall bounding volume hierarchies for hitscan(), cansee() and clipmove()
+//
+// Each sector with enough walls gets a binary tree over its wall index range.
+// Nodes split the range in the middle, so a leaf covers a few consecutive
+// walls and the leaves read left to right give back the walls in their
+// original order.  A query walks the tree and returns the index ranges of the
+// leaves the trace can possibly touch, which the callers then process exactly
+// like the full wall loop they replace: walls are visited in the same order
+// and only walls that would have been rejected anyway are skipped, so the
+// results are identical to the linear scan.
+//
+// Moving walls with dragpoint() or CON's setwall marks their sector dirty, and
+// the next query refits its tree in place.  Anything that replaces the whole
+// map has to call sectorbvhBuild() afterwards.  Queries are safe to run from
+// several threads at once only after sectorbvhRefresh() has brought every
+// tree up to date and as long as no walls move in the meantime.
+
+#pragma once
+
+#ifndef sectorbvh_h_
+#define sectorbvh_h_
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SECTORBVH_MAXRANGES 64
+
+typedef struct
+{
+    int32_t start[SECTORBVH_MAXRANGES], end[SECTORBVH_MAXRANGES];
+    int32_t numranges, range;
+} sectorbvhwalls_t;
+
+extern int32_t sectorbvh_enabled;
+
+void sectorbvhBuild(void);
+void sectorbvhInvalidateSector(int16_t sectnum);
+void sectorbvhInvalidateWall(int16_t wallnum);
+void sectorbvhRefresh(void);
+
+// walls of sectnum that can intersect the segment from pos to pos + vec, for cansee()
+void sectorbvhGetSegmentWalls(int16_t sectnum, vec2_t pos, vec2_t vec, sectorbvhwalls_t *walls);
+// walls of sectnum that can intersect the ray from pos along vec within a Manhattan distance
+// of maxdist from pos, with the precision of rintersect() in ENGINE_EDUKE32 mode, for hitscan()
+void sectorbvhGetRayWalls(int16_t sectnum, vec2_t pos, vec2_t vec, int32_t maxdist, sectorbvhwalls_t *walls);
+// walls of sectnum that aren't entirely on the outside of one edge of the box from boxmin to boxmax, for clipmove()
+void sectorbvhGetBoxWalls(int16_t sectnum, vec2_t boxmin, vec2_t boxmax, sectorbvhwalls_t *walls);
+
+static FORCE_INLINE void sectorbvhGetAllWalls(int16_t const sectnum, sectorbvhwalls_t * const walls)
+{
+    walls->start[0]  = sector[sectnum].wallptr;
+    walls->end[0]    = sector[sectnum].wallptr + sector[sectnum].wallnum;
+    walls->numranges = 1;
+}
+
+// for (w = sectorbvhFirstWall(&walls); w >= 0; w = sectorbvhNextWall(&walls, w))
+static FORCE_INLINE int32_t sectorbvhFirstWall(sectorbvhwalls_t * const walls)
+{
+    walls->range = 0;
+    return walls->numranges > 0 && walls->start[0] < walls->end[0] ? walls->start[0] : -1;
+}
+
+static FORCE_INLINE int32_t sectorbvhNextWall(sectorbvhwalls_t * const walls, int32_t const wallnum)
+{
+    if (wallnum + 1 < walls->end[walls->range])
+        return wallnum + 1;
+
+    return ++walls->range < walls->numranges ? walls->start[walls->range] : -1;
+}
+
+// runs random hitscan() and cansee() traces over the loaded map with and without the trees,
+// checks that the results match and prints the timings
+void sectorbvhBenchmark(int32_t numtraces);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
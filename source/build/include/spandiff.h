@@ -0,0 +1,136 @@
+// Span encoding of the differences between two arrays
+//
+// The changed elements are written as spans, each as its length, the number
+// of unchanged elements since the end of the previous span (both as varints)
+// and the new values.  The caller ends the list with a length of 0.
+// Identical SPANDIFF_BLOCK-byte blocks are skipped without looking at single
+// elements, and changes closer together than a span header is long share a
+// span.  The savegame code uses this for demo diffs, see cmpspecdata() and
+// applydiff().
+
+#pragma once
+
+#ifndef spandiff_h_
+#define spandiff_h_
+
+#include "compat.h"
+
+#define SPANDIFF_BLOCK 32
+
+#if defined BITNESS64 && (defined __SSE2__ || defined _MSC_VER) && !defined(_M_ARM64)
+# define SPANDIFF_SSE2
+#endif
+
+// returns the offset of the first block at or after ofs where a and b differ
+static FORCE_INLINE uint32_t spandiffSkipSameBlocks(uint8_t const *a, uint8_t const *b, uint32_t ofs, uint32_t const len)
+{
+    for (; ofs + SPANDIFF_BLOCK <= len; ofs += SPANDIFF_BLOCK)
+    {
+#ifdef SPANDIFF_SSE2
+        __m128i const lo = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(a + ofs)), _mm_loadu_si128((__m128i const *)(b + ofs)));
+        __m128i const hi = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)(a + ofs + 16)), _mm_loadu_si128((__m128i const *)(b + ofs + 16)));
+
+        if (_mm_movemask_epi8(_mm_and_si128(lo, hi)) != 0xffff)
+            break;
+#else
+        if (Bmemcmp(a + ofs, b + ofs, SPANDIFF_BLOCK))
+            break;
+#endif
+    }
+
+    return ofs;
+}
+
+static FORCE_INLINE uint8_t *spandiffPutVarint(uint8_t *p, uint32_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+        *p++ = v | 0x80;
+
+    *p++ = v;
+    return p;
+}
+
+static FORCE_INLINE uint8_t *spandiffGetVarint(uint8_t *p, uint32_t *v)
+{
+    uint32_t val = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        val |= (uint32_t)(*p & 0x7f) << shift;
+
+        if (!(*p++ & 0x80))
+        {
+            *v = val;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+// write spans for the elements in [i, end) that differ between p and op, updating op;
+// spanend is the end of the previous span in the same list, 0 for the first call
+template <typename Dat>
+static uint8_t *spandiffEncode(Dat const *p, Dat *op, uint32_t i, uint32_t const end, uint32_t *spanend, uint8_t *retdiff)
+{
+    uint32_t const maxgap = 2 / sizeof(Dat);
+
+    while (i < end)
+    {
+        i = spandiffSkipSameBlocks((uint8_t const *)p, (uint8_t const *)op, i * sizeof(Dat), end * sizeof(Dat)) / sizeof(Dat);
+
+        while (i < end && p[i] == op[i])
+            i++;
+
+        if (i >= end)
+            break;
+
+        uint32_t const start = i;
+        uint32_t last = i;
+
+        for (++i; i < end && i - last <= maxgap + 1; i++)
+            if (p[i] != op[i])
+                last = i;
+
+        uint32_t const len = last - start + 1;
+
+        retdiff = spandiffPutVarint(retdiff, len);
+        retdiff = spandiffPutVarint(retdiff, start - *spanend);
+
+        Bmemcpy(retdiff, p + start, len * sizeof(Dat));
+        Bmemcpy(op + start, p + start, len * sizeof(Dat));
+        retdiff += len * sizeof(Dat);
+
+        *spanend = i = last + 1;
+    }
+
+    return retdiff;
+}
+
+// apply the spans for an array of nelts elements, or return NULL if they don't fit it
+template <typename Dat>
+static uint8_t *spandiffApply(Dat *op, uint32_t const nelts, uint8_t *diff)
+{
+    uint32_t pos = 0;
+
+    do
+    {
+        uint32_t len, gap;
+
+        if ((diff = spandiffGetVarint(diff, &len)) == NULL)
+            return NULL;
+
+        if (len == 0)
+            return diff;
+
+        if ((diff = spandiffGetVarint(diff, &gap)) == NULL || gap > nelts - pos || len > nelts - pos - gap)
+            return NULL;
+
+        pos += gap;
+        Bmemcpy(op + pos, diff, len * sizeof(Dat));
+        diff += len * sizeof(Dat);
+        pos += len;
+    } while (1);
+}
+
+#endif
@@ -0,0 +1,41 @@
+// Uniform grid of sprite positions for proximity queries
+//
+// Sprites are bucketed by the cell their x/y falls into, with the cells
+// hashed into a fixed number of buckets so that the grid covers the whole
+// coordinate range without depending on the map's extents.  The engine keeps
+// the grid current in insertsprite(), deletesprite(), changespritesect(),
+// setsprite() and setspritez().  Game code writes sprite positions directly
+// in a lot of places though, so the game calls spritegridRefresh() once per
+// tic and after loading a savegame: it only rebuckets the sprites whose
+// position differs from the one the grid has, with a single linear pass over
+// sprite[].
+
+#pragma once
+
+#ifndef spritegrid_h_
+#define spritegrid_h_
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPRITEGRID_CELLSHIFT 11
+#define SPRITEGRID_BUCKETS 4096  // must be a power of 2
+
+void spritegridClear(void);
+void spritegridUpdate(int16_t spritenum);
+void spritegridRemove(int16_t spritenum);
+int32_t spritegridRefresh(void);
+
+// Stores up to maxsprites sprites whose position as of the last update lies in the square
+// with half-size radius around pos, in no particular order.  Returns the number found,
+// which may exceed maxsprites.
+int32_t spritegridQuery(vec2_t pos, int32_t radius, int16_t *sprites, int32_t maxsprites);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
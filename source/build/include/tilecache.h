@@ -0,0 +1,48 @@
+// Thread-safe tile cache
+//
+// cache1d hands out memory through waloff[] and evicts by zeroing the handle it was given,
+// which only works as long as everything that touches tiles runs on the main thread.  The
+// tile cache is a second store for ART tile data that worker threads can use: tileAcquire()
+// returns the pixels of a tile, loading them into the cache if needed, and they stay valid
+// until the matching tileRelease(), whichever thread evicts or invalidates the tile in the
+// meantime.  waloff[] and walock[] keep working as before for everything on the main thread.
+//
+// Memory is handed out in size classes, each of which carves fixed-size slots out of
+// segments that are allocated as the class needs them; tiles too large for the biggest class
+// get an allocation of their own.  Every cached tile has an atomic reference count and is
+// detached from its tile before its memory is reused.  As other threads may still be looking
+// at a detached block, it is retired rather than freed, and only returned to its class once
+// every thread that was inside the cache at the time has left it (epoch-based reclamation).
+// The lock-free free lists rely on this as well: a slot can't go back on a list while
+// another thread may be in the middle of popping it.
+//
+// Workers can only load tiles whose data can be had without going through the file system,
+// i.e. ART files that are read in place from a mapped group and tiles defined in memory.
+// Anything else has to be acquired by the main thread once first.  Tiles made with
+// tileCreate() only exist in waloff[] and are never cached here.
+//
+// "tilecacheinfo" in the console shows the occupancy of each size class and the eviction rate.
+
+#pragma once
+
+#ifndef tilecache_h_
+#define tilecache_h_
+
+#include "compat.h"
+
+// maxsize is a soft limit: the cache grows beyond it when nothing can be evicted
+void tilecacheInit(int32_t maxsize);
+// must not be called while other threads hold or acquire tiles
+void tilecacheUninit(void);
+
+// Returns the pixels of the tile, or NULL if it is empty or can't be loaded on this thread.
+char const *tileAcquire(int16_t tileNum);
+void tileRelease(char const *data);
+
+// Drop the cached copies of tiles whose data or size changed.  Main thread only.
+void tilecacheInvalidate(int16_t tileNum);
+void tilecacheInvalidateAll(void);
+
+void tilecacheReport(void);
+
+#endif
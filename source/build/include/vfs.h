@@ -186,6 +186,16 @@ extern "C" {
 
 extern char toupperlookup[256];
 
+// see kfileinfo()
+typedef struct
+{
+    char const *data;  // as kfiledata() would return it
+    int32_t length;
+    int32_t offset;    // of the file in the group holding it, 0 if it is stored on its own
+    int64_t disksize;  // of the file on disk holding it, which is a group unless offset is 0
+    int64_t mtime;     // ditto
+} buildvfs_kinfo_t;
+
 extern char *kpzbuf;
 extern int32_t kpzbufsiz;
 extern int32_t kpzbufload(const char *);
@@ -247,6 +257,16 @@ static inline void krename(int32_t, int32_t, const char *)
 {
 }
 
+static inline char const * kfiledata(buildvfs_kfd)
+{
+    return nullptr;
+}
+
+static inline int32_t kfileinfo(const char *filename, buildvfs_kinfo_t *)
+{
+    return PHYSFS_exists(filename) ? 0 : -1;
+}
+
 #else
 using buildvfs_kfd = int32_t;
 #define buildvfs_kfd_invalid (-1)
@@ -277,6 +297,17 @@ void	kclose(buildvfs_kfd handle);
 
 void krename(int32_t crcval, int32_t filenum, const char *newname);
 char const * kfileparent(int32_t handle);
+
+// Returns the whole contents of an open file if they can be used in place, i.e. if it is stored
+// uncompressed in a group or ZIP that could be memory mapped, or NULL if it has to be kread().
+// The data is read-only and stays valid until uninitgroupfile().
+char const * kfiledata(buildvfs_kfd handle);
+
+// Looks up the file kopen4load(filename, 0) would open without opening it.  Returns -1 if there is
+// no such file, 0 if it can only be told apart from its contents (it is stored in a ZIP) and 1 if
+// info is filled in.  Unless the file on disk holding it has been changed, the same info means the
+// same contents.
+int32_t kfileinfo(const char *filename, buildvfs_kinfo_t *info);
 #endif
 
 extern int32_t kpzbufloadfil(buildvfs_kfd);
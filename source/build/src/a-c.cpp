@@ -11,6 +11,8 @@
 // by the EDuke32 team (development@voidpoint.com)
 
 #include "a.h"
+#include "build_cpuid.h"
+#include "log.h"
 #include "pragmas.h"
 
 #ifdef ENGINE_USING_A_C
@@ -45,8 +47,173 @@ void settransnormal(void) { transmode = 0; }
 void settransreverse(void) { transmode = 1; }
 
 
+///// SIMD kernel variants /////
+
+// The texture and palette lookups stay scalar byte loads (a gather would read
+// past the end of tiles), but the texel addressing for 8 pixels at a time is
+// done in vector registers.  The same generic code is compiled once for the
+// baseline ISA (SSE2 on x86-64, NEON on ARM) and once with AVX2 enabled, and
+// the variant is picked at runtime from build_cpuid.h.  Every variant must
+// write exactly the same pixels as the scalar code, which also handles the
+// leftover pixels and the cases the vector code does not cover (shifts of 0
+// or 32, non-power-of-two tile heights, vplc saturation).
+
+#if defined __GNUC__ && (EDUKE32_GCC_PREREQ(4,9) || defined __clang__) && \
+    ((defined EDUKE32_CPU_X86 && defined BITNESS64) || defined __ARM_NEON || defined __ARM_NEON__)
+# define A_C_SIMD
+#endif
+
+static int32_t a_c_isa = A_C_ISA_SCALAR;
+
+static const char *const a_c_isanames[A_C_ISA_COUNT] = { "C", "SSE2", "NEON", "AVX2" };
+
+int32_t a_c_isasupported(int32_t isa)
+{
+    switch (isa)
+    {
+        case A_C_ISA_SCALAR: return 1;
+#ifdef A_C_SIMD
+# ifdef EDUKE32_CPU_X86
+        case A_C_ISA_SSE2: return cpu.features.sse2;
+        case A_C_ISA_AVX2: return cpu.features.avx2;
+# else
+        case A_C_ISA_NEON: return cpu.features.neon;
+# endif
+#endif
+    }
+
+    return 0;
+}
+
+int32_t a_c_setisa(int32_t isa)
+{
+    if ((unsigned)isa >= A_C_ISA_COUNT || !a_c_isasupported(isa))
+        return -1;
+
+    return a_c_isa = isa;
+}
+
+int32_t a_c_getisa(void) { return a_c_isa; }
+const char *a_c_isaname(int32_t isa) { return (unsigned)isa < A_C_ISA_COUNT ? a_c_isanames[isa] : "?"; }
+
+void a_c_init(void)
+{
+    for (int isa = A_C_ISA_COUNT-1; isa >= 0; isa--)
+        if (a_c_setisa(isa) >= 0)
+            break;
+
+    VLOG_F(LOG_ENGINE, "Classic renderer column/span kernels: %s", a_c_isaname(a_c_isa));
+}
+
+#ifdef A_C_SIMD
+// The kernels are instantiated with 4 lanes for the baseline ISA and with 8
+// for AVX2; generic 32-byte vectors would be spilled to memory without AVX.
+template <int lanes> struct a_c_vec;
+
+template <> struct a_c_vec<4>
+{
+    typedef uint32_t u32 __attribute__ ((vector_size (16)));
+    typedef int32_t i32 __attribute__ ((vector_size (16)));
+    typedef uint64_t u64 __attribute__ ((vector_size (16)));
+};
+
+template <> struct a_c_vec<8>
+{
+    typedef uint32_t u32 __attribute__ ((vector_size (32)));
+    typedef int32_t i32 __attribute__ ((vector_size (32)));
+    typedef uint64_t u64 __attribute__ ((vector_size (32)));
+};
+
+template <int lanes> using a_c_u32 = typename a_c_vec<lanes>::u32;
+template <int lanes> using a_c_i32 = typename a_c_vec<lanes>::i32;
+template <int lanes> using a_c_u64 = typename a_c_vec<lanes>::u64;
+
+# define A_C_RAMP(name) a_c_u32<lanes> name; for (int i=0; i<lanes; i++) name[i] = i
+
+// The kernels are bound by their byte loads, so the texel indices are taken
+// out of the vector two at a time instead of going through memory.
+# define A_C_LANE(vec, i) ((uint32_t)(((a_c_u64<lanes>)(vec))[((i)>>1)&(lanes/2-1)] >> (((i)&1)<<5)))
+# define A_C_UNROLL(f) do { f(0) f(1) f(2) f(3) if (lanes > 4) { f(4) f(5) f(6) f(7) } } while (0)
+
+# ifdef EDUKE32_CPU_X86
+#  define A_C_TARGET_AVX2 __attribute__ ((target ("avx2")))
+// Instantiates the always-inline body <simd> as <name>_vec and <name>_avx2.
+#  define A_C_SIMD_KERNEL(name, simd, mode, params, args) \
+    static void name##_vec params { simd<4, mode> args; } \
+    static A_C_TARGET_AVX2 void name##_avx2 params { simd<8, mode> args; }
+#  define A_C_DISPATCH(name, args) \
+    do { if (a_c_isa == A_C_ISA_AVX2) name##_avx2 args; else if (a_c_isa != A_C_ISA_SCALAR) name##_vec args; } while (0)
+# else
+#  define A_C_SIMD_KERNEL(name, simd, mode, params, args) \
+    static void name##_vec params { simd<4, mode> args; }
+#  define A_C_DISPATCH(name, args) \
+    do { if (a_c_isa != A_C_ISA_SCALAR) name##_vec args; } while (0)
+# endif
+
+// Vector shifts by 32 are undefined, and the scalar code relies on what x86 does with them.
+static FORCE_INLINE bool a_c_simdshift(int32_t const shift) { return (unsigned)(shift - 1) < 31; }
+
+enum
+{
+    A_C_OPAQUE,
+    A_C_MASKED,
+    A_C_TRANS,
+};
+
+template <int mode>
+static FORCE_INLINE void a_c_putpix(char *const pp, const char *const A_C_RESTRICT pal, char const ch, uint8_t const shift)
+{
+    if (mode == A_C_OPAQUE)
+        *pp = pal[ch];
+    else if (ch != 255)
+    {
+        if (mode == A_C_MASKED)
+            *pp = pal[ch];
+        else
+            *pp = gtrans[((*pp)<<(8-shift))|(pal[ch]<<shift)];
+    }
+}
+#endif
+
+
 ///// Ceiling/floor horizontal line functions /////
 
+#ifdef A_C_SIMD
+// cnt+1 pixels, leftwards from pp
+template <int lanes, int mode>
+static FORCE_INLINE void hlineasm4_simd(bssize_t &cnt, const char *const A_C_RESTRICT palptr, const char *const A_C_RESTRICT buf,
+                                        vec2_t const inc, vec2_t const log, uint32_t &bx, uint32_t &by, char *&pp)
+{
+    A_C_RAMP(ramp);
+
+    a_c_u32<lanes> u = bx - ramp*(uint32_t)inc.x;
+    a_c_u32<lanes> v = by - ramp*(uint32_t)inc.y;
+    uint32_t const ustep = (uint32_t)inc.x*lanes, vstep = (uint32_t)inc.y*lanes;
+    int32_t const logy = log.y, shx = 32-log.x, shy = 32-log.y;
+    bssize_t c = cnt;
+    char *d = pp;
+
+    for (; c>=lanes-1; c-=lanes, d-=lanes)
+    {
+        a_c_u32<lanes> const idx = ((u>>shx)<<logy)+(v>>shy);
+#define HLINE_PIX(i) d[-(i)] = palptr[buf[A_C_LANE(idx, i)]];
+        A_C_UNROLL(HLINE_PIX);
+#undef HLINE_PIX
+        u -= ustep;
+        v -= vstep;
+    }
+
+    cnt = c;
+    pp = d;
+    bx = u[0];
+    by = v[0];
+}
+
+A_C_SIMD_KERNEL(hlineasm4, hlineasm4_simd, A_C_OPAQUE,
+    (bssize_t &cnt, const char *palptr, const char *buf, vec2_t inc, vec2_t log, uint32_t &bx, uint32_t &by, char *&pp),
+    (cnt, palptr, buf, inc, log, bx, by, pp))
+#endif
+
 void sethlinesizes(int32_t logx, int32_t logy, intptr_t bufplc)
 { glogx = logx; glogy = logy; gbuf = (char *)bufplc; }
 void setpalookupaddress(char *paladdr) { ghlinepal = paladdr; }
@@ -64,6 +231,11 @@ void hlineasm4(bssize_t cnt, int32_t skiploadincs, int32_t paloffs, uint32_t by,
     const vec2_t log32 = { 32-log.x, 32-log.y };
     char *pp = (char *)p;
 
+#ifdef A_C_SIMD
+    if (a_c_simdshift(log.x) && a_c_simdshift(log.y))
+        A_C_DISPATCH(hlineasm4, (cnt, palptr, buf, inc, log, bx, by, pp));
+#endif
+
 #ifdef CLASSIC_SLICE_BY_4
     for (; cnt>=4; cnt-=4, pp-=4)
     {
@@ -93,6 +265,50 @@ void hlineasm4(bssize_t cnt, int32_t skiploadincs, int32_t paloffs, uint32_t by,
 
 
 ///// Sloped ceiling/floor vertical line functions /////
+#ifdef A_C_SIMD
+template <int lanes, int mode>
+static FORCE_INLINE void slopevlin_simd(intptr_t &p, intptr_t *A_C_RESTRICT &slopalptr, bssize_t &cnt, int32_t &bz, int32_t const bzinc,
+                                        uint32_t const bx, uint32_t const by)
+{
+    A_C_RAMP(ramp);
+
+    a_c_u32<lanes> z = (uint32_t)bz + ramp*(uint32_t)bzinc;
+    uint32_t const zstep = (uint32_t)bzinc*lanes;
+    int32_t const logy = glogy, shx = 32-glogx, shy = 32-glogy;
+    intptr_t const pinc = gpinc;
+    uint32_t const x3 = globalx3, y3 = globaly3;
+    const char *const A_C_RESTRICT buf = gbuf;
+    intptr_t *A_C_RESTRICT pal = slopalptr;
+    bssize_t c = cnt;
+    intptr_t d = p;
+
+    for (; c>=lanes; c-=lanes, pal-=lanes, d+=pinc*lanes)
+    {
+        a_c_u32<lanes> const zi = (a_c_u32<lanes>)(((a_c_i32<lanes>)z>>6)+HALFSLOPTABLESIZ);
+        a_c_u32<lanes> i;
+#define SLOPE_LANE(k) i[(k)&(lanes-1)] = sloptable[(int32_t)A_C_LANE(zi, k)];
+        A_C_UNROLL(SLOPE_LANE);
+#undef SLOPE_LANE
+        a_c_u32<lanes> const u = bx+x3*i;
+        a_c_u32<lanes> const v = by+y3*i;
+        a_c_u32<lanes> const idx = ((u>>shx)<<logy)+(v>>shy);
+#define SLOPE_PIX(k) (*(char *)(d+pinc*(k))) = *(char *)(((intptr_t)pal[-(k)])+buf[A_C_LANE(idx, k)]);
+        A_C_UNROLL(SLOPE_PIX);
+#undef SLOPE_PIX
+        z += zstep;
+    }
+
+    p = d;
+    slopalptr = pal;
+    cnt = c;
+    bz = z[0];
+}
+
+A_C_SIMD_KERNEL(slopevlin, slopevlin_simd, A_C_OPAQUE,
+    (intptr_t &p, intptr_t *A_C_RESTRICT &slopalptr, bssize_t &cnt, int32_t &bz, int32_t bzinc, uint32_t bx, uint32_t by),
+    (p, slopalptr, cnt, bz, bzinc, bx, by))
+#endif
+
 void slopevlin(intptr_t p, int32_t i, intptr_t slopaloffs, bssize_t cnt, int32_t bx, int32_t by)
 {
     intptr_t * A_C_RESTRICT slopalptr;
@@ -101,6 +317,12 @@ void slopevlin(intptr_t p, int32_t i, intptr_t slopaloffs, bssize_t cnt, int32_t
 
     bz = asm3; bzinc = (asm1>>3);
     slopalptr = (intptr_t *)slopaloffs;
+
+#ifdef A_C_SIMD
+    if (a_c_simdshift(glogx) && a_c_simdshift(glogy))
+        A_C_DISPATCH(slopevlin, (p, slopalptr, cnt, bz, bzinc, bx, by));
+#endif
+
     for (; cnt>0; cnt--)
     {
         i = (sloptable[(bz>>6)+HALFSLOPTABLESIZ]); bz += bzinc;
@@ -128,6 +350,99 @@ static inline int32_t getpix(int32_t logy, const char *buf, uint32_t vplc)
     return logy ? buf[vplc>>logy] : buf[ourmulscale32(vplc,globaltilesizy)];
 }
 
+#if (EDUKE32_GCC_PREREQ(4,7) || __has_extension(attribute_ext_vector_type)) && defined BITNESS64
+// XXX: The "Ubuntu clang version 3.5-1ubuntu1 (trunk) (based on LLVM 3.5)"
+// does not compile us with USE_VECTOR_EXT. Maybe a newer one does?
+# if !defined __clang__
+#  define USE_VECTOR_EXT
+# endif
+#endif
+
+#ifdef USE_VECTOR_EXT
+typedef uint32_t uint32_vec4 __attribute__ ((vector_size (16)));
+#endif
+
+#ifdef USE_SATURATE_VPLC
+# define saturate_vplc(vplc, vinc) vplc |= g_saturate & -(vplc < (uint32_t)vinc)
+// NOTE: the vector types yield -1 for logical "true":
+# define saturate_vplc_vec(vplc, vinc) vplc |= g_saturate & (vplc < vinc)
+# ifdef USE_SATURATE_VPLC_TRANS
+#  define saturate_vplc_trans(vplc, vinc) saturate_vplc(vplc, vinc)
+# else
+#  define saturate_vplc_trans(vplc, vinc)
+# endif
+#else
+# define saturate_vplc(vplc, vinc)
+# define saturate_vplc_vec(vplc, vinc)
+# define saturate_vplc_trans(vplc, vinc)
+#endif
+
+#ifdef USE_SATURATE_VPLC
+static int32_t g_saturate;  // -1 if saturating vplc is requested, 0 else
+# define set_saturate(dosaturate) g_saturate = -(int)!!dosaturate
+#else
+# define set_saturate(dosaturate) UNREFERENCED_PARAMETER(dosaturate)
+#endif
+
+#ifdef A_C_SIMD
+// Would adding vinc n more times wrap vplc around and make the scalar code saturate it?
+# ifdef USE_SATURATE_VPLC
+#  define vplc_saturates(vplc, vinc, n) (g_saturate && (uint64_t)(vplc) + (uint64_t)(uint32_t)(vinc)*(n) > UINT32_MAX)
+#  ifdef USE_SATURATE_VPLC_TRANS
+#   define vplc_saturates_trans(vplc, vinc, n) vplc_saturates(vplc, vinc, n)
+#  else
+#   define vplc_saturates_trans(vplc, vinc, n) 0
+#  endif
+# else
+#  define vplc_saturates(vplc, vinc, n) 0
+#  define vplc_saturates_trans(vplc, vinc, n) 0
+# endif
+
+template <int mode>
+static FORCE_INLINE bool a_c_saturates(uint32_t const vplc, int32_t const vinc, int const n)
+{
+    return mode == A_C_MASKED ? vplc_saturates(vplc, vinc, n) : mode == A_C_TRANS ? vplc_saturates_trans(vplc, vinc, n) : false;
+}
+
+// Leaves at least one pixel for the scalar do/while loops.
+template <int lanes, int mode>
+static FORCE_INLINE void vlineasm1_simd(bssize_t &cnt, const char *const A_C_RESTRICT buf, const char *const A_C_RESTRICT pal,
+                                        int32_t const logy, int32_t const vinc, uint32_t &vplc, char *&pp)
+{
+    A_C_RAMP(ramp);
+
+    a_c_u32<lanes> v = vplc + ramp*(uint32_t)vinc;
+    uint32_t const vstep = (uint32_t)vinc*lanes;
+    int32_t const ourbpl = bpl;
+    uint8_t const shift = transmode<<3;
+    bssize_t c = cnt;
+    char *d = pp;
+
+    for (; c>lanes; c-=lanes, d+=ourbpl*lanes)
+    {
+        if (a_c_saturates<mode>(v[0], vinc, lanes))
+            break;
+
+        a_c_u32<lanes> const idx = v>>logy;
+#define VLINE_PIX(i) a_c_putpix<mode>(d+ourbpl*(i), pal, buf[A_C_LANE(idx, i)], shift);
+        A_C_UNROLL(VLINE_PIX);
+#undef VLINE_PIX
+        v += vstep;
+    }
+
+    cnt = c;
+    pp = d;
+    vplc = v[0];
+}
+
+# define A_C_VLINE_PARAMS (bssize_t &cnt, const char *buf, const char *pal, int32_t logy, int32_t vinc, uint32_t &vplc, char *&pp)
+# define A_C_VLINE_ARGS (cnt, buf, pal, logy, vinc, vplc, pp)
+
+A_C_SIMD_KERNEL(vlineasm1, vlineasm1_simd, A_C_OPAQUE, A_C_VLINE_PARAMS, A_C_VLINE_ARGS)
+A_C_SIMD_KERNEL(mvlineasm1, vlineasm1_simd, A_C_MASKED, A_C_VLINE_PARAMS, A_C_VLINE_ARGS)
+A_C_SIMD_KERNEL(tvlineasm1, vlineasm1_simd, A_C_TRANS, A_C_VLINE_PARAMS, A_C_VLINE_ARGS)
+#endif
+
 void setupvlineasm(int32_t neglogy) { glogy = neglogy; }
 // cnt+1 loop iterations!
 int32_t vlineasm1(int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc, intptr_t bufplc, intptr_t p)
@@ -141,6 +456,11 @@ int32_t vlineasm1(int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc, i
 
     if (logy)
     {
+#ifdef A_C_SIMD
+        if (a_c_simdshift(logy))
+            A_C_DISPATCH(vlineasm1, (cnt, buf, pal, logy, vinc, vplc, pp));
+#endif
+
 #ifdef CLASSIC_SLICE_BY_4
         for (; cnt>=4; cnt-=4)
         {
@@ -187,31 +507,51 @@ extern uint32_t vplce[4];
 extern int32_t vince[4];
 extern intptr_t bufplce[4];
 
-#if (EDUKE32_GCC_PREREQ(4,7) || __has_extension(attribute_ext_vector_type)) && defined BITNESS64
-// XXX: The "Ubuntu clang version 3.5-1ubuntu1 (trunk) (based on LLVM 3.5)"
-// does not compile us with USE_VECTOR_EXT. Maybe a newer one does?
-# if !defined __clang__
-#  define USE_VECTOR_EXT
-# endif
-#endif
+#ifdef A_C_SIMD
+// Four columns of lanes/4 rows per iteration, leaving at least one row for the scalar loops.
+template <int lanes, int mode>
+static FORCE_INLINE void vlineasm4_simd(bssize_t &cnt, char *&p, char *const A_C_RESTRICT *pal, char *const A_C_RESTRICT *buf,
+                                        int32_t const logy)
+{
+    int const rows = lanes/4;
+    int32_t const vinc[4] = { vince[0], vince[1], vince[2], vince[3] };
+    a_c_u32<lanes> v, vstep;
 
-#ifdef USE_VECTOR_EXT
-typedef uint32_t uint32_vec4 __attribute__ ((vector_size (16)));
-#endif
+    for (int i=0; i<lanes; i++)
+    {
+        v[i] = vplce[i&3] + (uint32_t)vinc[i&3]*(i>>2);
+        vstep[i] = (uint32_t)vinc[i&3]*rows;
+    }
 
-#ifdef USE_SATURATE_VPLC
-# define saturate_vplc(vplc, vinc) vplc |= g_saturate & -(vplc < (uint32_t)vinc)
-// NOTE: the vector types yield -1 for logical "true":
-# define saturate_vplc_vec(vplc, vinc) vplc |= g_saturate & (vplc < vinc)
-# ifdef USE_SATURATE_VPLC_TRANS
-#  define saturate_vplc_trans(vplc, vinc) saturate_vplc(vplc, vinc)
-# else
-#  define saturate_vplc_trans(vplc, vinc)
-# endif
-#else
-# define saturate_vplc(vplc, vinc)
-# define saturate_vplc_vec(vplc, vinc)
-# define saturate_vplc_trans(vplc, vinc)
+    int32_t const ourbpl = bpl;
+    bssize_t c = cnt;
+    char *d = p;
+
+    for (; c>rows; c-=rows, d+=ourbpl*rows)
+    {
+        if (a_c_saturates<mode>(v[0], vinc[0], rows) || a_c_saturates<mode>(v[1], vinc[1], rows) ||
+            a_c_saturates<mode>(v[2], vinc[2], rows) || a_c_saturates<mode>(v[3], vinc[3], rows))
+            break;
+
+        a_c_u32<lanes> const idx = v>>logy;
+#define VLINE4_PIX(i) a_c_putpix<mode>(d+ourbpl*((i)>>2)+((i)&3), pal[(i)&3], buf[(i)&3][A_C_LANE(idx, i)], 0);
+        A_C_UNROLL(VLINE4_PIX);
+#undef VLINE4_PIX
+        v += vstep;
+    }
+
+    cnt = c;
+    p = d;
+
+    for (int i=0; i<4; i++)
+        vplce[i] = v[i];
+}
+
+# define A_C_VLINE4_PARAMS (bssize_t &cnt, char *&p, char *const A_C_RESTRICT *pal, char *const A_C_RESTRICT *buf, int32_t logy)
+# define A_C_VLINE4_ARGS (cnt, p, pal, buf, logy)
+
+A_C_SIMD_KERNEL(vlineasm4, vlineasm4_simd, A_C_OPAQUE, A_C_VLINE4_PARAMS, A_C_VLINE4_ARGS)
+A_C_SIMD_KERNEL(mvlineasm4, vlineasm4_simd, A_C_MASKED, A_C_VLINE4_PARAMS, A_C_VLINE4_ARGS)
 #endif
 
 #ifdef CLASSIC_NONPOW2_YSIZE_WALLS
@@ -252,6 +592,12 @@ void vlineasm4(bssize_t cnt, char *p)
 {
     char * const A_C_RESTRICT pal[4] = {(char *)palookupoffse[0], (char *)palookupoffse[1], (char *)palookupoffse[2], (char *)palookupoffse[3]};
     char * const A_C_RESTRICT buf[4] = {(char *)bufplce[0], (char *)bufplce[1], (char *)bufplce[2], (char *)bufplce[3]};
+
+#ifdef A_C_SIMD
+    if (a_c_simdshift(glogy))
+        A_C_DISPATCH(vlineasm4, (cnt, p, pal, buf, glogy));
+#endif
+
 #ifdef USE_VECTOR_EXT
     uint32_vec4 vinc = {(uint32_t)vince[0], (uint32_t)vince[1], (uint32_t)vince[2], (uint32_t)vince[3]};
     uint32_vec4 vplc = {vplce[0], vplce[1], vplce[2], vplce[3]};
@@ -326,13 +672,6 @@ void vlineasm4(bssize_t cnt, char *p)
     Bmemcpy(&vplce[0], &vplc[0], sizeof(uint32_t) * 4);
 }
 
-#ifdef USE_SATURATE_VPLC
-static int32_t g_saturate;  // -1 if saturating vplc is requested, 0 else
-# define set_saturate(dosaturate) g_saturate = -(int)!!dosaturate
-#else
-# define set_saturate(dosaturate) UNREFERENCED_PARAMETER(dosaturate)
-#endif
-
 void setupmvlineasm(int32_t neglogy, int32_t dosaturate)
 {
     glogy = neglogy;
@@ -366,6 +705,11 @@ int32_t mvlineasm1(int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc,
         return vplc;
     }
 
+#ifdef A_C_SIMD
+    if (a_c_simdshift(logy))
+        A_C_DISPATCH(mvlineasm1, (cnt, buf, pal, logy, vinc, vplc, pp));
+#endif
+
     do
     {
 
@@ -385,6 +729,12 @@ void mvlineasm4(bssize_t cnt, char *p)
 {
     char *const A_C_RESTRICT pal[4] = {(char *)palookupoffse[0], (char *)palookupoffse[1], (char *)palookupoffse[2], (char *)palookupoffse[3]};
     char *const A_C_RESTRICT buf[4] = {(char *)bufplce[0], (char *)bufplce[1], (char *)bufplce[2], (char *)bufplce[3]};
+
+#ifdef A_C_SIMD
+    if (a_c_simdshift(glogy))
+        A_C_DISPATCH(mvlineasm4, (cnt, p, pal, buf, glogy));
+#endif
+
 #ifdef USE_VECTOR_EXT
     uint32_vec4 vinc = {(uint32_t)vince[0], (uint32_t)vince[1], (uint32_t)vince[2], (uint32_t)vince[3]};
     uint32_vec4 vplc = {vplce[0], vplce[1], vplce[2], vplce[3]};
@@ -480,6 +830,11 @@ int32_t tvlineasm1(int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc,
 
     uint8_t const shift = transm<<3;
 
+#ifdef A_C_SIMD
+    if (a_c_simdshift(logy))
+        A_C_DISPATCH(tvlineasm1, (cnt, buf, pal, logy, vinc, vplc, pp));
+#endif
+
     do
     {
         ch = getpix(logy, buf, vplc);
@@ -500,6 +855,52 @@ void setuptvlineasm2(int32_t neglogy, intptr_t paloffs1, intptr_t paloffs2)
     gpal2 = (char *)paloffs2;
 }
 
+#ifdef A_C_SIMD
+// Both columns of lanes/2 rows per iteration, leaving at least one row for the scalar loop.
+template <int lanes, int mode>
+static FORCE_INLINE void tvlineasm2_simd(bssize_t &cnt, const char *const A_C_RESTRICT buf1, const char *const A_C_RESTRICT buf2,
+                                         int32_t const logy, int32_t const vinc1, int32_t const vinc2,
+                                         uint32_t &vplc1, uint32_t &vplc2, char *&pp)
+{
+    int const rows = lanes/2;
+    a_c_u32<lanes> v, vstep;
+
+    for (int i=0; i<lanes; i++)
+    {
+        v[i] = (i&1) ? vplc2 + (uint32_t)vinc2*(i>>1) : vplc1 + (uint32_t)vinc1*(i>>1);
+        vstep[i] = (uint32_t)((i&1) ? vinc2 : vinc1)*rows;
+    }
+
+    int32_t const ourbpl = bpl;
+    uint8_t const shift = transmode<<3;
+    const char *const A_C_RESTRICT pal1 = gpal;
+    const char *const A_C_RESTRICT pal2 = gpal2;
+    bssize_t c = cnt;
+    char *d = pp;
+
+    for (; c>rows; c-=rows, d+=ourbpl*rows)
+    {
+        if (a_c_saturates<mode>(v[0], vinc1, rows) || a_c_saturates<mode>(v[1], vinc2, rows))
+            break;
+
+        a_c_u32<lanes> const idx = v>>logy;
+#define TVLINE2_PIX(i) a_c_putpix<mode>(d+ourbpl*((i)>>1)+((i)&1), ((i)&1) ? pal2 : pal1, (((i)&1) ? buf2 : buf1)[A_C_LANE(idx, i)], shift);
+        A_C_UNROLL(TVLINE2_PIX);
+#undef TVLINE2_PIX
+        v += vstep;
+    }
+
+    cnt = c;
+    pp = d;
+    vplc1 = v[0];
+    vplc2 = v[1];
+}
+
+A_C_SIMD_KERNEL(tvlineasm2, tvlineasm2_simd, A_C_TRANS,
+    (bssize_t &cnt, const char *buf1, const char *buf2, int32_t logy, int32_t vinc1, int32_t vinc2, uint32_t &vplc1, uint32_t &vplc2, char *&pp),
+    (cnt, buf1, buf2, logy, vinc1, vinc2, vplc1, vplc2, pp))
+#endif
+
 // Pass: asm1=vinc2, asm2=pend
 // Return: asm1=vplc1, asm2=vplc2
 void tvlineasm2(uint32_t vplc2, int32_t vinc1, intptr_t bufplc1, intptr_t bufplc2, uint32_t vplc1, intptr_t p)
@@ -519,6 +920,11 @@ void tvlineasm2(uint32_t vplc2, int32_t vinc1, intptr_t bufplc1, intptr_t bufplc
 
     uint8_t const shift = transm<<3;
 
+#ifdef A_C_SIMD
+    if (a_c_simdshift(logy))
+        A_C_DISPATCH(tvlineasm2, (cnt, buf1, buf2, logy, vinc1, vinc2, vplc1, vplc2, pp));
+#endif
+
     do
     {
         ch = getpix(logy, buf1, vplc1);
@@ -540,6 +946,46 @@ void tvlineasm2(uint32_t vplc2, int32_t vinc1, intptr_t bufplc1, intptr_t bufplc
 }
 
 //Floor sprite horizontal line functions
+#ifdef A_C_SIMD
+// Leaves at least one pixel for the scalar do/while loops.
+template <int lanes, int mode>
+static FORCE_INLINE void mhline_simd(int32_t &cnt, uint32_t &bx, uint32_t &by, int32_t const xinc, int32_t const yinc, intptr_t &p)
+{
+    A_C_RAMP(ramp);
+
+    a_c_u32<lanes> u = bx + ramp*(uint32_t)xinc;
+    a_c_u32<lanes> v = by + ramp*(uint32_t)yinc;
+    uint32_t const ustep = (uint32_t)xinc*lanes, vstep = (uint32_t)yinc*lanes;
+    int32_t const logy = glogy, shx = 32-glogx, shy = 32-glogy;
+    const char *const A_C_RESTRICT buf = gbuf;
+    const char *const A_C_RESTRICT pal = gpal;
+    uint8_t const shift = transmode<<3;
+    int32_t c = cnt;
+    char *d = (char *)p;
+
+    for (; c>lanes; c-=lanes, d+=lanes)
+    {
+        a_c_u32<lanes> const idx = ((u>>shx)<<logy)+(v>>shy);
+#define MHLINE_PIX(i) a_c_putpix<mode>(d+(i), pal, buf[A_C_LANE(idx, i)], shift);
+        A_C_UNROLL(MHLINE_PIX);
+#undef MHLINE_PIX
+        u += ustep;
+        v += vstep;
+    }
+
+    cnt = c;
+    p = (intptr_t)d;
+    bx = u[0];
+    by = v[0];
+}
+
+# define A_C_MHLINE_PARAMS (int32_t &cnt, uint32_t &bx, uint32_t &by, int32_t xinc, int32_t yinc, intptr_t &p)
+# define A_C_MHLINE_ARGS (cnt, bx, by, xinc, yinc, p)
+
+A_C_SIMD_KERNEL(mhline, mhline_simd, A_C_MASKED, A_C_MHLINE_PARAMS, A_C_MHLINE_ARGS)
+A_C_SIMD_KERNEL(thline, mhline_simd, A_C_TRANS, A_C_MHLINE_PARAMS, A_C_MHLINE_ARGS)
+#endif
+
 void msethlineshift(int32_t logx, int32_t logy) { glogx = logx; glogy = logy; }
 // cntup16>>16 + 1 iterations
 void mhline(intptr_t bufplc, uint32_t bx, int32_t cntup16, int32_t junk, uint32_t by, intptr_t p)
@@ -555,6 +1001,12 @@ void mhline(intptr_t bufplc, uint32_t bx, int32_t cntup16, int32_t junk, uint32_
 
     cntup16>>=16;
     cntup16++;
+
+#ifdef A_C_SIMD
+    if (a_c_simdshift(glogx) && a_c_simdshift(glogy))
+        A_C_DISPATCH(mhline, (cntup16, bx, by, xinc, yinc, p));
+#endif
+
     do
     {
         ch = gbuf[((bx>>(32-glogx))<<glogy)+(by>>(32-glogy))];
@@ -584,6 +1036,11 @@ void thline(intptr_t bufplc, uint32_t bx, int32_t cntup16, int32_t junk, uint32_
 
     uint8_t const shift = transmode<<3;
 
+#ifdef A_C_SIMD
+    if (a_c_simdshift(glogx) && a_c_simdshift(glogy))
+        A_C_DISPATCH(thline, (cntup16, bx, by, xinc, yinc, p));
+#endif
+
     do
     {
         ch = gbuf[((bx>>(32-glogx))<<glogy)+(by>>(32-glogy))];
@@ -597,6 +1054,48 @@ void thline(intptr_t bufplc, uint32_t bx, int32_t cntup16, int32_t junk, uint32_
 
 
 //Rotatesprite vertical line functions
+#ifdef A_C_SIMD
+// cnt-1 pixels
+template <int lanes, int mode>
+static FORCE_INLINE void spritevline_simd(int32_t &bx, int32_t &by, bssize_t &cnt, intptr_t &p)
+{
+    A_C_RAMP(ramp);
+
+    a_c_u32<lanes> u = (uint32_t)bx + ramp*(uint32_t)gbxinc;
+    a_c_u32<lanes> v = (uint32_t)by + ramp*(uint32_t)gbyinc;
+    uint32_t const ustep = (uint32_t)gbxinc*lanes, vstep = (uint32_t)gbyinc*lanes;
+    uint32_t const ysiz = glogy;
+    int32_t const ourbpl = bpl;
+    const char *const A_C_RESTRICT buf = gbuf;
+    const char *const A_C_RESTRICT pal = gpal;
+    uint8_t const shift = transmode<<3;
+    bssize_t c = cnt;
+    char *d = (char *)p;
+
+    for (; c>lanes; c-=lanes, d+=ourbpl*lanes)
+    {
+        a_c_u32<lanes> const idx = (a_c_u32<lanes>)((a_c_i32<lanes>)u>>16)*ysiz+(a_c_u32<lanes>)((a_c_i32<lanes>)v>>16);
+#define SPRITE_PIX(i) a_c_putpix<mode>(d+ourbpl*(i), pal, buf[(int32_t)A_C_LANE(idx, i)], shift);
+        A_C_UNROLL(SPRITE_PIX);
+#undef SPRITE_PIX
+        u += ustep;
+        v += vstep;
+    }
+
+    cnt = c;
+    p = (intptr_t)d;
+    bx = u[0];
+    by = v[0];
+}
+
+# define A_C_SPRITEVLINE_PARAMS (int32_t &bx, int32_t &by, bssize_t &cnt, intptr_t &p)
+# define A_C_SPRITEVLINE_ARGS (bx, by, cnt, p)
+
+A_C_SIMD_KERNEL(spritevline, spritevline_simd, A_C_OPAQUE, A_C_SPRITEVLINE_PARAMS, A_C_SPRITEVLINE_ARGS)
+A_C_SIMD_KERNEL(mspritevline, spritevline_simd, A_C_MASKED, A_C_SPRITEVLINE_PARAMS, A_C_SPRITEVLINE_ARGS)
+A_C_SIMD_KERNEL(tspritevline, spritevline_simd, A_C_TRANS, A_C_SPRITEVLINE_PARAMS, A_C_SPRITEVLINE_ARGS)
+#endif
+
 void setupspritevline(intptr_t paloffs, int32_t bxinc, int32_t byinc, int32_t ysiz)
 {
     gpal = (char *)paloffs;
@@ -607,6 +1106,11 @@ void setupspritevline(intptr_t paloffs, int32_t bxinc, int32_t byinc, int32_t ys
 void spritevline(int32_t bx, int32_t by, bssize_t cnt, intptr_t bufplc, intptr_t p)
 {
     gbuf = (char *)bufplc;
+
+#ifdef A_C_SIMD
+    A_C_DISPATCH(spritevline, (bx, by, cnt, p));
+#endif
+
     for (; cnt>1; cnt--)
     {
         (*(char *)p) = gpal[gbuf[(bx>>16)*glogy+(by>>16)]];
@@ -629,6 +1133,11 @@ void mspritevline(int32_t bx, int32_t by, bssize_t cnt, intptr_t bufplc, intptr_
     char ch;
 
     gbuf = (char *)bufplc;
+
+#ifdef A_C_SIMD
+    A_C_DISPATCH(mspritevline, (bx, by, cnt, p));
+#endif
+
     for (; cnt>1; cnt--)
     {
         ch = gbuf[(bx>>16)*glogy+(by>>16)];
@@ -652,6 +1161,10 @@ void tspritevline(int32_t bx, int32_t by, bssize_t cnt, intptr_t bufplc, intptr_
 
     gbuf = (char *)bufplc;
 
+#ifdef A_C_SIMD
+    A_C_DISPATCH(tspritevline, (bx, by, cnt, p));
+#endif
+
     uint8_t const shift = transmode<<3;
 
     for (; cnt>1; cnt--)
@@ -3,11 +3,13 @@
 #include "a.h"
 #include "build.h"
 #include "cache1d.h"
+#include "classicmt.h"
 #include "communityapi.h"
 #include "compat.h"
 #include "osd.h"
 #include "polymost.h"
 #include "renderlayer.h"
+#include "sectorbvh.h"
 
 #define MINICORO_IMPL
 #define MCO_LOG initprintf
@@ -769,6 +771,30 @@ static int osdcmd_displayindex(osdcmdptr_t parm)
     return OSDCMD_OK;
 }
 
+static int osdcmd_tracebench(osdcmdptr_t parm)
+{
+    int32_t const numtraces = parm->numparms >= 1 ? Batol(parm->parms[0]) : 100000;
+
+    if (numtraces <= 0)
+        return OSDCMD_SHOWHELP;
+
+    sectorbvhBenchmark(numtraces);
+
+    return OSDCMD_OK;
+}
+
+static int osdcmd_clipbench(osdcmdptr_t parm)
+{
+    int32_t const numrounds = parm->numparms >= 1 ? Batol(parm->parms[0]) : 100;
+
+    if (numrounds <= 0)
+        return OSDCMD_SHOWHELP;
+
+    clipmoveBenchmark(numrounds);
+
+    return OSDCMD_OK;
+}
+
 static int osdcmd_cvar_set_baselayer(osdcmdptr_t parm)
 {
     int32_t r = osdcmd_cvar_set(parm);
@@ -799,7 +825,11 @@ int32_t baselayer_init(void)
 #endif
     static osdcvardata_t cvars_engine[] =
     {
+        { "clipmovethreads", "number of threads moving independent objects in batched clipmove calls (0/1: disabled)", (void *)&clipmove_threads, CVAR_INT, 0, 64 },
         { "lz4compressionlevel","adjust LZ4 compression level used for savegames",(void *) &lz4CompressionLevel, CVAR_INT, 1, 32 },
+#ifdef CLASSIC_MT
+        { "r_classicthreads", "number of threads drawing walls, ceilings and floors in the classic renderer (0/1: disabled)", (void *)&r_classicthreads, CVAR_INT, 0, 64 },
+#endif
         { "r_borderless", "borderless windowed mode: 0: never  1: always  2: if resolution matches desktop", (void *) &r_borderless, CVAR_INT|CVAR_RESTARTVID, 0, 2 },
         { "r_usenewaspect","enable/disable new screen aspect ratio determination code",(void *) &r_usenewaspect, CVAR_BOOL, 0, 1 },
         { "r_screenaspect","if using r_usenewaspect and in fullscreen, screen aspect ratio in the form XXYY, e.g. 1609 for 16:9",
@@ -818,6 +848,7 @@ int32_t baselayer_init(void)
         { "vid_contrast","contrast correction",(void *) &g_videoContrast, CVAR_FLOAT|CVAR_FUNCPTR, (int)floor(MIN_CONTRAST), (int)ceil(MAX_CONTRAST) },
         { "vid_saturation","saturation correction",(void *) &g_videoSaturation, CVAR_FLOAT|CVAR_FUNCPTR, (int)floor(MIN_SATURATION), (int)ceil(MAX_SATURATION) },
         { "screenshot_dir", "Screenshot save path",  (void*)screenshot_dir, CVAR_STRING, 0, sizeof(screenshot_dir) - 1 },
+        { "sectorbvh", "enable/disable per-sector wall trees for hitscan, cansee and clipmove", (void *)&sectorbvh_enabled, CVAR_BOOL, 0, 1 },
 #ifdef DEBUGGINGAIDS
         { "debug1","debug counter",(void *) &debug1, CVAR_FLOAT, -100000, 100000 },
         { "debug2","debug counter",(void *) &debug2, CVAR_FLOAT, -100000, 100000 },
@@ -833,6 +864,9 @@ int32_t baselayer_init(void)
     static osdcvardata_t displayindex = { "r_displayindex","index of output display",(void*)&r_displayindex, CVAR_INT | CVAR_FUNCPTR, 0, 8 };
     OSD_RegisterCvar(&displayindex, osdcmd_displayindex);
 
+    OSD_RegisterFunction("tracebench", "tracebench [traces]: times hitscan and cansee on the current map with and without sector trees", osdcmd_tracebench);
+    OSD_RegisterFunction("clipbench", "clipbench [rounds]: times moving every sprite on the current map with clipmove one at a time and batched", osdcmd_clipbench);
+
 #ifdef USE_OPENGL
     OSD_RegisterFunction("setrendermode","setrendermode <number>: sets the engine's rendering mode.\n"
                          "Mode numbers are:\n"
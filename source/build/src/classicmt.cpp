@@ -0,0 +1,258 @@
+// Multithreaded column/span fill for the classic renderer
+// See classicmt.h for an overview.
+
+#include "a.h"
+#include "build.h"
+#include "classicmt.h"
+#include "microprofile.h"
+
+#include "libasync_config.h"
+
+#ifdef CLASSIC_MT
+
+extern intptr_t palookupoffse[4];
+extern uint32_t vplce[4];
+extern int32_t vince[4];
+extern intptr_t bufplce[4];
+
+int32_t r_classicthreads = 0;
+bool classicmt_recording;
+
+#define CLASSICMT_MAXSTRIPS 64
+#define CLASSICMT_MINSTRIPWIDTH 16
+
+enum
+{
+    CMD_VLINE,
+    CMD_HLINE,
+};
+
+typedef struct
+{
+    intptr_t p, pal, buf;
+    uint32_t u, v;
+    int32_t  uinc, vinc;
+    int32_t  cnt;        // number of pixels
+    int32_t  tilesizy;   // vline with logy == 0 only
+    uint8_t  type, logx, logy;
+} classicmtcmd_t;
+
+typedef struct
+{
+    classicmtcmd_t *cmd;
+    int32_t num, cap;
+    int32_t x1, x2;      // window-relative, inclusive
+} classicmtstrip_t;
+
+static classicmtstrip_t strips[CLASSICMT_MAXSTRIPS];
+static int32_t numstrips;
+static uint8_t stripofx[MAXXDIM];
+static int32_t stripbpl;
+static int32_t pendingcmds;
+
+static async::threadpool_scheduler *classicmt_pool;
+static int32_t classicmt_poolthreads;
+
+static FORCE_INLINE classicmtcmd_t *classicmtAlloc(int32_t const strip)
+{
+    auto &s = strips[strip];
+
+    if (EDUKE32_PREDICT_FALSE(s.num == s.cap))
+    {
+        s.cap = s.cap ? s.cap << 1 : 1024;
+        s.cmd = (classicmtcmd_t *)Xrealloc(s.cmd, s.cap * sizeof(classicmtcmd_t));
+    }
+
+    pendingcmds++;
+    return &s.cmd[s.num++];
+}
+
+static void classicmtSetupPool(int32_t const numthreads)
+{
+    if (numthreads == classicmt_poolthreads)
+        return;
+
+    delete classicmt_pool;
+    classicmt_pool = nullptr;
+
+    // the thread calling classicmtFlush() fills strips too
+    if ((classicmt_poolthreads = numthreads) > 1)
+        classicmt_pool = new async::threadpool_scheduler(numthreads - 1);
+}
+
+void classicmtBeginFrame(int32_t const xdim, int32_t const bpl)
+{
+    int32_t const numthreads = min(min(r_classicthreads, CLASSICMT_MAXSTRIPS), xdim / CLASSICMT_MINSTRIPWIDTH);
+
+    classicmtSetupPool(numthreads);
+
+    if (numthreads <= 1)
+    {
+        classicmt_recording = false;
+        return;
+    }
+
+    numstrips = numthreads;
+    stripbpl  = bpl;
+
+    for (int i = 0; i < numstrips; i++)
+    {
+        strips[i].x1 = i * xdim / numstrips;
+        strips[i].x2 = (i + 1) * xdim / numstrips - 1;
+
+        for (int x = strips[i].x1; x <= strips[i].x2; x++)
+            stripofx[x] = i;
+    }
+
+    classicmt_recording = true;
+}
+
+void classicmtEndFrame(void)
+{
+    if (!classicmt_recording)
+        return;
+
+    classicmtFlush();
+    classicmt_recording = false;
+}
+
+void classicmtUninit(void)
+{
+    classicmt_recording = false;
+    classicmtSetupPool(0);
+
+    for (auto &s : strips)
+    {
+        DO_FREE_AND_NULL(s.cmd);
+        s.num = s.cap = 0;
+    }
+}
+
+int32_t classicmtVline(int32_t const x, int32_t const logy, int32_t const tilesizy, int32_t const vinc, intptr_t const paloffs,
+                       bssize_t const cnt, uint32_t const vplc, intptr_t const bufplc, intptr_t const p)
+{
+    auto c = classicmtAlloc(stripofx[x]);
+
+    c->type     = CMD_VLINE;
+    c->p        = p;
+    c->pal      = paloffs;
+    c->buf      = bufplc;
+    c->v        = vplc;
+    c->vinc     = vinc;
+    c->cnt      = cnt + 1;
+    c->logy     = logy;
+    c->tilesizy = tilesizy;
+
+    return vplc + vinc * (uint32_t)(cnt + 1);
+}
+
+void classicmtVline4(int32_t const x, int32_t const logy, int32_t const tilesizy, bssize_t const cnt, intptr_t const p)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        classicmtVline(x + i, logy, tilesizy, vince[i], palookupoffse[i], cnt - 1, vplce[i], bufplce[i], p + i);
+        vplce[i] += vince[i] * (uint32_t)cnt;
+    }
+}
+
+void classicmtHline(int32_t const xr, int32_t const logx, int32_t const logy, intptr_t const buf, intptr_t const pal,
+                    int32_t const bxinc, int32_t const byinc, bssize_t const cnt, uint32_t const by, uint32_t const bx,
+                    intptr_t const p)
+{
+    int32_t const xl = xr - cnt;
+
+    // split the span at strip boundaries, rightmost piece first like the kernel
+    for (int s = stripofx[xr], end = stripofx[xl]; s >= end; s--)
+    {
+        int32_t const hi = min(xr, strips[s].x2);
+        int32_t const lo = max(xl, strips[s].x1);
+        uint32_t const skip = xr - hi;
+
+        auto c = classicmtAlloc(s);
+
+        c->type = CMD_HLINE;
+        c->p    = p - skip;
+        c->pal  = pal;
+        c->buf  = buf;
+        c->u    = bx - bxinc * skip;
+        c->v    = by - byinc * skip;
+        c->uinc = bxinc;
+        c->vinc = byinc;
+        c->cnt  = hi - lo + 1;
+        c->logx = logx;
+        c->logy = logy;
+    }
+}
+
+// These must produce exactly the same pixels as vlineasm1() and hlineasm4() in a-c.cpp.
+
+static void classicmtDoVline(classicmtcmd_t const &c, int32_t const bpl)
+{
+    char const *const A_C_RESTRICT buf = (char const *)c.buf;
+    char const *const A_C_RESTRICT pal = (char const *)c.pal;
+    char *pp = (char *)c.p;
+    uint32_t vplc = c.v;
+    int32_t const vinc = c.vinc, logy = c.logy;
+
+    if (logy)
+    {
+        for (int32_t cnt = c.cnt; cnt > 0; cnt--, pp += bpl, vplc += vinc)
+            *pp = pal[buf[vplc >> logy]];
+    }
+    else
+    {
+        uint32_t const tilesizy = c.tilesizy;
+
+        for (int32_t cnt = c.cnt; cnt > 0; cnt--, pp += bpl, vplc += vinc)
+            *pp = pal[buf[((uint64_t)vplc * tilesizy) >> 32]];
+    }
+}
+
+static void classicmtDoHline(classicmtcmd_t const &c)
+{
+    char const *const A_C_RESTRICT buf = (char const *)c.buf;
+    char const *const A_C_RESTRICT pal = (char const *)c.pal;
+    char *pp = (char *)c.p;
+    uint32_t bx = c.u, by = c.v;
+    vec2_t const log = { c.logx, c.logy };
+    vec2_t const log32 = { 32 - log.x, 32 - log.y };
+
+    for (int32_t cnt = c.cnt; cnt > 0; cnt--, pp--)
+    {
+        *pp = pal[buf[((bx >> log32.x) << log.y) + (by >> log32.y)]];
+        bx -= c.uinc;
+        by -= c.vinc;
+    }
+}
+
+static void classicmtFillStrip(int32_t const strip)
+{
+    auto &s = strips[strip];
+    int32_t const bpl = stripbpl;
+
+    for (int i = 0; i < s.num; i++)
+    {
+        auto const &c = s.cmd[i];
+
+        if (c.type == CMD_VLINE)
+            classicmtDoVline(c, bpl);
+        else
+            classicmtDoHline(c);
+    }
+
+    s.num = 0;
+}
+
+void classicmtFlush(void)
+{
+    if (!pendingcmds)
+        return;
+
+    MICROPROFILE_SCOPEI("Engine", EDUKE32_FUNCTION, MP_AUTO);
+
+    async::parallel_for(*classicmt_pool, async::irange(0, numstrips), classicmtFillStrip);
+
+    pendingcmds = 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+// Multithreaded column/span fill for the classic renderer
+//
+// The bunch traversal in renderDrawRoomsQ16() stays serial: it is what
+// decides which pixels belong to which wall, ceiling or floor.  What it
+// produces in the end is a stream of vertical wall columns and horizontal
+// ceiling/floor spans, and that is where the time goes at high resolutions.
+// While recording, wallscan() and hline() append those draws to per-strip
+// queues instead of calling the a-c.cpp kernels, and classicmtFlush() fills
+// the vertical screen strips in parallel.  Each strip replays its queue in
+// submission order, and the opaque pass writes every pixel at most once, so
+// the result is byte-identical to the serial path.
+
+#pragma once
+
+#ifndef classicmt_h_
+#define classicmt_h_
+
+#include "a.h"
+#include "compat.h"
+
+// The replay kernels mirror the C versions in a-c.cpp.
+#ifdef ENGINE_USING_A_C
+# define CLASSIC_MT
+
+extern int32_t r_classicthreads;
+extern bool classicmt_recording;
+
+void classicmtBeginFrame(int32_t xdim, int32_t bpl);
+void classicmtEndFrame(void);
+void classicmtFlush(void);
+void classicmtUninit(void);
+
+// Same arguments and return value as vlineasm1(); x is the window-relative column.
+int32_t classicmtVline(int32_t x, int32_t logy, int32_t tilesizy, int32_t vinc, intptr_t paloffs, bssize_t cnt,
+                       uint32_t vplc, intptr_t bufplc, intptr_t p);
+// Equivalent of vlineasm4(), reads and updates vplce[] like the original.
+void classicmtVline4(int32_t x, int32_t logy, int32_t tilesizy, bssize_t cnt, intptr_t p);
+// Same arguments as hlineasm4() with explicit state; xr is the window-relative column of p.
+void classicmtHline(int32_t xr, int32_t logx, int32_t logy, intptr_t buf, intptr_t pal, int32_t bxinc, int32_t byinc,
+                    bssize_t cnt, uint32_t by, uint32_t bx, intptr_t p);
+
+// Pending draws may reference tile data that a cache allocation can evict.
+static FORCE_INLINE void classicmtFlushBeforeLoad(void)
+{
+    if (classicmt_recording)
+        classicmtFlush();
+}
+
+#endif
+
+#endif
@@ -12,19 +12,24 @@
 #include "clip.h"
 #include "engine_priv.h"
 #include "microprofile.h"
-
-static int16_t clipnum;
-static linetype clipit[MAXCLIPNUM];
-static int32_t clipsectnum, origclipsectnum, clipspritenum;
-int16_t clipsectorlist[MAXCLIPSECTORS];
-static int16_t origclipsectorlist[MAXCLIPSECTORS];
-static uint8_t clipsectormap[bitmap_size(MAXSECTORS)];
-static uint8_t origclipsectormap[bitmap_size(MAXSECTORS)];
+#include "sectorbvh.h"
+#include "timer.h"
+
+#include "libasync_config.h"
+
+// per thread so that clipmoveBatch() can run independent moves concurrently
+static thread_local int16_t clipnum;
+static thread_local linetype clipit[MAXCLIPNUM];
+static thread_local int32_t clipsectnum, origclipsectnum, clipspritenum;
+thread_local int16_t clipsectorlist[MAXCLIPSECTORS];
+static thread_local int16_t origclipsectorlist[MAXCLIPSECTORS];
+static thread_local uint8_t clipsectormap[bitmap_size(MAXSECTORS)];
+static thread_local uint8_t origclipsectormap[bitmap_size(MAXSECTORS)];
 #ifdef HAVE_CLIPSHAPE_FEATURE
-static int16_t clipspritelist[MAXCLIPNUM];  // sector-like sprite clipping
+static thread_local int16_t clipspritelist[MAXCLIPNUM];  // sector-like sprite clipping
 #endif
-static int16_t clipobjectval[MAXCLIPNUM];
-static uint8_t clipignore[bitmap_size(MAXCLIPNUM)];
+static thread_local int16_t clipobjectval[MAXCLIPNUM];
+static thread_local uint8_t clipignore[bitmap_size(MAXCLIPNUM)];
 
 #ifdef YAX_ENABLE
 static int16_t layerclipsectorlist[MAXCLIPSECTORS];
@@ -38,7 +43,7 @@ static int32_t layerclipsectnum;
 #define YAX_MAXCLIPSECTORS 256
 
 // Prevent iterating over the same sectors repeatedly in clipmove().
-static uint8_t yax_clipsectmap[bitmap_size(MAXSECTORS)];
+static thread_local uint8_t yax_clipsectmap[bitmap_size(MAXSECTORS)];
 
 // flags sectors that have been discovered using TROR traversal
 static uint8_t yax_hitscan_ceilmap[bitmap_size(MAXSECTORS)];
@@ -615,7 +620,7 @@ int clipinsidebox(vec2_t const vect, int const wallnum, int const walldist)
 }
 
 
-static int32_t clipmove_warned;
+static thread_local int32_t clipmove_warned;
 
 static inline void addclipsect(int const sectnum)
 {
@@ -890,22 +895,6 @@ static int cliptestsector(int const dasect, int const nextsect, int32_t const fl
     }
 }
 
-int32_t clipmovex(vec3_t *pos, int16_t *sectnum,
-                  int32_t xvect, int32_t yvect,
-                  int32_t const walldist, int32_t const ceildist, int32_t const flordist, uint32_t const cliptype,
-                  uint8_t const noslidep)
-{
-    const int32_t oboxtracenum = clipmoveboxtracenum;
-
-    if (noslidep)
-        clipmoveboxtracenum = 1;
-    int32_t ret = clipmove(pos, sectnum, xvect, yvect,
-        walldist, ceildist, flordist, cliptype);
-    clipmoveboxtracenum = oboxtracenum;
-
-    return ret;
-}
-
 //
 // raytrace (internal)
 //
@@ -1032,9 +1021,9 @@ static int clipupdatesector(vec2_t const pos, int16_t * const sectnum, int walld
         walldist = 0x7fff;
     }
 
-    static int16_t sectlist[MAXSECTORS];
-    static uint8_t sectbitmap[bitmap_size(MAXSECTORS)];
-    static uint8_t insidemap[bitmap_size(MAXSECTORS)];
+    static thread_local int16_t sectlist[MAXSECTORS];
+    static thread_local uint8_t sectbitmap[bitmap_size(MAXSECTORS)];
+    static thread_local uint8_t insidemap[bitmap_size(MAXSECTORS)];
 
     Bmemset(insidemap, 0, sizeof(insidemap));
     bitmap_set(insidemap, *sectnum);
@@ -1162,6 +1151,8 @@ void clipmove_compat(vec3_t* const pos, int16_t*sectnum)
 static void clipmove_sprite(vec3_t * const pos, int32_t const spriteClipSector, int32_t const walldist, int32_t const ceildist, int32_t const flordist,
                             int32_t const dasprclipmask, vec2_t const clipMin, vec2_t const clipMax, vec2_t const cent, vec2_t const diff, int32_t const rad)
 {
+    int32_t rxi[4], ryi[4];  // not the engine's, this can run on several threads
+
     for (native_t j=headspritesect[spriteClipSector]; j>=0; j=nextspritesect[j])
     {
         auto const spr = (uspriteptr_t)&sprite[j];
@@ -1475,11 +1466,14 @@ void clipmove_errorlogger(vec3_t* const pos, int32_t xvect, int32_t yvect)
     }
 }
 
-//
-// clipmove
-//
-int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int32_t yvect,
-                 int32_t const walldist, int32_t const ceildist, int32_t const flordist, uint32_t const cliptype)
+static FORCE_INLINE int32_t clipmove_getrad(vec2_t const diff, int32_t const walldist)
+{
+    return ksqrt_inline(compat_maybe_truncate_to_int32(uhypsq(diff.x, diff.y))) + MAXCLIPDIST + walldist + 8;
+}
+
+static int32_t clipmove_boxtrace(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int32_t yvect,
+                                 int32_t const walldist, int32_t const ceildist, int32_t const flordist, uint32_t const cliptype,
+                                 int32_t const boxtracenum)
 {
     if ((xvect|yvect) == 0 || *sectnum < 0)
         return 0;
@@ -1497,7 +1491,7 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
 
     //Extra walldist for sprites on sector lines
     vec2_t const  diff    = { goal.x - (pos->x), goal.y - (pos->y) };
-    int32_t const rad     = ksqrt_inline(compat_maybe_truncate_to_int32(uhypsq(diff.x, diff.y))) + MAXCLIPDIST + walldist + 8;
+    int32_t const rad     = clipmove_getrad(diff, walldist);
     vec2_t const  clipMin = { cent.x - rad, cent.y - rad };
     vec2_t const  clipMax = { cent.x + rad, cent.y + rad };
 
@@ -1565,10 +1559,17 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
         auto const sec       = (usectorptr_t)&sector[dasect];
         int const  startwall = sec->wallptr;
         int const  endwall   = startwall + sec->wallnum;
-        auto       wal       = (uwallptr_t)&wall[startwall];
 
-        for (native_t j=startwall; j<endwall; j++, wal++)
+        sectorbvhwalls_t walls;
+
+        if (curspr)
+            sectorbvhGetAllWalls(dasect, &walls);
+        else
+            sectorbvhGetBoxWalls(dasect, clipMin, clipMax, &walls);
+
+        for (native_t j = sectorbvhFirstWall(&walls); j >= 0; j = sectorbvhNextWall(&walls, j))
         {
+            auto const wal  = (uwallptr_t)&wall[j];
             auto const wal2 = (uwallptr_t)&wall[wal->point2];
 
             if ((wal->x < clipMin.x && wal2->x < clipMin.x) || (wal->x > clipMax.x && wal2->x > clipMax.x) ||
@@ -1730,7 +1731,7 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
     int32_t hitwalls[4] = {}, hitwall;
     int32_t clipReturn = 0;
 
-    native_t cnt = clipmoveboxtracenum;
+    native_t cnt = boxtracenum;
 
     // In ENGINE_EDUKE32 mode, the loop below may become endless in edge cases. This variable ensures that it will break out eventually.
     native_t failsafe_cnt = cnt;
@@ -1778,7 +1779,7 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
             else
                 tempint = dmulscale6(clipr.x, move.x, clipr.y, move.y);
 
-            for (native_t i=cnt+1, j; i<=clipmoveboxtracenum; ++i)
+            for (native_t i=cnt+1, j; i<=boxtracenum; ++i)
             {
                 j = hitwalls[i];
 
@@ -1803,7 +1804,7 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
             xvect = (goal.x-vec.x)<<14;
             yvect = (goal.y-vec.y)<<14;
 
-            if (cnt == clipmoveboxtracenum)
+            if (cnt == boxtracenum)
                 clipReturn = (uint16_t) clipobjectval[hitwall];
             hitwalls[cnt] = hitwall;
         }
@@ -1826,6 +1827,316 @@ int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int
     return clipReturn;
 }
 
+//
+// clipmove
+//
+int32_t clipmove(vec3_t * const pos, int16_t * const sectnum, int32_t xvect, int32_t yvect,
+                 int32_t const walldist, int32_t const ceildist, int32_t const flordist, uint32_t const cliptype)
+{
+    return clipmove_boxtrace(pos, sectnum, xvect, yvect, walldist, ceildist, flordist, cliptype, clipmoveboxtracenum);
+}
+
+int32_t clipmovex(vec3_t *pos, int16_t *sectnum,
+                  int32_t xvect, int32_t yvect,
+                  int32_t const walldist, int32_t const ceildist, int32_t const flordist, uint32_t const cliptype,
+                  uint8_t const noslidep)
+{
+    return clipmove_boxtrace(pos, sectnum, xvect, yvect, walldist, ceildist, flordist, cliptype, noslidep ? 1 : clipmoveboxtracenum);
+}
+
+////////// CLIPMOVE BATCHES //////////
+
+// Moves only affect each other through sprites: clipmove() reads the sprites
+// around its clipping box and writes *pos, which is usually a sprite's
+// position.  Every item gets a read box around what its clipmove() can look
+// at and, when pos belongs to a sprite, a write box around everything that
+// sprite's clip lines can cover before, during and after the move.  Two items
+// depend on each other when either one's write box overlaps the other's read
+// box.  Each item is put in the wave after the last one holding an earlier
+// item it depends on, so the items of a wave can run concurrently while any
+// two dependent items still run in their given order.  The results don't
+// depend on the number of threads or on timing.
+
+#define CLIPMOVEBATCH_CHUNK 1024       // items scheduled at once, bounds the pairwise dependency test
+#define CLIPMOVEBATCH_MINPARALLEL 4    // smaller waves aren't worth handing to the pool
+
+int32_t clipmove_threads = 0;
+
+typedef struct
+{
+    int64_t rxmin, rymin, rxmax, rymax;
+    int64_t wxmin, wymin, wxmax, wymax;  // empty when pos isn't a sprite's
+    int32_t wave;
+} clipmovebatchbox_t;
+
+static clipmovebatchbox_t clipmovebatchbox[CLIPMOVEBATCH_CHUNK];
+static int16_t clipmovebatchorder[CLIPMOVEBATCH_CHUNK];
+static int16_t clipmovebatchwavestart[CLIPMOVEBATCH_CHUNK + 1];
+
+static async::threadpool_scheduler *clipmove_pool;
+static int32_t clipmove_poolthreads;
+
+static void clipmoveSetupPool(int32_t const numthreads)
+{
+    if (numthreads == clipmove_poolthreads)
+        return;
+
+    delete clipmove_pool;
+    clipmove_pool = nullptr;
+
+    // the thread calling clipmoveBatch() moves items too
+    if ((clipmove_poolthreads = numthreads) > 1)
+        clipmove_pool = new async::threadpool_scheduler(numthreads - 1);
+}
+
+static FORCE_INLINE void clipmoveRunItem(clipmoveitem_t * const item)
+{
+    item->retval = clipmove_boxtrace(item->pos, item->sectnum, item->xvect, item->yvect, item->walldist, item->ceildist, item->flordist,
+                                     item->cliptype, item->noslide ? 1 : clipmoveboxtracenum);
+}
+
+// How far the clip lines clipmove_sprite() makes from a sprite can be from its position.
+static int32_t clipmoveSpriteReach(uspriteptr_t const spr)
+{
+    if ((spr->cstat & CSTAT_SPRITE_ALIGNMENT_MASK) == CSTAT_SPRITE_ALIGNMENT_FACING)
+        return 0;
+
+    int const     tilenum = spr->picnum;
+    int32_t const ofs     = klabs(picanm[tilenum].xofs) + klabs(picanm[tilenum].yofs) + klabs(spr->xoffset) + klabs(spr->yoffset);
+
+    return (((tilesiz[tilenum].x + tilesiz[tilenum].y + ofs) * max(spr->xrepeat, spr->yrepeat)) >> 1) + 16;
+}
+
+static void clipmoveGetBatchBox(clipmoveitem_t const &item, clipmovebatchbox_t * const box)
+{
+    box->rxmin = box->rymin = box->wxmin = box->wymin = INT64_MAX;
+    box->rxmax = box->rymax = box->wxmax = box->wymax = INT64_MIN;
+
+    // clipmove() returns right away for these
+    if ((item.xvect|item.yvect) == 0 || *item.sectnum < 0)
+        return;
+
+    vec2_t const pos  = item.pos->xy;
+    vec2_t const diff = { item.xvect >> 14, item.yvect >> 14 };
+    vec2_t const cent = { pos.x + (diff.x >> 1), pos.y + (diff.y >> 1) };
+    int64_t const rad = clipmove_getrad(diff, item.walldist) + 1;
+
+    box->rxmin = (int64_t)cent.x - rad, box->rxmax = (int64_t)cent.x + rad;
+    box->rymin = (int64_t)cent.y - rad, box->rymax = (int64_t)cent.y + rad;
+
+    uintptr_t const ofs = (uintptr_t)item.pos - (uintptr_t)&sprite[0].xyz;
+    int const spritenum = ofs / sizeof(spritetype);
+
+    if (ofs >= sizeof(spritetype) * MAXSPRITES || item.pos != &sprite[spritenum].xyz)
+        return;
+
+    // Sliding never takes the goal further from the start than the original
+    // move, and each of the few keepaway() pushes is shorter than 2*walldist.
+    int64_t const reach = (int64_t)klabs(diff.x) + klabs(diff.y) + 16 * (int64_t)klabs(item.walldist) + 256
+                          + clipmoveSpriteReach((uspriteptr_t)&sprite[spritenum]);
+
+    box->wxmin = (int64_t)pos.x - reach, box->wxmax = (int64_t)pos.x + reach;
+    box->wymin = (int64_t)pos.y - reach, box->wymax = (int64_t)pos.y + reach;
+}
+
+static FORCE_INLINE bool clipmoveBoxesOverlap(clipmovebatchbox_t const &r, clipmovebatchbox_t const &w)
+{
+    return r.rxmin <= w.wxmax && w.wxmin <= r.rxmax && r.rymin <= w.wymax && w.wymin <= r.rymax;
+}
+
+static bool clipmoveDependent(clipmoveitem_t const &a, clipmovebatchbox_t const &abox, clipmoveitem_t const &b, clipmovebatchbox_t const &bbox)
+{
+    return a.pos == b.pos || a.sectnum == b.sectnum || clipmoveBoxesOverlap(abox, bbox) || clipmoveBoxesOverlap(bbox, abox);
+}
+
+static void clipmoveBatchChunk(clipmoveitem_t * const items, int32_t const numitems)
+{
+    int32_t numwaves = 0;
+
+    for (int i = 0; i < numitems; i++)
+    {
+        auto &box = clipmovebatchbox[i];
+
+        clipmoveGetBatchBox(items[i], &box);
+        box.wave = 0;
+
+        for (int j = 0; j < i; j++)
+        {
+            auto const &other = clipmovebatchbox[j];
+
+            if (other.wave >= box.wave && clipmoveDependent(items[i], box, items[j], other))
+                box.wave = other.wave + 1;
+        }
+
+        numwaves = max(numwaves, box.wave + 1);
+    }
+
+    // counting sort by wave, keeping the items of each wave in their given order
+    Bmemset(clipmovebatchwavestart, 0, (numwaves + 1) * sizeof(clipmovebatchwavestart[0]));
+
+    for (int i = 0; i < numitems; i++)
+        clipmovebatchwavestart[clipmovebatchbox[i].wave + 1]++;
+
+    for (int i = 0; i < numwaves; i++)
+        clipmovebatchwavestart[i + 1] += clipmovebatchwavestart[i];
+
+    for (int i = 0; i < numitems; i++)
+        clipmovebatchorder[clipmovebatchwavestart[clipmovebatchbox[i].wave]++] = i;
+
+    // the pass above left each start at the next wave's
+    for (int i = numwaves; i > 0; i--)
+        clipmovebatchwavestart[i] = clipmovebatchwavestart[i - 1];
+
+    clipmovebatchwavestart[0] = 0;
+
+    for (int wave = 0; wave < numwaves; wave++)
+    {
+        int const start = clipmovebatchwavestart[wave];
+        int const end   = clipmovebatchwavestart[wave + 1];
+
+        if (end - start < CLIPMOVEBATCH_MINPARALLEL)
+        {
+            for (int i = start; i < end; i++)
+                clipmoveRunItem(&items[clipmovebatchorder[i]]);
+            continue;
+        }
+
+        async::parallel_for(*clipmove_pool, async::irange(start, end), [items](int const i) { clipmoveRunItem(&items[clipmovebatchorder[i]]); });
+    }
+}
+
+void clipmoveBatch(clipmoveitem_t * const items, int32_t const numitems)
+{
+    MICROPROFILE_SCOPEI("Engine", EDUKE32_FUNCTION, MP_AUTO);
+
+    clipmoveSetupPool(clipmove_threads);
+
+    // clip shapes swap out sector[] and wall[] while they're being tested, and
+    // updatesector() and the other compatibility paths share their search state
+    bool const serial = clipmove_poolthreads <= 1 || numitems < 2 || enginecompatibilitymode != ENGINE_EDUKE32 || numyaxbunches > 0
+#ifdef HAVE_CLIPSHAPE_FEATURE
+                        || numclipmaps > 0
+#endif
+                        ;
+
+    if (serial)
+    {
+        for (int i = 0; i < numitems; i++)
+            clipmoveRunItem(&items[i]);
+
+        return;
+    }
+
+    // the trees get refit lazily otherwise, which isn't safe from several threads
+    sectorbvhRefresh();
+
+    for (int i = 0; i < numitems; i += CLIPMOVEBATCH_CHUNK)
+        clipmoveBatchChunk(&items[i], min(numitems - i, CLIPMOVEBATCH_CHUNK));
+}
+
+static double clipmoveMilliseconds(uint64_t const ticks)
+{
+    return ticks * 1000.0 / timerGetPerformanceFrequency();
+}
+
+void clipmoveBenchmark(int32_t const numrounds)
+{
+    if (numsectors <= 0)
+    {
+        LOG_F(ERROR, "clipbench: no map loaded.");
+        return;
+    }
+
+    auto const items      = (clipmoveitem_t *)Xmalloc(MAXSPRITES * sizeof(clipmoveitem_t));
+    auto const sectnums   = (int16_t *)Xmalloc(MAXSPRITES * sizeof(int16_t));
+    auto const retvals    = (int32_t *)Xmalloc(MAXSPRITES * sizeof(int32_t));
+    auto const startpos   = (vec3_t *)Xmalloc(MAXSPRITES * sizeof(vec3_t));
+    auto const startsects = (int16_t *)Xmalloc(MAXSPRITES * sizeof(int16_t));
+    auto const endpos     = (vec3_t *)Xmalloc(MAXSPRITES * sizeof(vec3_t));
+    auto const endsects   = (int16_t *)Xmalloc(MAXSPRITES * sizeof(int16_t));
+
+    uint32_t seed = 0x1337;
+    uint64_t ticks[2] = {};
+    int32_t n = 0, mismatches = 0;
+
+    for (int round = 0; round < numrounds; round++)
+    {
+        n = 0;
+
+        for (int i = 0; i < MAXSPRITES; i++)
+        {
+            auto const &spr = sprite[i];
+
+            if (spr.statnum == MAXSTATUS || (unsigned)spr.sectnum >= (unsigned)numsectors)
+                continue;
+
+            seed = seed * 1664525 + 1013904223;
+
+            int const     ang  = (seed >> 8) & 2047;
+            int32_t const dist = (seed >> 20) & 1023;
+
+            startpos[n]   = spr.xyz;
+            startsects[n] = spr.sectnum;
+            items[n]      = { &sprite[i].xyz, &sectnums[n], sintable[(ang + 512) & 2047] * dist, sintable[ang] * dist,
+                              spr.clipdist << 2, 4 << 8, 4 << 8, 0x10001, (uint8_t)(round & 1), 0 };
+            n++;
+        }
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                *items[i].pos = startpos[i];
+                sectnums[i]   = startsects[i];
+            }
+
+            uint64_t const t = timerGetPerformanceCounter();
+
+            if (pass == 0)
+            {
+                for (int i = 0; i < n; i++)
+                    items[i].retval = clipmovex(items[i].pos, items[i].sectnum, items[i].xvect, items[i].yvect, items[i].walldist,
+                                                items[i].ceildist, items[i].flordist, items[i].cliptype, items[i].noslide);
+            }
+            else
+                clipmoveBatch(items, n);
+
+            ticks[pass] += timerGetPerformanceCounter() - t;
+
+            for (int i = 0; i < n; i++)
+            {
+                if (pass == 0)
+                {
+                    retvals[i]  = items[i].retval;
+                    endpos[i]   = *items[i].pos;
+                    endsects[i] = sectnums[i];
+                }
+                else if (items[i].retval != retvals[i] || sectnums[i] != endsects[i] || items[i].pos->x != endpos[i].x
+                         || items[i].pos->y != endpos[i].y || items[i].pos->z != endpos[i].z)
+                    mismatches++;
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+            *items[i].pos = startpos[i];
+    }
+
+    LOG_F(INFO, "clipbench: %d rounds of %d moves over %d sectors with %d threads", numrounds, n, numsectors, max(clipmove_poolthreads, 1));
+    LOG_F(INFO, "  clipmove: %9.3f ms one at a time, %9.3f ms batched, %d mismatches", clipmoveMilliseconds(ticks[0]),
+          clipmoveMilliseconds(ticks[1]), mismatches);
+
+    if (mismatches)
+        LOG_F(ERROR, "clipbench: batched results differ from sequential ones!");
+
+    Xfree(endsects);
+    Xfree(endpos);
+    Xfree(startsects);
+    Xfree(startpos);
+    Xfree(retvals);
+    Xfree(sectnums);
+    Xfree(items);
+}
+
 
 //
 // pushmove
@@ -2870,7 +3181,7 @@ int32_t hitscan(const vec3_t *sv, int16_t sectnum, int32_t vx, int32_t vy, int32
 
     do
     {
-        int32_t dasector, z, startwall, endwall;
+        int32_t dasector, z;
 
 #ifdef HAVE_CLIPSHAPE_FEATURE
         if (tempshortcnt >= tempshortnum)
@@ -2933,8 +3244,15 @@ int32_t hitscan(const vec3_t *sv, int16_t sectnum, int32_t vx, int32_t vy, int32
 
         ////////// Walls //////////
 
-        startwall = sec->wallptr; endwall = startwall + sec->wallnum;
-        for (z=startwall; z<endwall; z++)
+        sectorbvhwalls_t walls;
+
+        // clip shapes swap in their own sector[] and wall[]
+        if (enginecompatibilitymode == ENGINE_EDUKE32 && !curspr)
+            sectorbvhGetRayWalls(dasector, sv->xy, { vx, vy }, klabs(hit->x-sv->x)+klabs(hit->y-sv->y), &walls);
+        else
+            sectorbvhGetAllWalls(dasector, &walls);
+
+        for (z = sectorbvhFirstWall(&walls); z >= 0; z = sectorbvhNextWall(&walls, z))
         {
             auto const wal  = (uwallptr_t)&wall[z];
             auto const wal2 = (uwallptr_t)&wall[wal->point2];
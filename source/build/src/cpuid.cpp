@@ -13,6 +13,17 @@ cpuinfo_t cpu;
 # include <cpuid.h>
 #endif
 
+static inline uint64_t sysReadXCR0(void)
+{
+#ifdef _WIN32
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
 static char g_cpuVendorIDString[16];
 static char g_cpuBrandString[48];
 
@@ -36,6 +47,35 @@ void sysReadCPUID()
 
     cpu.vendorIDString = g_cpuVendorIDString;
 
+    auto const maxleaf = (unsigned)regs[0];
+
+    if (maxleaf >= 1)
+    {
+#ifdef _WIN32
+        __cpuid(regs, 1);
+#else
+        __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        cpu.features.sse2   = (regs[3] & (1 << 26)) != 0;
+        cpu.features.sse4_1 = (regs[2] & (1 << 19)) != 0;
+
+        // AVX state has to be enabled by the OS before any YMM register may be touched
+        bool const osxsave = (regs[2] & (1 << 27)) != 0;
+        bool const avx     = (regs[2] & (1 << 28)) != 0;
+
+        if (osxsave && avx && maxleaf >= 7 && (sysReadXCR0() & 6) == 6)
+        {
+#ifdef _WIN32
+            __cpuidex(regs, 7, 0);
+#else
+            __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+            cpu.features.avx2 = (regs[1] & (1 << 5)) != 0;
+        }
+    }
+
+    DVLOG_F(LOG_DEBUG, "CPUID features: sse2: %d sse4.1: %d avx2: %d", cpu.features.sse2, cpu.features.sse4_1, cpu.features.avx2);
+
     //if (!Bstrcmp(g_cpuVendorIDString, "GenuineIntel"))
     //    cpu.type = CPU_INTEL;
     //else if (!Bstrcmp(g_cpuVendorIDString, "AuthenticAMD"))
@@ -81,6 +121,11 @@ void sysReadCPUID()
 }
 #else
 
-void sysReadCPUID() { }
+void sysReadCPUID()
+{
+#if defined __ARM_NEON || defined __ARM_NEON__
+    cpu.features.neon = 1;
+#endif
+}
 
 #endif  // EDUKE32_CPU_X86
@@ -12,6 +12,7 @@
 #include "baselayer.h"
 #include "build.h"
 #include "cache1d.h"
+#include "classicmt.h"
 #include "colmatch.h"
 #include "common.h"
 #include "communityapi.h"
@@ -23,12 +24,16 @@
 #include "kplib.h"
 #include "lz4.h"
 #include "microprofile.h"
+#include "mio.hpp"
 #include "osd.h"
 #include "palette.h"
 #include "pragmas.h"
 #include "scriptfile.h"
+#include "sectorbvh.h"
 #include "softsurface.h"
+#include "spritegrid.h"
 #include "vfs.h"
+#include "xxhash_config.h"
 
 #ifdef USE_OPENGL
 # include "glad/glad.h"
@@ -64,6 +69,7 @@ float debug1, debug2;
 
 int32_t mapversion=7; // JBF 20040211: default mapversion to 7
 int32_t g_loadedMapVersion = -1;  // -1: none (e.g. started new)
+int32_t g_mapCache = 1;
 
 static int32_t get_mapversion(void);
 
@@ -211,6 +217,9 @@ classicht_t *tileLoadHigh(int dapicnum)
 
     if (!cht->ptr)
     {
+#ifdef CLASSIC_MT
+        classicmtFlushBeforeLoad();
+#endif
         int32_t xsiz = 0, ysiz = 0;
         int32_t const length = kpzbufload(si->filename);
 
@@ -281,6 +290,8 @@ invalid:
 static classicht_t *globalht;
 
 static uint8_t *reachablesectors;
+static size_t reachabilitytablesize;
+static uint16_t reachabilitycrc;
 int16_t wallsect[MAXWALLS];
 
 void initcrc16()
@@ -1521,6 +1532,9 @@ static int32_t globalzd;
 static int32_t globalyscale;
 static int32_t globalxspan, globalyspan, globalispow2=1;  // true if texture has power-of-two x and y size
 static intptr_t globalbufplc;
+#ifdef CLASSIC_MT
+static vec2_t globalhlinesiz;  // log2 sizes passed to sethlinesizes()
+#endif
 
 static int32_t globaly1, globalx2;
 
@@ -2071,7 +2085,13 @@ intptr_t tileLoadScaled(int const picnum, vec2_16_t *upscale/* = nullptr*/)
     }
     else
     {
-        if (waloff[picnum] == 0) tileLoad(picnum);
+        if (waloff[picnum] == 0)
+        {
+#ifdef CLASSIC_MT
+            classicmtFlushBeforeLoad();
+#endif
+            tileLoad(picnum);
+        }
         bufplc = waloff[picnum];
     }
 
@@ -2357,6 +2377,16 @@ static inline void hline(int32_t xr, int32_t yp)
     asm2 = (inthi_t)mulscale6(globaly2, r);
     int32_t const s = getpalookupsh(mulscale22(r,globvis));
 
+#ifdef CLASSIC_MT
+    if (classicmt_recording)
+    {
+        classicmtHline(xr, globalhlinesiz.x, globalhlinesiz.y, globalbufplc, (intptr_t)globalpalwritten + s, asm1, asm2,
+                       xr-xl, (uint32_t)mulscale6(globalx2,r)+globalypanning, (uint32_t)mulscale6(globaly1,r)+globalxpanning,
+                       ylookup[yp]+xr+frameoffset);
+        return;
+    }
+#endif
+
     hlineasm4(xr-xl,0,s,(uint32_t)mulscale6(globalx2,r)+globalypanning,(uint32_t)mulscale6(globaly1,r)+globalxpanning,
               ylookup[yp]+xr+frameoffset);
 }
@@ -2874,6 +2904,9 @@ static int32_t setup_globals_cf1(usectorptr_t sec, int32_t pal, int32_t zd,
     globalx2 = (globalx2-globaly2)*halfxdimen;
 
     sethlinesizes((picsiz[globalpicnum]&15)+upscale.x,(picsiz[globalpicnum]>>4)+upscale.y,globalbufplc);
+#ifdef CLASSIC_MT
+    globalhlinesiz = { (picsiz[globalpicnum]&15)+upscale.x, (picsiz[globalpicnum]>>4)+upscale.y };
+#endif
 
     globalx2 += globaly2*(x1-1);
     globaly1 += globalx1*(x1-1);
@@ -3082,6 +3115,43 @@ static void florscan(int32_t x1, int32_t x2, int32_t sectnum)
 }
 
 
+// Kernel wrappers for wallscan(), x is the window-relative column of p.
+static FORCE_INLINE int32_t wallscan_vlineasm1(int32_t x, int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc, intptr_t bufplc, intptr_t p)
+{
+#ifdef CLASSIC_MT
+    if (classicmt_recording)
+        return classicmtVline(x, globalshiftval, globaltilesizy, vinc, paloffs, cnt, vplc, bufplc, p);
+#else
+    UNREFERENCED_PARAMETER(x);
+#endif
+    return vlineasm1(vinc, paloffs, cnt, vplc, bufplc, p);
+}
+
+static FORCE_INLINE int32_t wallscan_prevlineasm1(int32_t x, int32_t vinc, intptr_t paloffs, bssize_t cnt, uint32_t vplc, intptr_t bufplc, intptr_t p)
+{
+#ifdef CLASSIC_MT
+    if (classicmt_recording)
+        return classicmtVline(x, globalshiftval, globaltilesizy, vinc, paloffs, cnt, vplc, bufplc, p);
+#else
+    UNREFERENCED_PARAMETER(x);
+#endif
+    return prevlineasm1(vinc, paloffs, cnt, vplc, bufplc, p);
+}
+
+static FORCE_INLINE void wallscan_vlineasm4(int32_t x, bssize_t cnt, char *p)
+{
+#ifdef CLASSIC_MT
+    if (classicmt_recording)
+    {
+        classicmtVline4(x, globalshiftval, globaltilesizy, cnt, (intptr_t)p);
+        return;
+    }
+#else
+    UNREFERENCED_PARAMETER(x);
+#endif
+    vlineasm4(cnt, p);
+}
+
 //
 // wallscan (internal)
 //
@@ -3151,7 +3221,7 @@ static void wallscan(int32_t x1, int32_t x2,
         calc_bufplc(&bufplce[0], lwal[x], tsiz);
         calc_vplcinc(&vplce[0], &vince[0], swal, x, y1ve[0]);
 
-        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],x+frameoffset+ylookup[y1ve[0]]);
+        wallscan_vlineasm1(x,vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],x+frameoffset+ylookup[y1ve[0]]);
     }
     for (; x<=x2-3; x+=4)
     {
@@ -3186,25 +3256,25 @@ static void wallscan(int32_t x1, int32_t x2,
 
         if ((bad != 0) || (u4 >= d4))
         {
-            if (!(bad&1)) prevlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0],vplce[0],bufplce[0],ylookup[y1ve[0]]+x+frameoffset+0);
-            if (!(bad&2)) prevlineasm1(vince[1],palookupoffse[1],y2ve[1]-y1ve[1],vplce[1],bufplce[1],ylookup[y1ve[1]]+x+frameoffset+1);
-            if (!(bad&4)) prevlineasm1(vince[2],palookupoffse[2],y2ve[2]-y1ve[2],vplce[2],bufplce[2],ylookup[y1ve[2]]+x+frameoffset+2);
-            if (!(bad&8)) prevlineasm1(vince[3],palookupoffse[3],y2ve[3]-y1ve[3],vplce[3],bufplce[3],ylookup[y1ve[3]]+x+frameoffset+3);
+            if (!(bad&1)) wallscan_prevlineasm1(x+0,vince[0],palookupoffse[0],y2ve[0]-y1ve[0],vplce[0],bufplce[0],ylookup[y1ve[0]]+x+frameoffset+0);
+            if (!(bad&2)) wallscan_prevlineasm1(x+1,vince[1],palookupoffse[1],y2ve[1]-y1ve[1],vplce[1],bufplce[1],ylookup[y1ve[1]]+x+frameoffset+1);
+            if (!(bad&4)) wallscan_prevlineasm1(x+2,vince[2],palookupoffse[2],y2ve[2]-y1ve[2],vplce[2],bufplce[2],ylookup[y1ve[2]]+x+frameoffset+2);
+            if (!(bad&8)) wallscan_prevlineasm1(x+3,vince[3],palookupoffse[3],y2ve[3]-y1ve[3],vplce[3],bufplce[3],ylookup[y1ve[3]]+x+frameoffset+3);
             continue;
         }
 
-        if (u4 > y1ve[0]) vplce[0] = prevlineasm1(vince[0],palookupoffse[0],u4-y1ve[0]-1,vplce[0],bufplce[0],ylookup[y1ve[0]]+x+frameoffset+0);
-        if (u4 > y1ve[1]) vplce[1] = prevlineasm1(vince[1],palookupoffse[1],u4-y1ve[1]-1,vplce[1],bufplce[1],ylookup[y1ve[1]]+x+frameoffset+1);
-        if (u4 > y1ve[2]) vplce[2] = prevlineasm1(vince[2],palookupoffse[2],u4-y1ve[2]-1,vplce[2],bufplce[2],ylookup[y1ve[2]]+x+frameoffset+2);
-        if (u4 > y1ve[3]) vplce[3] = prevlineasm1(vince[3],palookupoffse[3],u4-y1ve[3]-1,vplce[3],bufplce[3],ylookup[y1ve[3]]+x+frameoffset+3);
+        if (u4 > y1ve[0]) vplce[0] = wallscan_prevlineasm1(x+0,vince[0],palookupoffse[0],u4-y1ve[0]-1,vplce[0],bufplce[0],ylookup[y1ve[0]]+x+frameoffset+0);
+        if (u4 > y1ve[1]) vplce[1] = wallscan_prevlineasm1(x+1,vince[1],palookupoffse[1],u4-y1ve[1]-1,vplce[1],bufplce[1],ylookup[y1ve[1]]+x+frameoffset+1);
+        if (u4 > y1ve[2]) vplce[2] = wallscan_prevlineasm1(x+2,vince[2],palookupoffse[2],u4-y1ve[2]-1,vplce[2],bufplce[2],ylookup[y1ve[2]]+x+frameoffset+2);
+        if (u4 > y1ve[3]) vplce[3] = wallscan_prevlineasm1(x+3,vince[3],palookupoffse[3],u4-y1ve[3]-1,vplce[3],bufplce[3],ylookup[y1ve[3]]+x+frameoffset+3);
 
-        if (d4 >= u4) vlineasm4(d4-u4+1, (char *)(ylookup[u4]+x+frameoffset));
+        if (d4 >= u4) wallscan_vlineasm4(x, d4-u4+1, (char *)(ylookup[u4]+x+frameoffset));
 
         p = x+frameoffset+ylookup[d4+1];
-        if (y2ve[0] > d4) prevlineasm1(vince[0],palookupoffse[0],y2ve[0]-d4-1,vplce[0],bufplce[0],p+0);
-        if (y2ve[1] > d4) prevlineasm1(vince[1],palookupoffse[1],y2ve[1]-d4-1,vplce[1],bufplce[1],p+1);
-        if (y2ve[2] > d4) prevlineasm1(vince[2],palookupoffse[2],y2ve[2]-d4-1,vplce[2],bufplce[2],p+2);
-        if (y2ve[3] > d4) prevlineasm1(vince[3],palookupoffse[3],y2ve[3]-d4-1,vplce[3],bufplce[3],p+3);
+        if (y2ve[0] > d4) wallscan_prevlineasm1(x+0,vince[0],palookupoffse[0],y2ve[0]-d4-1,vplce[0],bufplce[0],p+0);
+        if (y2ve[1] > d4) wallscan_prevlineasm1(x+1,vince[1],palookupoffse[1],y2ve[1]-d4-1,vplce[1],bufplce[1],p+1);
+        if (y2ve[2] > d4) wallscan_prevlineasm1(x+2,vince[2],palookupoffse[2],y2ve[2]-d4-1,vplce[2],bufplce[2],p+2);
+        if (y2ve[3] > d4) wallscan_prevlineasm1(x+3,vince[3],palookupoffse[3],y2ve[3]-d4-1,vplce[3],bufplce[3],p+3);
     }
 #endif
 
@@ -3227,7 +3297,7 @@ do_vlineasm1:
             vlineasm1nonpow2(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],x+frameoffset+ylookup[y1ve[0]]);
         else
 #endif
-        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],x+frameoffset+ylookup[y1ve[0]]);
+        wallscan_vlineasm1(x,vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],x+frameoffset+ylookup[y1ve[0]]);
     }
 
     faketimerhandler();
@@ -8807,6 +8877,7 @@ int32_t insertsprite(int16_t sectnum, int16_t statnum)
         Bassert((unsigned)sectnum < MAXSECTORS);
 
         do_insertsprite_at_headofsect(newspritenum, sectnum);
+        spritegridUpdate(newspritenum);
         Numsprites++;
     }
 
@@ -8827,6 +8898,7 @@ int32_t deletesprite(int16_t spritenum)
 
     do_deletespritestat(spritenum);
     do_deletespritesect(spritenum);
+    spritegridRemove(spritenum);
 
     // (dummy) insert at tail of sector freelist, compat
     // for code that checks .sectnum==MAXSECTOR
@@ -8866,6 +8938,7 @@ int32_t changespritesect(int16_t spritenum, int16_t newsectnum)
 
     do_deletespritesect(spritenum);
     do_insertsprite_at_headofsect(spritenum, newsectnum);
+    spritegridUpdate(spritenum);
 
     return 0;
 }
@@ -9179,7 +9252,10 @@ int32_t enginePreInit(void)
 
 #if !defined ENGINE_USING_A_C
     mmxoverlay();
+#else
+    a_c_init();
 #endif
+    kpinit();
 
     upscalefactor = 1;
     validmodecnt = 0;
@@ -9187,6 +9263,7 @@ int32_t enginePreInit(void)
 
     initcrc16();
     initcrc32table();
+    spritegridClear();
 
 #ifdef HAVE_CLIPSHAPE_FEATURE
     engineInitClipMaps();
@@ -9289,6 +9366,10 @@ void engineUnInit(void)
 {
     communityapiShutdown();
 
+#ifdef CLASSIC_MT
+    classicmtUninit();
+#endif
+
 #ifdef USE_OPENGL
     if (qsetmode)
     {
@@ -9378,6 +9459,8 @@ void initspritelists(void)
     nextspritesect[MAXSPRITES-1] = -1;
 
 
+    spritegridClear();
+
     for (i=0; i<MAXSTATUS; i++)   //Init doubly-linked sprite status lists
         headspritestat[i] = -1;
     headspritestat[MAXSTATUS] = 0;
@@ -9599,6 +9682,11 @@ int32_t renderDrawRoomsQ16(int32_t daposx, int32_t daposy, int32_t daposz,
 
     frameoffset = frameplace + windowxy1.y*bytesperline + windowxy1.x;
 
+#ifdef CLASSIC_MT
+    // ylookup[1] is the pitch calc_ylookup() passed to setvlinebpl(), also when rendering to a tile
+    classicmtBeginFrame(xdimen, ylookup[1]);
+#endif
+
     numhits = xdimen; numscans = 0; numbunches = 0;
     maskwallcnt = 0; smostwallcnt = 0; smostcnt = 0; spritesortcnt = 0;
 
@@ -9658,6 +9746,9 @@ int32_t renderDrawRoomsQ16(int32_t daposx, int32_t daposy, int32_t daposz,
         if (numbunches==0)
         {
             inpreparemirror = 0;
+#ifdef CLASSIC_MT
+            classicmtEndFrame();
+#endif
             videoEndDrawing();  //!!!
             return 0;
         }
@@ -9746,6 +9837,9 @@ int32_t renderDrawRoomsQ16(int32_t daposx, int32_t daposy, int32_t daposz,
         bunchlast[closest] = bunchlast[numbunches];
     }
 
+#ifdef CLASSIC_MT
+    classicmtEndFrame();
+#endif
     videoEndDrawing();   //}}}
 
     return inpreparemirror;
@@ -10838,20 +10932,18 @@ void calc_sector_reachability(void)
     if (!numsectors)
         return;
 
-    static size_t tablesize = 0;
-    static uint16_t sectcrc = 0;
     uint16_t crc = getcrc16(sector, sizeof(sectortype) * numsectors, 0x1337);
 
-    if (reachablesectors && sectcrc == crc && tablesize == getreachabilitybitmapsize())
+    if (reachablesectors && reachabilitycrc == crc && reachabilitytablesize == getreachabilitybitmapsize())
         return;
 
-    sectcrc = crc;
+    reachabilitycrc = crc;
 
-    if (!reachablesectors || tablesize != getreachabilitybitmapsize())
+    if (!reachablesectors || reachabilitytablesize != getreachabilitybitmapsize())
     {
-        tablesize = getreachabilitybitmapsize();
+        reachabilitytablesize = getreachabilitybitmapsize();
         DO_FREE_AND_NULL(reachablesectors);
-        reachablesectors = (uint8_t *)Xcalloc(1, tablesize);
+        reachablesectors = (uint8_t *)Xcalloc(1, reachabilitytablesize);
     }
 
     Bmemset(wallsect, -1, sizeof(wallsect));
@@ -11002,6 +11094,7 @@ static int32_t engineFinishLoadBoard(const vec3_t* dapos, int16_t* dacursectnum,
     Bmemset(tilecols, 0, sizeof(tilecols));
 
     calc_sector_reachability();
+    sectorbvhBuild();
 
     return numremoved;
 }
@@ -11061,6 +11154,278 @@ int32_t (*loadboard_maptext)(buildvfs_kfd fil, vec3_t *dapos, int16_t *daang, in
 
 #include "md4.h"
 
+static int32_t engineGetMapMD4(buildvfs_kfd fil, uint8_t *md4)
+{
+    int32_t const pos = ktell(fil), length = kfilelength(fil);
+
+    if (auto const data = kfiledata(fil))
+    {
+        md4once((unsigned char const *)data, length, md4);
+        return 0;
+    }
+
+    auto fullboard = (uint8_t *)Xmalloc(length);
+
+    if (klseek_and_test(fil, 0, SEEK_SET) || kread_and_test(fil, fullboard, length))
+    {
+        Xfree(fullboard);
+        return -1;
+    }
+
+    md4once(fullboard, length, md4);
+    Xfree(fullboard);
+
+    return klseek_and_test(fil, pos, SEEK_SET) ? -1 : 0;
+}
+
+//////////////////// MAP CACHE ////////////////////
+
+// A binary map that was loaded in the game is written to "<map>.cache" in the working directory
+// as it stands after the sprites have been checked and yax_update() has run, together with the
+// reachability table and the TROR bunch arrays.  The sections are stored exactly as they are laid
+// out in memory and start on cache line boundaries, so loading the map again maps the file, checks
+// its header and hash and copies the sections back.  The cache is keyed by the MD4 of the map file,
+// which sv_loadBoardMD4() and the usermaphacks use anyway, and by the sizes of the structs and arrays
+// it holds; anything that doesn't match is rewritten.  The editor always parses the map, as
+// yax_update() leaves the map in a different state there.
+
+#if !defined NEW_MAP_FORMAT && !defined USE_PHYSFS
+# define USE_MAPCACHE
+#endif
+
+#ifdef USE_MAPCACHE
+#define MAPCACHE_VERSION   1
+#define MAPCACHE_ALIGNMENT 64
+
+static char const s_mapCacheMagic[8] = { 'E', 'D', 'U', 'K', 'E', 'M', 'A', 'P' };
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    int32_t  mapversion;
+    uint8_t  md4[16];
+    uint16_t sectorsize, wallsize, spritesize, maxbunches;
+    int32_t  maxsectors, maxwalls, maxsprites;
+    int16_t  numsectors, numwalls, numsprites, numbunches;
+    uint32_t reachabilitysize;
+    uint32_t sectorofs, wallofs, spriteofs, reachabilityofs, wallsectofs, bunchofs;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t hash;  // of everything after the header
+} mapcacheheader_t;
+
+EDUKE32_STATIC_ASSERT(sizeof(mapcacheheader_t) == 104);
+
+static void engineGetMapCacheName(char *buf, size_t const len, char const *filename)
+{
+    char const *name = Bstrrchr(filename, '/');
+
+    if (!name)
+        name = Bstrrchr(filename, '\\');
+
+    Bsnprintf(buf, len, "%s.cache", name ? name + 1 : filename);
+}
+
+#ifdef YAX_ENABLE
+// yax_bunchnum and yax_nextwall of the map's sectors and walls, then headsectbunch and
+// the map's part of nextsectbunch
+static FORCE_INLINE size_t engineGetMapCacheBunchSize(int32_t const numsects, int32_t const numwals)
+{
+    return numsects * sizeof(yax_bunchnum[0]) + numwals * sizeof(yax_nextwall[0]) + sizeof(headsectbunch)
+           + 2 * numsects * sizeof(nextsectbunch[0][0]);
+}
+#endif
+
+// Lays out the sections and returns the length of the file.
+static uint32_t engineLayoutMapCache(mapcacheheader_t *header)
+{
+    uint32_t ofs = sizeof(mapcacheheader_t);
+
+    auto section = [&ofs](size_t const size) {
+        uint32_t const start = (ofs + MAPCACHE_ALIGNMENT - 1) & ~(MAPCACHE_ALIGNMENT - 1);
+        ofs = start + (uint32_t)size;
+        return start;
+    };
+
+    header->sectorofs       = section(header->numsectors * sizeof(sectortype));
+    header->wallofs         = section(header->numwalls * sizeof(walltype));
+    header->spriteofs       = section(header->numsprites * sizeof(spritetype));
+    header->reachabilityofs = section(header->reachabilitysize);
+    header->wallsectofs     = section(header->numwalls * sizeof(wallsect[0]));
+#ifdef YAX_ENABLE
+    header->bunchofs        = section(engineGetMapCacheBunchSize(header->numsectors, header->numwalls));
+#endif
+
+    return ofs;
+}
+
+static void engineInitMapCacheHeader(mapcacheheader_t *header, int32_t const numsprites)
+{
+    Bmemset(header, 0, sizeof(mapcacheheader_t));
+    Bmemcpy(header->magic, s_mapCacheMagic, sizeof(header->magic));
+    header->version    = MAPCACHE_VERSION;
+    header->mapversion = mapversion;
+    Bmemcpy(header->md4, g_loadedMapHack.md4, sizeof(header->md4));
+
+    header->sectorsize = sizeof(sectortype);
+    header->wallsize   = sizeof(walltype);
+    header->spritesize = sizeof(spritetype);
+#ifdef YAX_ENABLE
+    header->maxbunches = YAX_MAXBUNCHES;
+#endif
+    header->maxsectors = MAXSECTORS;
+    header->maxwalls   = MAXWALLS;
+    header->maxsprites = MAXSPRITES;
+
+    header->numsectors = numsectors;
+    header->numwalls   = numwalls;
+    header->numsprites = numsprites;
+}
+
+static void engineWriteMapCache(char const *filename, int32_t const numsprites)
+{
+    mapcacheheader_t header;
+
+    engineInitMapCacheHeader(&header, numsprites);
+#ifdef YAX_ENABLE
+    header.numbunches = numyaxbunches;
+#endif
+    header.reachabilitysize = reachablesectors ? reachabilitytablesize : 0;
+    header.length = engineLayoutMapCache(&header);
+
+    auto data = (uint8_t *)Xcalloc(1, header.length);
+
+    Bmemcpy(data + header.sectorofs, sector, numsectors * sizeof(sectortype));
+    Bmemcpy(data + header.wallofs, wall, numwalls * sizeof(walltype));
+    Bmemcpy(data + header.spriteofs, sprite, numsprites * sizeof(spritetype));
+    if (header.reachabilitysize)
+        Bmemcpy(data + header.reachabilityofs, reachablesectors, header.reachabilitysize);
+    Bmemcpy(data + header.wallsectofs, wallsect, numwalls * sizeof(wallsect[0]));
+
+#ifdef YAX_ENABLE
+    auto bunches = data + header.bunchofs;
+
+    Bmemcpy(bunches, yax_bunchnum, numsectors * sizeof(yax_bunchnum[0]));
+    bunches += numsectors * sizeof(yax_bunchnum[0]);
+    Bmemcpy(bunches, yax_nextwall, numwalls * sizeof(yax_nextwall[0]));
+    bunches += numwalls * sizeof(yax_nextwall[0]);
+    Bmemcpy(bunches, headsectbunch, sizeof(headsectbunch));
+    bunches += sizeof(headsectbunch);
+
+    for (auto &next : nextsectbunch)
+    {
+        Bmemcpy(bunches, next, numsectors * sizeof(next[0]));
+        bunches += numsectors * sizeof(next[0]);
+    }
+#endif
+
+    header.hash = XXH3_64bits(data + sizeof(header), header.length - sizeof(header));
+    Bmemcpy(data, &header, sizeof(header));
+
+    char fn[BMAX_PATH];
+    engineGetMapCacheName(fn, sizeof(fn), filename);
+
+    buildvfs_FILE fp = buildvfs_fopen_write(fn);
+
+    if (fp)
+    {
+        buildvfs_fwrite(data, header.length, 1, fp);
+        buildvfs_fclose(fp);
+    }
+    else
+        LOG_F(WARNING, "Unable to write map cache %s.", fn);
+
+    Xfree(data);
+}
+
+// Returns the number of sprites, or -1 if there is no usable cache for the map.
+static int32_t engineLoadMapCache(char const *filename)
+{
+    char fn[BMAX_PATH];
+    engineGetMapCacheName(fn, sizeof(fn), filename);
+
+    std::error_code error;
+    mio::mmap_source const map = mio::make_mmap_source(fn, 0, mio::map_entire_file, error);
+
+    if (error || map.size() < sizeof(mapcacheheader_t))
+        return -1;
+
+    auto const data = (uint8_t const *)map.data();
+    mapcacheheader_t header, expected;
+
+    Bmemcpy(&header, data, sizeof(header));
+
+    // a cache of a different map or of a different build of the engine is silently replaced
+    engineInitMapCacheHeader(&expected, header.numsprites);
+
+    if (Bmemcmp(header.magic, expected.magic, offsetof(mapcacheheader_t, numsectors))
+        || (unsigned)header.numsectors > MAXSECTORS || (unsigned)header.numwalls > MAXWALLS
+        || (unsigned)header.numsprites > MAXSPRITES)
+        return -1;
+
+    expected.numsectors = header.numsectors;
+    expected.numwalls   = header.numwalls;
+    expected.reachabilitysize = header.reachabilitysize;
+    expected.length = engineLayoutMapCache(&expected);
+
+    if (header.length != map.size() || header.length != expected.length
+        || Bmemcmp(&header.sectorofs, &expected.sectorofs, offsetof(mapcacheheader_t, length) - offsetof(mapcacheheader_t, sectorofs))
+        || (header.reachabilitysize && header.reachabilitysize != (uint32_t)(header.numsectors * bitmap_size(header.numsectors)))
+#ifdef YAX_ENABLE
+        || (unsigned)header.numbunches > YAX_MAXBUNCHES
+#endif
+        || XXH3_64bits(data + sizeof(header), header.length - sizeof(header)) != header.hash)
+    {
+        LOG_F(WARNING, "Map cache %s is damaged, rebuilding it.", fn);
+        return -1;
+    }
+
+    numsectors = header.numsectors;
+    numwalls   = header.numwalls;
+
+    Bmemcpy(sector, data + header.sectorofs, numsectors * sizeof(sectortype));
+    Bmemcpy(wall, data + header.wallofs, numwalls * sizeof(walltype));
+    Bmemcpy(sprite, data + header.spriteofs, header.numsprites * sizeof(spritetype));
+
+#ifdef YAX_ENABLE
+    // clears the arrays past the end of the map
+    yax_update(1);
+
+    auto bunches = data + header.bunchofs;
+
+    Bmemcpy(yax_bunchnum, bunches, numsectors * sizeof(yax_bunchnum[0]));
+    bunches += numsectors * sizeof(yax_bunchnum[0]);
+    Bmemcpy(yax_nextwall, bunches, numwalls * sizeof(yax_nextwall[0]));
+    bunches += numwalls * sizeof(yax_nextwall[0]);
+    Bmemcpy(headsectbunch, bunches, sizeof(headsectbunch));
+    bunches += sizeof(headsectbunch);
+
+    for (auto &next : nextsectbunch)
+    {
+        Bmemcpy(next, bunches, numsectors * sizeof(next[0]));
+        bunches += numsectors * sizeof(next[0]);
+    }
+
+    numyaxbunches = header.numbunches;
+#endif
+
+    // calc_sector_reachability() in engineFinishLoadBoard() finds the table up to date
+    Bmemset(wallsect, -1, sizeof(wallsect));
+    Bmemcpy(wallsect, data + header.wallsectofs, numwalls * sizeof(wallsect[0]));
+
+    if (header.reachabilitysize)
+    {
+        reachabilitytablesize = header.reachabilitysize;
+        reachabilitycrc = getcrc16(sector, sizeof(sectortype) * numsectors, 0x1337);
+        reachablesectors = (uint8_t *)Xmalloc(reachabilitytablesize);
+        Bmemcpy(reachablesectors, data + header.reachabilityofs, reachabilitytablesize);
+    }
+
+    return header.numsprites;
+}
+#endif
+
 // flags: 1, 2: former parameter "fromwhere"
 //           4: don't call polymer_loadboard
 //           8: don't autoexec <mapname>.cfg
@@ -11121,6 +11486,17 @@ int32_t engineLoadBoard(const char *filename, char flags, vec3_t *dapos, int16_t
 
     if (enginePrepareLoadBoard(fil, dapos, daang, dacursectnum)) goto error;
 
+    if (engineGetMapMD4(fil, g_loadedMapHack.md4)) goto error;
+
+#ifdef USE_MAPCACHE
+    if (g_mapCache && !editstatus && (numsprites = engineLoadMapCache(filename)) >= 0)
+    {
+        kclose(fil);
+        g_loadedMapVersion = mapversion;
+        goto skip_parsing_map;
+    }
+#endif
+
 #ifdef NEW_MAP_FORMAT
     if (have_maptext())
     {
@@ -11225,22 +11601,17 @@ int32_t engineLoadBoard(const char *filename, char flags, vec3_t *dapos, int16_t
 
     if (kread_and_test(fil, sprite, sizeof(spritetype)*numsprites)) goto error;
 
-    int const pos = ktell(fil), len = kfilelength(fil);
+    {
+        int const pos = ktell(fil), len = kfilelength(fil);
 
-    if (pos != len)
-        LOG_F(WARNING, "Ignoring %d bytes of unknown data appended to map file. Saving changes to this file will result in loss of this data.", len - pos);
+        if (pos != len)
+            LOG_F(WARNING, "Ignoring %d bytes of unknown data appended to map file. Saving changes to this file will result in loss of this data.", len - pos);
+    }
 
 #ifdef NEW_MAP_FORMAT
 skip_reading_mapbin:
 #endif
 
-    klseek(fil, 0, SEEK_SET);
-    int32_t boardsize = kfilelength(fil);
-    uint8_t *fullboard = (uint8_t*)Xmalloc(boardsize);
-    if (kread_and_test(fil, fullboard, boardsize)) { Xfree(fullboard); goto error; }
-    md4once(fullboard, boardsize, g_loadedMapHack.md4);
-    Xfree(fullboard);
-
     kclose(fil);
     // Done reading file.
 
@@ -11277,6 +11648,19 @@ skip_reading_mapbin:
     g_loadedMapVersion = mapversion;
 #ifdef YAX_ENABLE
     yax_update(mapversion<9);
+#endif
+
+#ifdef USE_MAPCACHE
+    if (g_mapCache && !editstatus)
+    {
+        calc_sector_reachability();
+        engineWriteMapCache(filename, numsprites);
+    }
+
+skip_parsing_map:
+#endif
+
+#ifdef YAX_ENABLE
     if (editstatus)
         yax_updategrays(dapos->z);
 #endif
@@ -12565,12 +12949,16 @@ int32_t setsprite(int16_t spritenum, const vec3_t *newpos)
     if ((void const *) newpos != (void *) &sprite[spritenum])
         sprite[spritenum].xyz = *newpos;
 
+    spriteMarkChanged(spritenum);
+
     updatesector(newpos->x,newpos->y,&tempsectnum);
 
     if (tempsectnum < 0)
         return -1;
     if (tempsectnum != sprite[spritenum].sectnum)
         changespritesect(spritenum,tempsectnum);
+    else
+        spritegridUpdate(spritenum);
 
     return 0;
 }
@@ -12582,12 +12970,16 @@ int32_t setspritez(int16_t spritenum, const vec3_t *newpos)
     if ((void const *)newpos != (void *)&sprite[spritenum])
         sprite[spritenum].xyz = *newpos;
 
+    spriteMarkChanged(spritenum);
+
     updatesectorz(newpos->x,newpos->y,newpos->z,&tempsectnum);
 
     if (tempsectnum < 0)
         return -1;
     if (tempsectnum != sprite[spritenum].sectnum)
         changespritesect(spritenum,tempsectnum);
+    else
+        spritegridUpdate(spritenum);
 
     return 0;
 }
@@ -12766,9 +13158,6 @@ restart_grand:
     for (dacnt=0; dacnt<danum; dacnt++)
     {
         const int32_t dasectnum = clipsectorlist[dacnt];
-        auto const sec = (usectorptr_t)&sector[dasectnum];
-        uwallptr_t wal;
-        bssize_t cnt;
 #ifdef YAX_ENABLE
         int32_t cfz1[2], cfz2[2];  // both wrt dasectnum
         int16_t bn[2];
@@ -12777,8 +13166,17 @@ restart_grand:
         getzsofslope(dasectnum, x1,y1, &cfz1[0], &cfz1[1]);
         getzsofslope(dasectnum, x2,y2, &cfz2[0], &cfz2[1]);
 #endif
-        for (cnt=sec->wallnum,wal=(uwallptr_t)&wall[sec->wallptr]; cnt>0; cnt--,wal++)
+        sectorbvhwalls_t walls;
+#ifdef YAX_ENABLE
+        if (bn[0]>=0 || bn[1]>=0)
+            sectorbvhGetAllWalls(dasectnum, &walls);  // walls that miss can still lead through TROR
+        else
+#endif
+            sectorbvhGetSegmentWalls(dasectnum, { x1, y1 }, { x21, y21 }, &walls);
+
+        for (int w = sectorbvhFirstWall(&walls); w >= 0; w = sectorbvhNextWall(&walls, w))
         {
+            auto const wal  = (uwallptr_t)&wall[w];
             auto const wal2 = (uwallptr_t)&wall[wal->point2];
             const int32_t x31 = wal->x-x1, x34 = wal->x-wal2->x;
             const int32_t y31 = wal->y-y1, y34 = wal->y-wal2->y;
@@ -13045,6 +13443,7 @@ void dragpoint(int16_t pointhighlight, int32_t dax, int32_t day, uint8_t flags)
             wall[w].x = dax;
             wall[w].y = day;
             bitmap_set(walbitmap, w);
+            sectorbvhInvalidateWall(w);
 
             for (YAX_ITER_WALLS(w, j, tmpcf))
             {
@@ -13123,6 +13522,7 @@ void dragpoint(int16_t pointhighlight, int32_t dax, int32_t day, uint8_t flags)
 
     wall[tempshort].x = dax;
     wall[tempshort].y = day;
+    sectorbvhInvalidateWall(tempshort);
 
     if (editstatus)
     {
@@ -13141,6 +13541,7 @@ void dragpoint(int16_t pointhighlight, int32_t dax, int32_t day, uint8_t flags)
 
             wall[tempshort].x = dax;
             wall[tempshort].y = day;
+            sectorbvhInvalidateWall(tempshort);
             editwall[tempshort>>3] |= 1<<(tempshort&7);
         }
         else
@@ -13154,6 +13555,7 @@ void dragpoint(int16_t pointhighlight, int32_t dax, int32_t day, uint8_t flags)
                     tempshort = wall[thelastwall].nextwall;
                     wall[tempshort].x = dax;
                     wall[tempshort].y = day;
+                    sectorbvhInvalidateWall(tempshort);
                     editwall[tempshort>>3] |= 1<<(tempshort&7);
                 }
                 else
@@ -14513,6 +14915,8 @@ void setfirstwall(int16_t sectnum, int16_t newfirstwall)
         if (wall[i].nextwall >= 0)
             wall[wall[i].nextwall].nextwall = i;
 
+    sectorbvhInvalidateSector(sectnum);
+
 #ifdef YAX_ENABLE
     int16_t cb, fb;
     yax_getbunches(sectnum, &cb, &fb);
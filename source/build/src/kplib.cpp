@@ -31,11 +31,14 @@ credits.
 
 #include "compat.h"
 #include "baselayer.h"
+#include "build_cpuid.h"
 #include "kplib.h"
 #include "pragmas.h"
 
 #include "vfs.h"
 
+#include "libasync_config.h"
+
 #if !defined(_WIN32)
 static FORCE_INLINE CONSTEXPR int32_t klrotl(int32_t i, int sh) { return (i >> (-sh)) | (i << sh); }
 #else
@@ -54,9 +57,6 @@ static FORCE_INLINE CONSTEXPR int32_t klrotl(int32_t i, int sh) { return (i >> (
 #define ASMNAME(x)
 #endif
 
-static intptr_t kp_frameplace;
-static int32_t kp_bytesperline, kp_xres, kp_yres;
-
 static CONSTEXPR const int32_t pow2mask[32] =
 {
     0x00000000,0x00000001,0x00000003,0x00000007,
@@ -80,10 +80,6 @@ static CONSTEXPR const int32_t pow2long[32] =
     0x10000000,0x20000000,0x40000000,(int32_t)0x80000000,
 };
 
-//Hack for peekbits,getbits,suckbits (to prevent lots of duplicate code)
-//   0: PNG: do 12-byte chunk_header removal hack
-// !=0: ZIP: use 64K buffer (olinbuf)
-static int32_t zipfilmode;
 kzfilestate kzfs;
 
 // GCC 4.6 LTO build fix
@@ -105,9 +101,83 @@ kzfilestate kzfs;
 //   pow2mask     128*
 //   dcflagor      64
 
-B_KPLIB_STATIC int32_t ATTRIBUTE((used)) palcol[256] ASMNAME("palcol");
-static int32_t paleng, bakcol, numhufblocks, zlibcompflags;
-static int8_t kcoltype, filtype, bitdepth;
+//========================= SIMD kernel selection ============================
+
+//The None/Up PNG filters, the per-pixel Sub/Average/Paeth filters of 24 and 32-bit PNGs, the
+//JPG IDCT and the YCbCr->RGB conversion of whole 8-pixel rows have SSE2 and NEON variants, and
+//all but the per-pixel filters an AVX2 one as well.  They write exactly the same bytes as the
+//C code, which still handles everything else: the Huffman decoders, palettized and grayscale
+//PNGs, the ends of lines that straddle two putbuf() calls and blocks clipped at the right edge
+//of a JPG.
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define KPLIB_SIMD
+# define KPLIB_SSE2
+# include <emmintrin.h>
+# if defined __GNUC__ && (EDUKE32_GCC_PREREQ(4,9) || defined __clang__)
+#  define KPLIB_AVX2
+#  define KPLIB_TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+# elif defined _MSC_VER
+#  define KPLIB_AVX2
+#  define KPLIB_TARGET_AVX2
+#  include <immintrin.h>
+# endif
+#elif (defined __ARM_NEON || defined __ARM_NEON__ || defined _M_ARM64) && B_LITTLE_ENDIAN == 1
+# define KPLIB_SIMD
+# define KPLIB_NEON
+# include <arm_neon.h>
+#endif
+
+//Shared by all decodes: it is only changed by kpinit() and kpsetisa(), never during a decode.
+static int32_t kpisa = KPLIB_ISA_SCALAR;
+
+static const char *const kpisanames[KPLIB_ISA_COUNT] = { "C", "SSE2", "NEON", "AVX2" };
+
+int32_t kpisasupported(int32_t isa)
+{
+    switch (isa)
+    {
+        case KPLIB_ISA_SCALAR: return 1;
+#ifdef KPLIB_SSE2
+        case KPLIB_ISA_SSE2: return cpu.features.sse2;
+#endif
+#ifdef KPLIB_AVX2
+        case KPLIB_ISA_AVX2: return cpu.features.sse2 && cpu.features.avx2;
+#endif
+#ifdef KPLIB_NEON
+        case KPLIB_ISA_NEON: return cpu.features.neon;
+#endif
+    }
+
+    return 0;
+}
+
+int32_t kpsetisa(int32_t isa)
+{
+    if ((unsigned)isa >= KPLIB_ISA_COUNT || !kpisasupported(isa))
+        return -1;
+
+    return kpisa = isa;
+}
+
+int32_t kpgetisa(void) { return kpisa; }
+const char *kpisaname(int32_t isa) { return (unsigned)isa < KPLIB_ISA_COUNT ? kpisanames[isa] : "?"; }
+
+void kpinit(void)
+{
+    for (int isa = KPLIB_ISA_COUNT-1; isa >= 0; isa--)
+        if (kpsetisa(isa) >= 0)
+            break;
+
+    VLOG_F(LOG_ENGINE, "PNG/JPG decoder kernels: %s", kpisaname(kpisa));
+}
+
+//Kernels with an AVX2 variant are called through this; the other variant is SSE2 or NEON.
+#ifdef KPLIB_AVX2
+# define KPLIB_DISPATCH(name, args) (kpisa == KPLIB_ISA_AVX2 ? name##_avx2 args : name##_vec args)
+#else
+# define KPLIB_DISPATCH(name, args) (name##_vec args)
+#endif
 
 //============================ KPNGILIB begins ===============================
 
@@ -119,26 +189,106 @@ static int8_t kcoltype, filtype, bitdepth;
 //   * 16-bit color depth
 //   * Some useless ancillary chunks, like: gAMA(gamma) & pHYs(aspect ratio)
 
-//.PNG specific variables:
-static int32_t bakr = 0x80, bakg = 0x80, bakb = 0x80; //this used to be public...
-static int32_t gslidew = 0, gslider = 0, xm, xmn[4], xr0, xr1, xplc, yplc;
-static intptr_t nfplace;
-static int32_t clen[320], cclen[19], bitpos, filt, xsiz, ysiz;
-int32_t xsizbpl, ixsiz, ixoff, iyoff, ixstp, iystp, intlac, nbpl;
-B_KPLIB_STATIC int32_t ATTRIBUTE((used)) trnsrgb ASMNAME("trnsrgb");
 static int32_t ccind[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
-static int32_t hxbit[59][2], ibuf0[288], nbuf0[32], ibuf1[32], nbuf1[32];
-static const uint8_t *filptr;
-static uint8_t slidebuf[32768], opixbuf0[4], opixbuf1[4];
-static uint8_t pnginited = 0;
-B_KPLIB_STATIC uint8_t olinbuf[131072] ASMNAME("olinbuf"); //WARNING:max kp_xres is: 131072/bpp-1
+
+//Tables that never change once kpinittables() has filled them in, shared by all decodes:
+static int32_t hxbit[59][2];
 B_KPLIB_STATIC int32_t ATTRIBUTE((used)) abstab10[1024] ASMNAME("abstab10");
 
-//Variables to speed up dynamic Huffman decoding:
 #define LOGQHUFSIZ0 9
 #define LOGQHUFSIZ1 6
-static int32_t qhufval0[1<<LOGQHUFSIZ0], qhufval1[1<<LOGQHUFSIZ1];
-static uint8_t qhufbit0[1<<LOGQHUFSIZ0], qhufbit1[1<<LOGQHUFSIZ1];
+
+//Everything a decode changes.  kprender() allocates one of these for each picture, so any
+//number of pictures can be decoded on different threads at once.  The ZIP functions have one
+//of their own, see kzgetcontext().
+struct kpcontext
+{
+    intptr_t kp_frameplace;
+    int32_t kp_bytesperline, kp_xres, kp_yres;
+
+    //Hack for peekbits,getbits,suckbits (to prevent lots of duplicate code)
+    //   0: PNG: do 12-byte chunk_header removal hack
+    // !=0: ZIP: use 64K buffer (olinbuf)
+    int32_t zipfilmode;
+
+    int32_t palcol[256];
+    int32_t paleng, bakcol, numhufblocks, zlibcompflags;
+    int8_t kcoltype, filtype, bitdepth;
+
+    //.PNG specific variables:
+    int32_t bakr, bakg, bakb; //this used to be public...
+    int32_t gslidew, gslider, xm, xmn[4], xr0, xr1, xplc, yplc;
+    intptr_t nfplace;
+    int32_t clen[320], cclen[19], bitpos, filt, xsiz, ysiz;
+    int32_t xsizbpl, ixsiz, ixoff, iyoff, ixstp, iystp, intlac, nbpl;
+    int32_t trnsrgb;
+    int32_t ibuf0[288], nbuf0[32], ibuf1[32], nbuf1[32];
+    const uint8_t *filptr;
+    uint8_t slidebuf[32768], opixbuf0[4], opixbuf1[4];
+    uint8_t olinbuf[131072]; //WARNING:max kp_xres is: 131072/bpp-1
+
+    //Variables to speed up dynamic Huffman decoding:
+    int32_t qhufval0[1<<LOGQHUFSIZ0], qhufval1[1<<LOGQHUFSIZ1];
+    uint8_t qhufbit0[1<<LOGQHUFSIZ0], qhufbit1[1<<LOGQHUFSIZ1];
+
+    uint8_t fakebuf[8];
+    uint8_t const *nfilptr;
+    int32_t nbitpos;
+    int32_t filter1st, filterest;
+
+    //.JPG specific variables:
+    int32_t clipxdim, clipydim;
+    int32_t hufmaxatbit[8][20], hufvalatbit[8][20], hufcnt[8];
+    uint8_t hufnumatbit[8][20], huftable[8][256];
+    int32_t hufquickval[8][1024], hufquickbits[8][1024], hufquickcnt[8];
+    int32_t quantab[4][64], dct[12][64], lastdc[4]; //dct:10=MAX (says spec);+2 for hacks
+    uint8_t gnumcomponents;
+    int32_t gcompid[4], gcomphsamp[4], gcompvsamp[4], gcompquantab[4], gcomphsampshift[4], gcompvsampshift[4];
+    int32_t lnumcomponents, lcompid[4], lcompdc[4], lcompac[4], lcomphsamp[4], lcompvsamp[4], lcompquantab[4];
+    int32_t lcomphvsamp0, lcomphsampshift0, lcompvsampshift0;
+
+    //.GIF specific variables:
+    uint8_t suffix[4100], filbuffer[768], tempstack[4096];
+    int32_t prefix[4100];
+
+    void suckbitsnextblock();
+    inline int32_t peekbits(int32_t n);
+    inline void suckbits(int32_t n);
+    inline int32_t getbits(int32_t n);
+    int32_t hufgetsym(int32_t *hitab, const int32_t *hbmax);
+    int32_t initpass();
+    inline void rgbhlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp);
+    inline void pal8hlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp);
+#ifdef KPLIB_SIMD
+    int32_t pngunfilterup_vec(const uint8_t *buf, int32_t leng, int32_t up);
+# ifdef KPLIB_AVX2
+    KPLIB_TARGET_AVX2 int32_t pngunfilterup_avx2(const uint8_t *buf, int32_t leng, int32_t up);
+# endif
+    template <int bpp, int filter> int32_t pngunfilterpix_vec(const uint8_t *buf, int32_t leng);
+    int32_t pngunfilter(const uint8_t *buf, int32_t leng);
+#endif
+    void putbuf(const uint8_t *buf, int32_t leng);
+    int32_t kpngrend(const char *kfilebuf, int32_t kfilength,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+    void huffgetval(int32_t index, int32_t curbits, int32_t num, int32_t *daval, int32_t *dabits);
+    void yrbrend(int32_t x, int32_t y, int32_t *ldct);
+    int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+    int32_t kgifrend(const char *kfilebuf, int32_t kfilelength,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+#ifdef KPCEL
+    int32_t kcelrend(const char *buf, int32_t fleng,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+#endif
+    int32_t ktgarend(const char *header, int32_t fleng,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+    int32_t kbmprend(const char *buf, int32_t fleng,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+    int32_t kpcxrend(const char *buf, int32_t fleng,
+                     intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres);
+    int32_t render(const char *buf, int32_t leng, intptr_t frameptr, int32_t bpl, int32_t xdim, int32_t ydim);
+    int32_t zipread(void *buffer, int32_t leng);
+};
 
 #if defined(_MSC_VER) && !defined(NOASM)
 
@@ -178,10 +328,7 @@ static inline int32_t bitrev(int32_t b, int32_t c)
 
 #endif
 
-static uint8_t fakebuf[8];
-static uint8_t const *nfilptr;
-static int32_t nbitpos;
-static void suckbitsnextblock()
+void kpcontext::suckbitsnextblock()
 {
     if (zipfilmode)
     {
@@ -214,11 +361,11 @@ static void suckbitsnextblock()
     filptr = &fakebuf[4]; bitpos -= 32;
 }
 
-static inline int32_t peekbits(int32_t n) { return (B_LITTLE32(B_UNBUF32(&filptr[bitpos>>3]))>>(bitpos&7))&pow2mask[n]; }
-static inline void suckbits(int32_t n) { bitpos += n; if (bitpos < 0) return; suckbitsnextblock(); }
-static inline int32_t getbits(int32_t n) { int32_t i = peekbits(n); suckbits(n); return i; }
+inline int32_t kpcontext::peekbits(int32_t n) { return (B_LITTLE32(B_UNBUF32(&filptr[bitpos>>3]))>>(bitpos&7))&pow2mask[n]; }
+inline void kpcontext::suckbits(int32_t n) { bitpos += n; if (bitpos < 0) return; suckbitsnextblock(); }
+inline int32_t kpcontext::getbits(int32_t n) { int32_t i = peekbits(n); suckbits(n); return i; }
 
-static int32_t hufgetsym(int32_t *hitab, const int32_t *hbmax)
+int32_t kpcontext::hufgetsym(int32_t *hitab, const int32_t *hbmax)
 {
     int32_t v, n;
 
@@ -314,7 +461,7 @@ static void hufgencode(const int32_t *inbuf, int32_t inum, int32_t *hitab, int32
     for (i=0; i<inum; i++) if (inbuf[i]) hitab[hbmax[inbuf[i]]++] = i;
 }
 
-static int32_t initpass()  //Interlaced images have 7 "passes", non-interlaced have 1
+int32_t kpcontext::initpass()  //Interlaced images have 7 "passes", non-interlaced have 1
 {
     int32_t i, j, k;
 
@@ -410,73 +557,6 @@ static inline int32_t Paeth686(int32_t a, int32_t b, int32_t c)
     }
 }
 
-static inline void rgbhlineasm(int32_t c, int32_t d, int32_t t, int32_t b)
-{
-    _asm
-    {
-        push ebx
-        push edi
-
-        mov ecx, c
-        mov edx, d
-        mov edi, t
-        mov ebx, b
-        sub ecx, edx
-        jle short endit
-        add edx, offset olinbuf
-        cmp dword ptr trnsrgb, 0
-        jz short begit2
-        begit:
-        mov eax, dword ptr [ecx+edx]
-        or eax, 0xff000000
-        cmp eax, dword ptr trnsrgb
-        jne short skipit
-        and eax, 0xffffff
-        skipit:
-        sub ecx, 3
-        mov [edi], eax
-        lea edi, [edi+ebx]
-        jnz short begit
-        jmp short endit
-        begit2:
-        mov eax, dword ptr [ecx+edx]
-        or eax, 0xff000000
-        sub ecx, 3
-        mov [edi], eax
-        lea edi, [edi+ebx]
-        jnz short begit2
-        endit:
-        pop edi
-        pop ebx
-    }
-}
-
-static inline void pal8hlineasm(int32_t c, int32_t d, int32_t t, int32_t b)
-{
-    _asm
-    {
-        mov ecx, c
-        mov edx, d
-        sub ecx, edx
-        jle short endit
-
-        push ebx
-        push edi
-        mov edi, t
-        mov ebx, b
-        add edx, offset olinbuf
-        begit:movzx eax, byte ptr [ecx+edx]
-        mov eax, dword ptr palcol[eax*4]
-        sub ecx, 1
-        mov [edi], eax
-        lea edi, [edi+ebx]
-        jnz short begit
-        pop edi
-        pop ebx
-        endit:
-    }
-}
-
 #elif defined(__GNUC__) && defined(__i386__) && !defined(NOASM)
 
 static inline int32_t Paeth686(int32_t a, int32_t b, int32_t c)
@@ -498,53 +578,6 @@ static inline int32_t Paeth686(int32_t a, int32_t b, int32_t c)
     return c;
 }
 
-//Note: "cmove eax,?" may be faster than "jne ?:and eax,?" but who cares
-static inline void rgbhlineasm(int32_t c, int32_t d, int32_t t, int32_t b)
-{
-    __asm__ __volatile__(
-        "subl %%edx, %%ecx \n"
-        "jle 3f \n"
-        "addl $olinbuf, %%edx \n"
-        "cmpl $0, trnsrgb(,1) \n"
-        "jz 2f \n"
-        "0: movl (%%ecx,%%edx,1), %%eax \n"
-        "orl $0xff000000, %%eax \n"
-        "cmpl trnsrgb(,1), %%eax \n"
-        "jne 1f \n"
-        "andl $0xffffff, %%eax \n"
-        "1: subl $3, %%ecx \n"
-        "movl %%eax, (%%edi) \n"
-        "leal (%%edi,%%ebx,1), %%edi \n"
-        "jnz 0b \n"
-        "jmp 3f \n"
-        "2: movl (%%ecx,%%edx,1), %%eax \n"
-        "orl $0xff000000, %%eax \n"
-        "subl $3, %%ecx \n"
-        "movl %%eax, (%%edi) \n"
-        "leal (%%edi,%%ebx,1), %%edi \n"
-        "jnz 2b \n"
-        "3: \n"
-        : "+c"(c), "+d"(d), "+D"(t) : "b"(b) : "eax","memory","cc"
-    );
-}
-
-static inline void pal8hlineasm(int32_t c, int32_t d, int32_t t, int32_t b)
-{
-    __asm__ __volatile__(
-        "subl %%edx, %%ecx \n"
-        "jle 1f \n"
-        "addl $olinbuf, %%edx \n"
-        "0: movzbl (%%ecx,%%edx,1), %%eax \n"
-        "movl palcol(,%%eax,4), %%eax \n"
-        "subl $1, %%ecx \n"
-        "movl %%eax, (%%edi) \n"
-        "leal (%%edi,%%ebx,1), %%edi \n"
-        "jnz 0b \n"
-        "1: \n"
-        : "+c"(c), "+d"(d), "+D"(t) : "b"(b) : "eax","memory","cc"
-    );
-}
-
 #else
 
 static inline int32_t Paeth686(int32_t const a, int32_t const b, int32_t c)
@@ -556,7 +589,11 @@ static inline int32_t Paeth686(int32_t const a, int32_t const b, int32_t c)
     return (edi < *(ptr + a)) ? c : a;
 }
 
-static inline void rgbhlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp)
+#endif
+
+//There used to be x86 asm versions of these two, but they referred to olinbuf, trnsrgb and
+//palcol by name.
+inline void kpcontext::rgbhlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp)
 {
     if (!trnsrgb)
     {
@@ -571,13 +608,11 @@ static inline void rgbhlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp
     }
 }
 
-static inline void pal8hlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp)
+inline void kpcontext::pal8hlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixstp)
 {
     for (; x>xr1; p+=ixstp,x--) B_BUF32((void *) p, palcol[olinbuf[x]]);
 }
 
-#endif
-
 //Autodetect filter
 //    /f0: 0000000...
 //    /f1: 1111111...
@@ -586,8 +621,220 @@ static inline void pal8hlineasm(int32_t x, int32_t xr1, intptr_t p, int32_t ixst
 //    /f3: 3333333...
 //    /f4: 4444444...
 //    /f5: 0142321...
-static int32_t filter1st, filterest;
-static void putbuf(const uint8_t *buf, int32_t leng)
+#ifdef KPLIB_SIMD
+//olinbuf holds each line backwards (the byte at buf[i] goes to olinbuf[xplc--]), so the vector
+//code reverses the bytes it reads from buf.  The per-pixel filters keep a pixel's channels in
+//that reversed order as well: lane 0 is the byte at the lowest address of olinbuf.
+
+//Filters 0 and 2 have no dependencies along the line: whole vectors at a time.
+# ifdef KPLIB_SSE2
+static FORCE_INLINE __m128i kpreverse_sse2(__m128i v)
+{
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0,1,2,3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+int32_t kpcontext::pngunfilterup_vec(const uint8_t *buf, int32_t leng, int32_t up)
+{
+    uint8_t *dst = &olinbuf[xplc+1];
+    int32_t i = 0;
+
+    for (; i <= leng-16; i += 16)
+    {
+        dst -= 16;
+        __m128i v = kpreverse_sse2(_mm_loadu_si128((__m128i const *)&buf[i]));
+        if (up) v = _mm_add_epi8(v, _mm_loadu_si128((__m128i const *)dst));
+        _mm_storeu_si128((__m128i *)dst, v);
+    }
+
+    xplc -= i;
+    return i;
+}
+# elif defined KPLIB_NEON
+int32_t kpcontext::pngunfilterup_vec(const uint8_t *buf, int32_t leng, int32_t up)
+{
+    uint8_t *dst = &olinbuf[xplc+1];
+    int32_t i = 0;
+
+    for (; i <= leng-16; i += 16)
+    {
+        dst -= 16;
+        uint8x16_t v = vrev64q_u8(vld1q_u8(&buf[i]));
+        v = vcombine_u8(vget_high_u8(v), vget_low_u8(v));
+        if (up) v = vaddq_u8(v, vld1q_u8(dst));
+        vst1q_u8(dst, v);
+    }
+
+    xplc -= i;
+    return i;
+}
+# endif
+
+# ifdef KPLIB_AVX2
+KPLIB_TARGET_AVX2 int32_t kpcontext::pngunfilterup_avx2(const uint8_t *buf, int32_t leng, int32_t up)
+{
+    __m256i const reverse = _mm256_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,
+                                             15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+    uint8_t *dst = &olinbuf[xplc+1];
+    int32_t i = 0;
+
+    for (; i <= leng-32; i += 32)
+    {
+        dst -= 32;
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i const *)&buf[i]), reverse);
+        v = _mm256_permute2x128_si256(v, v, 1);
+        if (up) v = _mm256_add_epi8(v, _mm256_loadu_si256((__m256i const *)dst));
+        _mm256_storeu_si256((__m256i *)dst, v);
+    }
+
+    xplc -= i;
+    return i + pngunfilterup_vec(&buf[i], leng-i, up);
+}
+# endif
+
+//Filters 1, 3 and 4 depend on the pixel to the left, so these go one pixel at a time, with
+//all channels in one register.  A 24-bit pixel is loaded with the byte below it in olinbuf
+//(olinbuf[0] exists) and the byte after it in buf, which is why the loop stops 4 bytes short.
+template <int bpp> static FORCE_INLINE uint32_t pngpixrev(uint32_t v)
+{
+    return bpp == 4 ? (uint32_t)B_SWAP32(v) : (uint32_t)B_SWAP32(v)>>8;
+}
+template <int bpp> static FORCE_INLINE uint32_t pngpixunrev(uint32_t v)
+{
+    return bpp == 4 ? (uint32_t)B_SWAP32(v) : (uint32_t)B_SWAP32(v<<8);
+}
+
+# ifdef KPLIB_SSE2
+static FORCE_INLINE __m128i kpblend_sse2(__m128i x, __m128i y, __m128i mask)
+{
+    return _mm_or_si128(_mm_and_si128(mask, y), _mm_andnot_si128(mask, x));
+}
+
+static FORCE_INLINE __m128i kpabs16_sse2(__m128i x)
+{
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+//Paeth686() on 16-bit lanes
+static FORCE_INLINE __m128i kppaeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+    __m128i const bc = _mm_sub_epi16(b, c), ac = _mm_sub_epi16(a, c);
+    __m128i const pa = kpabs16_sse2(bc), pb = kpabs16_sse2(ac), pc = kpabs16_sse2(_mm_add_epi16(bc, ac));
+    __m128i const smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    return kpblend_sse2(kpblend_sse2(c, b, _mm_cmpeq_epi16(pb, smallest)), a, _mm_cmpeq_epi16(pa, smallest));
+}
+
+template <int bpp, int filter>
+int32_t kpcontext::pngunfilterpix_vec(const uint8_t *buf, int32_t leng)
+{
+    __m128i const zero = _mm_setzero_si128();
+    uint8_t *const lin = olinbuf;
+    uint32_t left = pngpixrev<bpp>(B_UNBUF32(opixbuf1)), upleft = pngpixrev<bpp>(B_UNBUF32(opixbuf0));
+    __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(left), zero), c = _mm_unpacklo_epi8(_mm_cvtsi32_si128(upleft), zero);
+    int32_t p = xplc, i = 0;
+
+    for (; i <= leng-4; i += bpp, p -= bpp)
+    {
+        uint32_t const uppix = B_UNBUF32(&lin[p-3]);
+        uint32_t const up = bpp == 4 ? uppix : uppix>>8;
+        __m128i const b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(up), zero);
+        __m128i pred;
+
+        switch (filter)
+        {
+            case 1: pred = a; break;
+            case 3: pred = _mm_srli_epi16(_mm_add_epi16(a, b), 1); break;
+            default: pred = kppaeth_sse2(a, b, c); c = b; upleft = up; break;
+        }
+
+        __m128i const x = _mm_add_epi8(_mm_packus_epi16(pred, pred), _mm_cvtsi32_si128(pngpixrev<bpp>(B_UNBUF32(&buf[i]))));
+        left = _mm_cvtsi128_si32(x);
+        B_BUF32(&lin[p-3], bpp == 4 ? left : (left<<8)|(uppix&255));
+        a = _mm_unpacklo_epi8(x, zero);
+    }
+
+    B_BUF32(opixbuf1, pngpixunrev<bpp>(left));
+    if (filter == 4) B_BUF32(opixbuf0, pngpixunrev<bpp>(upleft));
+    xplc = p;
+    return i;
+}
+# elif defined KPLIB_NEON
+static FORCE_INLINE uint8x8_t kppixel_neon(uint32_t v) { return vreinterpret_u8_u32(vdup_n_u32(v)); }
+
+template <int bpp, int filter>
+int32_t kpcontext::pngunfilterpix_vec(const uint8_t *buf, int32_t leng)
+{
+    uint8_t *const lin = olinbuf;
+    uint32_t left = pngpixrev<bpp>(B_UNBUF32(opixbuf1)), upleft = pngpixrev<bpp>(B_UNBUF32(opixbuf0));
+    uint8x8_t a = kppixel_neon(left), c = kppixel_neon(upleft);
+    int32_t p = xplc, i = 0;
+
+    for (; i <= leng-4; i += bpp, p -= bpp)
+    {
+        uint32_t const uppix = B_UNBUF32(&lin[p-3]);
+        uint32_t const up = bpp == 4 ? uppix : uppix>>8;
+        uint8x8_t const b = kppixel_neon(up);
+        uint8x8_t pred;
+
+        switch (filter)
+        {
+            case 1: pred = a; break;
+            case 3: pred = vhadd_u8(a, b); break;
+            default:
+            {
+                //Paeth686()
+                uint16x8_t const pa = vabdl_u8(b, c), pb = vabdl_u8(a, c);
+                uint16x8_t const pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+                uint16x8_t const smallest = vminq_u16(pc, vminq_u16(pa, pb));
+                pred = vbsl_u8(vmovn_u16(vceqq_u16(pb, smallest)), b, c);
+                pred = vbsl_u8(vmovn_u16(vceqq_u16(pa, smallest)), a, pred);
+                c = b; upleft = up;
+                break;
+            }
+        }
+
+        a = vadd_u8(pred, kppixel_neon(pngpixrev<bpp>(B_UNBUF32(&buf[i]))));
+        left = vget_lane_u32(vreinterpret_u32_u8(a), 0);
+        B_BUF32(&lin[p-3], bpp == 4 ? left : (left<<8)|(uppix&255));
+    }
+
+    B_BUF32(opixbuf1, pngpixunrev<bpp>(left));
+    if (filter == 4) B_BUF32(opixbuf0, pngpixunrev<bpp>(upleft));
+    xplc = p;
+    return i;
+}
+# endif
+
+//Unfilters the start of what putbuf() has of the current line and returns the number of bytes
+//it did.  The C code carries on from there with the state this leaves behind.
+int32_t kpcontext::pngunfilter(const uint8_t *buf, int32_t leng)
+{
+    switch (filt)
+    {
+        case 0: return KPLIB_DISPATCH(pngunfilterup, (buf, leng, 0));
+        case 2: return KPLIB_DISPATCH(pngunfilterup, (buf, leng, 1));
+    }
+
+    //only at a pixel boundary, and not for the palettized/grayscale types
+    if (xm || (kcoltype != 2 && kcoltype != 6))
+        return 0;
+
+    int32_t const bpp = kcoltype == 6 ? 4 : 3;
+
+    switch (filt)
+    {
+        case 1: return bpp == 4 ? pngunfilterpix_vec<4,1>(buf, leng) : pngunfilterpix_vec<3,1>(buf, leng);
+        case 3: return bpp == 4 ? pngunfilterpix_vec<4,3>(buf, leng) : pngunfilterpix_vec<3,3>(buf, leng);
+        case 4: return bpp == 4 ? pngunfilterpix_vec<4,4>(buf, leng) : pngunfilterpix_vec<3,4>(buf, leng);
+    }
+
+    return 0;
+}
+#endif
+
+void kpcontext::putbuf(const uint8_t *buf, int32_t leng)
 {
     int32_t i;
     intptr_t p;
@@ -604,6 +851,9 @@ static void putbuf(const uint8_t *buf, int32_t leng)
     while (i < leng)
     {
         int32_t x = i+xplc; if (x > leng) x = leng;
+#ifdef KPLIB_SIMD
+        if (kpisa != KPLIB_ISA_SCALAR) i += pngunfilter(&buf[i], x-i);
+#endif
         switch (filt)
         {
         case 0:
@@ -710,8 +960,8 @@ static void initpngtables()
     for (i=0; i<512; i++) abstab10[512+i] = abstab10[512-i] = i;
 }
 
-static int32_t kpngrend(const char *kfilebuf, int32_t kfilength,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kpngrend(const char *kfilebuf, int32_t kfilength,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i, j, k, bfinal, btype, hlit, hdist, leng;
     int32_t slidew, slider;
@@ -719,8 +969,6 @@ static int32_t kpngrend(const char *kfilebuf, int32_t kfilength,
 
     UNREFERENCED_PARAMETER(kfilength);
 
-    if (!pnginited) { pnginited = 1; initpngtables(); }
-
     if ((B_UNBUF32(&kfilebuf[0]) != B_LITTLE32(0x474e5089u)) || (B_UNBUF32(&kfilebuf[4]) != B_LITTLE32(0x0a1a0a0du)))
         return -1; //"Invalid PNG file signature"
     filptr = (uint8_t const *)&kfilebuf[8];
@@ -965,17 +1213,8 @@ kpngrend_goodret:
 //   All non 32-bit color drawing was removed
 //   "Motion" JPG code was removed
 //   A lot of parameters were added to kpeg() for library usage
-static int32_t kpeginited = 0;
-static int32_t clipxdim, clipydim;
-
-static int32_t hufmaxatbit[8][20], hufvalatbit[8][20], hufcnt[8];
-static uint8_t hufnumatbit[8][20], huftable[8][256];
-static int32_t hufquickval[8][1024], hufquickbits[8][1024], hufquickcnt[8];
-static int32_t quantab[4][64], dct[12][64], lastdc[4], unzig[64], zigit[64]; //dct:10=MAX (says spec);+2 for hacks
-static uint8_t gnumcomponents, dcflagor[64];
-static int32_t gcompid[4], gcomphsamp[4], gcompvsamp[4], gcompquantab[4], gcomphsampshift[4], gcompvsampshift[4];
-static int32_t lnumcomponents, lcompid[4], lcompdc[4], lcompac[4], lcomphsamp[4], lcompvsamp[4], lcompquantab[4];
-static int32_t lcomphvsamp0, lcomphsampshift0, lcompvsampshift0;
+static int32_t unzig[64], zigit[64];
+static uint8_t dcflagor[64];
 static int32_t colclip[1024], colclipup8[1024], colclipup16[1024];
 /*static uint8_t pow2char[8] = {1,2,4,8,16,32,64,128};*/
 
@@ -1074,11 +1313,16 @@ static void initkpeg()
         cbmul[(i<<1)+0] = j*-360857; //-0.34414*1048576
         cbmul[(i<<1)+1] = j*1858077; //1.772*1048576
     }
+}
 
-    Bmemset((void *)&dct[10][0],0,64*2*sizeof(dct[0][0]));
+//The tables above are filled in once, by the first decode on any thread.
+static bool kpinittables()
+{
+    static bool const inited = (initpngtables(), initkpeg(), true);
+    return inited;
 }
 
-static void huffgetval(int32_t index, int32_t curbits, int32_t num, int32_t *daval, int32_t *dabits)
+void kpcontext::huffgetval(int32_t index, int32_t curbits, int32_t num, int32_t *daval, int32_t *dabits)
 {
     int32_t b, v, pow2, *hmax;
 
@@ -1099,14 +1343,209 @@ static void huffgetval(int32_t index, int32_t curbits, int32_t num, int32_t *dav
     *dabits = 16; *daval = 0;
 }
 
-static void invdct8x8(int32_t *dc, uint8_t dcflag)
-{
 #define SQRT2 23726566   //(sqrt(2))<<24
 #define C182 31000253    //(cos(PI/8)*2)<<24
 #define C18S22 43840978  //(cos(PI/8)*sqrt(2)*2)<<24
 #define C38S22 18159528  //(cos(PI*3/8)*sqrt(2)*2)<<24
+
+#ifdef KPLIB_SIMD
+//One pass of invdct8x8() on 4 or 8 rows/columns at once.  Same operations as the C code, so
+//it wraps around the same way.  mulhi() is mulshr32() with one of the k* constants below.
+#define KPLIB_IDCT8(add, sub, shl, mulhi, d0, d1, d2, d3, d4, d5, d6, d7) \
+    do { \
+        auto t3 = add(d2, d6); \
+        auto t2 = sub(shl(mulhi(sub(d2, d6), ksqrt2), 2), t3); \
+        auto t4 = add(d0, d4), t5 = sub(d0, d4); \
+        auto const t0 = add(t4, t3); t3 = sub(t4, t3); \
+        auto const t1 = add(t5, t2); t2 = sub(t5, t2); \
+        t4 = shl(mulhi(add(sub(d5, d3), sub(d1, d7)), kc182), 2); \
+        auto const t7 = add(add(d1, d7), add(d5, d3)); \
+        auto const t6 = sub(add(shl(mulhi(sub(d3, d5), kc18s22), 3), t4), t7); \
+        t5 = sub(shl(mulhi(sub(add(d1, d7), add(d5, d3)), ksqrt2), 2), t6); \
+        t4 = add(sub(shl(mulhi(sub(d1, d7), kc38s22), 2), t4), t5); \
+        d0 = add(t0, t7); d7 = sub(t0, t7); d1 = add(t1, t6); d6 = sub(t1, t6); \
+        d2 = add(t2, t5); d5 = sub(t2, t5); d4 = add(t3, t4); d3 = sub(t3, t4); \
+    } while (0)
+
+//The rows that invdct8x8() skips are all zero, and come out of the vector code as zeros too.
+# ifdef KPLIB_SSE2
+//signed (a*k)>>32 for k > 0, from the unsigned products
+static FORCE_INLINE __m128i kpmulhi_sse2(__m128i a, __m128i k)
+{
+    __m128i const even = _mm_mul_epu32(a, k), odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), k);
+    __m128i const hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+    return _mm_sub_epi32(hi, _mm_and_si128(_mm_srai_epi32(a, 31), k));
+}
+
+#define KPLIB_TRANSPOSE4_SSE2(r0, r1, r2, r3) \
+    do { \
+        __m128i const t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3); \
+        __m128i const t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3); \
+        r0 = _mm_unpacklo_epi64(t0, t1); r1 = _mm_unpackhi_epi64(t0, t1); \
+        r2 = _mm_unpacklo_epi64(t2, t3); r3 = _mm_unpackhi_epi64(t2, t3); \
+    } while (0)
+
+//v[r*2+h] is columns h*4..h*4+3 of row r
+static FORCE_INLINE void kptranspose8x8_sse2(__m128i *v)
+{
+    KPLIB_TRANSPOSE4_SSE2(v[0], v[2], v[4], v[6]);
+    KPLIB_TRANSPOSE4_SSE2(v[1], v[3], v[5], v[7]);
+    KPLIB_TRANSPOSE4_SSE2(v[8], v[10], v[12], v[14]);
+    KPLIB_TRANSPOSE4_SSE2(v[9], v[11], v[13], v[15]);
+
+    for (int i = 1; i < 8; i += 2)
+    {
+        __m128i const t = v[i];
+        v[i] = v[i+7];
+        v[i+7] = t;
+    }
+}
+
+static void invdct8x8_vec(int32_t *dc)
+{
+    __m128i const ksqrt2 = _mm_set1_epi32(SQRT2<<6), kc182 = _mm_set1_epi32(C182<<6);
+    __m128i const kc18s22 = _mm_set1_epi32(C18S22<<5), kc38s22 = _mm_set1_epi32(C38S22<<6);
+    __m128i v[16];
+
+    for (int i = 0; i < 16; i++)
+        v[i] = _mm_loadu_si128((__m128i const *)&dc[i<<2]);
+
+    kptranspose8x8_sse2(v);
+
+    for (int h = 0; h < 2; h++)
+        KPLIB_IDCT8(_mm_add_epi32, _mm_sub_epi32, _mm_slli_epi32, kpmulhi_sse2,
+                    v[h], v[2+h], v[4+h], v[6+h], v[8+h], v[10+h], v[12+h], v[14+h]);
+
+    kptranspose8x8_sse2(v);
+
+    for (int h = 0; h < 2; h++)
+        KPLIB_IDCT8(_mm_add_epi32, _mm_sub_epi32, _mm_slli_epi32, kpmulhi_sse2,
+                    v[h], v[2+h], v[4+h], v[6+h], v[8+h], v[10+h], v[12+h], v[14+h]);
+
+    for (int i = 0; i < 16; i++)
+        _mm_storeu_si128((__m128i *)&dc[i<<2], v[i]);
+}
+# elif defined KPLIB_NEON
+static FORCE_INLINE int32x4_t kpmulhi_neon(int32x4_t a, int32x2_t k)
+{
+    return vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(a), k), 32), vshrn_n_s64(vmull_s32(vget_high_s32(a), k), 32));
+}
+
+#define KPLIB_TRANSPOSE4_NEON(r0, r1, r2, r3) \
+    do { \
+        int32x4x2_t const t01 = vtrnq_s32(r0, r1), t23 = vtrnq_s32(r2, r3); \
+        r0 = vcombine_s32(vget_low_s32(t01.val[0]), vget_low_s32(t23.val[0])); \
+        r1 = vcombine_s32(vget_low_s32(t01.val[1]), vget_low_s32(t23.val[1])); \
+        r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0])); \
+        r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1])); \
+    } while (0)
+
+//v[r*2+h] is columns h*4..h*4+3 of row r
+static FORCE_INLINE void kptranspose8x8_neon(int32x4_t *v)
+{
+    KPLIB_TRANSPOSE4_NEON(v[0], v[2], v[4], v[6]);
+    KPLIB_TRANSPOSE4_NEON(v[1], v[3], v[5], v[7]);
+    KPLIB_TRANSPOSE4_NEON(v[8], v[10], v[12], v[14]);
+    KPLIB_TRANSPOSE4_NEON(v[9], v[11], v[13], v[15]);
+
+    for (int i = 1; i < 8; i += 2)
+    {
+        int32x4_t const t = v[i];
+        v[i] = v[i+7];
+        v[i+7] = t;
+    }
+}
+
+static void invdct8x8_vec(int32_t *dc)
+{
+    int32x2_t const ksqrt2 = vdup_n_s32(SQRT2<<6), kc182 = vdup_n_s32(C182<<6);
+    int32x2_t const kc18s22 = vdup_n_s32(C18S22<<5), kc38s22 = vdup_n_s32(C38S22<<6);
+    int32x4_t v[16];
+
+    for (int i = 0; i < 16; i++)
+        v[i] = vld1q_s32(&dc[i<<2]);
+
+    kptranspose8x8_neon(v);
+
+    for (int h = 0; h < 2; h++)
+        KPLIB_IDCT8(vaddq_s32, vsubq_s32, vshlq_n_s32, kpmulhi_neon,
+                    v[h], v[2+h], v[4+h], v[6+h], v[8+h], v[10+h], v[12+h], v[14+h]);
+
+    kptranspose8x8_neon(v);
+
+    for (int h = 0; h < 2; h++)
+        KPLIB_IDCT8(vaddq_s32, vsubq_s32, vshlq_n_s32, kpmulhi_neon,
+                    v[h], v[2+h], v[4+h], v[6+h], v[8+h], v[10+h], v[12+h], v[14+h]);
+
+    for (int i = 0; i < 16; i++)
+        vst1q_s32(&dc[i<<2], v[i]);
+}
+# endif
+
+# ifdef KPLIB_AVX2
+static KPLIB_TARGET_AVX2 FORCE_INLINE __m256i kpmulhi_avx2(__m256i a, __m256i k)
+{
+    __m256i const even = _mm256_mul_epi32(a, k), odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), k);
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+}
+
+static KPLIB_TARGET_AVX2 FORCE_INLINE void kptranspose8x8_avx2(__m256i *v)
+{
+    __m256i t[8], u[8];
+
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(v[i], v[i+1]);
+        t[i+1] = _mm256_unpackhi_epi32(v[i], v[i+1]);
+    }
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i+2]);
+        u[i+1] = _mm256_unpackhi_epi64(t[i], t[i+2]);
+        u[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]);
+        u[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        v[i] = _mm256_permute2x128_si256(u[i], u[i+4], 0x20);
+        v[i+4] = _mm256_permute2x128_si256(u[i], u[i+4], 0x31);
+    }
+}
+
+static KPLIB_TARGET_AVX2 void invdct8x8_avx2(int32_t *dc)
+{
+    __m256i const ksqrt2 = _mm256_set1_epi32(SQRT2<<6), kc182 = _mm256_set1_epi32(C182<<6);
+    __m256i const kc18s22 = _mm256_set1_epi32(C18S22<<5), kc38s22 = _mm256_set1_epi32(C38S22<<6);
+    __m256i v[8];
+
+    for (int i = 0; i < 8; i++)
+        v[i] = _mm256_loadu_si256((__m256i const *)&dc[i<<3]);
+
+    kptranspose8x8_avx2(v);
+    KPLIB_IDCT8(_mm256_add_epi32, _mm256_sub_epi32, _mm256_slli_epi32, kpmulhi_avx2, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+    kptranspose8x8_avx2(v);
+    KPLIB_IDCT8(_mm256_add_epi32, _mm256_sub_epi32, _mm256_slli_epi32, kpmulhi_avx2, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+
+    for (int i = 0; i < 8; i++)
+        _mm256_storeu_si256((__m256i *)&dc[i<<3], v[i]);
+}
+# endif
+#endif
+
+static void invdct8x8(int32_t *dc, uint8_t dcflag)
+{
     int32_t *edc, t0, t1, t2, t3, t4, t5, t6, t7;
 
+#ifdef KPLIB_SIMD
+    if (kpisa != KPLIB_ISA_SCALAR)
+    {
+        KPLIB_DISPATCH(invdct8x8, (dc));
+        return;
+    }
+#endif
+
     edc = dc+64;
     do
     {
@@ -1146,7 +1585,135 @@ static void invdct8x8(int32_t *dc, uint8_t dcflag)
     while (dc < edc);
 }
 
-static void yrbrend(int32_t x, int32_t y, int32_t *ldct)
+#ifdef KPLIB_SIMD
+//One row of 8 pixels of yrbrend() when none of them is clipped.  The chroma comes from dc2
+//(Cb, with Cr 64 entries further) for every pixel if hsamp is 1, or every other one if it is 2.
+//crmul[]/cbmul[] hold k*constant for k = Cr/Cb>>20, and colclip[] is (sum>>22)+128 clamped to
+//0..255, which the vector code computes directly.
+# ifdef KPLIB_SSE2
+static FORCE_INLINE __m128i kpmullo_sse2(__m128i a, __m128i k)
+{
+    __m128i const even = _mm_mul_epu32(a, k), odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), k);
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+static FORCE_INLINE void kpycc4_sse2(__m128i y, __m128i cb, __m128i cr, __m128i &r, __m128i &g, __m128i &b)
+{
+    cb = _mm_srai_epi32(cb, 20); cr = _mm_srai_epi32(cr, 20);
+    r = _mm_srai_epi32(_mm_add_epi32(y, kpmullo_sse2(cr, _mm_set1_epi32(1470104))), 22);
+    g = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(y, kpmullo_sse2(cr, _mm_set1_epi32(-748830))),
+                                     kpmullo_sse2(cb, _mm_set1_epi32(-360857))), 22);
+    b = _mm_srai_epi32(_mm_add_epi32(y, kpmullo_sse2(cb, _mm_set1_epi32(1858077))), 22);
+}
+
+static void kpyccrow_vec(const int32_t *dc, const int32_t *dc2, int32_t hsamp, int32_t *p)
+{
+    __m128i cb0, cb1, cr0, cr1;
+
+    if (hsamp == 1)
+    {
+        cb0 = _mm_loadu_si128((__m128i const *)dc2); cb1 = _mm_loadu_si128((__m128i const *)&dc2[4]);
+        cr0 = _mm_loadu_si128((__m128i const *)&dc2[64]); cr1 = _mm_loadu_si128((__m128i const *)&dc2[68]);
+    }
+    else
+    {
+        __m128i const cb = _mm_loadu_si128((__m128i const *)dc2), cr = _mm_loadu_si128((__m128i const *)&dc2[64]);
+        cb0 = _mm_unpacklo_epi32(cb, cb); cb1 = _mm_unpackhi_epi32(cb, cb);
+        cr0 = _mm_unpacklo_epi32(cr, cr); cr1 = _mm_unpackhi_epi32(cr, cr);
+    }
+
+    __m128i r0, g0, b0, r1, g1, b1;
+    kpycc4_sse2(_mm_loadu_si128((__m128i const *)dc), cb0, cr0, r0, g0, b0);
+    kpycc4_sse2(_mm_loadu_si128((__m128i const *)&dc[4]), cb1, cr1, r1, g1, b1);
+
+    //packus does the clamping
+    __m128i const k128 = _mm_set1_epi16(128);
+    __m128i const r = _mm_add_epi16(_mm_packs_epi32(r0, r1), k128);
+    __m128i const g = _mm_add_epi16(_mm_packs_epi32(g0, g1), k128);
+    __m128i const b = _mm_add_epi16(_mm_packs_epi32(b0, b1), k128);
+    __m128i const bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    __m128i const ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(-1));
+
+    _mm_storeu_si128((__m128i *)p, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i *)&p[4], _mm_unpackhi_epi16(bg, ra));
+}
+# elif defined KPLIB_NEON
+static FORCE_INLINE uint8x8_t kpcolclip_neon(int32x4_t lo, int32x4_t hi)
+{
+    int32x4_t const k128 = vdupq_n_s32(128);
+    return vqmovn_u16(vcombine_u16(vqmovun_s32(vaddq_s32(vshrq_n_s32(lo, 22), k128)),
+                                   vqmovun_s32(vaddq_s32(vshrq_n_s32(hi, 22), k128))));
+}
+
+static void kpyccrow_vec(const int32_t *dc, const int32_t *dc2, int32_t hsamp, int32_t *p)
+{
+    int32x4_t cb0, cb1, cr0, cr1;
+
+    if (hsamp == 1)
+    {
+        cb0 = vld1q_s32(dc2); cb1 = vld1q_s32(&dc2[4]);
+        cr0 = vld1q_s32(&dc2[64]); cr1 = vld1q_s32(&dc2[68]);
+    }
+    else
+    {
+        int32x4_t const cb = vld1q_s32(dc2), cr = vld1q_s32(&dc2[64]);
+        int32x4x2_t const cbcb = vzipq_s32(cb, cb), crcr = vzipq_s32(cr, cr);
+        cb0 = cbcb.val[0]; cb1 = cbcb.val[1];
+        cr0 = crcr.val[0]; cr1 = crcr.val[1];
+    }
+
+    cb0 = vshrq_n_s32(cb0, 20); cb1 = vshrq_n_s32(cb1, 20);
+    cr0 = vshrq_n_s32(cr0, 20); cr1 = vshrq_n_s32(cr1, 20);
+
+    int32x4_t const y0 = vld1q_s32(dc), y1 = vld1q_s32(&dc[4]);
+    uint8x8x4_t bgra;
+
+    bgra.val[0] = kpcolclip_neon(vmlaq_n_s32(y0, cb0, 1858077), vmlaq_n_s32(y1, cb1, 1858077));
+    bgra.val[1] = kpcolclip_neon(vmlaq_n_s32(vmlaq_n_s32(y0, cr0, -748830), cb0, -360857),
+                                 vmlaq_n_s32(vmlaq_n_s32(y1, cr1, -748830), cb1, -360857));
+    bgra.val[2] = kpcolclip_neon(vmlaq_n_s32(y0, cr0, 1470104), vmlaq_n_s32(y1, cr1, 1470104));
+    bgra.val[3] = vdup_n_u8(255);
+    vst4_u8((uint8_t *)p, bgra);
+}
+# endif
+
+# ifdef KPLIB_AVX2
+static KPLIB_TARGET_AVX2 void kpyccrow_avx2(const int32_t *dc, const int32_t *dc2, int32_t hsamp, int32_t *p)
+{
+    __m256i cb, cr;
+
+    if (hsamp == 1)
+    {
+        cb = _mm256_loadu_si256((__m256i const *)dc2);
+        cr = _mm256_loadu_si256((__m256i const *)&dc2[64]);
+    }
+    else
+    {
+        __m256i const dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+        cb = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(_mm_loadu_si128((__m128i const *)dc2)), dup);
+        cr = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(_mm_loadu_si128((__m128i const *)&dc2[64])), dup);
+    }
+
+    cb = _mm256_srai_epi32(cb, 20); cr = _mm256_srai_epi32(cr, 20);
+
+    __m256i const y = _mm256_loadu_si256((__m256i const *)dc);
+    __m256i const zero = _mm256_setzero_si256(), k128 = _mm256_set1_epi32(128), k255 = _mm256_set1_epi32(255);
+    __m256i r = _mm256_add_epi32(y, _mm256_mullo_epi32(cr, _mm256_set1_epi32(1470104)));
+    __m256i g = _mm256_add_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(cr, _mm256_set1_epi32(-748830))),
+                                 _mm256_mullo_epi32(cb, _mm256_set1_epi32(-360857)));
+    __m256i b = _mm256_add_epi32(y, _mm256_mullo_epi32(cb, _mm256_set1_epi32(1858077)));
+
+    r = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(_mm256_srai_epi32(r, 22), k128), zero), k255);
+    g = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(_mm256_srai_epi32(g, 22), k128), zero), k255);
+    b = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(_mm256_srai_epi32(b, 22), k128), zero), k255);
+
+    _mm256_storeu_si256((__m256i *)p, _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(k255, 24), _mm256_slli_epi32(r, 16)),
+                                                      _mm256_or_si256(_mm256_slli_epi32(g, 8), b)));
+}
+# endif
+#endif
+
+void kpcontext::yrbrend(int32_t x, int32_t y, int32_t *ldct)
 {
     int32_t i, j, ox, oy, xx, yy, xxx, yyy, xxxend, yyyend, yv, cr = 0, cb = 0, *odc, *dc, *dc2;
     intptr_t p, pp;
@@ -1162,12 +1729,18 @@ static void yrbrend(int32_t x, int32_t y, int32_t *ldct)
             p = pp+(xx<<2);
             dc = odc;
             if (lnumcomponents > 1) dc2 = &ldct[(lcomphvsamp0<<6)+((yy>>lcompvsampshift0)<<3)+(xx>>lcomphsampshift0)];
+            else dc2 = &ldct[10<<6]; //grayscale: stay on the zeros, don't walk off the end of dct[]
             xxxend = min(clipxdim-ox,8);
             yyyend = min(clipydim-oy,8);
             if ((lcomphsamp[0] == 1) && (xxxend == 8))
             {
                 for (yyy=0; yyy<yyyend; yyy++)
                 {
+#ifdef KPLIB_SIMD
+                    if (kpisa != KPLIB_ISA_SCALAR)
+                        KPLIB_DISPATCH(kpyccrow, (dc, dc2, 1, (int32_t *)p));
+                    else
+#endif
                     for (xxx=0; xxx<8; xxx++)
                     {
                         yv = dc[xxx];
@@ -1186,6 +1759,11 @@ static void yrbrend(int32_t x, int32_t y, int32_t *ldct)
             {
                 for (yyy=0; yyy<yyyend; yyy++)
                 {
+#ifdef KPLIB_SIMD
+                    if (kpisa != KPLIB_ISA_SCALAR)
+                        KPLIB_DISPATCH(kpyccrow, (dc, dc2, 2, (int32_t *)p));
+                    else
+#endif
                     for (xxx=0; xxx<8; xxx+=2)
                     {
                         yv = dc[xxx];
@@ -1235,7 +1813,6 @@ static void yrbrend(int32_t x, int32_t y, int32_t *ldct)
         }
     }
 }
-void (*kplib_yrbrend_func)(int32_t,int32_t,int32_t *) = yrbrend;
 
 #define KPEG_GETBITS(curbits, minbits, num, kfileptr, kfileend)\
     while (curbits < minbits)\
@@ -1245,8 +1822,8 @@ void (*kplib_yrbrend_func)(int32_t,int32_t,int32_t *) = yrbrend;
     }
 
 
-static int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kpegrend(const char *kfilebuf, int32_t kfilength,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i, j, v, leng = 0, xdim = 0, ydim = 0, index, prec, restartcnt, restartinterval;
     int32_t x, y, z, xx, yy, zz, *dc = NULL, num, curbits, c, daval, dabits, *hqval, *hqbits, hqcnt, *quanptr = NULL;
@@ -1256,8 +1833,6 @@ static int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
     uint8_t ch, marker, dcflag;
     const uint8_t *kfileptr, *kfileend;
 
-    if (!kpeginited) { kpeginited = 1; initkpeg(); }
-
     kfileptr = (uint8_t const *)kfilebuf;
     kfileend = &kfileptr[kfilength];
 
@@ -1556,7 +2131,7 @@ static int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
                             }
                     }
 
-                    if (!dctbuf) kplib_yrbrend_func(x,y,&dct[0][0]);
+                    if (!dctbuf) yrbrend(x,y,&dct[0][0]);
 
                     restartcnt--;
                     if (!restartcnt)
@@ -1604,7 +2179,7 @@ static int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
                         for (z=0; z<64; z++) dc[z] = ((int32_t)dcs[zigit[z]])*quanptr[z];
                         invdct8x8(dc,0xff);
                     }
-            kplib_yrbrend_func(x,y,&dct[0][0]);
+            yrbrend(x,y,&dct[0][0]);
         }
 
     Xfree(dctbuf); return 0;
@@ -1613,11 +2188,8 @@ static int32_t kpegrend(const char *kfilebuf, int32_t kfilength,
 //==============================  KPEGILIB ends ==============================
 //================================ GIF begins ================================
 
-static uint8_t suffix[4100], filbuffer[768], tempstack[4096];
-static int32_t prefix[4100];
-
-static int32_t kgifrend(const char *kfilebuf, int32_t kfilelength,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kgifrend(const char *kfilebuf, int32_t kfilelength,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i, x, y, xsiz, ysiz, yinc, xend, xspan, yspan, currstr, numbitgoal;
     int32_t lzcols, dat, blocklen, bitcnt, xoff, transcol;
@@ -1744,8 +2316,8 @@ static int32_t kgifrend(const char *kfilebuf, int32_t kfilelength,
 //int32_t imagebytes, filler[4];
 //char pal6bit[256][3], image[ydim][xdim];
 #ifdef KPCEL
-static int32_t kcelrend(const char *buf, int32_t fleng,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kcelrend(const char *buf, int32_t fleng,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i, x, y, x0, x1, y0, y1, xsiz, ysiz;
     const char *cptr;
@@ -1782,8 +2354,8 @@ static int32_t kcelrend(const char *buf, int32_t fleng,
 //===============================  CEL ends ==================================
 //=============================  TARGA begins ================================
 
-static int32_t ktgarend(const char *header, int32_t fleng,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::ktgarend(const char *header, int32_t fleng,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i = 0, x, y, pi, xi, yi, x0, x1, y0, y1, xsiz, ysiz, rlestat, colbyte, pixbyte;
     intptr_t p;
@@ -1882,8 +2454,8 @@ static int32_t ktgarend(const char *header, int32_t fleng,
 //+---------------------+---------------+---------+------------------------------------+
 //                      | rastoff(?): bitmap data |
 //                      +-------------------------+
-static int32_t kbmprend(const char *buf, int32_t fleng,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kbmprend(const char *buf, int32_t fleng,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t i, j, x, y, x0, x1, y0, y1, rastoff, headsiz, xsiz, ysiz, cdim, comp, cptrinc, *lptr;
     const char *cptr;
@@ -1994,8 +2566,8 @@ static int32_t kbmprend(const char *buf, int32_t fleng,
 //===============================  BMP ends ==================================
 //==============================  PCX begins =================================
 //Note: currently only supports 8 and 24 bit PCX
-static int32_t kpcxrend(const char *buf, int32_t fleng,
-                        intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
+int32_t kpcontext::kpcxrend(const char *buf, int32_t fleng,
+                           intptr_t dakpframeplace, int32_t dakpbytesperline, int32_t daxres, int32_t dayres)
 {
     int32_t  j, x, y, nplanes, x0, x1, y0, y1, bpl, xsiz, ysiz;
     intptr_t p,i;
@@ -2293,8 +2865,8 @@ void kpgetdim(const char *buf, int32_t leng, int32_t *xsiz, int32_t *ysiz)
     }
 }
 
-int32_t kprender(const char *buf, int32_t leng, intptr_t frameptr, int32_t bpl,
-                 int32_t xdim, int32_t ydim)
+int32_t kpcontext::render(const char *buf, int32_t leng, intptr_t frameptr, int32_t bpl,
+                          int32_t xdim, int32_t ydim)
 {
     uint8_t const *ubuf = (uint8_t const *)buf;
 
@@ -2327,6 +2899,30 @@ int32_t kprender(const char *buf, int32_t leng, intptr_t frameptr, int32_t bpl,
     }
 }
 
+static kpcontext *kpcontextcreate(void)
+{
+    kpinittables();
+
+    //Everything starts out zero, dct[10] and dct[11] have to (see yrbrend()).  Plain calloc()
+    //rather than Xcalloc(): a block this size comes from the OS already zeroed, and a decode
+    //that only touches part of it shouldn't pay for clearing all of it.
+    auto ctx = (kpcontext *)Bcalloc(1, sizeof(kpcontext));
+
+    if (EDUKE32_PREDICT_FALSE(ctx == nullptr))
+        handle_memerr(sizeof(kpcontext));
+
+    return ctx;
+}
+
+int32_t kprender(const char *buf, int32_t leng, intptr_t frameptr, int32_t bpl,
+                 int32_t xdim, int32_t ydim)
+{
+    kpcontext *const ctx = kpcontextcreate();
+    int32_t const ret = ctx->render(buf, leng, frameptr, bpl, xdim, ydim);
+    Bfree(ctx);
+    return ret;
+}
+
 //==================== External picture interface ends =======================
 
 //Brute-force case-insensitive, slash-insensitive, * and ? wildcard matcher
@@ -2434,9 +3030,31 @@ static int32_t kzcheckhash(const char *filnam, char **zipnam, int32_t *fileoffs,
     return 0;
 }
 
+//Returns the name of the mounted ZIP/GRP holding filnam, or 0 if it isn't in one
+char const *kzgetarchive(const char *filnam)
+{
+    char *zipnam, iscomp;
+    int32_t fileoffs, fileleng;
+
+    return kzcheckhash(filnam,&zipnam,&fileoffs,&fileleng,&iscomp) ? zipnam : 0;
+}
+
+//The ZIP functions aren't thread-safe anyway, so they keep one decoder around for kzread().
+static kpcontext *kzcontext;
+
+static kpcontext *kzgetcontext(void)
+{
+    if (!kzcontext)
+        kzcontext = kpcontextcreate();
+
+    return kzcontext;
+}
+
 void kzuninit()
 {
     DO_FREE_AND_NULL(kzhashbuf);
+    Bfree(kzcontext);
+    kzcontext = nullptr;
     kzhashpos = kzhashsiz = 0; kzdirnamhead = -1;
 }
 
@@ -2606,12 +3224,11 @@ intptr_t kzopen(const char *filnam)
             {
             case 0: kzfs.i = 0; return (intptr_t)kzfs.fil;
             case 8:
-                    if (!pnginited) { pnginited = 1; initpngtables(); }
                 kzfs.comptell = 0;
                 kzfs.compleng = B_LITTLE32(B_UNBUF32(&tempbuf[18]));
 
                 //WARNING: No file in ZIP can be > 2GB-32K bytes
-                gslidew = 0x7fffffff; //Force reload at beginning
+                kzgetcontext()->gslidew = 0x7fffffff; //Force reload at beginning
 
                 return (intptr_t)kzfs.fil;
             default: buildvfs_fclose(kzfs.fil); kzfs.fil = 0; return 0;
@@ -2819,6 +3436,11 @@ static void putbuf4zip(const uint8_t *buf, int32_t uncomp0, int32_t uncomp1)
 
 //returns number of bytes copied
 int32_t kzread(void *buffer, int32_t leng)
+{
+    return kzgetcontext()->zipread(buffer, leng);
+}
+
+int32_t kpcontext::zipread(void *buffer, int32_t leng)
 {
     int32_t i, j, k, bfinal, btype, hlit, hdist;
 
@@ -3054,6 +3676,29 @@ void kpzdecode(int32_t const leng, intptr_t * const pic, int32_t * const xsiz, i
     }
 }
 
+void kpdecode(kpimage_t * const img)
+{
+    img->pic = 0;
+
+    kpgetdim(img->buf, img->leng, &img->xsiz, &img->ysiz);
+
+    if (img->xsiz <= 0 || img->ysiz <= 0)
+        return;
+
+    img->pic = (intptr_t)Xcalloc(img->xsiz * img->ysiz, sizeof(int32_t));
+
+    if (kprender(img->buf, img->leng, img->pic, img->xsiz<<2, img->xsiz, img->ysiz) < 0)
+    {
+        Xfree((void *)img->pic);
+        img->pic = 0;
+    }
+}
+
+void kpdecodemulti(kpimage_t * const images, int32_t const numimages)
+{
+    async::parallel_for(async::irange(0, numimages), [images](int32_t const i) { kpdecode(&images[i]); });
+}
+
 void kpzload(const char * const filnam, intptr_t * const pic, int32_t * const xsiz, int32_t * const ysiz)
 {
     kpzdecode(kpzbufload(filnam), pic, xsiz, ysiz);
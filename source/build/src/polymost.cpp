@@ -13,6 +13,7 @@ Ken Silverman's official web site: http://www.advsys.net/ken
 #include "editor.h"
 #include "engine_priv.h"
 #include "kplib.h"
+#include "libasync_config.h"
 #include "mdsprite.h"
 #include "polymost.h"
 #include "microprofile.h"
@@ -2307,19 +2308,100 @@ void gloadtile_art(int32_t dapic, int32_t dapal, int32_t tintpalnum, int32_t das
 
 int gloadtile_willprint;
 
+// Replacement textures decoded ahead of time by polymost_prefetch()
+typedef struct hicprefetch_
+{
+    struct hicprefetch_ *next;
+    char *fn;
+    char *buf;        // file contents, freed once decoded
+    int32_t leng;
+    int32_t lasttile;
+    vec2_t tsiz;
+    coltype *pic;     // tsiz.x*tsiz.y, NULL if decoding failed
+    async::task<void> task;
+} hicprefetch_t;
+
+static hicprefetch_t *hicprefetch_head;
+static int32_t hicprefetch_count;
+
+static hicprefetch_t *hicprefetch_find(char const *fn)
+{
+    for (auto p = hicprefetch_head; p; p = p->next)
+        if (!filnamcmp(p->fn, fn))
+            return p;
+
+    return NULL;
+}
+
+// runs on a worker thread
+static void hicprefetch_decode(hicprefetch_t *const p)
+{
+    kpimage_t img = { p->buf, p->leng, 0, 0, 0 };
+
+    // ART units and anything else kplib doesn't know are left to gloadtile_mdloadskin_check()
+    kpdecode(&img);
+
+    p->tsiz = { img.xsiz, img.ysiz };
+    p->pic = (coltype *)img.pic;
+
+    DO_FREE_AND_NULL(p->buf);
+}
+
+static void hicprefetch_free(hicprefetch_t *const p)
+{
+    p->task.wait();
+
+    Xfree(p->fn);
+    Xfree(p->pic);
+    delete p;
+
+    hicprefetch_count--;
+}
+
+// Set by gloadtile_mdloadskin_check() when the file has already been decoded by polymost_prefetch().
+static coltype const *gloadtile_prefetchpic;
+
+static int32_t gloadtile_render(int32_t picfillen, coltype *pic, int32_t bytesperline, vec2_t const &tsiz, vec2_t const &siz)
+{
+    if (gloadtile_prefetchpic)
+    {
+        for (int32_t y = 0; y < tsiz.y; y++)
+            Bmemcpy((char *)pic + y * bytesperline, &gloadtile_prefetchpic[y * tsiz.x], tsiz.x * sizeof(coltype));
+
+        return 0;
+    }
+
+    return kprender(kpzbuf, picfillen, (intptr_t)pic, bytesperline, siz.x, siz.y);
+}
+
 static bool gloadtile_mdloadskin_check(char *fn, int32_t picfillen, vec2_t *const tsiz, vec2_t *const siz, int *isart)
 {
     *isart = 0;
-    int32_t const length = kpzbufload(fn);
-    if (length == 0)
-        return false;
+    gloadtile_prefetchpic = NULL;
 
-    // tsizx/y = replacement texture's natural size
-    // xsiz/y = 2^x size of replacement
+    hicprefetch_t *const p = hicprefetch_find(fn);
+
+    if (p)
+        p->task.wait();
+
+    if (p && p->pic)
+    {
+        gloadtile_prefetchpic = p->pic;
+        *tsiz = p->tsiz;
+    }
+    else
+    {
+        int32_t const length = kpzbufload(fn);
+        if (length == 0)
+            return false;
+
+        // tsizx/y = replacement texture's natural size
+        // xsiz/y = 2^x size of replacement
 
 #ifdef WITHKPLIB
-    kpgetdim(kpzbuf, picfillen, &tsiz->x, &tsiz->y);
+        kpgetdim(kpzbuf, picfillen, &tsiz->x, &tsiz->y);
 #endif
+    }
 
     if (tsiz->x == 0 || tsiz->y == 0)
     {
@@ -2368,7 +2450,7 @@ uint8_t *gloadindexedtile_mdloadskin_shared(char *fn, int32_t picfillen, vec2_t
     {
         int32_t const bytesperline = tsiz->x * sizeof(coltype);
         coltype *temppic = (coltype *)Xcalloc(tsiz->y, bytesperline);
-        if (kprender(kpzbuf,picfillen,(intptr_t)temppic,bytesperline,tsiz->x,tsiz->y))
+        if (gloadtile_render(picfillen, temppic, bytesperline, *tsiz, *tsiz))
         {
             Xfree(pic);
             Xfree(temppic);
@@ -2423,7 +2505,7 @@ coltype *gloadtruecolortile_mdloadskin_shared(char *fn, int32_t picfillen, vec2_
 #ifdef WITHKPLIB
         else
         {
-            if (kprender(kpzbuf, picfillen, (intptr_t)pic, bytesperline, siz->x, siz->y))
+            if (gloadtile_render(picfillen, pic, bytesperline, *tsiz, *siz))
             {
                 Xfree(pic);
                 return nullptr;// -2;
@@ -10125,6 +10207,67 @@ void polymost_initosdfuncs(void)
         OSD_RegisterCvar(&cvars_polymost[i], (cvars_polymost[i].flags & CVAR_FUNCPTR) ? osdcmd_cvar_set_polymost : osdcmd_cvar_set);
 }
 
+void polymost_prefetch(int32_t dapicnum, int32_t dapalnum, int32_t datype)
+{
+    if (videoGetRenderMode() < REND_POLYMOST) return;
+    if ((dapalnum < (MAXPALOOKUPS - RESERVEDPALS)) && (palookup[dapalnum] == NULL)) return;
+
+    char const *const fn = texcache_getdecodefile(dapicnum, dapalnum, (datype & 1)*(DAMETH_CLAMPED|DAMETH_MASK));
+
+    if (fn == NULL)
+        return;
+
+    if (auto p = hicprefetch_find(fn))
+    {
+        p->lasttile = max(p->lasttile, dapicnum);
+        return;
+    }
+
+    // the file system isn't thread-safe, so the contents are read here
+    buildvfs_kfd const filh = kopen4load(fn, 0);
+
+    if (filh == buildvfs_kfd_invalid)
+        return;
+
+    auto p = new hicprefetch_t{};
+
+    p->fn   = Xstrdup(fn);
+    p->leng = kfilelength(filh);
+    p->buf  = (char *)Xmalloc(p->leng + 1);
+    p->buf[p->leng] = 0;  // see kpzbufloadfil()
+    p->lasttile = dapicnum;
+
+    kread(filh, p->buf, p->leng);
+    kclose(filh);
+
+    p->task = async::spawn([p]() { hicprefetch_decode(p); });
+
+    p->next = hicprefetch_head;
+    hicprefetch_head = p;
+    hicprefetch_count++;
+}
+
+bool polymost_prefetchfull(void)
+{
+    return hicprefetch_count >= max<int32_t>(4, 2 * async::hardware_concurrency());
+}
+
+void polymost_prefetchrelease(int32_t dapicnum)
+{
+    for (hicprefetch_t **pp = &hicprefetch_head; *pp;)
+    {
+        hicprefetch_t *const p = *pp;
+
+        if (p->lasttile <= dapicnum)
+        {
+            *pp = p->next;
+            hicprefetch_free(p);
+        }
+        else
+            pp = &p->next;
+    }
+}
+
 void polymost_precache(int32_t dapicnum, int32_t dapalnum, int32_t datype)
 {
     // dapicnum and dapalnum are like you'd expect
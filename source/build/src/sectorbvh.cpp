@@ -0,0 +1,475 @@
+// Per-sector wall bounding volume hierarchies for hitscan() and cansee()
+// See sectorbvh.h for an overview.
+
+#include "build.h"
+#include "baselayer.h"
+#include "engine_priv.h"
+#include "sectorbvh.h"
+#include "timer.h"
+
+#define SECTORBVH_LEAFWALLS 4
+#define SECTORBVH_MINWALLS 16  // smaller sectors are cheaper to scan linearly
+
+// Trees are only used while all of their walls lie within this distance of
+// the origin, which keeps the culling tests below exact in 64 bits and
+// rules out the int64 overflows rintersect() runs into with huge coordinates.
+#define SECTORBVH_MAXCOORD (1<<21)
+
+typedef struct
+{
+    int32_t xmin, ymin, xmax, ymax;
+    int32_t extent;  // largest x or y extent of a single wall below this node
+    int32_t startwall, endwall;
+    int32_t numnodes;  // size of the subtree rooted here in preorder, 1 for leaves
+} sectorbvhnode_t;
+
+typedef struct
+{
+    sectorbvhnode_t *nodes;
+    int32_t numnodes;
+    int16_t wallptr, wallnum;
+    bool    usable;
+} sectorbvhtree_t;
+
+int32_t sectorbvh_enabled = 1;
+
+static sectorbvhtree_t sectorbvhtree[MAXSECTORS];
+static uint8_t sectorbvhdirty[bitmap_size(MAXSECTORS)];
+
+static void sectorbvhBuildNodes(sectorbvhnode_t * const nodes, int32_t &numnodes, int32_t const startwall, int32_t const endwall)
+{
+    int32_t const nodenum = numnodes++;
+
+    if (endwall - startwall > SECTORBVH_LEAFWALLS)
+    {
+        int32_t const midwall = startwall + ((endwall - startwall) >> 1);
+
+        sectorbvhBuildNodes(nodes, numnodes, startwall, midwall);
+        sectorbvhBuildNodes(nodes, numnodes, midwall, endwall);
+    }
+
+    auto &node = nodes[nodenum];
+
+    node.startwall = startwall;
+    node.endwall   = endwall;
+    node.numnodes  = numnodes - nodenum;
+}
+
+static FORCE_INLINE bool sectorbvhCoordInRange(int32_t const c)
+{
+    return (unsigned)(c + SECTORBVH_MAXCOORD) <= 2u * SECTORBVH_MAXCOORD;
+}
+
+// children come after their parent in preorder, so a backwards pass sees them first
+static bool sectorbvhRefit(sectorbvhtree_t const &tree)
+{
+    for (int i = tree.numnodes - 1; i >= 0; i--)
+    {
+        auto &node = tree.nodes[i];
+
+        if (node.numnodes > 1)
+        {
+            auto const &left  = tree.nodes[i + 1];
+            auto const &right = tree.nodes[i + 1 + left.numnodes];
+
+            node.xmin   = min(left.xmin, right.xmin);
+            node.ymin   = min(left.ymin, right.ymin);
+            node.xmax   = max(left.xmax, right.xmax);
+            node.ymax   = max(left.ymax, right.ymax);
+            node.extent = max(left.extent, right.extent);
+            continue;
+        }
+
+        node.xmin = node.ymin = INT32_MAX;
+        node.xmax = node.ymax = INT32_MIN;
+        node.extent = 0;
+
+        for (int w = node.startwall; w < node.endwall; w++)
+        {
+            auto const &wal = *(uwallptr_t)&wall[w];
+
+            if ((unsigned)wal.point2 >= (unsigned)MAXWALLS)
+                return false;
+
+            auto const &wal2 = *(uwallptr_t)&wall[wal.point2];
+
+            if (!sectorbvhCoordInRange(wal.x) || !sectorbvhCoordInRange(wal.y) || !sectorbvhCoordInRange(wal2.x) || !sectorbvhCoordInRange(wal2.y))
+                return false;
+
+            node.xmin   = min(node.xmin, min(wal.x, wal2.x));
+            node.ymin   = min(node.ymin, min(wal.y, wal2.y));
+            node.xmax   = max(node.xmax, max(wal.x, wal2.x));
+            node.ymax   = max(node.ymax, max(wal.y, wal2.y));
+            node.extent = max(node.extent, max(klabs(wal2.x - wal.x), klabs(wal2.y - wal.y)));
+        }
+    }
+
+    return true;
+}
+
+static void sectorbvhUpdate(int const sectnum)
+{
+    auto &tree = sectorbvhtree[sectnum];
+    auto const &sec = sector[sectnum];
+
+    bitmap_clear(sectorbvhdirty, sectnum);
+
+    if (sec.wallnum < SECTORBVH_MINWALLS || sec.wallptr < 0 || sec.wallptr + sec.wallnum > MAXWALLS)
+    {
+        DO_FREE_AND_NULL(tree.nodes);
+        tree.numnodes = 0;
+        tree.wallptr  = sec.wallptr;
+        tree.wallnum  = sec.wallnum;
+        tree.usable   = false;
+        return;
+    }
+
+    if (!tree.nodes || tree.wallptr != sec.wallptr || tree.wallnum != sec.wallnum)
+    {
+        // a sector's tree never has more nodes than the sector has walls
+        tree.nodes    = (sectorbvhnode_t *)Xrealloc(tree.nodes, sec.wallnum * sizeof(sectorbvhnode_t));
+        tree.numnodes = 0;
+        tree.wallptr  = sec.wallptr;
+        tree.wallnum  = sec.wallnum;
+
+        sectorbvhBuildNodes(tree.nodes, tree.numnodes, sec.wallptr, sec.wallptr + sec.wallnum);
+    }
+
+    tree.usable = sectorbvhRefit(tree);
+}
+
+static sectorbvhtree_t const *sectorbvhGetTree(int const sectnum)
+{
+    if (!sectorbvh_enabled || editstatus || (unsigned)sectnum >= (unsigned)numsectors)
+        return nullptr;
+
+    auto const &tree = sectorbvhtree[sectnum];
+
+    if (bitmap_test(sectorbvhdirty, sectnum) || tree.wallptr != sector[sectnum].wallptr || tree.wallnum != sector[sectnum].wallnum)
+        sectorbvhUpdate(sectnum);
+
+    return tree.usable ? &tree : nullptr;
+}
+
+void sectorbvhBuild(void)
+{
+    for (int i = numsectors; i < MAXSECTORS; i++)
+    {
+        DO_FREE_AND_NULL(sectorbvhtree[i].nodes);
+        sectorbvhtree[i].numnodes = 0;
+        sectorbvhtree[i].wallnum  = 0;
+        sectorbvhtree[i].usable   = false;
+    }
+
+    Bmemset(sectorbvhdirty, 0, sizeof(sectorbvhdirty));
+
+    for (int i = 0; i < numsectors; i++)
+        sectorbvhUpdate(i);
+}
+
+void sectorbvhInvalidateSector(int16_t const sectnum)
+{
+    if ((unsigned)sectnum < MAXSECTORS)
+        bitmap_set(sectorbvhdirty, sectnum);
+}
+
+void sectorbvhInvalidateWall(int16_t const wallnum)
+{
+    int const sectnum = sectorofwall(wallnum);
+
+    if (sectnum >= 0)
+        bitmap_set(sectorbvhdirty, sectnum);
+}
+
+void sectorbvhRefresh(void)
+{
+    for (int i = 0; i < numsectors; i++)
+    {
+        auto const &tree = sectorbvhtree[i];
+
+        if (bitmap_test(sectorbvhdirty, i) || tree.wallptr != sector[i].wallptr || tree.wallnum != sector[i].wallnum)
+            sectorbvhUpdate(i);
+    }
+}
+
+// Appends the leaves cull() doesn't reject, merging ranges that touch.
+template <typename Cull>
+static void sectorbvhQuery(sectorbvhtree_t const &tree, sectorbvhwalls_t * const walls, Cull cull)
+{
+    auto const nodes = tree.nodes;
+
+    walls->numranges = 0;
+
+    for (int i = 0; i < tree.numnodes;)
+    {
+        auto const &node = nodes[i];
+
+        if (cull(node))
+        {
+            i += node.numnodes;
+            continue;
+        }
+
+        if (node.numnodes == 1)
+        {
+            int const n = walls->numranges;
+
+            if (n && walls->end[n - 1] == node.startwall)
+                walls->end[n - 1] = node.endwall;
+            else if (n == SECTORBVH_MAXRANGES)
+            {
+                // out of room, take everything that's left
+                walls->end[n - 1] = nodes[0].endwall;
+                return;
+            }
+            else
+            {
+                walls->start[n] = node.startwall;
+                walls->end[n]   = node.endwall;
+                walls->numranges++;
+            }
+        }
+
+        i++;
+    }
+}
+
+// cansee() keeps a wall when 0 <= t < bot for both of its int32 intersection
+// parameters, which puts the intersection on both segments as long as none of
+// its products overflow.  The bounds below make sure they don't for any wall
+// under the node before it is culled; the original products for
+// d = p2 - p1, e = wall extent and r = wall start - p1 are bounded by
+// 2*|d|*|e|, 2*|d|*|r| and 2*|r|*|e|.  cansee() moves its start point when it
+// passes through TROR but keeps d, so the segment is given as a vector too.
+void sectorbvhGetSegmentWalls(int16_t const sectnum, vec2_t const pos, vec2_t const vec, sectorbvhwalls_t * const walls)
+{
+    auto const tree = sectorbvhGetTree(sectnum);
+
+    if (!tree || !sectorbvhCoordInRange(pos.x) || !sectorbvhCoordInRange(pos.y))
+    {
+        sectorbvhGetAllWalls(sectnum, walls);
+        return;
+    }
+
+    int64_t const dx = vec.x, dy = vec.y;
+    int64_t const range = max(max(dx, -dx), max(dy, -dy));
+
+    int64_t const lox = min<int64_t>(pos.x, pos.x + dx), hix = max<int64_t>(pos.x, pos.x + dx);
+    int64_t const loy = min<int64_t>(pos.y, pos.y + dy), hiy = max<int64_t>(pos.y, pos.y + dy);
+
+    sectorbvhQuery(*tree, walls, [&](sectorbvhnode_t const &node)
+    {
+        int64_t const x0 = (int64_t)node.xmin - pos.x, x1 = (int64_t)node.xmax - pos.x;
+        int64_t const y0 = (int64_t)node.ymin - pos.y, y1 = (int64_t)node.ymax - pos.y;
+        int64_t const dist = max(max(-x0, x1), max(-y0, y1));
+
+        if (2 * range * node.extent > INT32_MAX || 2 * range * dist > INT32_MAX || 2 * dist * node.extent > INT32_MAX)
+            return false;
+
+        if (node.xmax < lox || node.xmin > hix || node.ymax < loy || node.ymin > hiy)
+            return true;
+
+        int64_t const s00 = x0 * dy - y0 * dx, s10 = x1 * dy - y0 * dx;
+        int64_t const s01 = x0 * dy - y1 * dx, s11 = x1 * dy - y1 * dx;
+
+        return (s00 > 0 && s10 > 0 && s01 > 0 && s11 > 0) || (s00 < 0 && s10 < 0 && s01 < 0 && s11 < 0);
+    });
+}
+
+// hitscan() keeps a wall when rintersect() puts the intersection on the wall
+// and in front of pos, and only if the rounded intersection is closer than
+// the current hit.  The rounding moves it by less than |vec|/65536 + 1 on
+// each axis, which is what the distance margin accounts for.
+void sectorbvhGetRayWalls(int16_t const sectnum, vec2_t const pos, vec2_t const vec, int32_t const maxdist, sectorbvhwalls_t * const walls)
+{
+    auto const tree = sectorbvhGetTree(sectnum);
+
+    if (!tree || !sectorbvhCoordInRange(pos.x) || !sectorbvhCoordInRange(pos.y))
+    {
+        sectorbvhGetAllWalls(sectnum, walls);
+        return;
+    }
+
+    int64_t const vx = vec.x, vy = vec.y;
+    int64_t const margin = ((max(vx, -vx) + max(vy, -vy)) >> 16) + 3;
+
+    sectorbvhQuery(*tree, walls, [&](sectorbvhnode_t const &node)
+    {
+        int64_t const x0 = (int64_t)node.xmin - pos.x, x1 = (int64_t)node.xmax - pos.x;
+        int64_t const y0 = (int64_t)node.ymin - pos.y, y1 = (int64_t)node.ymax - pos.y;
+
+        if (max<int64_t>(max(x0, -x1), 0) + max<int64_t>(max(y0, -y1), 0) - margin >= maxdist)
+            return true;
+
+        int64_t const s00 = x0 * vy - y0 * vx, s10 = x1 * vy - y0 * vx;
+        int64_t const s01 = x0 * vy - y1 * vx, s11 = x1 * vy - y1 * vx;
+
+        if ((s00 > 0 && s10 > 0 && s01 > 0 && s11 > 0) || (s00 < 0 && s10 < 0 && s01 < 0 && s11 < 0))
+            return true;
+
+        // behind pos
+        return max(x0 * vx, x1 * vx) + max(y0 * vy, y1 * vy) < 0;
+    });
+}
+
+// clipmove() skips a wall when both of its points are beyond the same edge of
+// its clipping box, which holds for every wall under a node whose bounding
+// box is disjoint from it.
+void sectorbvhGetBoxWalls(int16_t const sectnum, vec2_t const boxmin, vec2_t const boxmax, sectorbvhwalls_t * const walls)
+{
+    auto const tree = sectorbvhGetTree(sectnum);
+
+    if (!tree)
+    {
+        sectorbvhGetAllWalls(sectnum, walls);
+        return;
+    }
+
+    sectorbvhQuery(*tree, walls, [&](sectorbvhnode_t const &node)
+    {
+        return node.xmax < boxmin.x || node.xmin > boxmax.x || node.ymax < boxmin.y || node.ymin > boxmax.y;
+    });
+}
+
+static uint32_t sectorbvhseed;
+
+static uint32_t sectorbvhRand(void)
+{
+    sectorbvhseed = sectorbvhseed * 1664525 + 1013904223;
+    return sectorbvhseed >> 8;
+}
+
+static bool sectorbvhRandomPoint(vec3_t * const pos, int16_t * const sectnum)
+{
+    int const sect = sectorbvhRand() % numsectors;
+    auto const &sec = sector[sect];
+
+    if (sec.wallnum < 3)
+        return false;
+
+    auto const walls = (uwallptr_t)&wall[sec.wallptr];
+    vec2_t lo = walls[0].xy, hi = lo;
+
+    for (int w = 1; w < sec.wallnum; w++)
+    {
+        lo = { min(lo.x, walls[w].x), min(lo.y, walls[w].y) };
+        hi = { max(hi.x, walls[w].x), max(hi.y, walls[w].y) };
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        int32_t const x = lo.x + (int32_t)(sectorbvhRand() % ((uint32_t)(hi.x - lo.x) + 1));
+        int32_t const y = lo.y + (int32_t)(sectorbvhRand() % ((uint32_t)(hi.y - lo.y) + 1));
+
+        if (inside(x, y, sect) != 1)
+            continue;
+
+        int32_t cz, fz;
+        getzsofslope(sect, x, y, &cz, &fz);
+
+        *pos = { x, y, fz > cz ? cz + (int32_t)(sectorbvhRand() % ((uint32_t)(fz - cz))) : cz };
+        *sectnum = sect;
+        return true;
+    }
+
+    return false;
+}
+
+typedef struct
+{
+    vec3_t  pos, vec;
+    int16_t sectnum;
+} sectorbvhtrace_t;
+
+static double sectorbvhMilliseconds(uint64_t const ticks)
+{
+    return ticks * 1000.0 / timerGetPerformanceFrequency();
+}
+
+void sectorbvhBenchmark(int32_t const numtraces)
+{
+    if (numsectors <= 0)
+    {
+        LOG_F(ERROR, "tracebench: no map loaded.");
+        return;
+    }
+
+    auto const traces = (sectorbvhtrace_t *)Xmalloc(numtraces * sizeof(sectorbvhtrace_t));
+    auto const targets = (sectorbvhtrace_t *)Xmalloc(numtraces * sizeof(sectorbvhtrace_t));
+    auto const hits = (hitdata_t *)Xmalloc(numtraces * sizeof(hitdata_t));
+    auto const seen = (uint8_t *)Xmalloc(numtraces);
+
+    sectorbvhseed = 0x1337;
+
+    int32_t n = 0;
+
+    for (int i = 0; n < numtraces && i < numtraces * 4; i++)
+    {
+        if (!sectorbvhRandomPoint(&traces[n].pos, &traces[n].sectnum) || !sectorbvhRandomPoint(&targets[n].pos, &targets[n].sectnum))
+            continue;
+
+        int const ang = sectorbvhRand() & 2047;
+
+        traces[n].vec = { sintable[(ang + 512) & 2047], sintable[ang], (int32_t)(sectorbvhRand() & 0x3ffff) - 0x20000 };
+        n++;
+    }
+
+    int32_t const enabled = sectorbvh_enabled;
+    uint64_t ticks[2][2];
+    int32_t hitmismatches = 0, seemismatches = 0;
+
+    uint64_t const buildticks = timerGetPerformanceCounter();
+    sectorbvhBuild();
+    uint64_t const buildtime = timerGetPerformanceCounter() - buildticks;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        sectorbvh_enabled = pass;
+
+        uint64_t t = timerGetPerformanceCounter();
+
+        for (int i = 0; i < n; i++)
+        {
+            hitdata_t hit;
+            hitscan(&traces[i].pos, traces[i].sectnum, traces[i].vec.x, traces[i].vec.y, traces[i].vec.z, &hit, 0x10001);
+
+            if (pass == 0)
+                hits[i] = hit;
+            else if (hit.x != hits[i].x || hit.y != hits[i].y || hit.z != hits[i].z || hit.sprite != hits[i].sprite
+                     || hit.wall != hits[i].wall || hit.sect != hits[i].sect)
+                hitmismatches++;
+        }
+
+        ticks[pass][0] = timerGetPerformanceCounter() - t;
+        t = timerGetPerformanceCounter();
+
+        for (int i = 0; i < n; i++)
+        {
+            auto const &p1 = traces[i].pos, &p2 = targets[i].pos;
+            uint8_t const result = cansee(p1.x, p1.y, p1.z, traces[i].sectnum, p2.x, p2.y, p2.z, targets[i].sectnum);
+
+            if (pass == 0)
+                seen[i] = result;
+            else if (result != seen[i])
+                seemismatches++;
+        }
+
+        ticks[pass][1] = timerGetPerformanceCounter() - t;
+    }
+
+    sectorbvh_enabled = enabled;
+
+    LOG_F(INFO, "tracebench: %d traces over %d sectors, trees built in %.3f ms", n, numsectors, sectorbvhMilliseconds(buildtime));
+    LOG_F(INFO, "  hitscan: %9.3f ms linear, %9.3f ms with trees, %d mismatches", sectorbvhMilliseconds(ticks[0][0]),
+          sectorbvhMilliseconds(ticks[1][0]), hitmismatches);
+    LOG_F(INFO, "  cansee:  %9.3f ms linear, %9.3f ms with trees, %d mismatches", sectorbvhMilliseconds(ticks[0][1]),
+          sectorbvhMilliseconds(ticks[1][1]), seemismatches);
+
+    if (hitmismatches || seemismatches)
+        LOG_F(ERROR, "tracebench: results with and without sector trees differ!");
+
+    Xfree(seen);
+    Xfree(hits);
+    Xfree(targets);
+    Xfree(traces);
+}
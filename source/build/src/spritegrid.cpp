@@ -0,0 +1,162 @@
+// Uniform grid of sprite positions for proximity queries
+// See spritegrid.h for an overview.
+
+#include "build.h"
+#include "spritegrid.h"
+
+static int16_t headspritegrid[SPRITEGRID_BUCKETS];
+static int16_t prevspritegrid[MAXSPRITES], nextspritegrid[MAXSPRITES];
+static int16_t spritegridbucket[MAXSPRITES];  // -1 when not in the grid
+static vec2_t spritegridpos[MAXSPRITES];      // position the bucket was computed from
+
+static FORCE_INLINE int32_t spritegridGetBucket(int32_t const cellx, int32_t const celly)
+{
+    return ((uint32_t)cellx * 73856093u ^ (uint32_t)celly * 19349663u) & (SPRITEGRID_BUCKETS - 1);
+}
+
+static FORCE_INLINE int32_t spritegridGetBucket(vec2_t const pos)
+{
+    return spritegridGetBucket(pos.x >> SPRITEGRID_CELLSHIFT, pos.y >> SPRITEGRID_CELLSHIFT);
+}
+
+void spritegridClear(void)
+{
+    Bmemset(headspritegrid, -1, sizeof(headspritegrid));
+    Bmemset(spritegridbucket, -1, sizeof(spritegridbucket));
+}
+
+void spritegridRemove(int16_t const spritenum)
+{
+    int32_t const bucket = spritegridbucket[spritenum];
+
+    if (bucket < 0)
+        return;
+
+    int32_t const prev = prevspritegrid[spritenum];
+    int32_t const next = nextspritegrid[spritenum];
+
+    if (headspritegrid[bucket] == spritenum)
+        headspritegrid[bucket] = next;
+    if (prev >= 0)
+        nextspritegrid[prev] = next;
+    if (next >= 0)
+        prevspritegrid[next] = prev;
+
+    spritegridbucket[spritenum] = -1;
+}
+
+void spritegridUpdate(int16_t const spritenum)
+{
+    auto const &spr = sprite[spritenum];
+
+    if (spr.statnum == MAXSTATUS)
+    {
+        spritegridRemove(spritenum);
+        return;
+    }
+
+    int32_t const bucket = spritegridGetBucket(spr.xy);
+
+    spritegridpos[spritenum] = spr.xy;
+
+    if (bucket == spritegridbucket[spritenum])
+        return;
+
+    spritegridRemove(spritenum);
+
+    int16_t const ohead = headspritegrid[bucket];
+
+    prevspritegrid[spritenum] = -1;
+    nextspritegrid[spritenum] = ohead;
+    if (ohead >= 0)
+        prevspritegrid[ohead] = spritenum;
+    headspritegrid[bucket] = spritenum;
+
+    spritegridbucket[spritenum] = bucket;
+}
+
+int32_t spritegridRefresh(void)
+{
+    int32_t numupdated = 0;
+
+    for (int i = 0; i < MAXSPRITES; i++)
+    {
+        auto const &spr = sprite[i];
+
+        if (spr.statnum == MAXSTATUS)
+        {
+            spritegridRemove(i);
+            continue;
+        }
+
+        if (spritegridbucket[i] < 0 || spritegridpos[i].x != spr.x || spritegridpos[i].y != spr.y)
+        {
+            spritegridUpdate(i);
+            numupdated++;
+        }
+    }
+
+    return numupdated;
+}
+
+static FORCE_INLINE int32_t spritegridClampCoord(int64_t const c)
+{
+    return (int32_t)min<int64_t>(max<int64_t>(c, INT32_MIN), INT32_MAX);
+}
+
+int32_t spritegridQuery(vec2_t const pos, int32_t const radius, int16_t * const sprites, int32_t const maxsprites)
+{
+    vec2_t const lo = { spritegridClampCoord((int64_t)pos.x - radius), spritegridClampCoord((int64_t)pos.y - radius) };
+    vec2_t const hi = { spritegridClampCoord((int64_t)pos.x + radius), spritegridClampCoord((int64_t)pos.y + radius) };
+
+    vec2_t const celllo = { lo.x >> SPRITEGRID_CELLSHIFT, lo.y >> SPRITEGRID_CELLSHIFT };
+    vec2_t const cellhi = { hi.x >> SPRITEGRID_CELLSHIFT, hi.y >> SPRITEGRID_CELLSHIFT };
+
+    int32_t numfound = 0;
+
+    auto const testBucket = [&](int32_t const bucket)
+    {
+        for (int i = headspritegrid[bucket]; i >= 0; i = nextspritegrid[i])
+        {
+            vec2_t const &p = spritegridpos[i];
+
+            if (p.x < lo.x || p.x > hi.x || p.y < lo.y || p.y > hi.y)
+                continue;
+
+            if (numfound < maxsprites)
+                sprites[numfound] = i;
+
+            numfound++;
+        }
+    };
+
+    uint64_t const numcells = (uint64_t)(cellhi.x - celllo.x + 1) * (uint64_t)(cellhi.y - celllo.y + 1);
+
+    if (numcells >= SPRITEGRID_BUCKETS)
+    {
+        for (int bucket = 0; bucket < SPRITEGRID_BUCKETS; bucket++)
+            testBucket(bucket);
+
+        return numfound;
+    }
+
+    // several cells can hash to the same bucket
+    uint8_t visited[bitmap_size(SPRITEGRID_BUCKETS)];
+    Bmemset(visited, 0, sizeof(visited));
+
+    for (int32_t celly = celllo.y; celly <= cellhi.y; celly++)
+    {
+        for (int32_t cellx = celllo.x; cellx <= cellhi.x; cellx++)
+        {
+            int32_t const bucket = spritegridGetBucket(cellx, celly);
+
+            if (bitmap_test(visited, bucket))
+                continue;
+
+            bitmap_set(visited, bucket);
+            testBucket(bucket);
+        }
+    }
+
+    return numfound;
+}
@@ -130,21 +130,37 @@ pthtyp *texcache_fetchmulti(pthtyp *pth, hicreplctyp *si, int32_t dapicnum, int3
     return NULL;
 }
 
-// <dashade>: ignored if not in Polymost+r_usetileshades
-pthtyp *texcache_fetch(int32_t dapicnum, int32_t dapalnum, int32_t dashade, int32_t dameth)
+static hicreplctyp *texcache_findsubst(int32_t dapicnum, int32_t dapalnum, int32_t dameth, int *indexed)
 {
-    const int32_t j = dapicnum & (GLTEXCACHEADSIZ - 1);
-    int indexed = 0;
     hicreplctyp *si = usehightile ? hicfindsubst(dapicnum, dapalnum, hictinting[dapalnum].f & HICTINT_ALWAYSUSEART) : NULL;
+    *indexed = 0;
     if (usehightile && (dameth & DAMETH_INDEXED) && !(hictinting[dapalnum].f & HICTINT_ALWAYSUSEART))
     {
         hicreplctyp *pal0 = hicfindsubst(dapicnum, 0, 0);
         if (pal0 && pal0->flags & HICR_INDEXED)
         {
-            indexed = 1;
+            *indexed = 1;
             si = pal0;
         }
     }
+    return si;
+}
+
+static inline bool texcache_matchreplacement(pthtyp const *pth, int32_t dapicnum, int32_t checkcachepal, int32_t checktintpal,
+                                             polytintflags_t tintflags, int32_t dameth, int indexed)
+{
+    return pth->picnum == dapicnum && pth->palnum == checkcachepal && (checktintpal > 0 ? 1 : (pth->effects == tintflags))
+        && (pth->flags & (PTH_CLAMPED | PTH_HIGHTILE | PTH_SKYBOX | PTH_NOTRANSFIX | PTH_INDEXED))
+           == (TO_PTH_CLAMPED(dameth) | TO_PTH_NOTRANSFIX(dameth) | PTH_HIGHTILE | (drawingskybox > 0) * PTH_SKYBOX | indexed * PTH_INDEXED)
+        && (drawingskybox > 0 ? (pth->skyface == drawingskybox) : 1);
+}
+
+// <dashade>: ignored if not in Polymost+r_usetileshades
+pthtyp *texcache_fetch(int32_t dapicnum, int32_t dapalnum, int32_t dashade, int32_t dameth)
+{
+    const int32_t j = dapicnum & (GLTEXCACHEADSIZ - 1);
+    int indexed;
+    hicreplctyp *si = texcache_findsubst(dapicnum, dapalnum, dameth, &indexed);
 
     if (drawingskybox && usehightile)
         if ((si = hicfindskybox(dapicnum, dapalnum)) == NULL)
@@ -175,10 +191,7 @@ pthtyp *texcache_fetch(int32_t dapicnum, int32_t dapalnum, int32_t dashade, int3
     // load a replacement
     for (pthtyp *pth = texcache.list[j]; pth; pth = pth->next)
     {
-        if (pth->picnum == dapicnum && pth->palnum == checkcachepal && (checktintpal > 0 ? 1 : (pth->effects == tintflags))
-            && (pth->flags & (PTH_CLAMPED | PTH_HIGHTILE | PTH_SKYBOX | PTH_NOTRANSFIX | PTH_INDEXED))
-               == (TO_PTH_CLAMPED(dameth) | TO_PTH_NOTRANSFIX(dameth) | PTH_HIGHTILE | (drawingskybox > 0) * PTH_SKYBOX | indexed * PTH_INDEXED)
-            && (drawingskybox > 0 ? (pth->skyface == drawingskybox) : 1))
+        if (texcache_matchreplacement(pth, dapicnum, checkcachepal, checktintpal, tintflags, dameth, indexed))
         {
             if (pth->flags & PTH_INVALIDATED)
             {
@@ -225,6 +238,50 @@ pthtyp *texcache_fetch(int32_t dapicnum, int32_t dapalnum, int32_t dashade, int3
     return (drawingskybox || hicprecaching) ? NULL : texcache_tryart(dapicnum, dapalnum, dashade, dameth);
 }
 
+// Returns the replacement file texcache_fetch() would have to decode for a precache of the
+// same arguments, or NULL if there is none or it can be loaded from memory or the texcache.
+char const *texcache_getdecodefile(int32_t dapicnum, int32_t dapalnum, int32_t dameth)
+{
+    int indexed;
+    hicreplctyp *si = texcache_findsubst(dapicnum, dapalnum, dameth, &indexed);
+
+    // detail maps are usually shared between tiles, see texcache_fetchmulti()
+    if (!si || !si->filename || dapalnum == DETAILPAL)
+        return NULL;
+
+    if (!indexed)
+        dameth &= ~DAMETH_INDEXED;
+
+    polytintflags_t const tintflags = hictinting[dapalnum].f;
+
+    const int32_t checktintpal = (tintflags & HICTINT_APPLYOVERALTPAL) ? 0 : si->palnum;
+    const int32_t checkcachepal = ((tintflags & HICTINT_IN_MEMORY) || ((tintflags & HICTINT_APPLYOVERALTPAL) && si->palnum > 0)) ? dapalnum : si->palnum;
+
+    for (pthtyp *pth = texcache.list[dapicnum & (GLTEXCACHEADSIZ - 1)]; pth; pth = pth->next)
+        if (texcache_matchreplacement(pth, dapicnum, checkcachepal, checktintpal, tintflags, dameth, indexed))
+            return (pth->flags & PTH_INVALIDATED) ? si->filename : NULL;
+
+    if (indexed)
+        return si->filename;
+
+    buildvfs_kfd filh = kopen4load(si->filename, 0);
+
+    if (filh == buildvfs_kfd_invalid)
+        return NULL;
+
+    int32_t const picfillen = kfilelength(filh);
+    kclose(filh);
+
+    // must match gloadtile_hi()
+    char texcacheid[BMAX_PATH];
+    texcacheheader cachead;
+    polytintflags_t const effect = (checktintpal > 0) ? 0 : tintflags;
+
+    texcache_calcid(texcacheid, si->filename, picfillen+(dapalnum<<8), DAMETH_NARROW_MASKPROPS(dameth), effect & HICTINT_IN_MEMORY);
+
+    return texcache_readtexheader(texcacheid, &cachead, 0) ? NULL : si->filename;
+}
+
 static void texcache_closefiles(void)
 {
     MAYBE_FCLOSE_AND_NULL(texcache.dataFilePtr);
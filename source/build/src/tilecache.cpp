@@ -0,0 +1,577 @@
+// Thread-safe tile cache
+// See tilecache.h for an overview.
+
+#include "atomiclist.h"
+#include "baselayer.h"
+#include "build.h"
+#include "cache1d.h"
+#include "osd.h"
+#include "tilecache.h"
+#include "timer.h"
+
+#include <new>
+#include <thread>
+
+// slot sizes run from 256 bytes to 4MB, alternating steps of 1.5x and 1.33x
+#define TILECACHE_NUMCLASSES  29
+#define TILECACHE_MINSLOT     256
+// smallest segment a class allocates, classes with bigger slots get one slot per segment
+#define TILECACHE_SEGMENTSIZE (256 << 10)
+#define TILECACHE_HEADERSIZE  32
+#define TILECACHE_MAXTHREADS  256
+
+enum
+{
+    // set in a block's reference count once it has been detached from its tile
+    TILECACHE_DETACHED = 1 << 30,
+};
+
+typedef struct tilecacheblock_t
+{
+    tilecacheblock_t *m_next;  // free and retired lists
+    uint64_t retireepoch;
+    std::atomic<int32_t> refs;
+    std::atomic<uint8_t> used;  // second chance for eviction
+    uint8_t sizeclass;          // TILECACHE_NUMCLASSES for a block allocated on its own
+    int16_t tile;
+    int32_t size;
+} tilecacheblock_t;
+
+EDUKE32_STATIC_ASSERT(sizeof(tilecacheblock_t) <= TILECACHE_HEADERSIZE);
+
+typedef struct tilecachesegment_t
+{
+    tilecachesegment_t *m_next;
+} tilecachesegment_t;
+
+typedef struct
+{
+    AtomicSList64<tilecacheblock_t> freelist;
+    std::atomic<int32_t> numsegments, numslots, numused;
+    int32_t slotsize;
+} tilecacheclass_t;
+
+static tilecacheclass_t s_classes[TILECACHE_NUMCLASSES];
+static AtomicSList64<tilecachesegment_t> s_segments;
+static AtomicSList64<tilecacheblock_t> s_retired;
+
+static std::atomic<tilecacheblock_t *> s_tiles[MAXTILES];
+// bumped by tilecacheInvalidate(), so that loads racing with it don't leave stale data behind
+static std::atomic<int32_t> s_generation[MAXTILES];
+
+static std::atomic<int64_t> s_usedbytes;
+static int64_t s_maxbytes;
+static std::atomic<uint32_t> s_clockhand;
+
+static std::atomic<int32_t> s_numlarge;
+static std::atomic<int64_t> s_largebytes;
+
+static std::atomic<uint64_t> s_acquires, s_hits, s_loads, s_evictions;
+static uint64_t s_lastreportticks, s_lastreportevictions;
+
+static std::atomic<uint64_t> s_epoch;
+// the epoch each thread entered the cache at, 0 while it isn't inside
+static std::atomic<uint64_t> s_threadepoch[TILECACHE_MAXTHREADS];
+static std::atomic<bool> s_threadslot[TILECACHE_MAXTHREADS];
+static std::atomic_flag s_reclaiming = ATOMIC_FLAG_INIT;
+
+static std::thread::id s_mainthread;
+static bool s_init;
+
+struct tilecachethread_t
+{
+    int slot = -1;
+    int depth = 0;
+
+    ~tilecachethread_t()
+    {
+        if (slot >= 0)
+            s_threadslot[slot].store(false, std::memory_order_release);
+    }
+};
+
+static thread_local tilecachethread_t t_thread;
+
+static int tilecacheThreadSlot(void)
+{
+    if (EDUKE32_PREDICT_FALSE(t_thread.slot < 0))
+    {
+        for (int i = 0; i < TILECACHE_MAXTHREADS; i++)
+        {
+            bool expected = false;
+
+            if (s_threadslot[i].compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                t_thread.slot = i;
+                break;
+            }
+        }
+
+        if (t_thread.slot < 0)
+            fatal_exit("TOO MANY THREADS USING THE TILE CACHE!");
+    }
+
+    return t_thread.slot;
+}
+
+// Blocks reachable from s_tiles[] and the free lists may only be looked at while one of these is alive.
+struct tilecacheepoch
+{
+    tilecacheepoch()
+    {
+        if (t_thread.depth++ == 0)
+        {
+            s_threadepoch[tilecacheThreadSlot()].store(s_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    ~tilecacheepoch()
+    {
+        if (--t_thread.depth == 0)
+            s_threadepoch[t_thread.slot].store(0, std::memory_order_release);
+    }
+};
+
+static FORCE_INLINE char *tilecacheData(tilecacheblock_t *blk) { return (char *)blk + TILECACHE_HEADERSIZE; }
+
+static int tilecacheSizeClass(int32_t const bytes)
+{
+    for (int c = 0; c < TILECACHE_NUMCLASSES; c++)
+        if (bytes <= s_classes[c].slotsize)
+            return c;
+
+    return TILECACHE_NUMCLASSES;
+}
+
+static void tilecacheFreeBlock(tilecacheblock_t *blk)
+{
+    if (blk->sizeclass == TILECACHE_NUMCLASSES)
+    {
+        int64_t const bytes = TILECACHE_HEADERSIZE + blk->size;
+
+        s_usedbytes.fetch_sub(bytes, std::memory_order_relaxed);
+        s_largebytes.fetch_sub(bytes, std::memory_order_relaxed);
+        s_numlarge.fetch_sub(1, std::memory_order_relaxed);
+
+        blk->~tilecacheblock_t();
+        Xaligned_free(blk);
+        return;
+    }
+
+    auto &cls = s_classes[blk->sizeclass];
+
+    cls.numused.fetch_sub(1, std::memory_order_relaxed);
+    cls.freelist.push(blk);
+}
+
+static void tilecacheRetire(tilecacheblock_t *blk)
+{
+    blk->retireepoch = s_epoch.load(std::memory_order_seq_cst);
+    s_retired.push(blk);
+}
+
+// Frees the retired blocks no thread can still be looking at.  Must not be called from inside a
+// tilecacheepoch, or nothing retired since the caller entered it is freed.
+static void tilecacheReclaim(void)
+{
+    if (s_reclaiming.test_and_set(std::memory_order_acquire))
+        return;
+
+    s_epoch.fetch_add(1, std::memory_order_seq_cst);
+
+    uint64_t oldest = UINT64_MAX;
+
+    for (auto &epoch : s_threadepoch)
+    {
+        uint64_t const e = epoch.load(std::memory_order_seq_cst);
+
+        if (e && e < oldest)
+            oldest = e;
+    }
+
+    auto blk = s_retired.popAll();
+
+    while (blk)
+    {
+        auto next = blk->m_next;
+
+        if (blk->retireepoch < oldest)
+            tilecacheFreeBlock(blk);
+        else
+            s_retired.push(blk);
+
+        blk = next;
+    }
+
+    s_reclaiming.clear(std::memory_order_release);
+}
+
+// Takes a block off its tile.  Whoever gets to set TILECACHE_DETACHED first clears the tile, and
+// the block is retired by whoever drops the last reference to it afterwards.
+static void tilecacheDetach(int16_t const tileNum, tilecacheblock_t *blk)
+{
+    int32_t const refs = blk->refs.fetch_or(TILECACHE_DETACHED, std::memory_order_acq_rel);
+
+    if (refs & TILECACHE_DETACHED)
+        return;
+
+    auto expected = blk;
+    s_tiles[tileNum].compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+
+    if (refs == 0)
+        tilecacheRetire(blk);
+}
+
+// Evicts an unreferenced block of the given size class, or any that was allocated on its own as
+// that gives its memory back.  Blocks acquired since the clock last passed them get another round.
+static bool tilecacheEvict(int const sizeclass)
+{
+    tilecacheepoch const epoch;
+
+    for (int n = 0; n < 2 * MAXTILES; n++)
+    {
+        int const tile = s_clockhand.fetch_add(1, std::memory_order_relaxed) % MAXTILES;
+        auto blk = s_tiles[tile].load(std::memory_order_acquire);
+
+        if (blk == nullptr || (blk->sizeclass != sizeclass && blk->sizeclass != TILECACHE_NUMCLASSES))
+            continue;
+
+        if (blk->used.exchange(0, std::memory_order_relaxed))
+            continue;
+
+        int32_t expected = 0;
+
+        if (!blk->refs.compare_exchange_strong(expected, TILECACHE_DETACHED, std::memory_order_acq_rel))
+            continue;
+
+        auto slot = blk;
+        s_tiles[tile].compare_exchange_strong(slot, nullptr, std::memory_order_acq_rel);
+
+        tilecacheRetire(blk);
+        s_evictions.fetch_add(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool tilecacheGrow(int const sizeclass, bool const force)
+{
+    auto &cls = s_classes[sizeclass];
+
+    int32_t const numslots = max(1, TILECACHE_SEGMENTSIZE / cls.slotsize);
+    int64_t const bytes    = TILECACHE_HEADERSIZE + (int64_t)numslots * cls.slotsize;
+
+    if (s_usedbytes.fetch_add(bytes, std::memory_order_relaxed) + bytes > s_maxbytes && !force)
+    {
+        s_usedbytes.fetch_sub(bytes, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto seg = (tilecachesegment_t *)Xaligned_alloc(16, bytes);
+    s_segments.push(seg);
+
+    for (int i = 0; i < numslots; i++)
+    {
+        auto blk = new ((char *)seg + TILECACHE_HEADERSIZE + i * cls.slotsize) tilecacheblock_t;
+        blk->sizeclass = sizeclass;
+        cls.freelist.push(blk);
+    }
+
+    cls.numsegments.fetch_add(1, std::memory_order_relaxed);
+    cls.numslots.fetch_add(numslots, std::memory_order_relaxed);
+
+    return true;
+}
+
+static tilecacheblock_t *tilecacheAllocBlock(int32_t const size)
+{
+    int const sizeclass = tilecacheSizeClass(TILECACHE_HEADERSIZE + size);
+
+    if (sizeclass == TILECACHE_NUMCLASSES)
+    {
+        int64_t const bytes = TILECACHE_HEADERSIZE + size;
+
+        tilecacheReclaim();
+
+        if (s_usedbytes.load(std::memory_order_relaxed) + bytes > s_maxbytes && tilecacheEvict(sizeclass))
+            tilecacheReclaim();
+
+        s_usedbytes.fetch_add(bytes, std::memory_order_relaxed);
+        s_largebytes.fetch_add(bytes, std::memory_order_relaxed);
+        s_numlarge.fetch_add(1, std::memory_order_relaxed);
+
+        auto blk = new (Xaligned_alloc(16, bytes)) tilecacheblock_t;
+        blk->sizeclass = sizeclass;
+        return blk;
+    }
+
+    auto &cls = s_classes[sizeclass];
+
+    // Take a free slot, else one that was retired, else grow within the limit, else evict.
+    // Slots evicted here can't be had until the other threads have left the cache, which is
+    // given a few tries before growing beyond the limit rather than waiting any longer.
+    for (int pass = 0;; pass++)
+    {
+        {
+            tilecacheepoch const epoch;
+
+            if (auto blk = cls.freelist.pop())
+            {
+                cls.numused.fetch_add(1, std::memory_order_relaxed);
+                return blk;
+            }
+        }
+
+        switch (pass)
+        {
+            case 0:
+                tilecacheReclaim();
+                break;
+            case 1:
+                tilecacheGrow(sizeclass, false);
+                break;
+            case 2:
+            case 3:
+            case 4:
+            case 5:
+                if (tilecacheEvict(sizeclass))
+                {
+                    std::this_thread::yield();
+                    tilecacheReclaim();
+                }
+                break;
+            default:
+                tilecacheGrow(sizeclass, true);
+                break;
+        }
+    }
+}
+
+char const *tileAcquire(int16_t const tileNum)
+{
+    if (!s_init || (unsigned)tileNum >= (unsigned)MAXTILES)
+        return NULL;
+
+    s_acquires.fetch_add(1, std::memory_order_relaxed);
+
+    do
+    {
+        {
+            tilecacheepoch const epoch;
+
+            if (auto blk = s_tiles[tileNum].load(std::memory_order_acquire))
+            {
+                int32_t refs = blk->refs.load(std::memory_order_relaxed);
+
+                while (!(refs & TILECACHE_DETACHED))
+                {
+                    if (blk->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        blk->used.store(1, std::memory_order_relaxed);
+                        s_hits.fetch_add(1, std::memory_order_relaxed);
+                        return tilecacheData(blk);
+                    }
+                }
+
+                // on its way out, wait for the tile to be cleared
+                continue;
+            }
+        }
+
+        int32_t const dasiz = tilesiz[tileNum].x * tilesiz[tileNum].y;
+
+        if (dasiz <= 0 || walock[tileNum] == CACHE1D_PERMANENT)
+            return NULL;
+
+        int32_t const generation = s_generation[tileNum].load(std::memory_order_acquire);
+        auto blk = tilecacheAllocBlock(dasiz);
+
+        blk->tile = tileNum;
+        blk->size = dasiz;
+        blk->refs.store(1, std::memory_order_relaxed);
+        blk->used.store(1, std::memory_order_relaxed);
+
+        if (!tileReadData(tileNum, dasiz, tilecacheData(blk), std::this_thread::get_id() == s_mainthread))
+        {
+            // never seen by anyone else, but a thread popping the free list may still be looking at it
+            tilecacheRetire(blk);
+            return NULL;
+        }
+
+        tilecacheblock_t *expected = nullptr;
+
+        if (!s_tiles[tileNum].compare_exchange_strong(expected, blk, std::memory_order_acq_rel))
+        {
+            // someone else was faster
+            tilecacheRetire(blk);
+            continue;
+        }
+
+        s_loads.fetch_add(1, std::memory_order_relaxed);
+
+        if (s_generation[tileNum].load(std::memory_order_acquire) != generation)
+        {
+            tilecacheepoch const epoch;
+            tilecacheDetach(tileNum, blk);
+        }
+
+        return tilecacheData(blk);
+    }
+    while (1);
+}
+
+void tileRelease(char const *data)
+{
+    if (data == NULL)
+        return;
+
+    auto blk = (tilecacheblock_t *)const_cast<char *>(data - TILECACHE_HEADERSIZE);
+
+    if (blk->refs.fetch_sub(1, std::memory_order_acq_rel) == (TILECACHE_DETACHED | 1))
+        tilecacheRetire(blk);
+}
+
+void tilecacheInvalidate(int16_t const tileNum)
+{
+    if (!s_init || (unsigned)tileNum >= (unsigned)MAXTILES)
+        return;
+
+    s_generation[tileNum].fetch_add(1, std::memory_order_acq_rel);
+
+    tilecacheepoch const epoch;
+
+    if (auto blk = s_tiles[tileNum].load(std::memory_order_acquire))
+        tilecacheDetach(tileNum, blk);
+}
+
+void tilecacheInvalidateAll(void)
+{
+    if (!s_init)
+        return;
+
+    for (int i = 0; i < MAXTILES; i++)
+        tilecacheInvalidate(i);
+
+    tilecacheReclaim();
+}
+
+static int osdfunc_tilecacheinfo(osdcmdptr_t UNUSED(parm))
+{
+    UNREFERENCED_CONST_PARAMETER(parm);
+
+    tilecacheReport();
+
+    return OSDCMD_OK;
+}
+
+void tilecacheInit(int32_t const maxsize)
+{
+    static bool registered;
+
+    if (!registered)
+    {
+        OSD_RegisterFunction("tilecacheinfo", "tilecacheinfo: displays tile cache occupancy and eviction rate", osdfunc_tilecacheinfo);
+        registered = true;
+    }
+
+    tilecacheUninit();
+
+    for (int c = 0; c < TILECACHE_NUMCLASSES; c++)
+    {
+        int32_t const base = TILECACHE_MINSLOT << (c >> 1);
+        s_classes[c].slotsize = (c & 1) ? base + (base >> 1) : base;
+    }
+
+    s_maxbytes   = maxsize;
+    s_mainthread = std::this_thread::get_id();
+    s_epoch.store(1, std::memory_order_relaxed);
+
+    s_lastreportticks     = timerGetPerformanceCounter();
+    s_lastreportevictions = 0;
+
+    s_init = true;
+}
+
+void tilecacheUninit(void)
+{
+    if (!s_init)
+        return;
+
+    tilecacheInvalidateAll();
+
+    // with no other threads inside, everything has been handed back by now
+    Bassert(s_retired.isEmpty());
+
+    for (auto &cls : s_classes)
+    {
+        cls.freelist.popAll();
+        cls.numsegments = cls.numslots = cls.numused = 0;
+    }
+
+    while (auto seg = s_segments.pop())
+        Xaligned_free(seg);
+
+    for (auto &generation : s_generation)
+        generation.store(0, std::memory_order_relaxed);
+
+    s_usedbytes = s_largebytes = 0;
+    s_numlarge = 0;
+    s_acquires = s_hits = s_loads = s_evictions = 0;
+
+    s_init = false;
+}
+
+void tilecacheReport(void)
+{
+    if (!s_init)
+    {
+        LOG_F(INFO, "Tile cache not initialized.");
+        return;
+    }
+
+    tilecacheReclaim();
+
+    int32_t numcached = 0;
+
+    {
+        tilecacheepoch const epoch;
+
+        for (auto &tile : s_tiles)
+            numcached += (tile.load(std::memory_order_relaxed) != nullptr);
+    }
+
+    LOG_F(INFO, "Slot size  Segments  Slots used");
+
+    for (auto const &cls : s_classes)
+    {
+        int32_t const numslots = cls.numslots.load(std::memory_order_relaxed);
+
+        if (numslots == 0)
+            continue;
+
+        int32_t const numused = cls.numused.load(std::memory_order_relaxed);
+
+        LOG_F(INFO, "%9d  %8d  %6d/%-6d (%d%%)", cls.slotsize, cls.numsegments.load(std::memory_order_relaxed), numused, numslots,
+              numused * 100 / numslots);
+    }
+
+    uint64_t const acquires  = s_acquires.load(std::memory_order_relaxed);
+    uint64_t const hits      = s_hits.load(std::memory_order_relaxed);
+    uint64_t const evictions = s_evictions.load(std::memory_order_relaxed);
+    uint64_t const ticks     = timerGetPerformanceCounter();
+
+    double const seconds = (double)(ticks - s_lastreportticks) / (double)timerGetPerformanceFrequency();
+
+    LOG_F(INFO, "Separate:    %d blocks, %dKB", s_numlarge.load(std::memory_order_relaxed), (int32_t)(s_largebytes.load(std::memory_order_relaxed) >> 10));
+    LOG_F(INFO, "Used:        %dKB of %dKB", (int32_t)(s_usedbytes.load(std::memory_order_relaxed) >> 10), (int32_t)(s_maxbytes >> 10));
+    LOG_F(INFO, "Tiles:       %d cached, %d loaded", numcached, (int32_t)s_loads.load(std::memory_order_relaxed));
+    LOG_F(INFO, "Acquired:    %" PRIu64 " times, %.1f%% hits", acquires, acquires ? hits * 100.0 / acquires : 0.0);
+    LOG_F(INFO, "Evictions:   %" PRIu64 ", %.1f/s since the last report", evictions,
+          seconds > 0.0 ? (evictions - s_lastreportevictions) / seconds : 0.0);
+
+    s_lastreportticks     = ticks;
+    s_lastreportevictions = evictions;
+}
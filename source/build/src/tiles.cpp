@@ -12,9 +12,13 @@
 #include "compat.h"
 #include "crc32.h"
 #include "engine_priv.h"
+#include "libasync_config.h"
 #include "lz4.h"
 #include "texcache.h"
+#include "tilecache.h"
+#include "timer.h"
 #include "vfs.h"
+#include "xxhash_config.h"
 
 static void *g_vm_data;
 
@@ -44,6 +48,21 @@ static char mapartfilename[BMAX_PATH];  // map-specific ART file name
 static int32_t mapartfnXXofs;  // byte offset to 'XX' (the number part) in the above
 static int32_t artfilnum, artfilplc;
 static buildvfs_kfd artfil;
+static char const *artfildata;  // non-NULL if the open ART file can be read in place, see kfiledata()
+static int32_t artfillen;
+
+// The ART files that can be read in place, for tileReadData() on worker threads.
+static struct
+{
+    std::atomic<char const *> data;
+    int32_t length;
+} artfilemap[MAXARTFILES_TOTAL];
+
+static void artSetFileData(int32_t const tilefilei, char const * const data, int32_t const length)
+{
+    artfilemap[tilefilei].length = length;
+    artfilemap[tilefilei].data.store(data, std::memory_order_release);
+}
 
 ////////// Per-map ART file loading //////////
 
@@ -61,6 +80,8 @@ static inline void artUpdateManifest(void)
 {
     for (bssize_t i=0; i<MAXTILES; i++)
         tileUpdatePicSiz(i);
+
+    tilecacheInvalidateAll();
 }
 
 template <typename origar_t, typename bakar_t>
@@ -87,11 +108,15 @@ void artClearMapArt(void)
 
     artClearMapArtFilename();
 
+    for (bssize_t i=MAXARTFILES_BASE; i<MAXARTFILES_TOTAL; i++)
+        artSetFileData(i, NULL, 0);
+
     if (artfilnum >= MAXARTFILES_BASE)
     {
         kclose(artfil);
 
         artfil = buildvfs_kfd_invalid;
+        artfildata = NULL;
         artfilnum = -1;
         artfilplc = 0L;
     }
@@ -220,6 +245,7 @@ static void tileSetDataSafe(int32_t const tile, int32_t tsiz, char const * const
         faketiledata[tile] = (char *) Xrealloc(newtile, tsiz);
         bitmap_set(faketile, tile);
         tilefilenum[tile] = MAXARTFILES_TOTAL;
+        tilecacheInvalidate(tile);
     }
     else
     {
@@ -244,6 +270,8 @@ void tileSetData(int32_t const tile, int32_t tsiz, char const * const buffer)
         DO_FREE_AND_NULL(faketiledata[tile]);
         bitmap_clear(faketile, tile);
     }
+
+    tilecacheInvalidate(tile);
 }
 
 static void tileSoftDelete(int32_t const tile)
@@ -259,6 +287,8 @@ static void tileSoftDelete(int32_t const tile)
     bitmap_clear(faketile, tile);
 
     Bmemset(&picanm[tile], 0, sizeof(picanm_t));
+
+    tilecacheInvalidate(tile);
 }
 
 void tileDelete(int32_t const tile)
@@ -293,6 +323,9 @@ void tileUpdatePicSiz(int32_t picnum)
 
 void tileSetSize(int32_t picnum, int16_t dasizx, int16_t dasizy)
 {
+    if (tilesiz[picnum].x != dasizx || tilesiz[picnum].y != dasizy)
+        tilecacheInvalidate(picnum);
+
     tilesiz[picnum].x = dasizx;
     tilesiz[picnum].y = dasizy;
 
@@ -579,6 +612,8 @@ static int32_t artReadIndexedFile(int32_t tilefilei)
             }
 
             DO_FREE_AND_NULL(local.tileread);
+
+            artSetFileData(tilefilei, kfiledata(fil), kfilelength(fil));
         }
 
         if (permap)
@@ -591,6 +626,423 @@ static int32_t artReadIndexedFile(int32_t tilefilei)
     return -1;
 }
 
+////////// Base ART file indexing //////////
+
+// The parsed index of the base ART files is kept in a manifest file in the working
+// directory: one record per ART file saying where it was found (see kfileinfo()),
+// followed by the tile entries of every file. A file whose record still matches is set
+// up from the manifest, which is read in one go, without being opened at all.
+//
+// The other base ART files are opened one after another on the main thread, which only
+// reads their headers and, when a file can't be read in place, its index block (the size
+// and picanm arrays). Parsing the index blocks then happens on the thread pool, and the
+// results are applied in file order so that later files still override earlier ones.
+// Files that have to be preloaded (compressed ZIP entries, PhysFS) and anything unusual
+// go through artReadIndexedFile() as before, which also reports the errors.
+
+#define ARTMANIFEST_VERSION 2
+
+static char const s_artManifestMagic[8] = { 'E', 'D', 'U', 'K', 'E', 'A', 'R', 'T' };
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t numfiles;
+    uint32_t numtiles;
+    uint32_t reserved;
+    uint64_t hash;  // of everything after the header
+} artmanifestheader_t;
+
+typedef struct
+{
+    int32_t tilefilei;
+    int32_t tilestart, tileend;
+    int32_t firsttile, numtiles;  // range of this file's entries in the tile array
+    int32_t length, offset;       // the buildvfs_kinfo_t of the ART file
+    int32_t reserved;
+    int64_t disksize, mtime;
+} artmanifestfile_t;
+
+typedef struct
+{
+    uint16_t tile;
+    int16_t  sizx, sizy;
+    uint16_t reserved;
+    uint32_t picanm;  // as stored in the ART file
+    int32_t  offset;  // of the tile data in the ART file
+} artmanifesttile_t;
+
+EDUKE32_STATIC_ASSERT(sizeof(artmanifestheader_t) == 32);
+EDUKE32_STATIC_ASSERT(sizeof(artmanifestfile_t) == 48);
+EDUKE32_STATIC_ASSERT(sizeof(artmanifesttile_t) == 16);
+EDUKE32_STATIC_ASSERT(MAXUSERTILES <= UINT16_MAX);
+
+enum
+{
+    ARTINDEX_NONE,    // there is no such file
+    ARTINDEX_READ,    // read by artReadIndexedFile()
+    ARTINDEX_SCAN,    // index block parsed
+    ARTINDEX_CACHED,  // set up from the manifest
+};
+
+typedef struct
+{
+    int32_t status;
+    int32_t length;
+    buildvfs_kinfo_t info;
+    bool hasinfo;
+    artheader_t header;
+    uint8_t const *index;  // header and index block, either in place or in 'block'
+    uint8_t *block;
+    int32_t indexlen, dataofs;
+    artmanifesttile_t const *tiles;
+    int32_t numtiles;
+    artmanifesttile_t *parsed;
+} artindexfile_t;
+
+static void artGetManifestName(char *buf, size_t const len)
+{
+    // "tiles000.art" -> "tiles.cache"
+    Bsnprintf(buf, len, "%.5s.cache", artfilename);
+}
+
+static int32_t artOpenIndexedFile(int32_t const tilefilei, artindexfile_t * const f)
+{
+    buildvfs_kfd const fil = kopen4load(artGetIndexedFileName(tilefilei), 0);
+
+    if (fil == buildvfs_kfd_invalid)
+        return ARTINDEX_NONE;
+
+    char const * const data = kfiledata(fil);
+    f->length = kfilelength(fil);
+
+#ifdef USE_PHYSFS
+    UNREFERENCED_PARAMETER(data);
+    kclose(fil);
+    return ARTINDEX_READ;
+#else
+    if (data == NULL && cache1d_file_fromzip(fil))
+    {
+        kclose(fil);
+        return ARTINDEX_READ;
+    }
+
+    // version, numtiles, tilestart and tileend, after an optional "BUILDART"
+    uint8_t head[24] = {};
+    int32_t const headlen = min<int32_t>(f->length, sizeof(head));
+
+    if (data)
+        Bmemcpy(head, data, headlen);
+    else if (kread(fil, head, headlen) != headlen)
+    {
+        kclose(fil);
+        return ARTINDEX_READ;
+    }
+
+    int32_t const ofs = (headlen >= 8 && B_UNBUF32(&head[0]) == B_LITTLE32(0x4c495542) && B_UNBUF32(&head[4]) == B_LITTLE32(0x54524144)) ? 8 : 0;
+
+    f->header.tilestart = B_LITTLE32(B_UNBUF32(&head[ofs+8]));
+    f->header.tileend   = B_LITTLE32(B_UNBUF32(&head[ofs+12]));
+    f->header.numtiles  = f->header.tileend - f->header.tilestart + 1;
+
+    if (headlen < ofs + 16 || B_LITTLE32(B_UNBUF32(&head[ofs])) != 1 || (uint32_t)f->header.tilestart >= MAXUSERTILES
+        || (uint32_t)f->header.tileend >= MAXUSERTILES || f->header.tileend < f->header.tilestart)
+    {
+        kclose(fil);
+        return ARTINDEX_READ;
+    }
+
+    f->indexlen = 16 + f->header.numtiles * (2*sizeof(int16_t) + sizeof(uint32_t));
+    f->dataofs  = ofs + f->indexlen;
+
+    if (f->dataofs > f->length)
+    {
+        kclose(fil);
+        return ARTINDEX_READ;
+    }
+
+    if (data)
+    {
+        f->index = (uint8_t const *)data + ofs;
+        artSetFileData(tilefilei, data, f->length);
+    }
+    else
+    {
+        int32_t const readlen = f->indexlen - (headlen - ofs);
+
+        f->block = (uint8_t *)Xmalloc(f->indexlen);
+        Bmemcpy(f->block, &head[ofs], headlen - ofs);
+
+        if (kread(fil, f->block + headlen - ofs, readlen) != readlen)
+        {
+            DO_FREE_AND_NULL(f->block);
+            kclose(fil);
+            return ARTINDEX_READ;
+        }
+
+        f->index = f->block;
+    }
+
+    // the mapping in place stays valid after the file is closed
+    kclose(fil);
+    return ARTINDEX_SCAN;
+#endif
+}
+
+static void artParseIndexBlock(artindexfile_t * const f)
+{
+    int32_t const numtiles = f->header.numtiles;
+    uint8_t const * const sizx = f->index + 16;
+    uint8_t const * const sizy = sizx + numtiles * sizeof(int16_t);
+    uint8_t const * const anim = sizy + numtiles * sizeof(int16_t);
+
+    f->parsed = (artmanifesttile_t *)Xmalloc(numtiles * sizeof(artmanifesttile_t));
+    f->numtiles = 0;
+
+    int32_t offscount = f->dataofs;
+
+    for (int i = 0; i < numtiles; i++)
+    {
+        int16_t const tilex = B_LITTLE16(B_UNBUF16(&sizx[i * sizeof(int16_t)]));
+        int16_t const tiley = B_LITTLE16(B_UNBUF16(&sizy[i * sizeof(int16_t)]));
+        int32_t const dasiz = tilex * tiley;
+
+        if (dasiz == 0)
+            continue;
+
+        auto &t = f->parsed[f->numtiles++];
+
+        t.tile     = f->header.tilestart + i;
+        t.sizx     = tilex;
+        t.sizy     = tiley;
+        t.reserved = 0;
+        t.picanm   = B_LITTLE32(B_UNBUF32(&anim[i * sizeof(uint32_t)]));
+        t.offset   = offscount;
+
+        offscount += dasiz;
+    }
+
+    f->tiles = f->parsed;
+}
+
+// Returns the manifest read from the working directory, or NULL if there is none or it is damaged.
+static uint8_t *artLoadManifest(artmanifestheader_t * const header)
+{
+    char fn[BMAX_PATH];
+    artGetManifestName(fn, sizeof(fn));
+
+    buildvfs_FILE fp = buildvfs_fopen_read(fn);
+
+    if (!fp)
+        return NULL;
+
+    int64_t const length = buildvfs_flength(fp);
+
+    if (length < (int64_t)sizeof(artmanifestheader_t) || length > INT32_MAX)
+    {
+        buildvfs_fclose(fp);
+        return NULL;
+    }
+
+    auto data = (uint8_t *)Xmalloc(length);
+    bool const read = ((size_t)buildvfs_fread(data, 1, length, fp) == (size_t)length);
+
+    buildvfs_fclose(fp);
+
+    Bmemcpy(header, data, sizeof(artmanifestheader_t));
+
+    size_t const payloadlen = header->numfiles * sizeof(artmanifestfile_t) + header->numtiles * sizeof(artmanifesttile_t);
+
+    if (!read || Bmemcmp(header->magic, s_artManifestMagic, sizeof(header->magic)) || header->version != ARTMANIFEST_VERSION
+        || header->numfiles > MAXARTFILES_BASE || header->numtiles > MAXUSERTILES * MAXARTFILES_BASE
+        || payloadlen != (size_t)length - sizeof(artmanifestheader_t)
+        || XXH3_64bits(data + sizeof(artmanifestheader_t), payloadlen) != header->hash)
+    {
+        LOG_F(WARNING, "Tile manifest %s is damaged or from a different version, rebuilding it.", fn);
+        Xfree(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static void artWriteManifest(artindexfile_t const * const files)
+{
+    int32_t numfiles = 0, numtiles = 0;
+
+    for (int i = 0; i < MAXARTFILES_BASE; i++)
+    {
+        if ((files[i].status == ARTINDEX_SCAN || files[i].status == ARTINDEX_CACHED) && files[i].hasinfo)
+        {
+            numfiles++;
+            numtiles += files[i].numtiles;
+        }
+    }
+
+    size_t const payloadlen = numfiles * sizeof(artmanifestfile_t) + numtiles * sizeof(artmanifesttile_t);
+    auto payload = (uint8_t *)Xmalloc(payloadlen);
+    auto fileptr = (artmanifestfile_t *)payload;
+    auto tileptr = (artmanifesttile_t *)(fileptr + numfiles);
+
+    numtiles = 0;
+
+    for (int i = 0; i < MAXARTFILES_BASE; i++)
+    {
+        auto const &f = files[i];
+
+        if ((f.status != ARTINDEX_SCAN && f.status != ARTINDEX_CACHED) || !f.hasinfo)
+            continue;
+
+        *fileptr++ = { i, f.header.tilestart, f.header.tileend, numtiles, f.numtiles, f.info.length, f.info.offset, 0, f.info.disksize, f.info.mtime };
+        Bmemcpy(tileptr + numtiles, f.tiles, f.numtiles * sizeof(artmanifesttile_t));
+        numtiles += f.numtiles;
+    }
+
+    artmanifestheader_t header = {};
+
+    Bmemcpy(header.magic, s_artManifestMagic, sizeof(header.magic));
+    header.version  = ARTMANIFEST_VERSION;
+    header.numfiles = numfiles;
+    header.numtiles = numtiles;
+    header.hash     = XXH3_64bits(payload, payloadlen);
+
+    char fn[BMAX_PATH];
+    artGetManifestName(fn, sizeof(fn));
+
+    buildvfs_FILE fp = buildvfs_fopen_write(fn);
+
+    if (fp)
+    {
+        buildvfs_fwrite(&header, sizeof(header), 1, fp);
+        buildvfs_fwrite(payload, payloadlen, 1, fp);
+        buildvfs_fclose(fp);
+    }
+    else
+        LOG_F(WARNING, "Unable to write tile manifest %s.", fn);
+
+    Xfree(payload);
+}
+
+static void artIndexBaseFiles(void)
+{
+    uint64_t const startTicks = timerGetPerformanceCounter();
+
+    auto files = (artindexfile_t *)Xcalloc(MAXARTFILES_BASE, sizeof(artindexfile_t));
+
+    artmanifestheader_t header;
+    uint8_t * const manifest = artLoadManifest(&header);
+    auto const manifestfiles = manifest ? (artmanifestfile_t const *)(manifest + sizeof(artmanifestheader_t)) : NULL;
+    auto const manifesttiles = manifest ? (artmanifesttile_t const *)(manifestfiles + header.numfiles) : NULL;
+
+    // Files the manifest has a record for, which is only trusted if it is consistent with itself.
+    artmanifestfile_t const *records[MAXARTFILES_BASE] = {};
+
+    for (uint32_t i = 0; manifest && i < header.numfiles; i++)
+    {
+        auto const &rec = manifestfiles[i];
+
+        if ((uint32_t)rec.tilefilei < MAXARTFILES_BASE && rec.firsttile >= 0 && rec.numtiles >= 0
+            && (uint32_t)rec.firsttile + rec.numtiles <= header.numtiles && (uint32_t)rec.tilestart < MAXUSERTILES
+            && (uint32_t)rec.tileend < MAXUSERTILES && rec.tilestart <= rec.tileend)
+            records[rec.tilefilei] = &rec;
+    }
+
+    int32_t numfiles = 0, numtiles = 0, numcached = 0;
+
+    for (int i = 0; i < MAXARTFILES_BASE; i++)
+    {
+        auto &f = files[i];
+        int32_t const found = kfileinfo(artGetIndexedFileName(i), &f.info);
+
+        if (found < 0)
+            continue;
+
+        auto const rec = records[i];
+
+        f.hasinfo = (found > 0);
+
+        if (f.hasinfo && rec && rec->length == f.info.length && rec->offset == f.info.offset
+            && rec->disksize == f.info.disksize && rec->mtime == f.info.mtime)
+        {
+            f.status           = ARTINDEX_CACHED;
+            f.length           = f.info.length;
+            f.header.tilestart = rec->tilestart;
+            f.header.tileend   = rec->tileend;
+            f.header.numtiles  = rec->tileend - rec->tilestart + 1;
+            f.tiles            = manifesttiles + rec->firsttile;
+            f.numtiles         = rec->numtiles;
+
+            artSetFileData(i, f.info.data, f.info.length);
+        }
+        else
+            f.status = artOpenIndexedFile(i, &f);
+    }
+
+    async::parallel_for(async::irange(0, MAXARTFILES_BASE), [&](int const i) {
+        if (files[i].status == ARTINDEX_SCAN)
+            artParseIndexBlock(&files[i]);
+    });
+
+    bool rewrite = false;
+
+    for (int i = 0; i < MAXARTFILES_BASE; i++)
+    {
+        auto &f = files[i];
+
+        rewrite |= (f.status == ARTINDEX_SCAN && f.hasinfo) || (records[i] && f.status != ARTINDEX_CACHED);
+
+        if (f.status == ARTINDEX_READ)
+        {
+            artReadIndexedFile(i);
+            numfiles++;
+            continue;
+        }
+        else if (f.status == ARTINDEX_NONE)
+            continue;
+
+        numfiles++;
+        numtiles  += f.numtiles;
+        numcached += (f.status == ARTINDEX_CACHED);
+
+        for (int j = 0; j < f.numtiles; j++)
+        {
+            auto const &t = f.tiles[j];
+
+            // the manifest could hold anything, keep to what the ART file header covers
+            if (t.tile < f.header.tilestart || t.tile > f.header.tileend)
+                continue;
+
+            tilesiz[t.tile].x = t.sizx;
+            tilesiz[t.tile].y = t.sizy;
+            tileConvertAnimFormat(t.tile, t.picanm);
+
+            tilefilenum[t.tile]  = i;
+            tilefileoffs[t.tile] = t.offset;
+        }
+    }
+
+    if (rewrite)
+        artWriteManifest(files);
+
+    for (int i = 0; i < MAXARTFILES_BASE; i++)
+    {
+        Xfree(files[i].block);
+        Xfree(files[i].parsed);
+    }
+
+    Xfree(files);
+    Xfree(manifest);
+
+    double const ms = (double)(timerGetPerformanceCounter() - startTicks) * 1000.0 / (double)timerGetPerformanceFrequency();
+
+    if (numcached && numcached == numfiles)
+        LOG_F(INFO, "Indexed %d tiles in %d ART files in %.2fms (warm start, from the tile manifest).", numtiles, numfiles, ms);
+    else
+        LOG_F(INFO, "Indexed %d tiles in %d ART files in %.2fms (cold start, %d of %d files from the tile manifest).", numtiles, numfiles,
+              ms, numcached, numfiles);
+}
+
 //
 // loadpics
 //
@@ -606,18 +1058,22 @@ int32_t artLoadFiles(const char *filename, int32_t askedsize)
 
     //    artsize = 0;
 
-    for (int tilefilei=0; tilefilei<MAXARTFILES_BASE; tilefilei++)
-        artReadIndexedFile(tilefilei);
+    for (bssize_t i=0; i<MAXARTFILES_TOTAL; i++)
+        artSetFileData(i, NULL, 0);
+
+    artIndexBaseFiles();
 
     Bmemset(gotpic, 0, sizeof(gotpic));
     //cachesize = min((int32_t)((Bgetsysmemsize()/100)*60),max(artsize,askedsize));
     g_vm_size = (Bgetsysmemsize() <= (uint32_t)askedsize) ? (int32_t)((Bgetsysmemsize() / 100) * 60) : askedsize;
     g_vm_data = Xmalloc(g_vm_size);
     g_cache.initBuffer((intptr_t) g_vm_data, g_vm_size);
+    tilecacheInit(g_vm_size);
 
     artUpdateManifest();
 
     artfil = buildvfs_kfd_invalid;
+    artfildata = NULL;
     artfilnum = -1;
     artfilplc = 0L;
 
@@ -664,14 +1120,8 @@ bool tileLoad(int16_t tileNum)
     return (waloff[tileNum] != 0 && tilesiz[tileNum].x > 0 && tilesiz[tileNum].y > 0);
 }
 
-void tileMaybeRotate(int16_t tilenume)
+static void tileRotateData(char * const dst, char const * const src, vec2_16_t const siz)
 {
-    auto &rot = rottile[tilenume];
-    auto &siz = tilesiz[rot.owner];
-
-    auto src = (char *)waloff[rot.owner];
-    auto dst = (char *)waloff[tilenume];
-
     // the engine has a squarerotatetile() we could call, but it mirrors at the same time
     for (int x = 0; x < siz.x; ++x)
     {
@@ -681,7 +1131,14 @@ void tileMaybeRotate(int16_t tilenume)
         for (int y = 0; y < siz.y; ++y)
             *(dst + y * siz.x + xofs) = *(src + y + yofs);
     }
+}
+
+void tileMaybeRotate(int16_t tilenume)
+{
+    auto &rot = rottile[tilenume];
+    auto &siz = tilesiz[rot.owner];
 
+    tileRotateData((char *)waloff[tilenume], (char *)waloff[rot.owner], siz);
     tileSetSize(tilenume, siz.y, siz.x);
 }
 
@@ -729,12 +1186,21 @@ void tileLoadData(int16_t tilenume, int32_t dasiz, char *buffer)
             Bexit(EXIT_FAILURE);
         }
 
+        artfildata = kfiledata(artfil);
+        artfillen = kfilelength(artfil);
         artfilnum = tfn;
         artfilplc = 0L;
 
         faketimerhandler();
     }
 
+    if (artfildata && tilefileoffs[tilenume] + dasiz <= artfillen)
+    {
+        Bmemcpy(buffer, artfildata + tilefileoffs[tilenume], dasiz);
+        faketimerhandler();
+        return;
+    }
+
     // Seek to the right position.
     if (artfilplc != tilefileoffs[tilenume])
     {
@@ -747,6 +1213,54 @@ void tileLoadData(int16_t tilenume, int32_t dasiz, char *buffer)
     artfilplc = tilefileoffs[tilenume]+dasiz;
 }
 
+// Thread-safe counterpart to tileLoadData() for the tile cache.  Tiles in ART files that can't be
+// read in place are only loaded if canopen is set, which is only allowed on the main thread.
+bool tileReadData(int16_t tilenume, int32_t dasiz, char *buffer, bool canopen)
+{
+    int const owner = rottile[tilenume].owner;
+
+    if (owner != -1)
+    {
+        char const * const src = tileAcquire(owner);
+
+        if (src == NULL)
+            return false;
+
+        tileRotateData(buffer, src, tilesiz[owner]);
+        tileRelease(src);
+        return true;
+    }
+
+    if (bitmap_test(faketile, tilenume))
+    {
+        if (faketiledata[tilenume] != NULL)
+            LZ4_decompress_safe(faketiledata[tilenume], buffer, faketilesize[tilenume], dasiz);
+        else
+            Bmemset(buffer, 0, dasiz);
+
+        return true;
+    }
+
+    int const tfn = tilefilenum[tilenume];
+
+    if (tfn < MAXARTFILES_TOTAL)
+    {
+        char const * const data = artfilemap[tfn].data.load(std::memory_order_acquire);
+
+        if (data && tilefileoffs[tilenume] + dasiz <= artfilemap[tfn].length)
+        {
+            Bmemcpy(buffer, data + tilefileoffs[tilenume], dasiz);
+            return true;
+        }
+    }
+
+    if (!canopen)
+        return false;
+
+    tileLoadData(tilenume, dasiz, buffer);
+    return true;
+}
+
 static void tilePostLoad(int16_t tilenume)
 {
 #if !defined DEBUG_TILESIZY_512 && !defined DEBUG_TILEOFFSETS
@@ -844,6 +1358,7 @@ intptr_t tileCreate(int16_t tilenume, int32_t xsiz, int32_t ysiz)
 
     walock[tilenume] = CACHE1D_PERMANENT;
     g_cache.allocateBlock(&waloff[tilenume], dasiz, &walock[tilenume]);
+    tilecacheInvalidate(tilenume);
 
     tileSetSize(tilenume, xsiz, ysiz);
     Bmemset(&picanm[tilenume], 0, sizeof(picanm_t));
@@ -893,6 +1408,8 @@ void tileCopySection(int32_t tilenume1, int32_t sx1, int32_t sy1, int32_t xsiz,
 
 void Buninitart(void)
 {
+    tilecacheUninit();
+
     if (artfil != buildvfs_kfd_invalid)
         kclose(artfil);
 
@@ -10,6 +10,7 @@
 #include "compat.h"
 #include "klzw.h"
 #include "lz4.h"
+#include "mio.hpp"
 #include "osd.h"
 #include "pragmas.h"
 #include "vfs.h"
@@ -459,6 +460,18 @@ static char *gfilelist[MAXGROUPFILES];
 static char *groupname[MAXGROUPFILES];
 static int32_t *gfileoffs[MAXGROUPFILES];
 
+// Group files on disk are mapped into memory so that their contents can be
+// read without seeking and used in place, see kfiledata().  Groups nested
+// inside other groups go through the mapping of the outermost one.
+static mio::mmap_source groupmap[MAXGROUPFILES];
+
+// mio takes OS file handles on Windows and regular file descriptors elsewhere
+#ifdef _WIN32
+# define MIO_HANDLE_FROM_FD(fd) (mio::file_handle_type)(_get_osfhandle(fd))
+#else
+# define MIO_HANDLE_FROM_FD(fd) (mio::file_handle_type)(fd)
+#endif
+
 static uint8_t filegrp[MAXOPENFILES];
 static int32_t filepos[MAXOPENFILES];
 static intptr_t filehan[MAXOPENFILES] =
@@ -477,8 +490,86 @@ int32_t cache1d_file_fromzip(buildvfs_kfd fil)
 {
     return (filegrp[fil] == GRP_ZIP);
 }
+
+// ZIPs and GRPs mounted through kplib, mapped the first time something stored in them is asked for
+typedef struct
+{
+    char *name;
+    mio::mmap_source *map;
+} zipmap_t;
+
+static zipmap_t *zipmap;
+static int32_t numzipmaps;
+
+static mio::mmap_source const *kzipgetmap(char const *zipnam)
+{
+    for (bssize_t i = 0; i < numzipmaps; i++)
+        if (!Bstrcmp(zipmap[i].name, zipnam))
+            return zipmap[i].map;
+
+    zipmap = (zipmap_t *)Xrealloc(zipmap, (numzipmaps + 1) * sizeof(zipmap_t));
+
+    auto &z = zipmap[numzipmaps++];
+
+    std::error_code error;
+
+    z.name = Xstrdup(zipnam);
+    z.map  = new mio::mmap_source(mio::make_mmap_source(zipnam, 0, mio::map_entire_file, error));
+
+    // a failed mapping stays in the list so that we don't retry it for every file
+    if (error)
+        DVLOG_F(LOG_DEBUG, "Unable to map %s: %s", zipnam, error.message().c_str());
+
+    return z.map;
+}
+
+static void kzipfreemaps(void)
+{
+    for (bssize_t i = 0; i < numzipmaps; i++)
+    {
+        delete zipmap[i].map;
+        Xfree(zipmap[i].name);
+    }
+
+    DO_FREE_AND_NULL(zipmap);
+    numzipmaps = 0;
+}
 #endif
 
+static void kgroupmap(int32_t const groupnum)
+{
+    if (groupfilgrp[groupnum] != GRP_FILESYSTEM)
+        return;
+
+    std::error_code error;
+
+    groupmap[groupnum] = mio::make_mmap_source(MIO_HANDLE_FROM_FD(groupfil[groupnum]), 0, mio::map_entire_file, error);
+
+    if (error)
+    {
+        DVLOG_F(LOG_DEBUG, "Unable to map %s: %s", groupname[groupnum], error.message().c_str());
+        return;
+    }
+
+    if (groupmap[groupnum].length() < (size_t)gfileoffs[groupnum][gnumfiles[groupnum]])
+    {
+        LOG_F(WARNING, "%s is truncated, not mapping it", groupname[groupnum]);
+        groupmap[groupnum].unmap();
+    }
+}
+
+// Returns the outermost group containing groupnum and adds the offset of groupnum within it to offs.
+static int32_t kgrouproot(int32_t groupnum, int32_t *offs)
+{
+    while (groupfilgrp[groupnum] != GRP_FILESYSTEM)
+    {
+        *offs += gfileoffs[groupfilgrp[groupnum]][groupfil[groupnum]];
+        groupnum = groupfilgrp[groupnum];
+    }
+
+    return groupnum;
+}
+
 static int32_t kopen_internal(const char *filename, char **lastpfn, char searchfirst, char checkcase, char tryzip, int32_t newhandle, uint8_t *arraygrp, intptr_t *arrayhan, int32_t *arraypos);
 static int32_t kread_grp(int32_t handle, void *buffer, int32_t leng);
 static int32_t klseek_grp(int32_t handle, int32_t offset, int32_t whence);
@@ -546,6 +637,7 @@ int initgroupfile(const char *filename)
         }
         gfileoffs[numgroupfiles][gnumfiles[numgroupfiles]] = j;
         groupname[numgroupfiles] = Xstrdup(filename);
+        kgroupmap(numgroupfiles);
         return numgroupfiles++;
     }
     klseek_grp(numgroupfiles, 0, BSEEK_SET);
@@ -649,6 +741,7 @@ int initgroupfile(const char *filename)
         }
         gfileoffs[numgroupfiles][gnumfiles[numgroupfiles]] = j;
         groupname[numgroupfiles] = Xstrdup(filename);
+        kgroupmap(numgroupfiles);
         return numgroupfiles++;
     }
 
@@ -667,11 +760,17 @@ void uninitgroupfile(void)
             DO_FREE_AND_NULL(gfileoffs[i]);
             DO_FREE_AND_NULL(groupname[i]);
 
+            groupmap[i].unmap();
+
             Bclose(groupfil[i]);
             groupfil[i] = -1;
         }
     numgroupfiles = 0;
 
+#ifdef WITHKPLIB
+    kzipfreemaps();
+#endif
+
     // JBF 20040111: "close" any files open in groups
     for (i=0; i<MAXOPENFILES; i++)
     {
@@ -727,6 +826,38 @@ static int32_t check_filename_mismatch(const char * const filename, int ofs)
 }
 #endif
 
+// Returns the group holding filename, searching the last one added first, and sets *filenum to its entry in it.
+static int32_t kfindingroups(const char *filename, char searchfirst, int32_t *filenum)
+{
+    for (bssize_t k = searchfirst != 1 ? numgroupfiles-1 : 0; k >= 0; --k)
+    {
+        if (groupfil[k] < 0)
+            continue;
+
+        for (bssize_t i = gnumfiles[k]-1; i >= 0; --i)
+        {
+            char const * const gfileptr = (char *)&gfilelist[k][i<<4];
+
+            unsigned int j;
+            for (j = 0; j < 13; ++j)
+            {
+                if (!filename[j]) break;
+                if (toupperlookup[filename[j]] != toupperlookup[gfileptr[j]])
+                    goto gnumfiles_continue;
+            }
+            if (j<13 && gfileptr[j]) continue;   // JBF: because e1l1.map might exist before e1l1
+            if (j==13 && filename[j]) continue;   // JBF: long file name
+
+            *filenum = i;
+            return k;
+
+gnumfiles_continue: ;
+        }
+    }
+
+    return -1;
+}
+
 static int32_t kopen_internal(const char *filename, char **lastpfn, char searchfirst, char checkcase, char tryzip, int32_t newhandle, uint8_t *arraygrp, intptr_t *arrayhan, int32_t *arraypos)
 {
     buildvfs_kfd fil;
@@ -796,35 +927,69 @@ static int32_t kopen_internal(const char *filename, char **lastpfn, char searchf
     UNREFERENCED_PARAMETER(tryzip);
 #endif
 
-    for (bssize_t k = searchfirst != 1 ? numgroupfiles-1 : 0; k >= 0; --k)
-    {
-        if (groupfil[k] < 0)
-            continue;
+    int32_t filenum;
+    int32_t const groupnum = kfindingroups(filename, searchfirst, &filenum);
 
-        for (bssize_t i = gnumfiles[k]-1; i >= 0; --i)
-        {
-            char const * const gfileptr = (char *)&gfilelist[k][i<<4];
+    if (groupnum < 0)
+        return -1;
 
-            unsigned int j;
-            for (j = 0; j < 13; ++j)
-            {
-                if (!filename[j]) break;
-                if (toupperlookup[filename[j]] != toupperlookup[gfileptr[j]])
-                    goto gnumfiles_continue;
-            }
-            if (j<13 && gfileptr[j]) continue;   // JBF: because e1l1.map might exist before e1l1
-            if (j==13 && filename[j]) continue;   // JBF: long file name
+    arraygrp[newhandle] = groupnum;
+    arrayhan[newhandle] = filenum;
+    arraypos[newhandle] = 0;
+    return newhandle;
+}
 
-            arraygrp[newhandle] = k;
-            arrayhan[newhandle] = i;
-            arraypos[newhandle] = 0;
-            return newhandle;
+int32_t kfileinfo(const char *filename, buildvfs_kinfo_t *info)
+{
+    char *where = NULL;
+    struct Bstat st;
 
-gnumfiles_continue: ;
-        }
+    // the same order as kopen4load() with searchfirst == 0
+    if (findfrompath(filename, &where) >= 0)
+    {
+        int const staterr = Bstat(where, &st);
+
+        Xfree(where);
+
+        if (staterr)
+            return 0;
+
+        info->data     = NULL;
+        info->length   = st.st_size;
+        info->offset   = 0;
+        info->disksize = st.st_size;
+        info->mtime    = st.st_mtime;
+        return 1;
     }
 
-    return -1;
+    for (; toupperlookup[*filename] == '/'; filename++) { }
+
+#ifdef WITHKPLIB
+    // where the data of a ZIP entry starts is only known once its local header has been read
+    if (kzgetarchive(filename))
+        return 0;
+#endif
+
+    int32_t filenum;
+    int32_t const groupnum = kfindingroups(filename, 0, &filenum);
+
+    if (groupnum < 0)
+        return -1;
+
+    int32_t offs = gfileoffs[groupnum][filenum];
+    int32_t const rootnum = kgrouproot(groupnum, &offs);
+
+    if (Bfstat(groupfil[rootnum], &st))
+        return 0;
+
+    auto const &map = groupmap[rootnum];
+
+    info->length   = gfileoffs[groupnum][filenum+1] - gfileoffs[groupnum][filenum];
+    info->offset   = offs;
+    info->disksize = st.st_size;
+    info->mtime    = st.st_mtime;
+    info->data     = (map.is_mapped() && (size_t)info->length + offs <= map.length()) ? map.data() + offs : NULL;
+    return 1;
 }
 
 void krename(int32_t crcval, int32_t filenum, const char *newname)
@@ -907,22 +1072,31 @@ int32_t kread_internal(int32_t handle, void *buffer, int32_t leng, const uint8_t
     if (EDUKE32_PREDICT_FALSE(groupfil[groupnum] == -1))
         return 0;
 
-    int32_t rootgroupnum = groupnum;
     int32_t i = 0;
-    while (groupfilgrp[rootgroupnum] != GRP_FILESYSTEM)
-    {
-        i += gfileoffs[groupfilgrp[rootgroupnum]][groupfil[rootgroupnum]];
-        rootgroupnum = groupfilgrp[rootgroupnum];
-    }
+    int32_t const rootgroupnum = kgrouproot(groupnum, &i);
+
     if (EDUKE32_PREDICT_TRUE(groupfil[rootgroupnum] != -1))
     {
         i += gfileoffs[groupnum][filenum]+arraypos[handle];
+        leng = min(leng,(gfileoffs[groupnum][filenum+1]-gfileoffs[groupnum][filenum])-arraypos[handle]);
+
+        auto const &map = groupmap[rootgroupnum];
+
+        if (map.is_mapped())
+        {
+            if (EDUKE32_PREDICT_FALSE(leng <= 0 || (size_t)i + leng > map.length()))
+                return 0;
+
+            Bmemcpy(buffer, map.data() + i, leng);
+            arraypos[handle] += leng;
+            return leng;
+        }
+
         if (i != groupfilpos[rootgroupnum])
         {
             Blseek(groupfil[rootgroupnum],i,BSEEK_SET);
             groupfilpos[rootgroupnum] = i;
         }
-        leng = min(leng,(gfileoffs[groupnum][filenum+1]-gfileoffs[groupnum][filenum])-arraypos[handle]);
         leng = Bread(groupfil[rootgroupnum],buffer,leng);
         arraypos[handle] += leng;
         groupfilpos[rootgroupnum] += leng;
@@ -1032,6 +1206,51 @@ void kclose_internal(int32_t handle, const uint8_t *arraygrp, intptr_t *arrayhan
     arrayhan[handle] = -1;
 }
 
+char const *kfiledata(buildvfs_kfd handle)
+{
+    int32_t const groupnum = filegrp[handle];
+
+    if (groupnum == GRP_FILESYSTEM)
+        return NULL;
+#ifdef WITHKPLIB
+    else if (groupnum == GRP_ZIP)
+    {
+        if (kzcurhand != handle)
+        {
+            if (kztell() >= 0) { filepos[kzcurhand] = kztell(); kzclose(); }
+            kzcurhand = handle;
+            kzipopen(filenamsav[handle]);
+            kzseek(filepos[handle],SEEK_SET);
+        }
+
+        // only entries stored without compression can be used in place
+        char const *const zipnam = kzgetarchive(filenamsav[handle]);
+
+        if (kzfs.comptyp != 0 || zipnam == NULL)
+            return NULL;
+
+        auto const map = kzipgetmap(zipnam);
+
+        if (!map->is_mapped() || (size_t)kzfs.seek0 + kzfs.leng > map->length())
+            return NULL;
+
+        return map->data() + kzfs.seek0;
+    }
+#endif
+
+    if (groupfil[groupnum] == -1)
+        return NULL;
+
+    int32_t const filenum = filehan[handle];
+    int32_t offs = gfileoffs[groupnum][filenum];
+    auto const &map = groupmap[kgrouproot(groupnum, &offs)];
+
+    if (!map.is_mapped() || (size_t)gfileoffs[groupnum][filenum+1] - gfileoffs[groupnum][filenum] + offs > map.length())
+        return NULL;
+
+    return map.data() + offs;
+}
+
 int32_t kread(int32_t handle, void *buffer, int32_t leng)
 {
     return kread_internal(handle, buffer, leng, filegrp, filehan, filepos);
@@ -26,11 +26,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <map>
 #endif
 
+#include "benchsim.h"
 #include "colmatch.h"
 #include "duke3d.h"
 #include "input.h"
 #include "microprofile.h"
 #include "screens.h"
+#include "spritegrid.h"
 
 #if KRANDDEBUG
 # define ACTOR_STATIC
@@ -668,6 +670,8 @@ int32_t A_MoveSpriteClipdist(int32_t spriteNum, vec3_t const &change, uint32_t c
         pSprite->z += diffZ >> 1;
     }
 
+    spriteMarkChanged(spriteNum);
+
     // Testing: For some reason the assert below this was tripping for clients
     EDUKE32_UNUSED int16_t   dbg_ClipMoveSectnum = newSectnum;
 
@@ -3359,6 +3363,7 @@ ACTOR_STATIC void Proj_MoveCustom(int const spriteNum)
                         else
                         {
                             sprite[spriteNum].xy -= Proj_GetOffset(spriteNum);
+                            spriteMarkChanged(spriteNum);
 
                             A_DamageWall(spriteNum, otherSprite, pSprite->xyz, pSprite->picnum);
 
@@ -3382,6 +3387,7 @@ ACTOR_STATIC void Proj_MoveCustom(int const spriteNum)
 
                     case 16384:
                         sprite[spriteNum].xy -= Proj_GetOffset(spriteNum);
+                        spriteMarkChanged(spriteNum);
 
                         if (Proj_MaybeDamageCF(spriteNum))
                         {
@@ -3670,6 +3676,7 @@ ACTOR_STATIC void G_MoveWeapons(void)
 
                         case 16384:
                             pSprite->xy -= Proj_GetOffset(spriteNum);
+                            spriteMarkChanged(spriteNum);
 
                             if (Proj_MaybeDamageCF(spriteNum))
                                 DELETE_SPRITE_AND_CONTINUE(spriteNum);
@@ -4377,6 +4384,7 @@ ACTOR_STATIC void G_MoveActors(void)
                     moveSprite &= (MAXWALLS - 1);
 
                     pSprite->xy -= Proj_GetOffset(spriteNum);
+                    spriteMarkChanged(spriteNum);
                     A_DamageWall(spriteNum, moveSprite, pSprite->xyz, pSprite->picnum);
 
                     break;
@@ -6563,7 +6571,10 @@ ACTOR_STATIC void G_MoveEffectors(void)   //STATNUM 3
                         pPlayer->pos.xy = r;
 
                         if (sprite[pPlayer->i].extra <= 0)
+                        {
                             sprite[pPlayer->i].xy = r;
+                            spriteMarkChanged(pPlayer->i);
+                        }
                     }
                 }
 
@@ -6585,7 +6596,10 @@ ACTOR_STATIC void G_MoveEffectors(void)   //STATNUM 3
                             actor[p].bpos.xy = sprite[p].xy;
 
                             if (move_rotfixed_sprite(p, j, pData[2]))
+                            {
                                 rotatepoint(sprite[j].xy, sprite[p].xy, (q * l), &sprite[p].xy);
+                                spriteMarkChanged(p);
+                            }
                         }
                 }
 
@@ -6778,7 +6792,10 @@ ACTOR_STATIC void G_MoveEffectors(void)   //STATNUM 3
                             pPlayer->q16ang &= 0x7FFFFFF;
 
                             if (sprite[pPlayer->i].extra <= 0)
+                            {
                                 sprite[pPlayer->i].xy = pPlayer->pos.xy;
+                                spriteMarkChanged(pPlayer->i);
+                            }
                         }
                     }
 
@@ -7401,6 +7418,7 @@ ACTOR_STATIC void G_MoveEffectors(void)   //STATNUM 3
 
                                 int16_t    sectnum    = foundSprite->sectnum;
                                 int const  pushResult = pushmove(&foundSprite->xyz, &sectnum, clipdist - 1, (4L << 8), (4L << 8), CLIPMASK0);
+                                spriteMarkChanged(findSprite);
                                 bool const squish     = sectnum == pSprite->sectnum || sectnum == -1 || pushResult < 0;
 
                                 if (sectnum != -1 && sectnum != foundSprite->sectnum)
@@ -8258,7 +8276,10 @@ ACTOR_STATIC void G_MoveEffectors(void)   //STATNUM 3
                         pPlayer->opos.xy = pPlayer->pos.xy;
 
                     if (sprite[pPlayer->i].extra <= 0)
+                    {
                         sprite[pPlayer->i].xy = pPlayer->pos.xy;
+                        spriteMarkChanged(pPlayer->i);
+                    }
                 }
             }
 
@@ -9339,28 +9360,36 @@ void G_MoveWorld(void)
     auto framecnt = g_frameCounter;
 
     MICROPROFILE_SCOPEI("Game", "MoveWorld", MP_YELLOW);
+    BENCHSIM_SCOPE(MOVEWORLD);
 
     VM_OnEvent(EVENT_PREWORLD);
     G_DoEventGame(EVENT_PREGAME, false);
     G_RecordOldSpritePos();
 
+    // once per tic for findnearsprite, see VM_FindNearSprite()
+    spritegridRefresh();
+
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveZombieActors", MP_YELLOW2);
+        BENCHSIM_SCOPE(MOVEZOMBIEACTORS);
         G_MoveZombieActors();  //ST 2
     }
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveWeapons", MP_YELLOW3);
+        BENCHSIM_SCOPE(MOVEWEAPONS);
         G_MoveWeapons();  //ST 4
     }
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveTransports", MP_YELLOW4);
+        BENCHSIM_SCOPE(MOVETRANSPORTS);
         G_MoveTransports();  //ST 9
     }
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MovePlayers", MP_YELLOW);
+        BENCHSIM_SCOPE(MOVEPLAYERS);
         G_MovePlayers();  //ST 10
     }
 
@@ -9369,11 +9398,13 @@ void G_MoveWorld(void)
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveFallers", MP_YELLOW2);
+        BENCHSIM_SCOPE(MOVEFALLERS);
         G_MoveFallers();  //ST 12
     }
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveMisc", MP_YELLOW3);
+        BENCHSIM_SCOPE(MOVEMISC);
         G_MoveMisc();  //ST 5
     }
 
@@ -9382,6 +9413,7 @@ void G_MoveWorld(void)
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveActors", MP_YELLOW4);
+        BENCHSIM_SCOPE(MOVEACTORS);
         G_MoveActors();  //ST 1
     }
 
@@ -9400,11 +9432,13 @@ void G_MoveWorld(void)
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveEffectors", MP_YELLOW);
+        BENCHSIM_SCOPE(MOVEEFFECTORS);
         G_MoveEffectors();  //ST 3
     }
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveStandables", MP_YELLOW2);
+        BENCHSIM_SCOPE(MOVESTANDABLES);
         G_MoveStandables();  //ST 6
     }
 
@@ -9417,6 +9451,7 @@ void G_MoveWorld(void)
 
     {
         MICROPROFILE_SCOPEI("MoveWorld", "MoveFX", MP_YELLOW3);
+        BENCHSIM_SCOPE(MOVEFX);
         G_MoveFX();  //ST 11
     }
 
@@ -0,0 +1,400 @@
+// Offline audio mixer benchmark
+// See benchaudio.h for an overview.
+
+#include "benchaudio.h"
+#include "common.h"
+#include "duke3d.h"
+#include "fx_man.h"
+#include "scriptfile.h"
+#include "vfs.h"
+#include "xxhash_config.h"
+
+int32_t g_benchAudio;
+char g_benchAudioScript[BMAX_PATH];
+char g_benchAudioOutput[BMAX_PATH] = "benchaudio.wav";
+
+// frames rendered per FX_Render() call; sounds are started in between
+#define BENCHAUDIO_BLOCKFRAMES 256
+#define BENCHAUDIO_MAXEXPECT   8
+
+enum
+{
+    T_MIXRATE,
+    T_CHANNELS,
+    T_VOICES,
+    T_LENGTH,
+    T_SOUND,
+    T_SOUND3D,
+    T_EXPECT,
+    T_TIME,
+    T_PITCH,
+    T_VOLUME,
+    T_PAN,
+    T_ANGLE,
+    T_DISTANCE,
+    T_GAIN,
+    T_PRIORITY,
+    T_LOOP,
+    T_DECODED,
+};
+
+typedef struct
+{
+    char *ptr;
+    char *alloc;  // what to free afterwards, NULL if ptr points into a mapped group
+    int32_t len;
+    int32_t order;
+    int32_t startFrame;
+    int32_t pitch, vol, left, right;
+    int32_t angle, distance;
+    int32_t priority;
+    fix16_t gain;
+    uint8_t is3D, loop, decoded;
+} benchaudiosound_t;
+
+static struct
+{
+    int32_t mixRate    = 48000;
+    int32_t numChannels = 2;
+    int32_t numVoices  = 32;
+    int32_t lengthMs   = 10000;
+
+    uint64_t expect[BENCHAUDIO_MAXEXPECT];
+    int32_t numExpect;
+
+    GrowArray<benchaudiosound_t, 64> sounds;
+} benchAudio;
+
+static int32_t G_BenchAudioLoadSound(benchaudiosound_t *snd, char const *fileName)
+{
+    buildvfs_kfd fp = S_OpenAudio(fileName, 0, 0);
+
+    if (fp == buildvfs_kfd_invalid)
+    {
+        LOG_F(ERROR, "benchaudio: could not open \"%s\".", fileName);
+        return -1;
+    }
+
+    snd->len = kfilelength(fp);
+
+    if (auto const data = kfiledata(fp))
+        snd->ptr = (char *)(intptr_t)data;
+    else
+    {
+        snd->ptr = snd->alloc = (char *)Xmalloc(snd->len);
+        snd->len = kread(fp, snd->ptr, snd->len);
+    }
+
+    kclose(fp);
+
+    if (!snd->decoded)
+        return 0;
+
+    // played from a WAV image, the way the sound cache plays sounds heard more than once
+    char *wav;
+    uint32_t wavLen;
+
+    if (FX_DecodeToWAV(snd->ptr, snd->len, &wav, &wavLen, INT32_MAX) != FX_Ok)
+    {
+        LOG_F(ERROR, "benchaudio: could not decode \"%s\".", fileName);
+        return -1;
+    }
+
+    Xfree(snd->alloc);
+    snd->ptr = snd->alloc = wav;
+    snd->len = wavLen;
+
+    return 0;
+}
+
+static int32_t G_BenchAudioParseSound(scriptfile *pScript, int32_t const is3D)
+{
+    static const tokenlist soundTokens[] =
+    {
+        { "time",     T_TIME     },
+        { "pitch",    T_PITCH    },
+        { "volume",   T_VOLUME   },
+        { "pan",      T_PAN      },
+        { "angle",    T_ANGLE    },
+        { "distance", T_DISTANCE },
+        { "gain",     T_GAIN     },
+        { "priority", T_PRIORITY },
+        { "loop",     T_LOOP     },
+        { "decoded",  T_DECODED  },
+    };
+
+    benchaudiosound_t snd = {};
+    char *fileName = NULL;
+    char *soundEnd;
+    int32_t timeMs = 0;
+    double gain = 1.0;
+
+    snd.vol = snd.left = snd.right = 255;
+    snd.is3D = is3D;
+    snd.order = benchAudio.sounds.size();
+
+    if (scriptfile_getstring(pScript, &fileName) || scriptfile_getbraces(pScript, &soundEnd))
+        return -1;
+
+    while (pScript->textptr < soundEnd)
+    {
+        switch (getatoken(pScript, soundTokens, ARRAY_SIZE(soundTokens)))
+        {
+            case T_TIME:     scriptfile_getnumber(pScript, &timeMs); break;
+            case T_PITCH:    scriptfile_getnumber(pScript, &snd.pitch); break;
+            case T_VOLUME:   scriptfile_getnumber(pScript, &snd.vol); break;
+            case T_PAN:
+                scriptfile_getnumber(pScript, &snd.left);
+                scriptfile_getnumber(pScript, &snd.right);
+                break;
+            case T_ANGLE:    scriptfile_getnumber(pScript, &snd.angle); break;
+            case T_DISTANCE: scriptfile_getnumber(pScript, &snd.distance); break;
+            case T_GAIN:     scriptfile_getdouble(pScript, &gain); break;
+            case T_PRIORITY: scriptfile_getnumber(pScript, &snd.priority); break;
+            case T_LOOP:     snd.loop = 1; break;
+            case T_DECODED:  snd.decoded = 1; break;
+        }
+    }
+
+    snd.startFrame = (int32_t)((int64_t)max(timeMs, 0) * benchAudio.mixRate / 1000);
+    snd.gain = fix16_from_dbl(gain);
+
+    if (G_BenchAudioLoadSound(&snd, fileName))
+        return -1;
+
+    benchAudio.sounds.append(snd);
+    return 0;
+}
+
+static int32_t G_BenchAudioParseScript(char const *fileName)
+{
+    static const tokenlist tokens[] =
+    {
+        { "mixrate",  T_MIXRATE  },
+        { "channels", T_CHANNELS },
+        { "voices",   T_VOICES   },
+        { "length",   T_LENGTH   },
+        { "sound",    T_SOUND    },
+        { "sound3d",  T_SOUND3D  },
+        { "expect",   T_EXPECT   },
+    };
+
+    scriptfile *pScript = scriptfile_fromfile(fileName);
+
+    if (!pScript)
+    {
+        LOG_F(ERROR, "benchaudio: could not open script \"%s\".", fileName);
+        return -1;
+    }
+
+    int32_t status = 0;
+
+    while (!status)
+    {
+        int const token = getatoken(pScript, tokens, ARRAY_SIZE(tokens));
+        char *const pToken = pScript->ltextptr;
+
+        if (token == T_EOF)
+            break;
+
+        switch (token)
+        {
+            case T_MIXRATE:  scriptfile_getnumber(pScript, &benchAudio.mixRate); break;
+            case T_CHANNELS: scriptfile_getnumber(pScript, &benchAudio.numChannels); break;
+            case T_VOICES:   scriptfile_getnumber(pScript, &benchAudio.numVoices); break;
+            case T_LENGTH:   scriptfile_getnumber(pScript, &benchAudio.lengthMs); break;
+
+            case T_SOUND:
+            case T_SOUND3D:
+                // sounds are placed in time using the mix rate, which therefore has to come first
+                status = G_BenchAudioParseSound(pScript, token == T_SOUND3D);
+                break;
+
+            case T_EXPECT:
+            {
+                char *hash;
+
+                if (scriptfile_getstring(pScript, &hash))
+                    break;
+
+                if (benchAudio.numExpect < BENCHAUDIO_MAXEXPECT)
+                    benchAudio.expect[benchAudio.numExpect++] = strtoull(hash, NULL, 16);
+                else
+                    LOG_F(WARNING, "%s:%d: too many expect lines, ignoring \"%s\".",
+                          pScript->filename, scriptfile_getlinum(pScript, pToken), hash);
+                break;
+            }
+
+            default:
+                LOG_F(ERROR, "%s:%d: error: unknown token.", pScript->filename, scriptfile_getlinum(pScript, pToken));
+                status = -1;
+                break;
+        }
+    }
+
+    scriptfile_close(pScript);
+
+    if (!status && (benchAudio.mixRate <= 0 || (unsigned)(benchAudio.numChannels - 1) > 1 || benchAudio.numVoices <= 0 || benchAudio.lengthMs <= 0))
+    {
+        LOG_F(ERROR, "benchaudio: invalid mixrate, channels, voices or length in \"%s\".", fileName);
+        status = -1;
+    }
+
+    return status;
+}
+
+static int G_BenchAudioCompareSounds(void const *a, void const *b)
+{
+    auto const sa = (benchaudiosound_t const *)a;
+    auto const sb = (benchaudiosound_t const *)b;
+
+    if (sa->startFrame != sb->startFrame)
+        return sa->startFrame < sb->startFrame ? -1 : 1;
+
+    return sa->order - sb->order;
+}
+
+static int32_t G_BenchAudioWriteWAV(char const *fileName, int16_t const *samples, int32_t numFrames)
+{
+    buildvfs_FILE fil = buildvfs_fopen_write(fileName);
+
+    if (!fil)
+    {
+        LOG_F(ERROR, "benchaudio: could not open \"%s\" for writing", fileName);
+        return -1;
+    }
+
+    uint32_t const blockAlign = benchAudio.numChannels * sizeof(int16_t);
+    uint32_t const dataSize   = numFrames * blockAlign;
+
+    uint32_t const riffHeader[] = { B_LITTLE32(0x46464952) /* RIFF */, B_LITTLE32(36 + dataSize), B_LITTLE32(0x45564157) /* WAVE */,
+                                    B_LITTLE32(0x20746d66) /* fmt  */, B_LITTLE32(16) };
+    uint16_t const fmtHeader[]  = { B_LITTLE16(1) /* PCM */, B_LITTLE16((uint16_t)benchAudio.numChannels) };
+    uint32_t const fmtRate[]    = { B_LITTLE32((uint32_t)benchAudio.mixRate), B_LITTLE32(benchAudio.mixRate * blockAlign) };
+    uint16_t const fmtFormat[]  = { B_LITTLE16(blockAlign), B_LITTLE16(16) };
+    uint32_t const dataHeader[] = { B_LITTLE32(0x61746164) /* data */, B_LITTLE32(dataSize) };
+
+    buildvfs_fwrite(riffHeader, sizeof(riffHeader), 1, fil);
+    buildvfs_fwrite(fmtHeader, sizeof(fmtHeader), 1, fil);
+    buildvfs_fwrite(fmtRate, sizeof(fmtRate), 1, fil);
+    buildvfs_fwrite(fmtFormat, sizeof(fmtFormat), 1, fil);
+    buildvfs_fwrite(dataHeader, sizeof(dataHeader), 1, fil);
+
+#if B_BIG_ENDIAN != 0
+    for (int32_t i = 0, n = numFrames * benchAudio.numChannels; i < n; i++)
+    {
+        int16_t const sample = B_LITTLE16(samples[i]);
+        buildvfs_fwrite(&sample, sizeof(sample), 1, fil);
+    }
+#else
+    buildvfs_fwrite(samples, dataSize, 1, fil);
+#endif
+
+    buildvfs_fclose(fil);
+    return 0;
+}
+
+int32_t G_BenchAudio(void)
+{
+    int32_t status = 1;
+
+    if (G_BenchAudioParseScript(g_benchAudioScript))
+        goto cleanup;
+
+    qsort(benchAudio.sounds.begin(), benchAudio.sounds.size(), sizeof(benchaudiosound_t), G_BenchAudioCompareSounds);
+
+    FX_SetDevice(ASS_Null);
+
+    if (FX_Init(benchAudio.numVoices, benchAudio.numChannels, benchAudio.mixRate, NULL) != FX_Ok)
+    {
+        LOG_F(ERROR, "benchaudio: could not initialize the null output driver: %s", FX_ErrorString(FX_Error));
+        FX_SetDevice(ASS_AutoDetect);
+        goto cleanup;
+    }
+
+    {
+        int32_t const numFrames   = (int32_t)((int64_t)benchAudio.lengthMs * benchAudio.mixRate / 1000);
+        int32_t const frameSize   = benchAudio.numChannels * sizeof(int16_t);
+        auto const    output      = (int16_t *)Xmalloc(numFrames * frameSize);
+        uint64_t      mixTicks    = 0;
+        uint64_t      voiceFrames = 0;
+        int32_t       numStarted  = 0;
+        int32_t       numFailed   = 0;
+        size_t        nextSound   = 0;
+
+        for (int32_t frame = 0; frame < numFrames;)
+        {
+            for (; nextSound < benchAudio.sounds.size() && benchAudio.sounds[nextSound].startFrame <= frame; nextSound++)
+            {
+                auto const &snd = benchAudio.sounds[nextSound];
+
+                int const handle = snd.is3D ? FX_Play3D(snd.ptr, snd.len, snd.loop ? FX_LOOP : FX_ONESHOT, snd.pitch, snd.angle,
+                                                        snd.distance, snd.priority, snd.gain, 0)
+                                            : FX_Play(snd.ptr, snd.len, snd.loop ? 0 : -1, -1, snd.pitch, snd.vol, snd.left, snd.right,
+                                                      snd.priority, snd.gain, 0);
+                // Ogg, FLAC and module voices stay paused until a decoder task has opened the stream;
+                // FX_PauseVoice() waits for it, so they start in the same block on every run.
+                if (handle > FX_Ok && FX_PauseVoice(handle, false) == FX_Ok)
+                    numStarted++;
+                else
+                    numFailed++;
+            }
+
+            int32_t blockFrames = min(BENCHAUDIO_BLOCKFRAMES, numFrames - frame);
+
+            if (nextSound < benchAudio.sounds.size())
+                blockFrames = min(blockFrames, benchAudio.sounds[nextSound].startFrame - frame);
+
+            voiceFrames += (uint64_t)FX_SoundsPlaying() * blockFrames;
+
+            uint64_t const startTicks = timerGetPerformanceCounter();
+            FX_Render((char *)output + frame * frameSize, blockFrames * frameSize);
+            mixTicks += timerGetPerformanceCounter() - startTicks;
+
+            frame += blockFrames;
+        }
+
+        FX_Shutdown();
+        FX_SetDevice(ASS_AutoDetect);
+
+        uint64_t const hash    = XXH3_64bits(output, numFrames * frameSize);
+        double const   mixSecs = (double)mixTicks / timerGetPerformanceFrequency();
+
+        LOG_F(INFO, "benchaudio: %s: %d sounds (%d not started), %d frames at %d Hz in %.03f ms, %.1fx realtime",
+              g_benchAudioScript, numStarted, numFailed, numFrames, benchAudio.mixRate, mixSecs * 1000.0,
+              mixSecs > 0.0 ? (double)numFrames / benchAudio.mixRate / mixSecs : 0.0);
+        LOG_F(INFO, "benchaudio: %.0f voice-samples/s, %.02f voices mixed on average",
+              mixSecs > 0.0 ? voiceFrames / mixSecs : 0.0, (double)voiceFrames / numFrames);
+        LOG_F(INFO, "benchaudio: output hash %016" PRIx64, hash);
+
+        status = G_BenchAudioWriteWAV(g_benchAudioOutput, output, numFrames) ? 1 : 0;
+        Xfree(output);
+
+        if (!status)
+            LOG_F(INFO, "benchaudio: wrote \"%s\"", g_benchAudioOutput);
+
+        if (benchAudio.numExpect)
+        {
+            int32_t matched = 0;
+
+            for (int32_t i = 0; i < benchAudio.numExpect; i++)
+                matched |= (benchAudio.expect[i] == hash);
+
+            if (matched)
+                LOG_F(INFO, "benchaudio: output matches the expected hash");
+            else
+            {
+                LOG_F(ERROR, "benchaudio: output hash %016" PRIx64 " does not match any expected hash!", hash);
+                status = 1;
+            }
+        }
+    }
+
+cleanup:
+    for (auto &snd : benchAudio.sounds)
+        Xfree(snd.alloc);
+
+    benchAudio.sounds.clear();
+
+    return status;
+}
@@ -0,0 +1,50 @@
+// Offline audio mixer benchmark
+//
+// "-benchaudio <script>" starts the game without video, input or menus and
+// renders a scripted set of sounds through FX_Play()/FX_Play3D() on the null
+// output driver, which hands out mix buffers as fast as they can be mixed
+// instead of at the rate a device consumes them.  The result is written to a
+// WAV file ("-benchaudioout <file>", default benchaudio.wav) and its hash is
+// checked against the golden values listed in the script, so changes to the
+// mixer can be verified for speed and output on a machine with no audio
+// hardware.
+//
+// Scripts use the same syntax as DEF files:
+//
+//   mixrate  48000          // output rate in Hz
+//   channels 2              // 1 or 2
+//   voices   32             // size of the voice pool
+//   length   10000          // milliseconds of output to render
+//
+//   sound   "file.voc" { time 0 pitch 0 volume 255 pan 255 255 gain 1.0 priority 0 loop }
+//   sound3d "file.ogg" { time 250 pitch -512 angle 16 distance 400 gain 1.0 priority 0 loop decoded }
+//
+//   expect 0123456789abcdef // XXH3 of the rendered samples
+//
+// Each sound starts "time" milliseconds into the output, in mixer buffer
+// granularity; every field in the braces is optional.  Files may be VOC, WAV,
+// Ogg Vorbis or FLAC and are looked up like any other game sound.  "decoded"
+// Ogg Vorbis and FLAC sounds are decoded to PCM with FX_DecodeToWAV() up
+// front and played from that, as snd_pcmcache does, instead of streamed.
+// Any number of expect lines can be given, as the float mixer rounds
+// slightly differently on platforms that lack the SSE2 or NEON paths; the
+// output passes if it matches one of them.  Without any, the hash is only
+// reported.
+// package/sdk/samples/benchaudio.txt is a ready-made script covering every
+// format, with sounds made by source/tools/src/mkbenchsounds.py.
+
+#pragma once
+
+#ifndef benchaudio_h_
+#define benchaudio_h_
+
+#include "compat.h"
+
+extern int32_t g_benchAudio;
+extern char g_benchAudioScript[BMAX_PATH];
+extern char g_benchAudioOutput[BMAX_PATH];
+
+// returns the process exit code: 0 if the output matched a golden hash or none were given
+int32_t G_BenchAudio(void);
+
+#endif
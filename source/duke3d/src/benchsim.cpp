@@ -0,0 +1,181 @@
+// Headless simulation benchmark
+// See benchsim.h for an overview.
+
+#include "benchsim.h"
+#include "duke3d.h"
+#include "sjson.h"
+#include "vfs.h"
+#include "xxhash_config.h"
+
+int32_t g_benchSim;
+int32_t g_benchSimNet;
+char g_benchSimOutput[BMAX_PATH] = "benchsim.json";
+uint64_t g_benchSimTicks[BENCHSIM_NUMTIMERS];
+
+static char const *const benchSimTimerNames[BENCHSIM_NUMTIMERS] =
+{
+    "Tic",
+    "MoveWorld",
+    "MoveZombieActors",
+    "MoveWeapons",
+    "MoveTransports",
+    "MovePlayers",
+    "MoveFallers",
+    "MoveMisc",
+    "MoveActors",
+    "MoveEffectors",
+    "MoveStandables",
+    "MoveFX",
+};
+
+typedef struct
+{
+    uint64_t hash, ticks;
+} benchsimtic_t;
+
+static GrowArray<benchsimtic_t, 4096> benchSimTics;
+
+void G_BenchSimReset(void)
+{
+    Bmemset(g_benchSimTicks, 0, sizeof(g_benchSimTicks));
+    benchSimTics.clear();
+}
+
+static uint64_t G_BenchSimHashState(void)
+{
+    XXH3_state_t xxh;
+    XXH3_64bits_reset(&xxh);
+
+    XXH3_64bits_update(&xxh, &randomseed, sizeof(randomseed));
+    XXH3_64bits_update(&xxh, &g_globalRandom, sizeof(g_globalRandom));
+
+    XXH3_64bits_update(&xxh, sector, sizeof(sectortype) * numsectors);
+    XXH3_64bits_update(&xxh, wall, sizeof(walltype) * numwalls);
+
+    for (int i = 0; i < MAXSPRITES; i++)
+    {
+        if (sprite[i].statnum == MAXSTATUS)
+            continue;
+
+        XXH3_64bits_update(&xxh, &i, sizeof(i));
+        XXH3_64bits_update(&xxh, &sprite[i], sizeof(spritetype));
+        // dispicnum and everything after it is only touched by the renderer
+        XXH3_64bits_update(&xxh, &actor[i], offsetof(actor_t, dispicnum));
+    }
+
+    for (int TRAVERSE_CONNECT(i))
+        XXH3_64bits_update(&xxh, g_player[i].ps, sizeof(DukePlayer_t));
+
+    return XXH3_64bits_digest(&xxh);
+}
+
+void G_BenchSimEndTic(uint64_t const ticTicks)
+{
+    g_benchSimTicks[BENCHSIM_TIC] += ticTicks;
+    benchSimTics.append({ G_BenchSimHashState(), ticTicks });
+}
+
+int32_t G_BenchSimWriteReport(char const * const demoName, int32_t const firstOutOfSync)
+{
+    int const numTics = benchSimTics.size();
+    double const msPerTick = 1000.0 / timerGetPerformanceFrequency();
+
+    LOG_F(INFO, "benchsim: %s: %d tics in %.03f ms", demoName, numTics, g_benchSimTicks[BENCHSIM_TIC] * msPerTick);
+
+    sjson_context * ctx = sjson_create_context(0, 0, NULL);
+    if (!ctx)
+    {
+        LOG_F(ERROR, "Could not create sjson_context");
+        return 1;
+    }
+
+    sjson_node * root = sjson_mkobject(ctx);
+
+    sjson_put_string(ctx, root, "demo", demoName);
+    sjson_put_int(ctx, root, "tics", numTics);
+    sjson_put_int(ctx, root, "firstOutOfSync", firstOutOfSync);
+
+    {
+        sjson_node * timers = sjson_put_obj(ctx, root, "timers");
+
+        for (int i = 0; i < BENCHSIM_NUMTIMERS; i++)
+        {
+            double const totalMs = g_benchSimTicks[i] * msPerTick;
+
+            sjson_node * timer = sjson_put_obj(ctx, timers, benchSimTimerNames[i]);
+            sjson_put_double(ctx, timer, "totalMs", totalMs);
+            sjson_put_double(ctx, timer, "usPerTic", numTics ? totalMs * 1000.0 / numTics : 0.0);
+
+            if (i != BENCHSIM_TIC)
+                LOG_F(INFO, "benchsim: %-16s %10.03f ms", benchSimTimerNames[i], totalMs);
+        }
+    }
+
+#ifndef NETCODE_DISABLE
+    if (g_benchSimNet)
+    {
+        static char const *const modeNames[2] = { "plain", "rangeCoded" };
+
+        sjson_node * net = sjson_put_obj(ctx, root, "net");
+        int const numUpdates = g_netBenchStats.updates;
+
+        sjson_put_int(ctx, net, "updates", numUpdates);
+
+        for (int i = 0; i < 2; i++)
+        {
+            double const bytesPerTic = numUpdates ? (double)g_netBenchStats.bytes[i] / numUpdates : 0.0;
+            double const encodeUs = numUpdates ? g_netBenchStats.encodeTicks[i] * msPerTick * 1000.0 / numUpdates : 0.0;
+            double const decodeUs = numUpdates ? g_netBenchStats.decodeTicks[i] * msPerTick * 1000.0 / numUpdates : 0.0;
+
+            sjson_node * mode = sjson_put_obj(ctx, net, modeNames[i]);
+            sjson_put_double(ctx, mode, "bytesPerTic", bytesPerTic);
+            sjson_put_double(ctx, mode, "encodeUsPerTic", encodeUs);
+            sjson_put_double(ctx, mode, "decodeUsPerTic", decodeUs);
+            sjson_put_int(ctx, mode, "mismatches", g_netBenchStats.mismatches[i]);
+
+            LOG_F(INFO, "benchsim: net %-10s %10.01f bytes/tic, encode %8.02f us/tic, decode %8.02f us/tic, %d mismatches",
+                  modeNames[i], bytesPerTic, encodeUs, decodeUs, g_netBenchStats.mismatches[i]);
+        }
+    }
+#endif
+
+    {
+        sjson_node * ticUs = sjson_put_array(ctx, root, "ticUs");
+        sjson_node * hashes = sjson_put_array(ctx, root, "hashes");
+        char buf[24];
+
+        for (auto const &tic : benchSimTics)
+        {
+            sjson_append_element(ticUs, sjson_mknumber(ctx, tic.ticks * msPerTick * 1000.0));
+            Bsprintf(buf, "%016" PRIx64, tic.hash);
+            sjson_append_element(hashes, sjson_mkstring(ctx, buf));
+        }
+    }
+
+    char * encoded = sjson_stringify(ctx, root, "  ");
+
+    buildvfs_FILE fil = buildvfs_fopen_write(g_benchSimOutput);
+    if (!fil)
+    {
+        LOG_F(ERROR, "benchsim: could not open \"%s\" for writing", g_benchSimOutput);
+        sjson_free_string(ctx, encoded);
+        sjson_destroy_context(ctx);
+        return 1;
+    }
+
+    buildvfs_fwrite(encoded, strlen(encoded), 1, fil);
+    buildvfs_fclose(fil);
+
+    sjson_free_string(ctx, encoded);
+    sjson_destroy_context(ctx);
+
+    LOG_F(INFO, "benchsim: wrote \"%s\"", g_benchSimOutput);
+
+#ifndef NETCODE_DISABLE
+    // a world update that doesn't decode to what was sent fails the run
+    if (g_netBenchStats.mismatches[0] || g_netBenchStats.mismatches[1])
+        return 1;
+#endif
+
+    return 0;
+}
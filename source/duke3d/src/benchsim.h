@@ -0,0 +1,72 @@
+// Headless simulation benchmark
+//
+// "-benchsim <demo>" replays a demo with no video, sound or input and without
+// drawing a single frame: the game tics are stepped back to back as fast as
+// they run, which makes the timings usable for tracking performance on
+// machines that have no display.  The recorded diffs are skipped rather than
+// applied, so the game state evolves from the demo's initial snapshot and
+// its inputs alone.
+//
+// Every tic is timed as a whole and per MoveWorld subsystem (the same
+// sections the microprofile scopes in G_MoveWorld() cover), and a hash of the
+// simulation state is taken after it.  Both end up in a JSON report, so two
+// runs can be compared for speed as well as for the tic at which their states
+// first differ.
+//
+// "-benchnet <demo>" does the same and also turns every tic into a multiplayer
+// world update, which is encoded with and without the range coder, decoded
+// again and checked against the state it was made from (see
+// Net_BenchWorldUpdate()).  The report then has the bytes per tic and the
+// encode and decode times for both kinds of update.
+
+#pragma once
+
+#ifndef benchsim_h_
+#define benchsim_h_
+
+#include "compat.h"
+#include "timer.h"
+
+enum
+{
+    BENCHSIM_TIC,
+    BENCHSIM_MOVEWORLD,
+    BENCHSIM_MOVEZOMBIEACTORS,
+    BENCHSIM_MOVEWEAPONS,
+    BENCHSIM_MOVETRANSPORTS,
+    BENCHSIM_MOVEPLAYERS,
+    BENCHSIM_MOVEFALLERS,
+    BENCHSIM_MOVEMISC,
+    BENCHSIM_MOVEACTORS,
+    BENCHSIM_MOVEEFFECTORS,
+    BENCHSIM_MOVESTANDABLES,
+    BENCHSIM_MOVEFX,
+    BENCHSIM_NUMTIMERS
+};
+
+extern int32_t g_benchSim;
+extern int32_t g_benchSimNet;
+extern char g_benchSimOutput[BMAX_PATH];
+extern uint64_t g_benchSimTicks[BENCHSIM_NUMTIMERS];
+
+struct BenchSimScope
+{
+    int const timer;
+    uint64_t const startTicks;
+
+    explicit BenchSimScope(int const t) : timer(t), startTicks(g_benchSim ? timerGetPerformanceCounter() : 0) {}
+    ~BenchSimScope()
+    {
+        if (g_benchSim)
+            g_benchSimTicks[timer] += timerGetPerformanceCounter() - startTicks;
+    }
+};
+
+#define BENCHSIM_SCOPE(timer) BenchSimScope const benchSimScope_##timer(BENCHSIM_##timer)
+
+void G_BenchSimReset(void);
+// hashes the simulation state and records it together with the time the tic took
+void G_BenchSimEndTic(uint64_t ticTicks);
+int32_t G_BenchSimWriteReport(char const *demoName, int32_t firstOutOfSync);
+
+#endif
@@ -21,6 +21,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //-------------------------------------------------------------------------
 
 #include "duke3d.h"
+#include "benchaudio.h"
+#include "benchsim.h"
 #include "demo.h"
 #include "screens.h"
 #include "renderlayer.h"
@@ -98,15 +100,22 @@ void G_ShowDebugHelp(void)
 #if 0
         "-a\t\tUse fake player AI (fake multiplayer only)\n"
 #endif
+        "-benchaudio [script]\tRender a scripted set of sounds without a sound device, check the output and exit\n"
+        "-benchaudioout [file]\tWrite the -benchaudio output to this WAV file (default: benchaudio.wav)\n"
+        "-benchnet [demo]\tLike -benchsim, also encoding and decoding a multiplayer world update every tic\n"
+        "-benchsim [demo]\tPlay back a demo without video or sound as fast as possible and exit\n"
+        "-benchsimout [file]\tWrite the -benchsim timings and state hashes to this file (default: benchsim.json)\n"
         "-cachesize #\tSet cache size in kB\n"
         "-game_dir [dir]\tSpecify game data directory\n"
         "-gamegrp   \tSelect main grp file\n"
         "-name [name]\tPlayer name in multiplayer\n"
         "-noautoload\tDisable loading from autoload directory\n"
+        "-noconcache\tAlways compile the CON scripts instead of loading them from the cache\n"
 #if defined RENDERTYPEWIN
         "-nodinput\t\tDisable DirectInput (joystick) support\n"
 #endif
         "-nologo\t\tSkip intro anim\n"
+        "-nomapcache\tAlways parse the map files instead of loading them from the cache\n"
         "-ns\t\tDisable sound\n"
         "-nm\t\tDisable music\n"
         "-q#\t\tFake multiplayer with # players\n"
@@ -408,6 +417,62 @@ void G_CheckCommandLine(int32_t argc, char const * const * argv)
                     i++;
                     continue;
                 }
+                if (!Bstrcasecmp(c+1, "benchaudio"))
+                {
+                    if (argc > i+1)
+                    {
+                        Bstrncpyz(g_benchAudioScript, argv[i+1], sizeof(g_benchAudioScript));
+                        g_benchAudio = 1;
+                        g_noSetup = g_noLogo = TRUE;
+                        i++;
+                    }
+                    i++;
+                    continue;
+                }
+                if (!Bstrcasecmp(c+1, "benchaudioout"))
+                {
+                    if (argc > i+1)
+                    {
+                        Bstrncpyz(g_benchAudioOutput, argv[i+1], sizeof(g_benchAudioOutput));
+                        i++;
+                    }
+                    i++;
+                    continue;
+                }
+                if (!Bstrcasecmp(c+1, "benchsim"))
+                {
+                    if (argc > i+1)
+                    {
+                        Demo_SetFirst(argv[i+1]);
+                        g_benchSim = 1;
+                        g_noSetup = g_noLogo = TRUE;
+                        i++;
+                    }
+                    i++;
+                    continue;
+                }
+                if (!Bstrcasecmp(c+1, "benchnet"))
+                {
+                    if (argc > i+1)
+                    {
+                        Demo_SetFirst(argv[i+1]);
+                        g_benchSim = g_benchSimNet = 1;
+                        g_noSetup = g_noLogo = TRUE;
+                        i++;
+                    }
+                    i++;
+                    continue;
+                }
+                if (!Bstrcasecmp(c+1, "benchsimout"))
+                {
+                    if (argc > i+1)
+                    {
+                        Bstrncpyz(g_benchSimOutput, argv[i+1], sizeof(g_benchSimOutput));
+                        i++;
+                    }
+                    i++;
+                    continue;
+                }
                 if (!Bstrcasecmp(c+1, "map"))
                 {
                     if (argc > i+1)
@@ -514,6 +579,18 @@ void G_CheckCommandLine(int32_t argc, char const * const * argv)
                     i++;
                     continue;
                 }
+                if (!Bstrcasecmp(c+1, "noconcache"))
+                {
+                    g_scriptCache = 0;
+                    i++;
+                    continue;
+                }
+                if (!Bstrcasecmp(c+1, "nomapcache"))
+                {
+                    g_mapCache = 0;
+                    i++;
+                    continue;
+                }
                 if (!Bstrcasecmp(c+1, "nologo") || !Bstrcasecmp(c+1, "quick"))
                 {
                     g_noLogo = 1;
@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 //-------------------------------------------------------------------------
 
+#include "benchsim.h"
 #include "demo.h"
 #include "duke3d.h"
 #include "input.h"
@@ -42,7 +43,7 @@ int32_t g_demo_rewind=0;
 int32_t g_demo_showStats=1;
 static int32_t g_demo_soundToggle;
 
-static int32_t demo_hasdiffs, demorec_diffs=1, demorec_difftics = 2*REALGAMETICSPERSEC;
+static int32_t demo_hasdiffs, demo_skipdiffs, demorec_diffs=1, demorec_difftics = 2*REALGAMETICSPERSEC;
 int32_t demoplay_diffs=1;
 int32_t demorec_diffs_cvar=1;
 int32_t demorec_force_cvar=0;
@@ -107,7 +108,12 @@ static int32_t G_OpenDemoRead(int32_t g_whichDemo) // 0 = mine
         return 0;
     }
 
-    demo_hasdiffs = saveh.recdiffsp;
+    demo_hasdiffs = (saveh.recdiffsp == SV_DIFFS_SPANS);
+    demo_skipdiffs = (saveh.recdiffsp == SV_DIFFS_ELEMENTS);
+
+    if (demo_skipdiffs)
+        LOG_F(WARNING, "Demo #%d has diffs in an older format, playing it without them.", g_whichDemo);
+
     g_demo_totalCnt = saveh.reccnt;
     demo_synccompress = saveh.synccompress;
 
@@ -469,6 +475,91 @@ static void Demo_FinishProfile(void)
 }
 ////////////////////
 
+////////// HEADLESS SIMULATION BENCHMARK //////////
+int32_t Demo_BenchSim(void)
+{
+    int32_t bigi = 0, firstOutOfSync = -1;
+
+    ud.config.SoundToggle = 0;
+    ud.config.MusicToggle = 0;
+
+    if (!G_OpenDemoRead(1))
+    {
+        LOG_F(ERROR, "benchsim: could not open demo \"%s\".", g_firstDemoFile);
+        return 1;
+    }
+
+    ud.recstat = 2;
+    g_player[myconnectindex].ps->gm &= ~MODE_GAME;
+    g_player[myconnectindex].ps->gm |= MODE_DEMO;
+
+    G_BenchSimReset();
+
+    if (g_benchSimNet)
+        Net_BenchReset();
+
+    while (g_demo_cnt < g_demo_totalCnt)
+    {
+        if (ud.reccnt <= 0)
+        {
+            char tmpbuf[4];
+
+            bigi = 0;
+
+            if (ud.reccnt < 0 || kread(g_demo_recFilePtr, tmpbuf, 4) != 4)
+                break;
+
+            // the recorded diffs would mask any divergence, read past them
+            if ((demo_hasdiffs || demo_skipdiffs) && Bmemcmp(tmpbuf, "dIfF", 4) == 0)
+            {
+                int32_t const k = demo_hasdiffs ? sv_readdiff(g_demo_recFilePtr) : sv_skipdiff(g_demo_recFilePtr);
+
+                if (k || kread(g_demo_recFilePtr, tmpbuf, 4) != 4)
+                    break;
+            }
+
+            if (Bmemcmp(tmpbuf, "sYnC", 4) || Demo_ReadSync(3))
+                break;
+        }
+
+        if (demo_hasseeds && firstOutOfSync < 0 && (uint8_t)(randomseed>>24) != g_demo_seedbuf[bigi])
+            firstOutOfSync = g_demo_cnt;
+
+        for (int TRAVERSE_CONNECT(j))
+        {
+            Bmemcpy(&inputfifo[0][j], &recsync[bigi], sizeof(input_t));
+            bigi++;
+            ud.reccnt--;
+        }
+
+        g_demo_cnt++;
+
+        uint64_t const t = timerGetPerformanceCounter();
+        G_DoMoveThings();
+        G_BenchSimEndTic(timerGetPerformanceCounter() - t);
+
+        if (g_benchSimNet)
+            Net_BenchWorldUpdate();
+
+        totalclock = ototalclock += TICSPERFRAME;
+
+        if (g_player[myconnectindex].ps->gm & MODE_EOL)
+            break;
+    }
+
+    int32_t const numTics = g_demo_cnt - 1;
+
+    if (numTics < g_demo_totalCnt - 1 && !(g_player[myconnectindex].ps->gm & MODE_EOL))
+        LOG_F(WARNING, "benchsim: demo \"%s\" ended after %d of %d tics.", g_firstDemoFile, numTics, g_demo_totalCnt - 1);
+
+    kclose(g_demo_recFilePtr);
+    g_demo_recFilePtr = buildvfs_kfd_invalid;
+    ud.recstat = 0;
+
+    return G_BenchSimWriteReport(g_firstDemoFile, firstOutOfSync);
+}
+////////////////////
+
 int32_t G_PlaybackDemo(void)
 {
     int32_t bigi, j, initsyncofs = 0, lastsyncofs = 0, lastsynctic = 0, lastsyncclock = 0;
@@ -666,6 +757,19 @@ RECHECK:
                             CORRUPT(err);
                     }
 
+                    else if (demo_skipdiffs && Bmemcmp(tmpbuf, "dIfF", 4)==0)
+                    {
+                        if (sv_skipdiff(g_demo_recFilePtr))
+                            CORRUPT(6);
+                        if (kread(g_demo_recFilePtr, tmpbuf, 4) != 4)
+                            CORRUPT(7);
+                        if (Bmemcmp(tmpbuf, "sYnC", 4))
+                            CORRUPT(8);
+
+                        int32_t err = Demo_ReadSync(9);
+                        if (err)
+                            CORRUPT(err);
+                    }
                     else if (demo_hasdiffs && Bmemcmp(tmpbuf, "dIfF", 4)==0)
                     {
                         int32_t k = sv_readdiff(g_demo_recFilePtr);
@@ -59,6 +59,8 @@ void Demo_PlayFirst(int32_t prof, int32_t exitafter);
 void Demo_SetFirst(const char *demostr);
 
 int32_t Demo_IsProfiling(void);
+// plays back g_firstDemoFile headless for -benchsim, returns the process exit code
+int32_t Demo_BenchSim(void);
 
 #if KRANDDEBUG
 int32_t krd_print(const char *filename);
@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define game_c_
 
 #include "anim.h"
+#include "benchaudio.h"
+#include "benchsim.h"
 #include "cheats.h"
 #include "cmdline.h"
 #include "colmatch.h"
@@ -1373,6 +1375,7 @@ int32_t A_InsertSprite(int16_t whatsect,int32_t s_x,int32_t s_y,int32_t s_z,int1
 #endif
 
     sprite[newSprite] = { s_x, s_y, s_z, 0, s_pn, s_s, 0, 0, 0, s_xr, s_yr, 0, 0, whatsect, s_ss, s_a, s_ow, s_ve, 0, s_zv, 0, 0, 0 };
+    spriteMarkChanged(newSprite);
 
     auto &a = actor[newSprite];
     a = {};
@@ -6882,7 +6885,7 @@ int app_main(int argc, char const* const* argv)
     OSD_SetParameters(0, 0, 0, 12, 2, 12, OSD_ERROR, OSDTEXT_RED, OSDTEXT_DARKRED, gamefunctions[gamefunc_Show_Console][0] == '\0' ? OSD_PROTECTED : 0);
     registerosdcommands();
 
-    if (g_networkMode != NET_DEDICATED_SERVER)
+    if (g_networkMode != NET_DEDICATED_SERVER && !g_benchSim && !g_benchAudio)
     {
         if (CONTROL_Startup(controltype_keyboardandmouse, &BGetTime, TICRATE))
         {
@@ -6918,7 +6921,7 @@ int app_main(int argc, char const* const* argv)
 
     if (quitevent) app_exit(4);
 
-    if (g_networkMode != NET_DEDICATED_SERVER && validmodecnt > 0)
+    if (g_networkMode != NET_DEDICATED_SERVER && !g_benchSim && !g_benchAudio && validmodecnt > 0)
     {
         if (videoSetGameMode(ud.setup.fullscreen, ud.setup.xdim, ud.setup.ydim, ud.setup.bpp, ud.detail) < 0)
         {
@@ -6966,7 +6969,7 @@ int app_main(int argc, char const* const* argv)
 
     G_InitText();
 
-    if (g_networkMode != NET_DEDICATED_SERVER)
+    if (g_networkMode != NET_DEDICATED_SERVER && !g_benchSim && !g_benchAudio)
     {
         Menu_Init();
     }
@@ -6999,6 +7002,12 @@ int app_main(int argc, char const* const* argv)
 
     VM_OnEvent(EVENT_INITCOMPLETE);
 
+    if (g_benchSim)
+        app_exit(Demo_BenchSim());
+
+    if (g_benchAudio)
+        app_exit(G_BenchAudio());
+
 MAIN_LOOP_RESTART:
     totalclock = 0;
     ototalclock = 0;
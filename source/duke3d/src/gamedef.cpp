@@ -34,6 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "osd.h"
 #include "savegame.h"
 #include "vfs.h"
+#include "xxhash.h"
 
 #include "microprofile.h"
 
@@ -94,6 +95,30 @@ static intptr_t *g_caseTablePtr;
 static bool C_ParseCommand(bool loop = false);
 static void C_SetScriptSize(int32_t newsize);
 
+// definitions that act on state outside of the compiler, journaled for the compiled script cache
+enum
+{
+    CONCACHE_GAMEVAR,
+    CONCACHE_GAMEARRAY,
+    CONCACHE_SOUND,
+    CONCACHE_GAMESTARTUP,
+    CONCACHE_TILEMAPPING,
+    CONCACHE_SOUNDMAPPING,
+    CONCACHE_GAMEFUNCNAME,
+    CONCACHE_UNDEFINEGAMEFUNC,
+    CONCACHE_GAMENAME,
+    CONCACHE_DEFNAME,
+    CONCACHE_CFGNAME,
+};
+
+static void C_CacheAddSource(char const *fileName, char const *text, int32_t len);
+static void C_CacheRecord(int32_t op, char const *str, int32_t const *values, int32_t numValues);
+
+static inline void C_CacheRecord(int32_t op, char const *str, std::initializer_list<int32_t> values)
+{
+    C_CacheRecord(op, str, values.begin(), (int32_t)values.size());
+}
+
 int32_t g_errorCnt;
 int32_t g_warningCnt;
 int32_t g_numXStrings;
@@ -877,6 +902,32 @@ static const tokenmap_t keywords_for_private_opcodes[] =
 
     { "getplayer", CON_GETPLAYERSTRUCT },
     { "setplayer", CON_SETPLAYERSTRUCT },
+
+    { "setvar",    CON_SETVAR_GLOBAL },
+    { "setvar",    CON_SETVAR_PLAYER },
+    { "setvar",    CON_SETVAR_ACTOR },
+    { "setvar",    CON_SETVARS_GLOBAL },
+    { "setvar",    CON_SETVARS_PLAYER },
+    { "setvar",    CON_SETVARS_ACTOR },
+
+    { "ifvarand",  CON_IFVARAND_GLOBAL },
+    { "ifvarand",  CON_IFVARAND_ACTOR },
+    { "ifvare",    CON_IFVARE_GLOBAL },
+    { "ifvare",    CON_IFVARE_ACTOR },
+    { "ifvare",    CON_IFVARE_GLOBAL_STATE },
+    { "ifvare",    CON_IFVARE_ACTOR_STATE },
+    { "ifvarg",    CON_IFVARG_GLOBAL },
+    { "ifvarg",    CON_IFVARG_ACTOR },
+    { "ifvarg",    CON_IFVARG_GLOBAL_STATE },
+    { "ifvarg",    CON_IFVARG_ACTOR_STATE },
+    { "ifvarl",    CON_IFVARL_GLOBAL },
+    { "ifvarl",    CON_IFVARL_ACTOR },
+    { "ifvarl",    CON_IFVARL_GLOBAL_STATE },
+    { "ifvarl",    CON_IFVARL_ACTOR_STATE },
+    { "ifvarn",    CON_IFVARN_GLOBAL },
+    { "ifvarn",    CON_IFVARN_ACTOR },
+    { "ifvarn",    CON_IFVARN_GLOBAL_STATE },
+    { "ifvarn",    CON_IFVARN_ACTOR_STATE },
 };
 
 char const *VM_GetKeywordForID(int32_t id)
@@ -2039,6 +2090,7 @@ static void C_Include(const char *confile, int optional)
         if (EDUKE32_PREDICT_FALSE(optional))
         {
             VLOG_F(LOG_CON, "Optional include %s absent. skipping.", confile);
+            C_CacheAddSource(confile, nullptr, -1);
             return;
         }
 
@@ -2059,6 +2111,8 @@ static void C_Include(const char *confile, int optional)
 
     mptr[len] = 0;
 
+    C_CacheAddSource(confile, mptr, len);
+
     if (*textptr == '"') // skip past the closing quote if it's there so we don't screw up the next line
         textptr++;
 
@@ -2518,6 +2572,177 @@ static void C_FillEventBreakStackWithJump(intptr_t *breakPtr, intptr_t destinati
     }
 }
 
+// Superinstructions
+//
+// C_InitSuperInstructions() runs once the whole script is compiled and every jump target is known.
+// It resolves the storage class of the variable tested by the most common compare-and-branch
+// opcodes, fuses "if<cond> <var> <value> state <label>" into a single instruction and lets a run of
+// setvars execute without going back through the jump table for each one.  A rewrite only ever
+// replaces the instruction word and leaves the operands where they are, so C_SetSuperInstructions()
+// can switch between the fused and the original bytecode at any time.
+
+int32_t g_vm_superinstructions = 1;
+
+enum
+{
+    SUPERINST_SEQUENCE = 1,  // parsed as one statement of a block rather than as the body of an if, else or loop
+};
+
+typedef struct
+{
+    int32_t offset;
+    int32_t original;
+    int32_t fused;
+    int32_t flags;
+} superinst_t;
+
+static GrowArray<superinst_t, 1024> g_superInstSites;  // candidates recorded while parsing
+static GrowArray<superinst_t, 1024> g_superInsts;      // rewrites made by C_InitSuperInstructions()
+static bool g_parsingSequence;
+
+static const struct
+{
+    int32_t opcode, global, actor, globalState, actorState;
+} superinst_compares[] =
+{
+    { CON_IFVARAND, CON_IFVARAND_GLOBAL, CON_IFVARAND_ACTOR, -1,                      -1 },
+    { CON_IFVARE,   CON_IFVARE_GLOBAL,   CON_IFVARE_ACTOR,   CON_IFVARE_GLOBAL_STATE, CON_IFVARE_ACTOR_STATE },
+    { CON_IFVARG,   CON_IFVARG_GLOBAL,   CON_IFVARG_ACTOR,   CON_IFVARG_GLOBAL_STATE, CON_IFVARG_ACTOR_STATE },
+    { CON_IFVARL,   CON_IFVARL_GLOBAL,   CON_IFVARL_ACTOR,   CON_IFVARL_GLOBAL_STATE, CON_IFVARL_ACTOR_STATE },
+    { CON_IFVARN,   CON_IFVARN_GLOBAL,   CON_IFVARN_ACTOR,   CON_IFVARN_GLOBAL_STATE, CON_IFVARN_ACTOR_STATE },
+};
+
+static void C_AddSuperInstructionSite(intptr_t const * const ins)
+{
+    // the switch counting pass is thrown away and parsed again
+    if (g_switchCountPhase)
+        return;
+
+    auto const offset = (int32_t)(ins - apScript);
+
+    // the compiler only ever goes back to rewrite what it has just written, so anything past this point is stale
+    while (g_superInstSites.size() && g_superInstSites.last().offset >= offset)
+        g_superInstSites.removeLast();
+
+    g_superInstSites.append({ offset, (int32_t)*ins, 0, g_parsingSequence ? SUPERINST_SEQUENCE : 0 });
+}
+
+static FORCE_INLINE bool C_IsSetVarOpcode(int const opcode)
+{
+    return opcode == CON_SETVAR_GLOBAL || opcode == CON_SETVAR_ACTOR || opcode == CON_SETVAR_PLAYER;
+}
+
+// returns the opcode that replaces the instruction at apScript[ofs], or -1
+static int C_GetSuperInstruction(int const ofs, int const scriptLen, uint8_t const * const sites, uint8_t const * const sequence)
+{
+    auto const ins    = &apScript[ofs];
+    int const  opcode = VM_DECODE_INST(*ins);
+
+    if (C_IsSetVarOpcode(opcode))
+    {
+        // the body of an if or a loop has to stay a single statement
+        if (!bitmap_test(sequence, ofs) || ofs + 3 >= scriptLen || !bitmap_test(sites, ofs + 3) || !C_IsSetVarOpcode(VM_DECODE_INST(ins[3])))
+            return -1;
+
+        return opcode == CON_SETVAR_GLOBAL ? CON_SETVARS_GLOBAL : opcode == CON_SETVAR_ACTOR ? CON_SETVARS_ACTOR : CON_SETVARS_PLAYER;
+    }
+
+    for (auto const &compare : superinst_compares)
+    {
+        if (opcode != compare.opcode && opcode != compare.global && opcode != compare.actor)
+            continue;
+
+        intptr_t const varNum = ins[1];
+
+        if ((uintptr_t)varNum >= MAXGAMEVARS || varNum == g_thisActorVarID || ofs + 5 >= scriptLen || !bitmap_test(bitptr, ofs + 3))
+            return -1;
+
+        bool isActor;
+
+        switch (aGameVars[varNum].flags & (GAMEVAR_USER_MASK | GAMEVAR_PTR_MASK))
+        {
+            case 0: isActor = false; break;
+            case GAMEVAR_PERACTOR: isActor = true; break;
+            default: return -1;
+        }
+
+        // the statement following the jump slot is the body of the branch
+        if (compare.globalState != -1 && VM_DECODE_INST(ins[4]) == CON_STATE && bitmap_test(bitptr, ofs + 5))
+            return isActor ? compare.actorState : compare.globalState;
+
+        return isActor ? compare.actor : compare.global;
+    }
+
+    return -1;
+}
+
+static void C_InitSuperInstructions(void)
+{
+    g_superInsts.clear();
+
+    int const scriptLen = g_scriptPtr - apScript;
+    auto const sites    = (uint8_t *)Xcalloc(1, bitmap_size(scriptLen) + 1);
+    auto const sequence = (uint8_t *)Xcalloc(1, bitmap_size(scriptLen) + 1);
+
+    // anything the compiler backed up over and overwrote since it was recorded is dropped here
+    for (auto const &site : g_superInstSites)
+    {
+        if (site.offset < scriptLen && apScript[site.offset] == site.original)
+        {
+            bitmap_set(sites, site.offset);
+
+            if (site.flags & SUPERINST_SEQUENCE)
+                bitmap_set(sequence, site.offset);
+        }
+    }
+
+    g_superInstSites.clear();
+
+    int numSetVars = 0, numStates = 0;
+
+    for (int ofs = 0; ofs < scriptLen; ofs++)
+    {
+        if (!bitmap_test(sites, ofs))
+            continue;
+
+        int const opcode = C_GetSuperInstruction(ofs, scriptLen, sites, sequence);
+        auto const word  = (int32_t)apScript[ofs];
+
+        if (opcode == -1 || opcode == VM_DECODE_INST(word))
+            continue;
+
+        g_superInsts.append({ ofs, word, (int32_t)((word & ~VM_INSTMASK) | opcode), 0 });
+
+        if (opcode == CON_SETVARS_GLOBAL || opcode == CON_SETVARS_ACTOR || opcode == CON_SETVARS_PLAYER)
+        {
+            // the rest of the run is executed by the head, but stays intact for jumps into the middle of it
+            while (ofs + 3 < scriptLen && bitmap_test(sites, ofs + 3) && C_IsSetVarOpcode(VM_DECODE_INST(apScript[ofs + 3])))
+                ofs += 3;
+
+            numSetVars++;
+        }
+        else
+        {
+            for (auto const &compare : superinst_compares)
+                numStates += (opcode == compare.globalState) | (opcode == compare.actorState);
+        }
+    }
+
+    Xfree(sites);
+    Xfree(sequence);
+
+    g_superInsts.vacuum();
+
+    VLOG_F(LOG_CON, "Found %d superinstructions: %d setvar runs, %d branches to states, %d resolved compares", (int)g_superInsts.size(),
+           numSetVars, numStates, (int)g_superInsts.size() - numSetVars - numStates);
+}
+
+void C_SetSuperInstructions(bool const enable)
+{
+    for (auto const &inst : g_superInsts)
+        apScript[inst.offset] = enable ? inst.fused : inst.original;
+}
+
 static void scriptUpdateOpcodeForVariableType(intptr_t *ins)
 {
     int opcode = -1;
@@ -2548,6 +2773,8 @@ static void scriptUpdateOpcodeForVariableType(intptr_t *ins)
 
         scriptWriteAtOffset(opcode | LINE_NUMBER, ins);
     }
+
+    C_AddSuperInstructionSite(ins);
 }
 
 static bool C_ParseCommand(bool loop /*= false*/)
@@ -2556,6 +2783,8 @@ static bool C_ParseCommand(bool loop /*= false*/)
 
     do
     {
+        g_parsingSequence = loop;
+
         if (EDUKE32_PREDICT_FALSE(g_errorCnt > 63 || (*textptr == '\0') || (*(textptr+1) == '\0')))
             return 1;
 
@@ -2824,6 +3053,7 @@ DO_DEFSTATE:
             }
 
             Gv_NewVar(LAST_LABEL, defaultValue, varFlags);
+            C_CacheRecord(CONCACHE_GAMEVAR, LAST_LABEL, { defaultValue, varFlags });
             continue;
         }
 
@@ -2868,6 +3098,7 @@ DO_DEFSTATE:
             g_scriptPtr--;
 
             Gv_NewArray(arrayName, NULL, g_scriptPtr[-1], arrayFlags);
+            C_CacheRecord(CONCACHE_GAMEARRAY, arrayName, { (int32_t)g_scriptPtr[-1], arrayFlags });
 
             g_scriptPtr -= 2; // no need to save in script...
             continue;
@@ -2910,7 +3141,10 @@ DO_DEFSTATE:
                     hash_add(&h_labels,LAST_LABEL,g_labelCnt,0);
 
                     if ((unsigned)g_scriptPtr[-1] < MAXTILES && g_dynamicTileMapping)
+                    {
                         G_ProcessDynamicNameMapping(LAST_LABEL, g_dynTileList, g_scriptPtr[-1]);
+                        C_CacheRecord(CONCACHE_TILEMAPPING, LAST_LABEL, { (int32_t)g_scriptPtr[-1] });
+                    }
 
                     labeltype[g_labelCnt] = LABEL_DEFINE;
                     labelcode[g_labelCnt++] = g_scriptPtr[-1];
@@ -5551,6 +5785,7 @@ repeatcase:
             }
             gamefunctions[j][i] = '\0';
             hash_add(&h_gamefuncs,gamefunctions[j],j,0);
+            C_CacheRecord(CONCACHE_GAMEFUNCNAME, gamefunctions[j], { j });
 
             continue;
 
@@ -5572,6 +5807,7 @@ repeatcase:
             hash_delete(&h_gamefuncs, gamefunctions[j]);
 
             gamefunctions[j][0] = '\0';
+            C_CacheRecord(CONCACHE_UNDEFINEGAMEFUNC, "", { j });
 
             continue;
 
@@ -5657,6 +5893,7 @@ repeatcase:
                 gamename[i] = '\0';
                 g_gameNamePtr = Xstrdup(gamename);
                 G_UpdateAppTitle();
+                C_CacheRecord(CONCACHE_GAMENAME, gamename, {});
             }
             continue;
 
@@ -5673,6 +5910,7 @@ repeatcase:
                 }
                 tempbuf[j] = '\0';
 
+                C_CacheRecord(CONCACHE_DEFNAME, tempbuf, {});
                 C_SetDefName(tempbuf);
             }
             continue;
@@ -5690,6 +5928,7 @@ repeatcase:
                 }
                 tempbuf[j] = '\0';
 
+                C_CacheRecord(CONCACHE_CFGNAME, tempbuf, {});
                 C_SetCfgName(tempbuf);
             }
             continue;
@@ -6109,8 +6348,15 @@ repeatcase:
             if (k > g_highestSoundIdx)
                 g_highestSoundIdx = k;
 
+            int32_t volumeBits;
+            Bmemcpy(&volumeBits, &volume, sizeof(volumeBits));
+            C_CacheRecord(CONCACHE_SOUND, filename, { k, minpitch, maxpitch, priority, type, distance, volumeBits });
+
             if (g_dynamicSoundMapping && j >= 0 && (labeltype[j] & LABEL_DEFINE))
+            {
                 G_ProcessDynamicNameMapping(label + (j << 6), g_dynSoundList, k);
+                C_CacheRecord(CONCACHE_SOUNDMAPPING, label + (j << 6), { k });
+            }
             continue;
         }
 
@@ -6301,7 +6547,7 @@ repeatcase:
 
         case CON_GAMESTARTUP:
             {
-                int32_t params[31];
+                int32_t params[31] = {};
 
                 g_scriptPtr--;
                 for (j = 0; j < 31; j++)
@@ -6363,6 +6609,11 @@ repeatcase:
                 */
 
                 G_DoGameStartup(params);
+
+                // replayed with the script version it was parsed with, which decides how many of the parameters are used
+                int32_t values[ARRAY_SIZE(params) + 1] = { g_scriptVersion };
+                Bmemcpy(&values[1], params, sizeof(params));
+                C_CacheRecord(CONCACHE_GAMESTARTUP, "", values, ARRAY_SIZE(values));
             }
             continue;
         }
@@ -6664,11 +6915,12 @@ static int C_GetLabelIndex(int32_t val, int type)
     return -1;
 }
 
-void C_Compile(const char *fileName)
+static void C_InitScriptState(void)
 {
+    g_superInstSites.clear();
+    g_superInsts.clear();
+
     Bmemset(apScriptEvents, 0, sizeof(apScriptEvents));
-    apScriptGameEventEnd = (intptr_t *)Xcalloc(MAXEVENTS, sizeof(intptr_t));
-    apScriptStateEnd = (intptr_t *)Xcalloc(MAXLABELS, sizeof(intptr_t));
 
     for (auto & i : g_tile)
         Bmemset(&i, 0, sizeof(tiledata_t));
@@ -6678,6 +6930,802 @@ void C_Compile(const char *fileName)
 
     Gv_Init();
     C_InitProjectiles();
+}
+
+// Compiled script cache
+//
+// Parsing the scripts of a large mod takes a good part of the startup time, so the result of a
+// successful compile is written to "<main CON file>.cache" and loaded in its place on the next start.
+// The image holds the bytecode with every pointer turned into an offset, the labels, events, actor
+// entry points, tile flags and projectiles, the superinstruction rewrites and the tables filled in by
+// the definition commands.  Gamevars, gamearrays, sounds and the other definitions that act on state
+// outside of the compiler are journaled while parsing and replayed through the same functions.
+//
+// An image is only used if it was written by a build with the same bytecode version for the same main
+// file, modules and game, and every file the compile read still has the same contents.  Optional
+// includes that were absent have to still be absent.  Anything else falls back to a full compile,
+// which replaces the image.
+
+int32_t g_scriptCache = 1;
+
+#define CONCACHE_VERSION 1
+
+static char const s_conCacheMagic[8] = { 'E', 'D', 'U', 'K', 'E', 'C', 'O', 'N' };
+
+typedef struct
+{
+    char     magic[8];
+    uint64_t key;
+    uint64_t payloadHash;
+    int32_t  payloadSize;
+    int32_t  reserved;
+} concacheheader_t;
+
+typedef struct
+{
+    char *  data;
+    int32_t size, capacity;
+} concachebuf_t;
+
+typedef struct
+{
+    char const *data;
+    int32_t     pos, size;
+    bool        failed;
+} concachereader_t;
+
+static concachebuf_t g_cacheSources;
+static concachebuf_t g_cacheJournal;
+static int32_t       g_cacheNumSources;
+static int32_t       g_cacheNumRecords;
+static uint64_t      g_cacheKey;
+static struct vmofs *g_cacheFirstOffset;  // file offsets older than this one were added by an earlier compile
+
+static void C_CacheWrite(concachebuf_t *buf, void const *src, int32_t len)
+{
+    if (len <= 0)
+        return;
+
+    if (buf->size + len > buf->capacity)
+    {
+        buf->capacity = max(buf->capacity << 1, buf->size + len);
+        buf->data     = (char *)Xrealloc(buf->data, buf->capacity);
+    }
+
+    Bmemcpy(buf->data + buf->size, src, len);
+    buf->size += len;
+}
+
+static inline void C_CacheWriteInt(concachebuf_t *buf, int32_t const value) { C_CacheWrite(buf, &value, sizeof(value)); }
+
+static void C_CacheWriteBlock(concachebuf_t *buf, void const *src, int32_t len)
+{
+    C_CacheWriteInt(buf, len);
+    C_CacheWrite(buf, src, len);
+}
+
+// strings are stored with their terminator, a length of -1 is a null pointer
+static void C_CacheWriteString(concachebuf_t *buf, char const *str)
+{
+    int32_t const len = str ? Bstrlen(str) : -1;
+
+    C_CacheWriteInt(buf, len);
+    C_CacheWrite(buf, str, len + 1);
+}
+
+static void C_CacheFree(concachebuf_t *buf)
+{
+    DO_FREE_AND_NULL(buf->data);
+    buf->size = buf->capacity = 0;
+}
+
+static bool C_CacheRead(concachereader_t *r, void *dst, int32_t len)
+{
+    if (r->failed || len < 0 || len > r->size - r->pos)
+    {
+        r->failed = true;
+        return false;
+    }
+
+    Bmemcpy(dst, r->data + r->pos, len);
+    r->pos += len;
+    return true;
+}
+
+static int32_t C_CacheReadInt(concachereader_t *r)
+{
+    int32_t value = 0;
+    C_CacheRead(r, &value, sizeof(value));
+    return value;
+}
+
+static void C_CacheReadBlock(concachereader_t *r, void *dst, int32_t len)
+{
+    if (C_CacheReadInt(r) != len)
+        r->failed = true;
+
+    C_CacheRead(r, dst, len);
+}
+
+// the returned string points into the image
+static char const *C_CacheReadString(concachereader_t *r)
+{
+    int32_t const len = C_CacheReadInt(r);
+
+    if (len == -1 && !r->failed)
+        return nullptr;
+
+    if (r->failed || len < 0 || len >= r->size - r->pos || r->data[r->pos + len] != '\0')
+    {
+        r->failed = true;
+        return "";
+    }
+
+    char const *str = r->data + r->pos;
+    r->pos += len + 1;
+    return str;
+}
+
+static void C_CacheReadDupString(concachereader_t *r, char **dst)
+{
+    char const *str = C_CacheReadString(r);
+
+    Xfree(*dst);
+    *dst = str ? Xstrdup(str) : nullptr;
+}
+
+static void C_CacheAddSource(char const *fileName, char const *text, int32_t len)
+{
+    C_CacheWriteString(&g_cacheSources, fileName);
+    C_CacheWriteInt(&g_cacheSources, len);
+
+    if (len >= 0)
+    {
+        uint64_t const hash = XXH3_64bits(text, len);
+        C_CacheWrite(&g_cacheSources, &hash, sizeof(hash));
+    }
+
+    g_cacheNumSources++;
+}
+
+static void C_CacheRecord(int32_t op, char const *str, int32_t const *values, int32_t numValues)
+{
+    C_CacheWriteInt(&g_cacheJournal, op);
+    C_CacheWriteString(&g_cacheJournal, str);
+    C_CacheWriteInt(&g_cacheJournal, numValues);
+    C_CacheWrite(&g_cacheJournal, values, numValues * sizeof(int32_t));
+
+    g_cacheNumRecords++;
+}
+
+static bool C_CacheReplayRecord(int32_t op, char const *str, int32_t const *values, int32_t numValues)
+{
+    switch (op)
+    {
+        case CONCACHE_GAMEVAR:
+            if (numValues != 2)
+                return false;
+            Gv_NewVar(str, values[0], values[1]);
+            return true;
+
+        case CONCACHE_GAMEARRAY:
+            if (numValues != 2)
+                return false;
+            Gv_NewArray(str, NULL, values[0], values[1]);
+            return true;
+
+        case CONCACHE_SOUND:
+        {
+            int const soundNum = values[0];
+
+            if (numValues != 7 || (unsigned)soundNum >= MAXSOUNDS - 1)
+                return false;
+
+            float volume;
+            Bmemcpy(&volume, &values[6], sizeof(volume));
+
+            S_AllocIndexes(soundNum);
+
+            if (g_sounds[soundNum] == &nullsound)
+                g_sounds[soundNum] = (sound_t *)Xcalloc(1, sizeof(sound_t));
+
+            S_DefineSound(soundNum, str, values[1], values[2], values[3], values[4], values[5], volume);
+
+            if (soundNum > g_highestSoundIdx)
+                g_highestSoundIdx = soundNum;
+            return true;
+        }
+
+        case CONCACHE_GAMESTARTUP:
+        {
+            if (numValues != 32)
+                return false;
+
+            int32_t const scriptVersion = g_scriptVersion;
+            g_scriptVersion = values[0];
+            G_DoGameStartup(&values[1]);
+            g_scriptVersion = scriptVersion;
+            return true;
+        }
+
+        case CONCACHE_TILEMAPPING:
+        case CONCACHE_SOUNDMAPPING:
+            if (numValues != 1)
+                return false;
+            G_ProcessDynamicNameMapping(str, op == CONCACHE_TILEMAPPING ? g_dynTileList : g_dynSoundList, values[0]);
+            return true;
+
+        case CONCACHE_GAMEFUNCNAME:
+        case CONCACHE_UNDEFINEGAMEFUNC:
+            if (numValues != 1 || (unsigned)values[0] >= NUMGAMEFUNCTIONS)
+                return false;
+
+            hash_delete(&h_gamefuncs, gamefunctions[values[0]]);
+
+            if (op == CONCACHE_UNDEFINEGAMEFUNC)
+            {
+                gamefunctions[values[0]][0] = '\0';
+                return true;
+            }
+
+            Bstrncpyz(gamefunctions[values[0]], str, MAXGAMEFUNCLEN);
+            hash_add(&h_gamefuncs, gamefunctions[values[0]], values[0], 0);
+            return true;
+
+        case CONCACHE_GAMENAME:
+            g_gameNamePtr = Xstrdup(str);
+            G_UpdateAppTitle();
+            return true;
+
+        case CONCACHE_DEFNAME:
+            C_SetDefName(str);
+            return true;
+
+        case CONCACHE_CFGNAME:
+            C_SetCfgName(str);
+            return true;
+    }
+
+    return false;
+}
+
+// everything that decides how the same files compile, other than their contents
+static uint64_t C_ScriptCacheKey(char const *fileName)
+{
+    concachebuf_t buf = {};
+
+    C_CacheWriteInt(&buf, CONCACHE_VERSION);
+    C_CacheWriteInt(&buf, BYTEVERSION_EDUKE32);
+    C_CacheWriteInt(&buf, sizeof(intptr_t));
+    C_CacheWriteInt(&buf, g_scriptVersion);
+    C_CacheWriteInt(&buf, g_gameType);
+    C_CacheWriteInt(&buf, VOLUMEONE);
+    C_CacheWriteString(&buf, fileName);
+
+    for (char const *m : g_scriptModules)
+        C_CacheWriteString(&buf, m);
+
+    uint64_t const key = XXH3_64bits(buf.data, buf.size);
+    C_CacheFree(&buf);
+
+    return key;
+}
+
+static void C_GetScriptCacheName(char *buf, size_t const size, char const *fileName)
+{
+    char const *name = Bstrrchr(fileName, '/');
+
+    if (!name)
+        name = Bstrrchr(fileName, '\\');
+
+    Bsnprintf(buf, size, "%s.cache", name ? name + 1 : fileName);
+}
+
+// oldest first, so that loading can add them back with C_AddFileOffset() in order
+static void C_CacheWriteFileOffsets(concachebuf_t *buf, struct vmofs const *ofs)
+{
+    if (ofs == g_cacheFirstOffset)
+        return;
+
+    C_CacheWriteFileOffsets(buf, ofs->next);
+    C_CacheWriteInt(buf, ofs->offset);
+    C_CacheWriteString(buf, ofs->fn);
+}
+
+static void C_WriteScriptCache(char const *fileName)
+{
+    concachebuf_t buf = {};
+
+    C_CacheWriteInt(&buf, g_cacheNumSources);
+    C_CacheWrite(&buf, g_cacheSources.data, g_cacheSources.size);
+
+    C_CacheWriteInt(&buf, g_scriptVersion);
+    C_CacheWriteInt(&buf, g_warningCnt);
+    C_CacheWriteInt(&buf, g_totalLines);
+    C_CacheWriteInt(&buf, g_dynamicTileMapping);
+    C_CacheWriteInt(&buf, g_dynamicSoundMapping);
+
+    int32_t const scriptLen = g_scriptPtr - apScript;
+
+    C_CacheWriteInt(&buf, g_scriptSize);
+    C_CacheWriteInt(&buf, scriptLen);
+
+    C_SetSuperInstructions(false);
+
+    for (int i = 0; i < g_scriptSize; i++)
+    {
+        intptr_t const word = bitmap_test(bitptr, i) ? apScript[i] - (intptr_t)apScript : apScript[i];
+        C_CacheWrite(&buf, &word, sizeof(word));
+    }
+
+    C_SetSuperInstructions(g_vm_superinstructions);
+
+    C_CacheWrite(&buf, bitptr, bitmap_size(g_scriptSize) + 1);
+
+    C_CacheWriteInt(&buf, (int32_t)g_superInsts.size());
+    C_CacheWrite(&buf, g_superInsts.begin(), g_superInsts.size() * sizeof(superinst_t));
+
+    int32_t numOffsets = 0;
+
+    for (auto ofs = vmoffset; ofs != g_cacheFirstOffset; ofs = ofs->next)
+        numOffsets++;
+
+    C_CacheWriteInt(&buf, numOffsets);
+    C_CacheWriteFileOffsets(&buf, vmoffset);
+
+    C_CacheWriteInt(&buf, g_labelCnt);
+
+    for (int i = 0; i < g_labelCnt; i++)
+    {
+        C_CacheWriteString(&buf, label + (i << 6));
+        C_CacheWriteInt(&buf, labelcode[i]);
+        C_CacheWriteInt(&buf, labeltype[i]);
+    }
+
+    for (auto event : apScriptEvents)
+        C_CacheWriteInt(&buf, (int32_t)event);
+
+    int32_t numTiles = 0;
+
+    for (auto const &tile : g_tile)
+        numTiles += (tile.execPtr || tile.loadPtr || tile.proj || tile.flags || tile.cacherange);
+
+    C_CacheWriteInt(&buf, numTiles);
+
+    for (int i = 0; i < MAXTILES; i++)
+    {
+        auto const &tile = g_tile[i];
+
+        if (!tile.execPtr && !tile.loadPtr && !tile.proj && !tile.flags && !tile.cacherange)
+            continue;
+
+        C_CacheWriteInt(&buf, i);
+        C_CacheWriteInt(&buf, tile.execPtr ? (int32_t)(tile.execPtr - apScript) : 0);
+        C_CacheWriteInt(&buf, tile.loadPtr ? (int32_t)(tile.loadPtr - apScript) : 0);
+        C_CacheWriteInt(&buf, tile.flags);
+        C_CacheWriteInt(&buf, tile.cacherange);
+        C_CacheWriteInt(&buf, tile.proj != nullptr);
+
+        if (tile.proj)
+        {
+            C_CacheWrite(&buf, tile.proj, sizeof(projectile_t));
+            C_CacheWrite(&buf, tile.defproj, sizeof(projectile_t));
+        }
+    }
+
+    C_CacheWriteInt(&buf, g_cacheNumRecords);
+    C_CacheWrite(&buf, g_cacheJournal.data, g_cacheJournal.size);
+
+    for (auto const &map : g_mapInfo)
+    {
+        C_CacheWriteInt(&buf, map.partime);
+        C_CacheWriteInt(&buf, map.designertime);
+        C_CacheWriteString(&buf, map.name);
+        C_CacheWriteString(&buf, map.filename);
+        C_CacheWriteString(&buf, map.musicfn);
+    }
+
+    C_CacheWriteBlock(&buf, g_volumeNames, sizeof(g_volumeNames));
+    C_CacheWriteBlock(&buf, g_volumeFlags, sizeof(g_volumeFlags));
+    C_CacheWriteInt(&buf, g_volumeCnt);
+    C_CacheWriteBlock(&buf, g_skillNames, sizeof(g_skillNames));
+    C_CacheWriteInt(&buf, g_maxDefinedSkill);
+    C_CacheWriteBlock(&buf, g_gametypeNames, sizeof(g_gametypeNames));
+    C_CacheWriteBlock(&buf, g_gametypeFlags, sizeof(g_gametypeFlags));
+    C_CacheWriteInt(&buf, g_gametypeCnt);
+    C_CacheWriteBlock(&buf, CheatStrings, sizeof(CheatStrings));
+    C_CacheWriteBlock(&buf, CheatDescriptions, sizeof(CheatDescriptions));
+    C_CacheWriteBlock(&buf, CheatKeys, sizeof(CheatKeys));
+
+    int32_t numQuotes = 0;
+
+    for (auto quote : apStrings)
+        numQuotes += (quote != nullptr);
+
+    C_CacheWriteInt(&buf, numQuotes);
+
+    for (int i = 0; i < MAXQUOTES; i++)
+    {
+        if (apStrings[i])
+        {
+            C_CacheWriteInt(&buf, i);
+            C_CacheWriteString(&buf, apStrings[i]);
+        }
+    }
+
+    C_CacheWriteInt(&buf, g_numXStrings);
+
+    for (int i = 0; i < g_numXStrings; i++)
+        C_CacheWriteString(&buf, apXStrings[i]);
+
+    concacheheader_t header = {};
+
+    Bmemcpy(header.magic, s_conCacheMagic, sizeof(header.magic));
+    header.key         = g_cacheKey;
+    header.payloadHash = XXH3_64bits(buf.data, buf.size);
+    header.payloadSize = buf.size;
+
+    char cacheName[BMAX_PATH];
+    C_GetScriptCacheName(cacheName, sizeof(cacheName), fileName);
+
+    buildvfs_FILE fp = buildvfs_fopen_write(cacheName);
+
+    if (fp)
+    {
+        buildvfs_fwrite(&header, sizeof(header), 1, fp);
+        buildvfs_fwrite(buf.data, buf.size, 1, fp);
+        buildvfs_fclose(fp);
+
+        VLOG_F(LOG_CON, "Wrote compiled scripts to %s", cacheName);
+    }
+    else
+        VLOG_F(LOG_CON, "Unable to write compiled scripts to %s", cacheName);
+
+    C_CacheFree(&buf);
+}
+
+static bool C_ScriptCacheSourcesMatch(concachereader_t *r)
+{
+    int32_t const numSources = C_CacheReadInt(r);
+
+    for (int i = 0; i < numSources && !r->failed; i++)
+    {
+        char const *  fileName = C_CacheReadString(r);
+        int32_t const len      = C_CacheReadInt(r);
+        uint64_t      hash     = 0;
+
+        if (len >= 0)
+            C_CacheRead(r, &hash, sizeof(hash));
+
+        if (r->failed)
+            break;
+
+        buildvfs_kfd const kFile = kopen4loadfrommod(fileName, g_loadFromGroupOnly);
+
+        if (kFile == buildvfs_kfd_invalid)
+        {
+            if (len < 0)
+                continue;
+
+            VLOG_F(LOG_CON, "Compiled scripts are out of date: %s is gone.", fileName);
+            return false;
+        }
+
+        bool match = (kfilelength(kFile) == len);
+
+        if (match)
+        {
+            auto text = (char *)Xmalloc(len + 1);
+            match = (kread(kFile, text, len) == len && XXH3_64bits(text, len) == hash);
+            Xfree(text);
+        }
+
+        kclose(kFile);
+
+        if (!match)
+        {
+            VLOG_F(LOG_CON, "Compiled scripts are out of date: %s has changed.", fileName);
+            return false;
+        }
+    }
+
+    return !r->failed;
+}
+
+static bool C_ApplyScriptCache(concachereader_t *r)
+{
+    int32_t const scriptVersion        = C_CacheReadInt(r);
+    int32_t const numWarnings          = C_CacheReadInt(r);
+    int32_t const totalLines           = C_CacheReadInt(r);
+    int32_t const dynamicTileMapping   = C_CacheReadInt(r);
+    int32_t const dynamicSoundMapping  = C_CacheReadInt(r);
+    int32_t const scriptSize           = C_CacheReadInt(r);
+    int32_t const scriptLen            = C_CacheReadInt(r);
+
+    if (r->failed || scriptLen <= 0 || scriptLen > scriptSize || scriptSize > (r->size - r->pos) / (int32_t)sizeof(intptr_t))
+        return false;
+
+    Xfree(apScript);
+    Xfree(bitptr);
+
+    apScript = (intptr_t *)Xmalloc(scriptSize * sizeof(intptr_t));
+    bitptr   = (uint8_t *)Xcalloc(1, (bitmap_size(scriptSize) + 1) * sizeof(uint8_t));
+
+    C_CacheRead(r, apScript, scriptSize * sizeof(intptr_t));
+    C_CacheRead(r, bitptr, bitmap_size(scriptSize) + 1);
+
+    for (int i = 0; i < scriptSize; i++)
+    {
+        if (bitmap_test(bitptr, i))
+        {
+            if ((uintptr_t)apScript[i] > (uintptr_t)scriptLen)
+                return false;
+
+            apScript[i] += (intptr_t)apScript;
+        }
+    }
+
+    g_scriptSize = scriptSize;
+    g_scriptPtr  = apScript + scriptLen;
+
+    int32_t const numSuperInsts = C_CacheReadInt(r);
+
+    for (int i = 0; i < numSuperInsts && !r->failed; i++)
+    {
+        superinst_t inst;
+
+        if (!C_CacheRead(r, &inst, sizeof(inst)) || (unsigned)inst.offset >= (unsigned)scriptLen)
+            return false;
+
+        g_superInsts.append(inst);
+    }
+
+    int32_t const numOffsets = C_CacheReadInt(r);
+
+    for (int i = 0; i < numOffsets && !r->failed; i++)
+    {
+        int32_t const offset   = C_CacheReadInt(r);
+        char const *  fileName = C_CacheReadString(r);
+
+        if (!fileName || (unsigned)offset > (unsigned)scriptLen)
+            return false;
+
+        if (!r->failed)
+            C_AddFileOffset(offset, fileName);
+    }
+
+    int32_t const numLabels = C_CacheReadInt(r);
+
+    if (r->failed || (unsigned)numLabels >= MAXLABELS)
+        return false;
+
+    for (int i = 0; i < numLabels; i++)
+    {
+        char const *name = C_CacheReadString(r);
+
+        if (r->failed || !name || Bstrlen(name) >= 64)
+            return false;
+
+        Bstrcpy(label + (i << 6), name);
+        labelcode[i] = C_CacheReadInt(r);
+        labeltype[i] = C_CacheReadInt(r);
+        hash_add(&h_labels, label + (i << 6), i, 0);
+    }
+
+    g_labelCnt = numLabels;
+
+    for (auto &event : apScriptEvents)
+    {
+        event = C_CacheReadInt(r);
+
+        if ((uintptr_t)event >= (uintptr_t)scriptLen)
+            return false;
+    }
+
+    int32_t const numTiles = C_CacheReadInt(r);
+
+    for (int i = 0; i < numTiles && !r->failed; i++)
+    {
+        int32_t const tileNum = C_CacheReadInt(r);
+        int32_t const execOfs = C_CacheReadInt(r);
+        int32_t const loadOfs = C_CacheReadInt(r);
+
+        if ((unsigned)tileNum >= MAXTILES || (unsigned)execOfs >= (unsigned)scriptLen || (unsigned)loadOfs >= (unsigned)scriptLen)
+            return false;
+
+        auto &tile = g_tile[tileNum];
+
+        tile.execPtr    = execOfs ? apScript + execOfs : nullptr;
+        tile.loadPtr    = loadOfs ? apScript + loadOfs : nullptr;
+        tile.flags      = C_CacheReadInt(r);
+        tile.cacherange = C_CacheReadInt(r);
+
+        if (C_CacheReadInt(r))
+        {
+            C_AllocProjectile(tileNum);
+            C_CacheRead(r, tile.proj, sizeof(projectile_t));
+            C_CacheRead(r, tile.defproj, sizeof(projectile_t));
+        }
+    }
+
+    int32_t const numRecords = C_CacheReadInt(r);
+
+    for (int i = 0; i < numRecords && !r->failed; i++)
+    {
+        int32_t const op        = C_CacheReadInt(r);
+        char const *  str       = C_CacheReadString(r);
+        int32_t const numValues = C_CacheReadInt(r);
+        int32_t       values[32];
+
+        if (!str || (unsigned)numValues > ARRAY_SIZE(values) || !C_CacheRead(r, values, numValues * sizeof(int32_t))
+            || !C_CacheReplayRecord(op, str, values, numValues))
+            return false;
+    }
+
+    for (auto &map : g_mapInfo)
+    {
+        map.partime      = C_CacheReadInt(r);
+        map.designertime = C_CacheReadInt(r);
+        C_CacheReadDupString(r, &map.name);
+        C_CacheReadDupString(r, &map.filename);
+        C_CacheReadDupString(r, &map.musicfn);
+    }
+
+    C_CacheReadBlock(r, g_volumeNames, sizeof(g_volumeNames));
+    C_CacheReadBlock(r, g_volumeFlags, sizeof(g_volumeFlags));
+    g_volumeCnt = C_CacheReadInt(r);
+    C_CacheReadBlock(r, g_skillNames, sizeof(g_skillNames));
+    g_maxDefinedSkill = C_CacheReadInt(r);
+    C_CacheReadBlock(r, g_gametypeNames, sizeof(g_gametypeNames));
+    C_CacheReadBlock(r, g_gametypeFlags, sizeof(g_gametypeFlags));
+    g_gametypeCnt = C_CacheReadInt(r);
+    C_CacheReadBlock(r, CheatStrings, sizeof(CheatStrings));
+    C_CacheReadBlock(r, CheatDescriptions, sizeof(CheatDescriptions));
+    C_CacheReadBlock(r, CheatKeys, sizeof(CheatKeys));
+
+    int32_t const numQuotes = C_CacheReadInt(r);
+
+    for (int i = 0; i < numQuotes && !r->failed; i++)
+    {
+        int32_t const quoteNum = C_CacheReadInt(r);
+        char const *  quote    = C_CacheReadString(r);
+
+        if ((unsigned)quoteNum >= MAXQUOTES || !quote)
+            return false;
+
+        C_AllocQuote(quoteNum);
+        Bstrncpyz(apStrings[quoteNum], quote, MAXQUOTELEN);
+    }
+
+    int32_t const numXStrings = C_CacheReadInt(r);
+
+    if ((unsigned)numXStrings > MAXQUOTES)
+        return false;
+
+    for (int i = 0; i < numXStrings && !r->failed; i++)
+    {
+        char const *str = C_CacheReadString(r);
+
+        if (!str)
+            continue;
+
+        if (apXStrings[i] == NULL)
+            apXStrings[i] = (char *)Xcalloc(MAXQUOTELEN, sizeof(uint8_t));
+
+        Bstrncpyz(apXStrings[i], str, MAXQUOTELEN);
+    }
+
+    if (r->failed || r->pos != r->size)
+        return false;
+
+    g_numXStrings         = numXStrings;
+    g_scriptVersion       = scriptVersion;
+    g_totalLines          = totalLines;
+    g_warningCnt          = numWarnings;
+    g_errorCnt            = 0;
+    g_dynamicTileMapping  = dynamicTileMapping;
+    g_dynamicSoundMapping = dynamicSoundMapping;
+
+    C_SetSuperInstructions(g_vm_superinstructions);
+
+    return true;
+}
+
+static bool C_LoadScriptCache(char const *fileName)
+{
+    char cacheName[BMAX_PATH];
+    C_GetScriptCacheName(cacheName, sizeof(cacheName), fileName);
+
+    buildvfs_FILE fp = buildvfs_fopen_read(cacheName);
+
+    if (!fp)
+        return false;
+
+    uint32_t const startTime = timerGetTicks();
+    int64_t const  fileLen   = buildvfs_flength(fp);
+
+    concacheheader_t header;
+
+    if (fileLen < (int64_t)sizeof(header) || (size_t)buildvfs_fread(&header, 1, sizeof(header), fp) != sizeof(header)
+        || Bmemcmp(header.magic, s_conCacheMagic, sizeof(header.magic)) || header.key != g_cacheKey
+        || header.payloadSize != fileLen - (int64_t)sizeof(header))
+    {
+        buildvfs_fclose(fp);
+        VLOG_F(LOG_CON, "Compiled scripts in %s do not match this build or %s.", cacheName, fileName);
+        return false;
+    }
+
+    auto const data = (char *)Xmalloc(header.payloadSize);
+    bool const read = ((size_t)buildvfs_fread(data, 1, header.payloadSize, fp) == (size_t)header.payloadSize);
+
+    buildvfs_fclose(fp);
+
+    concachereader_t r = { data, 0, header.payloadSize, false };
+
+    if (!read || XXH3_64bits(data, header.payloadSize) != header.payloadHash)
+    {
+        Xfree(data);
+        LOG_F(WARNING, "Compiled scripts in %s are damaged.", cacheName);
+        return false;
+    }
+
+    if (!C_ScriptCacheSourcesMatch(&r))
+    {
+        Xfree(data);
+        return false;
+    }
+
+    bool const applied = C_ApplyScriptCache(&r);
+
+    Xfree(data);
+
+    if (!applied)
+    {
+        // only reachable if the image doesn't agree with the code that wrote it, as it has been checked in full above
+        LOG_F(ERROR, "Unable to load compiled scripts from %s.", cacheName);
+
+        DO_FREE_AND_NULL(apScript);
+        DO_FREE_AND_NULL(bitptr);
+        g_labelCnt = 0;
+
+        Gv_Clear();
+        C_InitScriptState();
+
+        return false;
+    }
+
+    Bstrcpy(g_scriptFileName, fileName);
+
+    VLOG_F(LOG_CON, "Loaded %d bytes of compiled scripts from %s in %ums%s", (int)((intptr_t)g_scriptPtr - (intptr_t)apScript),
+           cacheName, timerGetTicks() - startTime, C_ScriptVersionString(g_scriptVersion));
+
+    if (g_warningCnt)
+        VLOG_F(LOG_CON, "%s was compiled with %d warning(s).", fileName, g_warningCnt);
+
+    return true;
+}
+
+static void C_FinishCompile(void);
+
+void C_Compile(const char *fileName)
+{
+    C_InitScriptState();
+
+    C_CacheFree(&g_cacheSources);
+    C_CacheFree(&g_cacheJournal);
+    g_cacheNumSources  = 0;
+    g_cacheNumRecords  = 0;
+    g_cacheKey         = C_ScriptCacheKey(fileName);
+    g_cacheFirstOffset = vmoffset;
+
+    if (g_scriptCache && !g_scriptDebug && !g_loadFromGroupOnly && C_LoadScriptCache(fileName))
+    {
+        C_FinishCompile();
+        return;
+    }
+
+    apScriptGameEventEnd = (intptr_t *)Xcalloc(MAXEVENTS, sizeof(intptr_t));
+    apScriptStateEnd = (intptr_t *)Xcalloc(MAXLABELS, sizeof(intptr_t));
 
     buildvfs_kfd kFile = kopen4loadfrommod(fileName, g_loadFromGroupOnly);
 
@@ -6719,6 +7767,8 @@ void C_Compile(const char *fileName)
     kread(kFile, (char *)textptr, kFileLen);
     kclose(kFile);
 
+    C_CacheAddSource(fileName, mptr, kFileLen);
+
     Xfree(apScript);
 
     apScript = (intptr_t *)Xcalloc(1, g_scriptSize * sizeof(intptr_t));
@@ -6845,6 +7895,9 @@ err:
 
     C_SetScriptSize(g_scriptPtr-apScript+8);
 
+    C_InitSuperInstructions();
+    C_SetSuperInstructions(g_vm_superinstructions);
+
     VLOG_F(LOG_CON, "Compiled %d bytes in %ums%s", (int)((intptr_t)g_scriptPtr - (intptr_t)apScript),
                timerGetTicks() - startcompiletime, C_ScriptVersionString(g_scriptVersion));
 
@@ -6852,6 +7905,18 @@ err:
     DO_FREE_AND_NULL(apScriptStateEnd);
     DO_FREE_AND_NULL(bitstate);
 
+    if (g_scriptCache && !g_loadFromGroupOnly)
+        C_WriteScriptCache(fileName);
+
+    C_CacheFree(&g_cacheSources);
+    C_CacheFree(&g_cacheJournal);
+
+    C_FinishCompile();
+}
+
+// what's left to do once the script is in place, whether compiled or loaded from the cache
+static void C_FinishCompile(void)
+{
     for (auto i : tables_free)
         hash_free(i);
 
@@ -170,6 +170,10 @@ extern intptr_t *g_scriptPtr;
 typedef projectile_t defaultprojectile_t;
 
 extern defaultprojectile_t DefaultProjectile;
+extern int32_t g_vm_superinstructions;
+extern int32_t g_scriptCache;
+void C_SetSuperInstructions(bool enable);
+
 int32_t C_AllocQuote(int32_t qnum);
 void C_AllocProjectile(int32_t j);
 void C_FreeProjectile(int32_t j);
@@ -856,21 +860,40 @@ enum IterationTypes_t
     TRANSFORM(CON_SETVAR_GLOBAL) DELIMITER \
     TRANSFORM(CON_SETVAR_PLAYER) DELIMITER \
     TRANSFORM(CON_SETVAR_ACTOR) DELIMITER \
+    \
+    TRANSFORM(CON_IFVARAND_GLOBAL) DELIMITER \
+    TRANSFORM(CON_IFVARE_GLOBAL) DELIMITER \
+    TRANSFORM(CON_IFVARG_GLOBAL) DELIMITER \
+    TRANSFORM(CON_IFVARL_GLOBAL) DELIMITER \
+    TRANSFORM(CON_IFVARN_GLOBAL) DELIMITER \
+    TRANSFORM(CON_IFVARAND_ACTOR) DELIMITER \
+    TRANSFORM(CON_IFVARE_ACTOR) DELIMITER \
+    TRANSFORM(CON_IFVARG_ACTOR) DELIMITER \
+    TRANSFORM(CON_IFVARL_ACTOR) DELIMITER \
+    TRANSFORM(CON_IFVARN_ACTOR) DELIMITER \
+    \
+    /* superinstructions, only ever written by C_InitSuperInstructions() */ \
+    TRANSFORM(CON_SETVARS_GLOBAL) DELIMITER \
+    TRANSFORM(CON_SETVARS_PLAYER) DELIMITER \
+    TRANSFORM(CON_SETVARS_ACTOR) DELIMITER \
+    TRANSFORM(CON_IFVARE_GLOBAL_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARG_GLOBAL_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARL_GLOBAL_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARN_GLOBAL_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARE_ACTOR_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARG_ACTOR_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARL_ACTOR_STATE) DELIMITER \
+    TRANSFORM(CON_IFVARN_ACTOR_STATE) DELIMITER \
 /*  CON_DISCRETE_VAR_ACCESS \
 
     TRANSFORM(CON_IFVARA_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARAE_GLOBAL) DELIMITER \
-    TRANSFORM(CON_IFVARAND_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARB_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARBE_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARBOTH_GLOBAL) DELIMITER \
-    TRANSFORM(CON_IFVARE_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVAREITHER_GLOBAL) DELIMITER \
-    TRANSFORM(CON_IFVARG_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARGE_GLOBAL) DELIMITER \
-    TRANSFORM(CON_IFVARL_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARLE_GLOBAL) DELIMITER \
-    TRANSFORM(CON_IFVARN_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVAROR_GLOBAL) DELIMITER \
     TRANSFORM(CON_IFVARXOR_GLOBAL) DELIMITER \
     \
@@ -922,17 +945,12 @@ enum IterationTypes_t
     \
     TRANSFORM(CON_IFVARA_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARAE_ACTOR) DELIMITER \
-    TRANSFORM(CON_IFVARAND_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARB_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARBE_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARBOTH_ACTOR) DELIMITER \
-    TRANSFORM(CON_IFVARE_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVAREITHER_ACTOR) DELIMITER \
-    TRANSFORM(CON_IFVARG_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARGE_ACTOR) DELIMITER \
-    TRANSFORM(CON_IFVARL_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARLE_ACTOR) DELIMITER \
-    TRANSFORM(CON_IFVARN_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVAROR_ACTOR) DELIMITER \
     TRANSFORM(CON_IFVARXOR_ACTOR) DELIMITER \
     \
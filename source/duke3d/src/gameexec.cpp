@@ -33,7 +33,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "osdcmds.h"
 #include "savegame.h"
 #include "scriplib.h"
+#include "sectorbvh.h"
+#include "spritegrid.h"
 #include "vfs.h"
+#include "vmprofile.h"
 
 #if KRANDDEBUG
 # define GAMEEXEC_INLINE
@@ -74,6 +77,21 @@ int32_t g_structVarIDs   = -1;
 
 GAMEEXEC_STATIC void VM_Execute(int loop = false);
 
+// runs the state insptr points to
+static FORCE_INLINE void VM_ExecuteState(void)
+{
+    if (EDUKE32_PREDICT_FALSE(g_vm_profile))
+    {
+        VM_ProfileEnter(VMPROF_STATE, insptr - apScript);
+        VM_Execute(true);
+        VM_ProfileLeave();
+    }
+    else
+        VM_Execute(true);
+
+    vm.flags &= ~VM_TERMINATE;
+}
+
 void VM_ScriptInfo(intptr_t const * const ptr, int const range)
 {
     if (!ptr || (g_currentEvent == -1 && insptr == nullptr))
@@ -186,9 +204,17 @@ static FORCE_INLINE int32_t VM_EventInlineInternal__(int const eventNum, int con
     if ((unsigned)playerNum >= (unsigned)g_mostConcurrentPlayers)
         vm.pPlayer = g_player[0].ps;
 
+    bool const profile = g_vm_profile;
+
+    if (EDUKE32_PREDICT_FALSE(profile))
+        VM_ProfileEnter(VMPROF_EVENT, eventNum);
+
     VM_Execute(true);
     vm.flags &= ~VM_TERMINATE;
 
+    if (EDUKE32_PREDICT_FALSE(profile))
+        VM_ProfileLeave();
+
     if (vm.flags & VM_KILL)
         VM_DeleteSprite(vm.spriteNum, vm.playerNum);
 
@@ -1131,6 +1157,7 @@ static void VM_Fall(int const spriteNum, spritetype * const pSprite)
             int16_t newsect = pSprite->sectnum;
 
             pushmove(&pSprite->xyz, &newsect, 128, 4<<8, 4<<8, CLIPMASK0);
+            spriteMarkChanged(spriteNum);
             if ((unsigned)newsect < MAXSECTORS)
                 changespritesect(spriteNum, newsect);
 
@@ -1157,6 +1184,64 @@ static void VM_Fall(int const spriteNum, spritetype * const pSprite)
     pSprite->zvel = 0;
 }
 
+// whether the status list walk from MAXSTATUS-1 down to 0 reaches spriteNum before otherSprite
+static int VM_SpriteWalkedBefore(int const spriteNum, int const otherSprite)
+{
+    if (sprite[spriteNum].statnum != sprite[otherSprite].statnum)
+        return sprite[spriteNum].statnum > sprite[otherSprite].statnum;
+
+    for (bssize_t SPRITES_OF(sprite[spriteNum].statnum, i))
+    {
+        if (i == spriteNum)
+            return true;
+        else if (i == otherSprite)
+            return false;
+    }
+
+    return false;
+}
+
+// Nearest sprite of findTile closer than maxDist, ties going to the sprite the status list walk
+// reaches first, exactly as the findnearsprite commands have always done it.  Instead of walking
+// every list the candidates come from the sprite grid: both distance approximations are at least
+// 15/16 of the larger axis distance, so an eighth more than maxDist bounds the square to search.
+// G_MoveWorld() refreshes the grid once per tic.  The engine keeps it current for sprites moved
+// with setsprite() and friends, but a sprite whose x/y game code wrote directly since then is
+// looked up by the position it had at the start of the tic.
+static int VM_FindNearSprite(int const findTile, int maxDist, int const checkZ, int const maxZDist,
+                             int32_t (*const distFunc)(void const *, void const *))
+{
+    static int16_t candidates[MAXSPRITES];
+
+    if (maxDist <= 0)
+        return -1;
+
+    int const searchRadius = (int)min<int64_t>((int64_t)maxDist + (maxDist >> 3) + 1, INT32_MAX);
+    int const numCandidates = min(spritegridQuery(vm.pSprite->xy, searchRadius, candidates, MAXSPRITES), MAXSPRITES);
+    int foundSprite = -1;
+
+    for (int i = 0; i < numCandidates; i++)
+    {
+        int const spriteNum = candidates[i];
+
+        if (sprite[spriteNum].picnum != findTile || spriteNum == vm.spriteNum)
+            continue;
+
+        if (checkZ && klabs(vm.pSprite->z - sprite[spriteNum].z) >= maxZDist)
+            continue;
+
+        int const foundDist = distFunc(vm.pSprite, &sprite[spriteNum]);
+
+        if (foundDist < maxDist || (foundDist == maxDist && foundSprite >= 0 && VM_SpriteWalkedBefore(spriteNum, foundSprite)))
+        {
+            maxDist     = foundDist;
+            foundSprite = spriteNum;
+        }
+    }
+
+    return foundSprite;
+}
+
 static int32_t VM_ResetPlayer(int const playerNum, int32_t vmFlags, int32_t const resetFlags)
 {
     //AddLog("resetplayer");
@@ -1420,7 +1505,7 @@ static void ResizeArray(int const arrayNum, int const newSize)
 # define vInstruction(KEYWORDID) VINST_ ## KEYWORDID
 # define vmErrorCase VINST_CON_OPCODE_END
 # define eval(INSTRUCTION) { goto *jumpTable[INSTRUCTION]; }
-# define dispatch_unconditionally(...) { eval((VM_DECODE_INST((g_tw = tw = *insptr)))) }
+# define dispatch_unconditionally(...) { g_vmInstructionCount++; eval((VM_DECODE_INST((g_tw = tw = *insptr)))) }
 # define dispatch(...) { if (!vm_execution_depth | ((vm.flags & (VM_RETURN|VM_TERMINATE|VM_KILL)) != 0)) return; dispatch_unconditionally(__VA_ARGS__); }
 # define abort_after_error(...) return
 # define vInstructionPointer(KEYWORDID) &&VINST_ ## KEYWORDID
@@ -1463,6 +1548,39 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
         }
     };
 
+    // "if<cond> <var> <value> state <label>" with the state called directly instead of from a nested VM_Execute()
+    auto branchstate = [&](int const x)
+    {
+        if (x)
+        {
+            auto tempscrptr = &insptr[6];
+            insptr = (intptr_t *)insptr[5];
+            VM_ExecuteState();
+            insptr = tempscrptr;
+        }
+        else
+        {
+            insptr += 2;
+            branch(false);
+        }
+    };
+
+    // runs the setvars directly following a CON_SETVARS_* head without going back through the jump table
+    auto setvarchain = [&]()
+    {
+        do
+        {
+            switch (VM_DECODE_INST(*insptr))
+            {
+                case CON_SETVAR_GLOBAL: aGameVars[insptr[1]].global = insptr[2]; break;
+                case CON_SETVAR_ACTOR:  aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)] = insptr[2]; break;
+                case CON_SETVAR_PLAYER: aGameVars[insptr[1]].pValues[vm.playerNum & (MAXPLAYERS-1)] = insptr[2]; break;
+                default: return;
+            }
+            insptr += 3;
+        } while (1);
+    };
+
     auto bad_quote = [](int const q)
     {
         return ((unsigned)q >= MAXQUOTES) | (apStrings[q & (MAXQUOTES-1)] == nullptr);
@@ -1476,6 +1594,7 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
 #endif
         int32_t tw = *insptr;
         g_tw = tw;
+        g_vmInstructionCount++;
 
         int const decoded = VM_DECODE_INST(tw);
 #if 0 && defined CON_USE_COMPUTED_GOTO
@@ -1506,8 +1625,7 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
             {
                 auto tempscrptr = &insptr[2];
                 insptr = (intptr_t *)insptr[1];
-                VM_Execute(true);
-                vm.flags &= ~VM_TERMINATE;
+                VM_ExecuteState();
                 insptr = tempscrptr;
             }
             dispatch();
@@ -1528,22 +1646,107 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
                 insptr += 2;
                 dispatch();
 
-#ifdef CON_DISCRETE_VAR_ACCESS
+            vInstruction(CON_IFVARAND_GLOBAL):
+                insptr++;
+                tw = aGameVars[*insptr++].global;
+                branch(tw & *insptr);
+                dispatch();
             vInstruction(CON_IFVARE_GLOBAL):
                 insptr++;
                 tw = aGameVars[*insptr++].global;
                 branch(tw == *insptr);
                 dispatch();
+            vInstruction(CON_IFVARG_GLOBAL):
+                insptr++;
+                tw = aGameVars[*insptr++].global;
+                branch(tw > *insptr);
+                dispatch();
+            vInstruction(CON_IFVARL_GLOBAL):
+                insptr++;
+                tw = aGameVars[*insptr++].global;
+                branch(tw < *insptr);
+                dispatch();
             vInstruction(CON_IFVARN_GLOBAL):
                 insptr++;
                 tw = aGameVars[*insptr++].global;
                 branch(tw != *insptr);
                 dispatch();
-            vInstruction(CON_IFVARAND_GLOBAL):
+            vInstruction(CON_IFVARAND_ACTOR):
                 insptr++;
-                tw = aGameVars[*insptr++].global;
+                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
                 branch(tw & *insptr);
                 dispatch();
+            vInstruction(CON_IFVARE_ACTOR):
+                insptr++;
+                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branch(tw == *insptr);
+                dispatch();
+            vInstruction(CON_IFVARG_ACTOR):
+                insptr++;
+                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branch(tw > *insptr);
+                dispatch();
+            vInstruction(CON_IFVARL_ACTOR):
+                insptr++;
+                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branch(tw < *insptr);
+                dispatch();
+            vInstruction(CON_IFVARN_ACTOR):
+                insptr++;
+                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branch(tw != *insptr);
+                dispatch();
+            // superinstructions, see C_InitSuperInstructions()
+            vInstruction(CON_SETVARS_GLOBAL):
+                aGameVars[insptr[1]].global = insptr[2];
+                insptr += 3;
+                setvarchain();
+                dispatch();
+            vInstruction(CON_SETVARS_ACTOR):
+                aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)] = insptr[2];
+                insptr += 3;
+                setvarchain();
+                dispatch();
+            vInstruction(CON_SETVARS_PLAYER):
+                aGameVars[insptr[1]].pValues[vm.playerNum & (MAXPLAYERS-1)] = insptr[2];
+                insptr += 3;
+                setvarchain();
+                dispatch();
+
+            vInstruction(CON_IFVARE_GLOBAL_STATE):
+                tw = aGameVars[insptr[1]].global;
+                branchstate(tw == insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARG_GLOBAL_STATE):
+                tw = aGameVars[insptr[1]].global;
+                branchstate(tw > insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARL_GLOBAL_STATE):
+                tw = aGameVars[insptr[1]].global;
+                branchstate(tw < insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARN_GLOBAL_STATE):
+                tw = aGameVars[insptr[1]].global;
+                branchstate(tw != insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARE_ACTOR_STATE):
+                tw = aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branchstate(tw == insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARG_ACTOR_STATE):
+                tw = aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branchstate(tw > insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARL_ACTOR_STATE):
+                tw = aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branchstate(tw < insptr[2]);
+                dispatch();
+            vInstruction(CON_IFVARN_ACTOR_STATE):
+                tw = aGameVars[insptr[1]].pValues[vm.spriteNum & (MAXSPRITES-1)];
+                branchstate(tw != insptr[2]);
+                dispatch();
+
+#ifdef CON_DISCRETE_VAR_ACCESS
             vInstruction(CON_IFVAROR_GLOBAL):
                 insptr++;
                 tw = aGameVars[*insptr++].global;
@@ -1564,21 +1767,11 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
                 tw = aGameVars[*insptr++].global;
                 branch(tw && *insptr);
                 dispatch();
-            vInstruction(CON_IFVARG_GLOBAL):
-                insptr++;
-                tw = aGameVars[*insptr++].global;
-                branch(tw > *insptr);
-                dispatch();
             vInstruction(CON_IFVARGE_GLOBAL):
                 insptr++;
                 tw = aGameVars[*insptr++].global;
                 branch(tw >= *insptr);
                 dispatch();
-            vInstruction(CON_IFVARL_GLOBAL):
-                insptr++;
-                tw = aGameVars[*insptr++].global;
-                branch(tw < *insptr);
-                dispatch();
             vInstruction(CON_IFVARLE_GLOBAL):
                 insptr++;
                 tw = aGameVars[*insptr++].global;
@@ -1646,21 +1839,6 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
                 insptr += 2;
                 dispatch();
 
-            vInstruction(CON_IFVARE_ACTOR):
-                insptr++;
-                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
-                branch(tw == *insptr);
-                dispatch();
-            vInstruction(CON_IFVARN_ACTOR):
-                insptr++;
-                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
-                branch(tw != *insptr);
-                dispatch();
-            vInstruction(CON_IFVARAND_ACTOR):
-                insptr++;
-                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
-                branch(tw & *insptr);
-                dispatch();
             vInstruction(CON_IFVAROR_ACTOR):
                 insptr++;
                 tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
@@ -1681,21 +1859,11 @@ GAMEEXEC_STATIC void VM_Execute(int vm_execution_depth /*= false*/)
                 tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
                 branch(tw && *insptr);
                 dispatch();
-            vInstruction(CON_IFVARG_ACTOR):
-                insptr++;
-                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
-                branch(tw > *insptr);
-                dispatch();
             vInstruction(CON_IFVARGE_ACTOR):
                 insptr++;
                 tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
                 branch(tw >= *insptr);
                 dispatch();
-            vInstruction(CON_IFVARL_ACTOR):
-                insptr++;
-                tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
-                branch(tw < *insptr);
-                dispatch();
             vInstruction(CON_IFVARLE_ACTOR):
                 insptr++;
                 tw = aGameVars[*insptr++].pValues[vm.spriteNum & (MAXSPRITES-1)];
@@ -5899,33 +6067,27 @@ breakfor:
                     int       maxDist   = Gv_GetVar(*insptr++);
                     int const returnVar = *insptr++;
 
-                    int findStatnum = actorsOnly ? STAT_ACTOR : MAXSTATUS - 1;
+                    if (!actorsOnly)
+                    {
+                        Gv_SetVar(returnVar, VM_FindNearSprite(findTile, maxDist, false, 0, dist_funcptr));
+                        dispatch();
+                    }
+
                     int foundSprite = -1;
 
-                    do
+                    for (bssize_t SPRITES_OF(STAT_ACTOR, spriteNum))
                     {
-                        int spriteNum = headspritestat[findStatnum];  // all sprites
-
-                        while ((unsigned)spriteNum < MAXSPRITES)
+                        if (sprite[spriteNum].picnum == findTile && spriteNum != vm.spriteNum)
                         {
-                            if (sprite[spriteNum].picnum == findTile && spriteNum != vm.spriteNum)
-                            {
-                                int const foundDist = dist_funcptr(vm.pSprite, &sprite[spriteNum]);
+                            int const foundDist = dist_funcptr(vm.pSprite, &sprite[spriteNum]);
 
-                                if (foundDist < maxDist)
-                                {
-                                    maxDist     = foundDist;
-                                    foundSprite = spriteNum;
-                                }
+                            if (foundDist < maxDist)
+                            {
+                                maxDist     = foundDist;
+                                foundSprite = spriteNum;
                             }
-
-                            spriteNum = nextspritestat[spriteNum];
                         }
-
-                        if (actorsOnly)
-                            break;
                     }
-                    while (findStatnum--);
 
                     Gv_SetVar(returnVar, foundSprite);
                     dispatch();
@@ -5947,33 +6109,27 @@ breakfor:
                     int const maxZDist  = Gv_GetVar(*insptr++);
                     int const returnVar = *insptr++;
 
-                    int findStatnum = actorsOnly ? STAT_ACTOR : MAXSTATUS - 1;
+                    if (!actorsOnly)
+                    {
+                        Gv_SetVar(returnVar, VM_FindNearSprite(findTile, maxDist, true, maxZDist, &ldist));
+                        dispatch();
+                    }
+
                     int foundSprite = -1;
 
-                    do
+                    for (bssize_t SPRITES_OF(STAT_ACTOR, spriteNum))
                     {
-                        int spriteNum = headspritestat[findStatnum];  // all sprites
-
-                        while ((unsigned)spriteNum < MAXSPRITES)
+                        if (sprite[spriteNum].picnum == findTile && spriteNum != vm.spriteNum)
                         {
-                            if (sprite[spriteNum].picnum == findTile && spriteNum != vm.spriteNum)
-                            {
-                                int const foundDist = ldist(vm.pSprite, &sprite[spriteNum]);
+                            int const foundDist = ldist(vm.pSprite, &sprite[spriteNum]);
 
-                                if (foundDist < maxDist && klabs(vm.pSprite->z - sprite[spriteNum].z) < maxZDist)
-                                {
-                                    maxDist     = foundDist;
-                                    foundSprite = spriteNum;
-                                }
+                            if (foundDist < maxDist && klabs(vm.pSprite->z - sprite[spriteNum].z) < maxZDist)
+                            {
+                                maxDist     = foundDist;
+                                foundSprite = spriteNum;
                             }
-
-                            spriteNum = nextspritestat[spriteNum];
                         }
-
-                        if (actorsOnly)
-                            break;
                     }
-                    while (findStatnum--);
 
                     Gv_SetVar(returnVar, foundSprite);
                     dispatch();
@@ -7011,11 +7167,19 @@ void A_Execute(int const spriteNum, int const playerNum, int const playerDist)
 
     VM_UpdateAnim(vm.spriteNum, vm.pData);
 
+    bool const profile = g_vm_profile;
+
+    if (EDUKE32_PREDICT_FALSE(profile))
+        VM_ProfileEnter(VMPROF_ACTOR, picnum);
+
     insptr = 4 + (g_tile[vm.pSprite->picnum].execPtr);
     VM_Execute(true);
     vm.flags &= ~VM_TERMINATE;
     insptr = NULL;
 
+    if (EDUKE32_PREDICT_FALSE(profile))
+        VM_ProfileLeave();
+
     if ((vm.flags & VM_KILL) == 0)
     {
         VM_Move();
@@ -7219,6 +7383,13 @@ void G_RestoreMapState(void)
         Bmemcpy(&sprite[0],&pSavedState->sprite[0],sizeof(spritetype)*MAXSPRITES);
         Bmemcpy(&spriteext[0],&pSavedState->spriteext[0],sizeof(spriteext_t)*MAXSPRITES);
 
+        for (native_t i=0; i<MAXWALLS; i++)
+            wallMarkChanged(i);
+        for (native_t i=0; i<MAXSECTORS; i++)
+            sectorMarkChanged(i);
+        for (native_t i=0; i<MAXSPRITES; i++)
+            spriteMarkChanged(i);
+
         // If we're restoring from EVENT_ANIMATESPRITES, all spriteext[].tspr
         // will be overwritten, so NULL them.
         if (EDUKE32_PREDICT_FALSE(g_currentEvent == EVENT_ANIMATESPRITES))
@@ -7359,6 +7530,7 @@ void G_RestoreMapState(void)
         sv_postyaxload();
 #endif
         calc_sector_reachability();
+        sectorbvhBuild();
         G_ResetInterpolations();
 
         Net_ResetPrediction();
@@ -27,6 +27,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "sector.h"
 #include "gameexec.h"
 #include "global.h"
+#include "sectorbvh.h"
 
 #define LABEL(struct, memb, name, idx)                                                              \
     {                                                                                                               \
@@ -151,9 +152,9 @@ void __fastcall VM_SetSector(int const sectNum, int const labelNum, int32_t newV
 
 memberlabel_t const WallLabels[]=
 {
-    MEMBER(wall, x,          WALL_X),
-    MEMBER(wall, y,          WALL_Y),
-    MEMBER(wall, point2,     WALL_POINT2),
+    { "x",      WALL_X,      sizeof(wall[0].x) | LABEL_WRITEFUNC,      0, offsetof(uwalltype, x) },
+    { "y",      WALL_Y,      sizeof(wall[0].y) | LABEL_WRITEFUNC,      0, offsetof(uwalltype, y) },
+    { "point2", WALL_POINT2, sizeof(wall[0].point2) | LABEL_WRITEFUNC, 0, offsetof(uwalltype, point2) },
     MEMBER(wall, nextwall,   WALL_NEXTWALL),
     MEMBER(wall, nextsector, WALL_NEXTSECTOR),
     MEMBER(wall, cstat,      WALL_CSTAT),
@@ -197,8 +198,23 @@ int32_t __fastcall VM_GetWall(int const wallNum, int32_t labelNum)
 
 void __fastcall VM_SetWall(int const wallNum, int const labelNum, int32_t const newValue)
 {
+    auto &w = wall[wallNum];
+
     switch (labelNum)
     {
+        case WALL_X:
+            w.x = newValue;
+            sectorbvhInvalidateWall(wallNum);
+            break;
+        case WALL_Y:
+            w.y = newValue;
+            sectorbvhInvalidateWall(wallNum);
+            break;
+        case WALL_POINT2:
+            w.point2 = newValue;
+            sectorbvhInvalidateWall(wallNum);
+            break;
+
         case WALL_BLEND:
 #ifdef NEW_MAP_FORMAT
             w.blend = newValue;
@@ -41,6 +41,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "vfs.h"
 
+#include "libasync_config.h"
+
 // Data needed even if netcode is disabled
 ENetHost    *g_netServer     = NULL;
 ENetHost    *g_netClient     = NULL;
@@ -443,10 +445,129 @@ static netmapstate_t *g_mapStartState;
 
 static netmapstate_t *g_cl_InterpolatedMapStateHistory[NET_REVISIONS];
 
+// Map state history
+//
+// Rather than a full netmapstate_t per revision, the history keeps the actor, wall and sector arrays of each
+// revision as tables of pages holding NET_MAPPAGE_RECORDS records each. Pages are reference counted and shared
+// between revisions until a record in them changes, at which point the revision that changed it gets a copy of
+// its own, so a revision only costs the pages that differ from the one it was stored against. Comparing page
+// pointers also lets the delta encoder skip any stretch of records two revisions share without looking at it.
+
+#define NET_MAPPAGE_RECORDS 32
+#define NET_MAPPAGES(numRecords) ((numRecords) / NET_MAPPAGE_RECORDS)
+
+// the pages of a revision cover the map state arrays exactly, and the delta encoder skips pages by masking indices
+EDUKE32_STATIC_ASSERT((NET_MAPPAGE_RECORDS & (NET_MAPPAGE_RECORDS - 1)) == 0);
+EDUKE32_STATIC_ASSERT(MAXSPRITES % NET_MAPPAGE_RECORDS == 0 && MAXWALLS % NET_MAPPAGE_RECORDS == 0 && MAXSECTORS % NET_MAPPAGE_RECORDS == 0);
+
+template <typename T>
+struct netmappage_t
+{
+    netmappage_t* nextFree;
+    int32_t       refCount;
+    T             record[NET_MAPPAGE_RECORDS];
+};
+
+typedef struct netmaprevision_s
+{
+    uint32_t                   revisionNumber;
+    netmappage_t<netactor_t>*  actorPage[NET_MAPPAGES(MAXSPRITES)];
+    netmappage_t<netWall_t>*   wallPage[NET_MAPPAGES(MAXWALLS)];
+    netmappage_t<netSector_t>* sectorPage[NET_MAPPAGES(MAXSECTORS)];
+} netmaprevision_t;
+
+// the newest revision in full, built from the game arrays on the server and from world updates on the client
+static netmapstate_t *g_mapCurrentState;
+
+// client only, where a world update is read into before it becomes the current state
+static netmapstate_t *g_cl_NextMapState;
+
+// g_mapStartState as stored in the history, see Net_GetMapRevision()
+static netmaprevision_t g_mapStartRevision;
+
 // note that the map state number is not an index into here,
 // to get the index into this array out of a map state number, do <Map state number> % NET_REVISONS
-static netmapstate_t *g_mapStateHistory[NET_REVISIONS];
-static uint8_t       *tempnetbuf;
+static netmaprevision_t g_mapStateHistory[NET_REVISIONS];
+static uint8_t         *tempnetbuf;
+
+// Interest management (server only)
+//
+// Walls and sectors go out to every client whenever they change, but actors are sent by relevance: an actor
+// in a sector reachable from the player's and within net_relevancedist of them is sent as soon as it changes,
+// up to net_actorbudget actors per update in order of priority. Other changes are deferred, and the client
+// keeps the copy it already has until the actor becomes relevant or that copy gets too old.
+//
+// To delta encode against what a client really holds, the server remembers for every update it sent
+// which revision the client's copy of each actor came from, as an age relative to the update's revision.
+
+// a changed actor is sent regardless of relevance once the client's copy is this many revisions old, which
+// also keeps the revision of that copy in g_mapStateHistory for as long as a later update may need it
+#define NET_MAXDEFERRED (NET_REVISIONS / 4)
+
+// the client's copy is the one from the initial map state, which never goes stale
+static const uint8_t cNetActorInitialState = UINT8_MAX;
+
+typedef struct
+{
+    int32_t  actorIndex;
+    uint32_t priority;
+} netactorcandidate_t;
+
+// see "Range coded world updates" further down
+typedef struct netcoder_s netcoder_t;
+
+typedef struct netclientview_s
+{
+    uint32_t revision[NET_REVISIONS];
+    uint8_t  age[NET_REVISIONS][MAXSPRITES];
+
+    // scratch space for Net_WriteRelevantActorsToBuffer(), kept per client so that updates can be encoded concurrently
+    netactorcandidate_t candidates[MAXSPRITES];
+    uint8_t             sendActor[bitmap_size(MAXSPRITES)];
+
+    // the coder state the client's actors continue from in a PACKET_WORLD_UPDATE_CODED, allocated on first use
+    netcoder_t*         coder;
+} netclientview_t;
+
+static netclientview_t *g_netClientView[MAXPLAYERS];
+
+// the last revision in which each actor differed from the revision before it
+static uint32_t g_netActorChangeRevision[MAXSPRITES];
+
+// World update encoding (server only)
+//
+// Each client's update is encoded into a packet buffer of its own. The revision numbers, walls and sectors only
+// depend on the revision the update starts from, so they are encoded once per distinct starting revision and
+// copied into the packet of every client sharing it, after which the client's actors are appended. With
+// net_encodethreads above 1 both steps are spread over a worker pool, and only the sends stay on the main thread.
+// Range coded updates get prefixes of their own, which also keep the coder state for the actors to continue from.
+
+typedef struct
+{
+    uint32_t    fromRevisionNumber;
+    int32_t     coded;
+    int32_t     bitLength;  // of the encoded part, not counting the packet type in front of it
+    uint8_t*    data;
+    netcoder_t* coder;      // allocated on first use
+} networldprefix_t;
+
+typedef struct
+{
+    int32_t  playerIndex;
+    uint32_t fromRevisionNumber;
+    int32_t  prefixIndex;
+    int32_t  packetSize;
+} networldupdate_t;
+
+static networldprefix_t g_netWorldPrefix[MAXPLAYERS];
+static networldupdate_t g_netWorldUpdate[MAXPLAYERS];
+static uint8_t*         g_netPacketBuffer[MAXPLAYERS];
+
+static async::threadpool_scheduler *g_netEncodePool;
+static int32_t g_netEncodePoolThreads;
+
+// the NETPROTOCOL_* flags each client sent in its PACKET_AUTH
+static uint8_t g_netPlayerProtocolFlags[MAXPLAYERS];
 
 // Remember that this constant needs to be one bit longer than a struct index, so it can't be mistaken for a valid wall, sprite, or sector index
 static const int32_t cSTOP_PARSING_CODE = ((1 << NETINDEX_BITS) - 1);
@@ -458,6 +579,10 @@ int32_t     g_netPlayersWaiting = 0;
 int32_t     g_netIndex          = 2;
 newgame_t   pendingnewgame;
 bool        g_enableClientInterpolationCheck = true;
+int32_t     g_netRelevanceDist  = 32768;
+int32_t     g_netActorBudget    = MAX_SNAPSHOT_ACTORS;
+int32_t     g_netEncodeThreads  = 0;
+int32_t     g_netRangeCoder     = 1;
 
 
 // Internal functions
@@ -1513,7 +1638,7 @@ static void Net_SendPlayerIndex(int32_t index, ENetPeer *peer)
 }
 
 // sync a connecting player up with the current game state
-static void Net_SyncPlayer(ENetEvent *event)
+static void Net_SyncPlayer(ENetEvent *event, uint8_t protocolFlags)
 {
     int32_t newPlayerIndex, j;
 
@@ -1545,6 +1670,8 @@ static void Net_SyncPlayer(ENetEvent *event)
     NET_75_CHECK++; // is it necessary to se event->peer->data to the new player index in Net_SyncPlayer?
     event->peer->data = (void *)(intptr_t)newPlayerIndex;
 
+    g_netPlayerProtocolFlags[newPlayerIndex] = protocolFlags;
+
     g_player[newPlayerIndex].netsynctime = (int32_t) totalclock;
     g_player[newPlayerIndex].playerquitflag = 1;
 
@@ -1772,9 +1899,7 @@ static void Net_ReceiveChallenge(uint8_t *pbuf, int32_t packbufleng, ENetEvent *
     const uint16_t netVersion  = B_UNBUF16(&pbuf[3]);
     const uint32_t crc         = B_UNBUF32(&pbuf[5]);
 
-    UNREFERENCED_PARAMETER(packbufleng);  // remove when this variable is used
-
-    if (byteVersion != BYTEVERSION || netVersion != NETVERSION)
+    if (packbufleng < 11 || byteVersion != BYTEVERSION || netVersion != NETVERSION)
     {
         enet_peer_disconnect_later(event->peer, DISC_VERSION_MISMATCH);
         LOG_F(ERROR, "Bad client protocol: version %u.%u", byteVersion, netVersion);
@@ -1787,7 +1912,8 @@ static void Net_ReceiveChallenge(uint8_t *pbuf, int32_t packbufleng, ENetEvent *
         return;
     }
 
-    Net_SyncPlayer(event);
+    // the NETPROTOCOL_* flags the client supports
+    Net_SyncPlayer(event, pbuf[10]);
 }
 
 static void Net_ReceiveMessage(uint8_t *pbuf, int32_t packbufleng)
@@ -2262,7 +2388,8 @@ static void Net_ReceiveServerUpdate(ENetEvent *event)
     }
 }
 
-// sends the version and a simple crc32 of the current password, all verified by the server before the connection can continue
+// sends the version and a simple crc32 of the current password, all verified by the server before the connection can continue,
+// followed by the NETPROTOCOL_* features this client supports
 static void Net_SendChallenge()
 {
     if (!g_netClientPeer)
@@ -2275,8 +2402,9 @@ static void Net_SendChallenge()
     B_BUF16(&tempnetbuf[3], NETVERSION);
     B_BUF32(&tempnetbuf[5], Bcrc32((uint8_t *)g_netPassword, Bstrlen(g_netPassword), 0));
     tempnetbuf[9] = myconnectindex;
+    tempnetbuf[10] = g_netRangeCoder ? NETPROTOCOL_RANGECODER : 0;
 
-    enet_peer_send(g_netClientPeer, CHAN_GAMESTATE, enet_packet_create(&tempnetbuf[0], 10, ENET_PACKET_FLAG_RELIABLE));
+    enet_peer_send(g_netClientPeer, CHAN_GAMESTATE, enet_packet_create(&tempnetbuf[0], 11, ENET_PACKET_FLAG_RELIABLE));
 
     Dbg_PacketSent(PACKET_AUTH);
 }
@@ -2442,6 +2570,7 @@ static void Net_ParseServerPacket(ENetEvent *event)
         P_ResetPlayer(pbuf[1]);
         Bmemcpy(&g_player[pbuf[1]].ps->pos, &pbuf[2], sizeof(vec3_t));
         Bmemcpy(&sprite[g_player[pbuf[1]].ps->i], &pbuf[2], sizeof(vec3_t));
+        spriteMarkChanged(g_player[pbuf[1]].ps->i);
         Bmemcpy(&g_player[pbuf[1]].ps->opos, &pbuf[14], sizeof(vec3_t));
         break;
 
@@ -2464,6 +2593,7 @@ static void Net_ParseServerPacket(ENetEvent *event)
 
         // [75]
     case PACKET_WORLD_UPDATE:
+    case PACKET_WORLD_UPDATE_CODED:
         Net_ReadWorldUpdate(pbuf, packbufleng);
         break;
 
@@ -2543,6 +2673,150 @@ static void Net_FillPlayerUpdate(playerupdate_t *update, int32_t player)
 ////////////////////////////////////////////////////////////////////////////////
 // New Game Packets
 
+// Map state history, see g_mapStateHistory
+//------------------------------------------------------------------------------
+
+// pages no revision refers to anymore, kept for reuse
+static netmappage_t<netactor_t>*  g_netFreeActorPages;
+static netmappage_t<netWall_t>*   g_netFreeWallPages;
+static netmappage_t<netSector_t>* g_netFreeSectorPages;
+
+template <typename T>
+static netmappage_t<T>* Net_AllocateMapPage(netmappage_t<T>*& freeList)
+{
+    netmappage_t<T>* page = freeList;
+
+    if (page != nullptr)
+    {
+        freeList = page->nextFree;
+    }
+    else
+    {
+        page = (netmappage_t<T> *)Xmalloc(sizeof(netmappage_t<T>));
+    }
+
+    page->refCount = 1;
+
+    return page;
+}
+
+template <typename T>
+static void Net_ReleaseMapPage(netmappage_t<T>*& page, netmappage_t<T>*& freeList)
+{
+    if (page != nullptr && --page->refCount == 0)
+    {
+        page->nextFree = freeList;
+        freeList       = page;
+    }
+
+    page = nullptr;
+}
+
+// points pages at the records of a map state array, sharing every page of basePages (if any) whose records are unchanged
+template <typename T>
+static void Net_StoreMapPages(netmappage_t<T>** pages, int32_t numPages, const T* records, netmappage_t<T>* const* basePages, netmappage_t<T>*& freeList)
+{
+    for (int32_t pageIndex = 0; pageIndex < numPages; pageIndex++)
+    {
+        const T* const         pageRecords = &records[pageIndex * NET_MAPPAGE_RECORDS];
+        netmappage_t<T>* const basePage    = basePages ? basePages[pageIndex] : nullptr;
+        netmappage_t<T>*       page;
+
+        if (basePage != nullptr && !memcmp(basePage->record, pageRecords, sizeof(basePage->record)))
+        {
+            page = basePage;
+            page->refCount++;
+        }
+        else
+        {
+            page = Net_AllocateMapPage(freeList);
+            Bmemcpy(page->record, pageRecords, sizeof(page->record));
+        }
+
+        // pages may be basePages, so only let go of the old page once the new one holds a reference
+        Net_ReleaseMapPage(pages[pageIndex], freeList);
+        pages[pageIndex] = page;
+    }
+}
+
+template <typename T>
+static void Net_LoadMapPages(T* records, int32_t numPages, netmappage_t<T>* const* pages)
+{
+    for (int32_t pageIndex = 0; pageIndex < numPages; pageIndex++)
+    {
+        Bassert(pages[pageIndex] != nullptr);
+        Bmemcpy(&records[pageIndex * NET_MAPPAGE_RECORDS], pages[pageIndex]->record, sizeof(pages[pageIndex]->record));
+    }
+}
+
+static void Net_ClearMapRevision(netmaprevision_t* revision)
+{
+    for (auto& page : revision->actorPage)
+    {
+        Net_ReleaseMapPage(page, g_netFreeActorPages);
+    }
+
+    for (auto& page : revision->wallPage)
+    {
+        Net_ReleaseMapPage(page, g_netFreeWallPages);
+    }
+
+    for (auto& page : revision->sectorPage)
+    {
+        Net_ReleaseMapPage(page, g_netFreeSectorPages);
+    }
+
+    // no revision stored in the history has this number, see Net_GetMapRevision()
+    revision->revisionNumber = cInitialMapStateRevisionNumber;
+}
+
+// stores mapState into revision, sharing the pages it has in common with base, which can be null
+static void Net_StoreMapState(netmaprevision_t* revision, const netmapstate_t* mapState, const netmaprevision_t* base)
+{
+    Bassert(revision != nullptr);
+    Bassert(mapState != nullptr);
+
+    Net_StoreMapPages(revision->actorPage, ARRAY_SIZE(revision->actorPage), mapState->actor, base ? base->actorPage : nullptr, g_netFreeActorPages);
+    Net_StoreMapPages(revision->wallPage, ARRAY_SIZE(revision->wallPage), mapState->wall, base ? base->wallPage : nullptr, g_netFreeWallPages);
+    Net_StoreMapPages(revision->sectorPage, ARRAY_SIZE(revision->sectorPage), mapState->sector, base ? base->sectorPage : nullptr, g_netFreeSectorPages);
+
+    revision->revisionNumber = mapState->revisionNumber;
+}
+
+// reconstructs the full map state of a stored revision
+static void Net_LoadMapState(netmapstate_t* mapState, const netmaprevision_t* revision)
+{
+    Bassert(mapState != nullptr);
+    Bassert(revision != nullptr);
+
+    Net_LoadMapPages(mapState->actor, ARRAY_SIZE(revision->actorPage), revision->actorPage);
+    Net_LoadMapPages(mapState->wall, ARRAY_SIZE(revision->wallPage), revision->wallPage);
+    Net_LoadMapPages(mapState->sector, ARRAY_SIZE(revision->sectorPage), revision->sectorPage);
+
+    mapState->revisionNumber = revision->revisionNumber;
+    mapState->maxActorIndex  = MAXSPRITES;
+}
+
+// returns a revision from the history, or nullptr if it was never stored or has been overwritten since
+static const netmaprevision_t* Net_GetMapRevision(uint32_t revisionNumber)
+{
+    if (revisionNumber == cInitialMapStateRevisionNumber)
+    {
+        return &g_mapStartRevision;
+    }
+
+    const netmaprevision_t* revision = &g_mapStateHistory[revisionNumber % NET_REVISIONS];
+
+    return (revision->revisionNumber == revisionNumber) ? revision : nullptr;
+}
+
+static FORCE_INLINE const netactor_t* Net_GetRevisionActor(const netmaprevision_t* revision, int32_t actorIndex)
+{
+    Bassert(revision != nullptr);
+
+    return &revision->actorPage[actorIndex / NET_MAPPAGE_RECORDS]->record[actorIndex % NET_MAPPAGE_RECORDS];
+}
+
 // set all actors, walls, and sectors in a snapshot to their Null states.
 static void Net_InitMapState(netmapstate_t* mapState)
 {
@@ -2639,6 +2913,79 @@ static void Net_ResetPlayerReady()
 const int32_t cTruncInt_Min = -(1 << (FLOAT_INT_BITS - 1));
 const int32_t cTruncInt_Max = (1 << (FLOAT_INT_BITS - 1)) - 1;
 
+// Range coded world updates
+//
+// Clients that advertise NETPROTOCOL_RANGECODER in their PACKET_AUTH get PACKET_WORLD_UPDATE_CODED packets while
+// net_rangecoder is on at both ends. After the two revision numbers, which are written as usual, these carry the
+// same sequence of structs as a PACKET_WORLD_UPDATE, run through a binary adaptive range coder instead of being
+// written as fixed width bit fields. Each struct type has its own context models, which start from scratch in
+// every packet so that updates can still be decoded whichever of them get lost:
+//
+// - struct indices are coded as the distance from the previous one in their section,
+// - every field has its own probabilities for having changed (also depending on whether the field before it did)
+//   and for being zeroed, so fields like picnum and statnum that rarely change cost next to nothing when they don't,
+// - changed values are coded as the difference from a prediction, split into the number of significant bits it
+//   has (modeled per field) and the bits below the top one. The prediction is the old value, except for actor
+//   positions, which move on from the last tic's position by the distance covered in the previous one.
+//
+// The values decoded are exactly those a PACKET_WORLD_UPDATE carries, including the truncation of each field to
+// its width, so the two kinds of update can be freely mixed on one connection.
+
+enum
+{
+    NETSTRUCT_WALL,
+    NETSTRUCT_SECTOR,
+    NETSTRUCT_ACTOR,
+    NETSTRUCT_COUNT
+};
+
+enum
+{
+    NETSTRUCTFLAG_DELETED,
+    NETSTRUCTFLAG_CHANGED,
+    NETSTRUCTFLAG_COUNT
+};
+
+#define NET_RC_PROBBITS 11
+#define NET_RC_MOVEBITS 5
+#define NET_RC_TOP      (1u << 24)
+
+// bits needed to code the 33 possible bit lengths of a 32-bit value
+#define NET_SLOTBITS 6
+
+#define NET_MAXFIELDS ARRAY_SIZE(ActorFields)
+
+EDUKE32_STATIC_ASSERT(ARRAY_SIZE(WallFields) <= NET_MAXFIELDS && ARRAY_SIZE(SectorFields) <= NET_MAXFIELDS);
+
+typedef uint16_t netprob_t;
+
+typedef struct
+{
+    netprob_t index[1 << NET_SLOTBITS];
+    netprob_t maxChange[1 << STRUCTINDEX_BITS];
+    netprob_t flag[NETSTRUCTFLAG_COUNT];
+    netprob_t fieldChanged[NET_MAXFIELDS][2];
+    netprob_t fieldNonZero[NET_MAXFIELDS];
+    netprob_t fieldValue[NET_MAXFIELDS][1 << NET_SLOTBITS];
+} netstructmodel_t;
+
+struct netcoder_s
+{
+    uint64_t low;
+    uint32_t range;
+    uint32_t code;
+    int32_t  cacheSize;
+    uint8_t  cache;
+
+    // next byte of the buffer to write or read
+    int32_t  pos;
+
+    int32_t  lastIndex[NETSTRUCT_COUNT];
+    netstructmodel_t model[NETSTRUCT_COUNT];
+};
+
+static netcoder_t g_cl_Coder;
+
 typedef struct NetBuffer_s
 {
     uint8_t     *Data;
@@ -2646,6 +2993,7 @@ typedef struct NetBuffer_s
     int32_t     ReadCurByte;
     int32_t     CurSize;
     int32_t     MaxSize; // set in NetBuffer_Init to the size of the byte array that this struct referrs to in Data
+    netcoder_t  *Coder;  // set while the buffer is range coded, see NetBuffer_StartEncoding() and NetBuffer_StartDecoding()
 } NetBuffer_t;
 
 // NOTE: does NOT fill byteArray with zeros
@@ -2790,130 +3138,411 @@ EDUKE32_UNUSED static float Dbg_RawIntToFloat(NetChunk32 floatRawData)
 }
 
 
-static void NetBuffer_WriteBits(NetBuffer_t *netBuffer, int32_t data, int16_t numberOfBits)
+// range coder, see "Range coded world updates" above
+//----------------------------------------------------------------------------------------------------------
+
+static void NetCoder_InitModels(netcoder_t *coder)
 {
-    if (netBuffer->CurSize >= netBuffer->MaxSize)
+    // every probability starts out even
+    for (netstructmodel_t &model : coder->model)
     {
-        Net_Error_Disconnect("NetBuffer_WriteBits: Buffer overrun.");
-    }
-
-    int32_t dataToWrite = data & (0xffffffff >> (32 - numberOfBits));
-
-    PutBits(dataToWrite, netBuffer->Data, &netBuffer->Bit, numberOfBits);
+        netprob_t *const probs = (netprob_t *)&model;
 
-    netBuffer->CurSize = (netBuffer->Bit >> 3) + 1;
-
-}
+        for (size_t probIndex = 0; probIndex < sizeof(model) / sizeof(netprob_t); probIndex++)
+        {
+            probs[probIndex] = 1 << (NET_RC_PROBBITS - 1);
+        }
+    }
 
-EDUKE32_UNUSED static void NetBuffer_WriteUnsignedByte(NetBuffer_t *netBuffer, int32_t byte)
-{
-#ifdef PICKY_TYPECHECK
-    if ((byte < 0) || byte > 255)
+    for (int32_t structType = 0; structType < NETSTRUCT_COUNT; structType++)
     {
-        Net_Error_Disconnect("NetBuffer_WriteUnsignedByte: Value not valid.");
+        coder->lastIndex[structType] = -1;
     }
-#endif
-    NetBuffer_WriteBits(netBuffer, byte, 8);
 }
 
-EDUKE32_UNUSED static void NetBuffer_WriteSignedByte(NetBuffer_t *netBuffer, int32_t byte)
+static void NetCoder_ShiftLow(NetBuffer_t *netBuffer, netcoder_t *coder)
 {
-#ifdef PICKY_TYPECHECK
-    if ((byte < -128) || (byte > 127))
+    if ((uint32_t)coder->low < 0xFF000000u || (coder->low >> 32) != 0)
     {
-        Net_Error_Disconnect("NetBuffer_WriteSignedByte: Value not valid.");
+        uint8_t const carry = (uint8_t)(coder->low >> 32);
+        uint8_t       byte  = coder->cache;
+
+        do
+        {
+            // overruns are reported once encoding is finished
+            if (coder->pos < netBuffer->MaxSize)
+            {
+                netBuffer->Data[coder->pos] = (uint8_t)(byte + carry);
+            }
+
+            coder->pos++;
+            byte = 0xFF;
+        } while (--coder->cacheSize != 0);
+
+        coder->cache = (uint8_t)(coder->low >> 24);
     }
-#endif
-    NetBuffer_WriteBits(netBuffer, byte, 8);
-}
 
+    coder->cacheSize++;
+    coder->low = (coder->low & 0x00FFFFFF) << 8;
+}
 
-EDUKE32_UNUSED static void NetBuffer_WriteInt16(NetBuffer_t *netBuffer, int32_t word)
+// past the end of the packet the stream reads as zeroes, which the callers catch through ReadCurByte
+static uint32_t NetCoder_ReadByte(NetBuffer_t *netBuffer, netcoder_t *coder)
 {
-#ifdef PICKY_TYPECHECK
-    const int16_t cLowVal = (int16_t)0x00008000;
-    const int16_t cHighVal = (int16_t)0x00007fff;
+    uint32_t const byte = (coder->pos < netBuffer->CurSize) ? netBuffer->Data[coder->pos] : 0;
 
-    if ((word < cLowVal) || (word > cHighVal))
-    {
-        Net_Error_Disconnect("NetBuffer_WriteInt16: Value not valid.");
-    }
-#endif
-    NetBuffer_WriteBits(netBuffer, word, 16);
+    netBuffer->ReadCurByte = ++coder->pos;
+
+    return byte;
 }
 
-EDUKE32_UNUSED static void NetBuffer_WriteUInt16(NetBuffer_t *netBuffer, int32_t word)
+static void NetCoder_EncodeBit(NetBuffer_t *netBuffer, netprob_t *prob, int32_t bit)
 {
-#ifdef PICKY_TYPECHECK
-    const uint16_t cLowVal = (uint16_t)0x00000000;
-    const uint16_t cHighVal = (uint16_t)0x0000ffff;
+    netcoder_t *const coder = netBuffer->Coder;
+    uint32_t const    bound = (coder->range >> NET_RC_PROBBITS) * *prob;
 
-    if ((word < cLowVal) | (word > cHighVal))
+    if (!bit)
     {
-        Net_Error_Disconnect("NetBuffer_WriteUInt16: Value not valid.");
+        coder->range = bound;
+        *prob += ((1 << NET_RC_PROBBITS) - *prob) >> NET_RC_MOVEBITS;
+    }
+    else
+    {
+        coder->low   += bound;
+        coder->range -= bound;
+        *prob -= *prob >> NET_RC_MOVEBITS;
     }
 
-#endif
-    NetBuffer_WriteBits(netBuffer, word, 16);
+    while (coder->range < NET_RC_TOP)
+    {
+        coder->range <<= 8;
+        NetCoder_ShiftLow(netBuffer, coder);
+    }
 }
 
-static void NetBuffer_WriteDword(NetBuffer_t *netBuffer, int32_t dword)
+static int32_t NetCoder_DecodeBit(NetBuffer_t *netBuffer, netprob_t *prob)
 {
-    // don't care about signed/unsigned since the bit width matches
-    NetBuffer_WriteBits(netBuffer, dword, 32);
-}
+    netcoder_t *const coder = netBuffer->Coder;
+    uint32_t const    bound = (coder->range >> NET_RC_PROBBITS) * *prob;
+    int32_t           bit;
 
+    if (coder->code < bound)
+    {
+        coder->range = bound;
+        *prob += ((1 << NET_RC_PROBBITS) - *prob) >> NET_RC_MOVEBITS;
+        bit = 0;
+    }
+    else
+    {
+        coder->code  -= bound;
+        coder->range -= bound;
+        *prob -= *prob >> NET_RC_MOVEBITS;
+        bit = 1;
+    }
 
-//where length is the size in bytes
-static void NetBuffer_WriteData(NetBuffer_t  *netBuffer, const void *data, int16_t length)
-{
-    int32_t byteIndex;
-    for (byteIndex = 0; byteIndex < length; byteIndex++)
+    while (coder->range < NET_RC_TOP)
     {
-        NetBuffer_WriteUnsignedByte(netBuffer, ((const int8_t *)data)[byteIndex]);
+        coder->range <<= 8;
+        coder->code = (coder->code << 8) | NetCoder_ReadByte(netBuffer, coder);
     }
+
+    return bit;
 }
 
-EDUKE32_UNUSED static void NetBuffer_WriteString(NetBuffer_t *netBuffer, const char *stringToWrite)
+// bits at even odds, most significant first
+static void NetCoder_EncodeDirectBits(NetBuffer_t *netBuffer, uint32_t value, int32_t numberOfBits)
 {
-    if (!stringToWrite)
+    netcoder_t *const coder = netBuffer->Coder;
+
+    while (numberOfBits-- > 0)
     {
-        // if stringToWrite is null, write a NUL ('\0') character
-        NetBuffer_WriteData(netBuffer, "", 1);
+        coder->range >>= 1;
+
+        if ((value >> numberOfBits) & 1)
+        {
+            coder->low += coder->range;
+        }
+
+        while (coder->range < NET_RC_TOP)
+        {
+            coder->range <<= 8;
+            NetCoder_ShiftLow(netBuffer, coder);
+        }
     }
+}
 
-    else
+static uint32_t NetCoder_DecodeDirectBits(NetBuffer_t *netBuffer, int32_t numberOfBits)
+{
+    netcoder_t *const coder = netBuffer->Coder;
+    uint32_t          value = 0;
+
+    while (numberOfBits-- > 0)
     {
-        int32_t     length; // length of input string
-        char        tempStringBuffer[MAX_PACKET_STRING]; // temp storage
+        coder->range >>= 1;
 
-        length = strlen(stringToWrite);
+        uint32_t const bit = (coder->code >= coder->range);
 
-        if (length >= MAX_PACKET_STRING)
+        if (bit)
         {
-            Net_Error_Disconnect("NetBuffer_WriteString: String too long.");
+            coder->code -= coder->range;
         }
-        SafeStrncpyz(tempStringBuffer, stringToWrite, sizeof(tempStringBuffer));
 
-        NetBuffer_WriteData(netBuffer, tempStringBuffer, length + 1);
+        value = (value << 1) | bit;
+
+        while (coder->range < NET_RC_TOP)
+        {
+            coder->range <<= 8;
+            coder->code = (coder->code << 8) | NetCoder_ReadByte(netBuffer, coder);
+        }
     }
+
+    return value;
 }
 
-static void NetBuffer_WriteDeltaFloat(NetBuffer_t *netBuffer, NetChunk32 rawFloatData)
+// codes a numberOfBits wide value with a probability for every prefix of it, probs needs (1 << numberOfBits) entries
+static void NetCoder_EncodeTree(NetBuffer_t *netBuffer, netprob_t *probs, int32_t numberOfBits, uint32_t value)
 {
-    if (sizeof(float) != sizeof(int32_t))
+    uint32_t node = 1;
+
+    while (numberOfBits-- > 0)
     {
-        Net_Error_Disconnect("Can't write float to buffer: sizeof(float) must be 4 bytes");
+        int32_t const bit = (value >> numberOfBits) & 1;
+
+        NetCoder_EncodeBit(netBuffer, &probs[node], bit);
+        node = (node << 1) | bit;
     }
+}
 
+static uint32_t NetCoder_DecodeTree(NetBuffer_t *netBuffer, netprob_t *probs, int32_t numberOfBits)
+{
+    uint32_t node = 1;
 
-    // interpret the FOUR BYTES of raw float data as a float
-    float*	floatDataPtr = (float*) &(rawFloatData);
-    float	floatValue = *(floatDataPtr);
+    for (int32_t bitIndex = 0; bitIndex < numberOfBits; bitIndex++)
+    {
+        node = (node << 1) | NetCoder_DecodeBit(netBuffer, &probs[node]);
+    }
 
-    int32_t truncatedFloat = (int32_t)floatValue;
+    return node - (1 << numberOfBits);
+}
 
-    if (floatValue == 0.0f)
+// codes the bit length of the value through slotProbs, then the bits below its top one at even odds
+static void NetCoder_EncodeValue(NetBuffer_t *netBuffer, netprob_t *slotProbs, uint32_t value)
+{
+    int32_t numberOfBits = 0;
+
+    while (numberOfBits < 32 && (value >> numberOfBits) != 0)
+    {
+        numberOfBits++;
+    }
+
+    NetCoder_EncodeTree(netBuffer, slotProbs, NET_SLOTBITS, numberOfBits);
+
+    if (numberOfBits > 1)
+    {
+        NetCoder_EncodeDirectBits(netBuffer, value, numberOfBits - 1);
+    }
+}
+
+static uint32_t NetCoder_DecodeValue(NetBuffer_t *netBuffer, netprob_t *slotProbs)
+{
+    int32_t const numberOfBits = NetCoder_DecodeTree(netBuffer, slotProbs, NET_SLOTBITS);
+
+    if (numberOfBits == 0)
+    {
+        return 0;
+    }
+
+    if (numberOfBits > 32)
+    {
+        Net_Error_Disconnect("NetCoder_DecodeValue: Invalid value length.");
+        return 0;
+    }
+
+    return (1u << (numberOfBits - 1)) | NetCoder_DecodeDirectBits(netBuffer, numberOfBits - 1);
+}
+
+// everything written to the buffer from here on goes through the coder, starting at the next whole byte
+static void NetBuffer_StartEncoding(NetBuffer_t *netBuffer, netcoder_t *coder)
+{
+    coder->low       = 0;
+    coder->range     = 0xFFFFFFFF;
+    coder->cache     = 0;
+    coder->cacheSize = 1;
+    coder->pos       = (netBuffer->Bit + 7) >> 3;
+
+    NetCoder_InitModels(coder);
+
+    netBuffer->Coder   = coder;
+    netBuffer->CurSize = coder->pos;
+}
+
+static void NetBuffer_FinishEncoding(NetBuffer_t *netBuffer)
+{
+    netcoder_t *const coder = netBuffer->Coder;
+
+    for (int32_t byteIndex = 0; byteIndex < 5; byteIndex++)
+    {
+        NetCoder_ShiftLow(netBuffer, coder);
+    }
+
+    if (coder->pos > netBuffer->MaxSize)
+    {
+        Net_Error_Disconnect("NetBuffer_FinishEncoding: Buffer overrun.");
+        coder->pos = netBuffer->MaxSize;
+    }
+
+    netBuffer->CurSize = coder->pos;
+    netBuffer->Coder   = nullptr;
+}
+
+static void NetBuffer_StartDecoding(NetBuffer_t *netBuffer, netcoder_t *coder)
+{
+    coder->range = 0xFFFFFFFF;
+    coder->code  = 0;
+    coder->pos   = (netBuffer->Bit + 7) >> 3;
+
+    NetCoder_InitModels(coder);
+
+    netBuffer->Coder = coder;
+
+    for (int32_t byteIndex = 0; byteIndex < 5; byteIndex++)
+    {
+        coder->code = (coder->code << 8) | NetCoder_ReadByte(netBuffer, coder);
+    }
+}
+
+
+static void NetBuffer_WriteBits(NetBuffer_t *netBuffer, int32_t data, int16_t numberOfBits)
+{
+    if (netBuffer->CurSize >= netBuffer->MaxSize)
+    {
+        Net_Error_Disconnect("NetBuffer_WriteBits: Buffer overrun.");
+    }
+
+    int32_t dataToWrite = data & (0xffffffff >> (32 - numberOfBits));
+
+    if (netBuffer->Coder != nullptr)
+    {
+        NetCoder_EncodeDirectBits(netBuffer, dataToWrite, numberOfBits);
+        netBuffer->CurSize = netBuffer->Coder->pos;
+        return;
+    }
+
+    PutBits(dataToWrite, netBuffer->Data, &netBuffer->Bit, numberOfBits);
+
+    netBuffer->CurSize = (netBuffer->Bit >> 3) + 1;
+
+}
+
+EDUKE32_UNUSED static void NetBuffer_WriteUnsignedByte(NetBuffer_t *netBuffer, int32_t byte)
+{
+#ifdef PICKY_TYPECHECK
+    if ((byte < 0) || byte > 255)
+    {
+        Net_Error_Disconnect("NetBuffer_WriteUnsignedByte: Value not valid.");
+    }
+#endif
+    NetBuffer_WriteBits(netBuffer, byte, 8);
+}
+
+EDUKE32_UNUSED static void NetBuffer_WriteSignedByte(NetBuffer_t *netBuffer, int32_t byte)
+{
+#ifdef PICKY_TYPECHECK
+    if ((byte < -128) || (byte > 127))
+    {
+        Net_Error_Disconnect("NetBuffer_WriteSignedByte: Value not valid.");
+    }
+#endif
+    NetBuffer_WriteBits(netBuffer, byte, 8);
+}
+
+
+EDUKE32_UNUSED static void NetBuffer_WriteInt16(NetBuffer_t *netBuffer, int32_t word)
+{
+#ifdef PICKY_TYPECHECK
+    const int16_t cLowVal = (int16_t)0x00008000;
+    const int16_t cHighVal = (int16_t)0x00007fff;
+
+    if ((word < cLowVal) || (word > cHighVal))
+    {
+        Net_Error_Disconnect("NetBuffer_WriteInt16: Value not valid.");
+    }
+#endif
+    NetBuffer_WriteBits(netBuffer, word, 16);
+}
+
+EDUKE32_UNUSED static void NetBuffer_WriteUInt16(NetBuffer_t *netBuffer, int32_t word)
+{
+#ifdef PICKY_TYPECHECK
+    const uint16_t cLowVal = (uint16_t)0x00000000;
+    const uint16_t cHighVal = (uint16_t)0x0000ffff;
+
+    if ((word < cLowVal) | (word > cHighVal))
+    {
+        Net_Error_Disconnect("NetBuffer_WriteUInt16: Value not valid.");
+    }
+
+#endif
+    NetBuffer_WriteBits(netBuffer, word, 16);
+}
+
+static void NetBuffer_WriteDword(NetBuffer_t *netBuffer, int32_t dword)
+{
+    // don't care about signed/unsigned since the bit width matches
+    NetBuffer_WriteBits(netBuffer, dword, 32);
+}
+
+
+//where length is the size in bytes
+static void NetBuffer_WriteData(NetBuffer_t  *netBuffer, const void *data, int16_t length)
+{
+    int32_t byteIndex;
+    for (byteIndex = 0; byteIndex < length; byteIndex++)
+    {
+        NetBuffer_WriteUnsignedByte(netBuffer, ((const int8_t *)data)[byteIndex]);
+    }
+}
+
+EDUKE32_UNUSED static void NetBuffer_WriteString(NetBuffer_t *netBuffer, const char *stringToWrite)
+{
+    if (!stringToWrite)
+    {
+        // if stringToWrite is null, write a NUL ('\0') character
+        NetBuffer_WriteData(netBuffer, "", 1);
+    }
+
+    else
+    {
+        int32_t     length; // length of input string
+        char        tempStringBuffer[MAX_PACKET_STRING]; // temp storage
+
+        length = strlen(stringToWrite);
+
+        if (length >= MAX_PACKET_STRING)
+        {
+            Net_Error_Disconnect("NetBuffer_WriteString: String too long.");
+        }
+        SafeStrncpyz(tempStringBuffer, stringToWrite, sizeof(tempStringBuffer));
+
+        NetBuffer_WriteData(netBuffer, tempStringBuffer, length + 1);
+    }
+}
+
+static void NetBuffer_WriteDeltaFloat(NetBuffer_t *netBuffer, NetChunk32 rawFloatData)
+{
+    if (sizeof(float) != sizeof(int32_t))
+    {
+        Net_Error_Disconnect("Can't write float to buffer: sizeof(float) must be 4 bytes");
+    }
+
+
+    // interpret the FOUR BYTES of raw float data as a float
+    float*	floatDataPtr = (float*) &(rawFloatData);
+    float	floatValue = *(floatDataPtr);
+
+    int32_t truncatedFloat = (int32_t)floatValue;
+
+    if (floatValue == 0.0f)
     {
         NetBuffer_WriteBits(netBuffer, 0, 1);                                          // float is zeroed
 
@@ -2952,6 +3581,11 @@ static void NetBuffer_WriteDeltaFloat(NetBuffer_t *netBuffer, NetChunk32 rawFloa
 
 static int32_t NetBuffer_ReadBits(NetBuffer_t *netBuffer, int32_t numberOfBits)
 {
+    if (netBuffer->Coder != nullptr)
+    {
+        return NetCoder_DecodeDirectBits(netBuffer, numberOfBits);
+    }
+
     int32_t    value = GetBits(netBuffer->Data, &netBuffer->Bit, numberOfBits);
 
     netBuffer->ReadCurByte = (netBuffer->Bit >> 3) + 1;
@@ -3037,6 +3671,228 @@ EDUKE32_UNUSED static void NetBuffer_ReadData(NetBuffer_t *netBuffer, void *data
     }
 }
 
+// struct indices and fields, coded or not
+//----------------------------------------------------------------------------------------------------------
+
+// the indices in each section of an update go up, and each section ends with cSTOP_PARSING_CODE
+static void NetBuffer_WriteNetIndex(NetBuffer_t *netBuffer, int32_t structType, int32_t netIndex)
+{
+    netcoder_t *const coder = netBuffer->Coder;
+
+    if (coder == nullptr)
+    {
+        NetBuffer_WriteBits(netBuffer, netIndex, NETINDEX_BITS);
+        return;
+    }
+
+    int32_t &lastIndex = coder->lastIndex[structType];
+
+    if (netIndex == cSTOP_PARSING_CODE)
+    {
+        NetCoder_EncodeValue(netBuffer, coder->model[structType].index, 0);
+        lastIndex = -1;
+        return;
+    }
+
+    Bassert(netIndex > lastIndex);
+
+    NetCoder_EncodeValue(netBuffer, coder->model[structType].index, netIndex - lastIndex);
+    lastIndex = netIndex;
+}
+
+// returns -1 for an index that can't be valid
+static int32_t NetBuffer_ReadNetIndex(NetBuffer_t *netBuffer, int32_t structType)
+{
+    netcoder_t *const coder = netBuffer->Coder;
+
+    if (coder == nullptr)
+    {
+        return NetBuffer_ReadBits(netBuffer, NETINDEX_BITS);
+    }
+
+    int32_t &      lastIndex = coder->lastIndex[structType];
+    uint32_t const distance  = NetCoder_DecodeValue(netBuffer, coder->model[structType].index);
+
+    if (distance == 0)
+    {
+        lastIndex = -1;
+        return cSTOP_PARSING_CODE;
+    }
+
+    if (distance >= (uint32_t)(cSTOP_PARSING_CODE - lastIndex))
+    {
+        return -1;
+    }
+
+    lastIndex += distance;
+
+    return lastIndex;
+}
+
+static void NetBuffer_WriteStructFlag(NetBuffer_t *netBuffer, int32_t structType, int32_t flag, int32_t value)
+{
+    if (netBuffer->Coder == nullptr)
+    {
+        NetBuffer_WriteBits(netBuffer, value, 1);
+        return;
+    }
+
+    NetCoder_EncodeBit(netBuffer, &netBuffer->Coder->model[structType].flag[flag], value);
+}
+
+static int32_t NetBuffer_ReadStructFlag(NetBuffer_t *netBuffer, int32_t structType, int32_t flag)
+{
+    if (netBuffer->Coder == nullptr)
+    {
+        return NetBuffer_ReadBits(netBuffer, 1);
+    }
+
+    return NetCoder_DecodeBit(netBuffer, &netBuffer->Coder->model[structType].flag[flag]);
+}
+
+// returns what a changed field is coded relative to
+//
+// fields are decoded in order, so only the fields of "to" before this one may be used
+static uint32_t Net_PredictField(int32_t structType, const netField_t *field, const void *from, const void *to)
+{
+    if (structType == NETSTRUCT_ACTOR)
+    {
+        auto const fromActor = (const netactor_t *)from;
+        auto const toActor   = (const netactor_t *)to;
+
+        // bpos is where the actor was before the tic, so usually the old position; the new position is then
+        // expected to be as far from it as the old one was from the old bpos (bpos comes first in ActorFields)
+        switch (field->offset)
+        {
+            case offsetof(netactor_t, bpos_x): return fromActor->spr_x;
+            case offsetof(netactor_t, bpos_y): return fromActor->spr_y;
+            case offsetof(netactor_t, bpos_z): return fromActor->spr_z;
+
+            case offsetof(netactor_t, spr_x): return (uint32_t)toActor->bpos_x + ((uint32_t)fromActor->spr_x - (uint32_t)fromActor->bpos_x);
+            case offsetof(netactor_t, spr_y): return (uint32_t)toActor->bpos_y + ((uint32_t)fromActor->spr_y - (uint32_t)fromActor->bpos_y);
+            case offsetof(netactor_t, spr_z): return (uint32_t)toActor->bpos_z + ((uint32_t)fromActor->spr_z - (uint32_t)fromActor->bpos_z);
+        }
+    }
+
+    return *(const uint32_t *)((const int8_t *)from + field->offset);
+}
+
+// maps a difference taken in the width of the field to a small number if it is close to zero either way
+static uint32_t Net_ZigZagResidual(uint32_t residual, int32_t bits)
+{
+    int32_t const shift          = 32 - bits;
+    int32_t const signedResidual = (int32_t)(residual << shift) >> shift;
+
+    return ((uint32_t)signedResidual << 1) ^ (uint32_t)(signedResidual >> 31);
+}
+
+static uint32_t Net_UnZigZagResidual(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// like NetBuffer_WriteDeltaFloat(), treats -0.0 as 0.0, so that either end may hold one where the other has the other
+static uint32_t Net_FloatBits(uint32_t rawFloatData)
+{
+    float floatValue;
+    Bmemcpy(&floatValue, &rawFloatData, sizeof(floatValue));
+
+    return (floatValue == 0.0f) ? 0 : rawFloatData;
+}
+
+// the coded counterpart of the max change index and field loop in the NetBuffer_WriteDelta* functions
+static void NetBuffer_WriteCodedFields(NetBuffer_t *netBuffer, int32_t structType, const netField_t *fields, int32_t maxChgIndex,
+                                       const void *from, const void *to)
+{
+    netstructmodel_t *const model       = &netBuffer->Coder->model[structType];
+    int32_t                 lastChanged = 1;
+
+    NetCoder_EncodeTree(netBuffer, model->maxChange, STRUCTINDEX_BITS, maxChgIndex);
+
+    for (int32_t fieldIndex = 0; fieldIndex < maxChgIndex; fieldIndex++)
+    {
+        const netField_t *field     = &fields[fieldIndex];
+        uint32_t const    fromValue = *(const uint32_t *)((const int8_t *)from + field->offset);
+        uint32_t const    toValue   = *(const uint32_t *)((const int8_t *)to + field->offset);
+        int32_t const     changed   = (fromValue != toValue);
+
+        NetCoder_EncodeBit(netBuffer, &model->fieldChanged[fieldIndex][lastChanged], changed);
+        lastChanged = changed;
+
+        if (!changed)
+        {
+            continue;
+        }
+
+        if (field->bits == 0)
+        {
+            // floats are coded as the bits that differ from the old value
+            NetCoder_EncodeValue(netBuffer, model->fieldValue[fieldIndex], Net_FloatBits(fromValue) ^ Net_FloatBits(toValue));
+            continue;
+        }
+
+        NetCoder_EncodeBit(netBuffer, &model->fieldNonZero[fieldIndex], toValue != 0);
+
+        if (toValue != 0)
+        {
+            uint32_t const prediction = Net_PredictField(structType, field, from, to);
+
+            NetCoder_EncodeValue(netBuffer, model->fieldValue[fieldIndex], Net_ZigZagResidual(toValue - prediction, field->bits));
+        }
+    }
+}
+
+// returns false if the field count is invalid
+static bool NetBuffer_ReadCodedFields(NetBuffer_t *netBuffer, int32_t structType, const netField_t *fields, int32_t numFields,
+                                      const void *from, void *to)
+{
+    netstructmodel_t *const model       = &netBuffer->Coder->model[structType];
+    int32_t                 lastChanged = 1;
+    int32_t const           maxChgIndex = NetCoder_DecodeTree(netBuffer, model->maxChange, STRUCTINDEX_BITS);
+
+    if (maxChgIndex > numFields)
+    {
+        return false;
+    }
+
+    for (int32_t fieldIndex = 0; fieldIndex < numFields; fieldIndex++)
+    {
+        const netField_t *field     = &fields[fieldIndex];
+        uint32_t const    fromValue = *(const uint32_t *)((const int8_t *)from + field->offset);
+        uint32_t *const   toField   = (uint32_t *)((int8_t *)to + field->offset);
+
+        if (fieldIndex >= maxChgIndex)
+        {
+            *toField = fromValue;
+            continue;
+        }
+
+        lastChanged = NetCoder_DecodeBit(netBuffer, &model->fieldChanged[fieldIndex][lastChanged]);
+
+        if (!lastChanged)
+        {
+            *toField = fromValue;
+        }
+        else if (field->bits == 0)
+        {
+            *toField = Net_FloatBits(fromValue) ^ NetCoder_DecodeValue(netBuffer, model->fieldValue[fieldIndex]);
+        }
+        else if (!NetCoder_DecodeBit(netBuffer, &model->fieldNonZero[fieldIndex]))
+        {
+            *toField = 0;
+        }
+        else
+        {
+            uint32_t const prediction = Net_PredictField(structType, field, from, to);
+            uint32_t const residual   = Net_UnZigZagResidual(NetCoder_DecodeValue(netBuffer, model->fieldValue[fieldIndex]));
+
+            *toField = (prediction + residual) & (0xffffffff >> (32 - field->bits));
+        }
+    }
+
+    return true;
+}
+
 // net struct -> Buffer functions
 //----------------------------------------------------------------------------------------------------------
 
@@ -3085,7 +3941,13 @@ static void NetBuffer_WriteDeltaNetWall(NetBuffer_t *netBuffer, const netWall_t
         return;     // write nothing at all
     }
 
-    NetBuffer_WriteBits(netBuffer, to->netIndex, NETINDEX_BITS);
+    NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_WALL, to->netIndex);
+
+    if (netBuffer->Coder != nullptr)
+    {
+        NetBuffer_WriteCodedFields(netBuffer, NETSTRUCT_WALL, WallFields, maxChgIndex, from, to);
+        return;
+    }
 
     NetBuffer_WriteBits(netBuffer, maxChgIndex, STRUCTINDEX_BITS);
 
@@ -3162,7 +4024,13 @@ static void NetBuffer_WriteDeltaNetSector(NetBuffer_t *netBuffer, const netSecto
         return;     // write nothing at all
     }
 
-    NetBuffer_WriteBits(netBuffer, to->netIndex, NETINDEX_BITS);
+    NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_SECTOR, to->netIndex);
+
+    if (netBuffer->Coder != nullptr)
+    {
+        NetBuffer_WriteCodedFields(netBuffer, NETSTRUCT_SECTOR, SectorFields, maxChgIndex, from, to);
+        return;
+    }
 
     NetBuffer_WriteBits(netBuffer, maxChgIndex, STRUCTINDEX_BITS);
 
@@ -3222,8 +4090,8 @@ static void NetBuffer_WriteDeltaNetActor(NetBuffer_t* netBuffer, const netactor_
     if (to == NULL)
     {
         // The actor was present in the "From" snapshot but it's now deleted in the "To" snapshot.
-        NetBuffer_WriteBits(netBuffer, from->netIndex, NETINDEX_BITS);                      // {<NetIndex>}     sprite index
-        NetBuffer_WriteBits(netBuffer, 1, 1);                                               // {<NetIndex>, 1}  sprite deleted
+        NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_ACTOR, from->netIndex);                // {<NetIndex>}     sprite index
+        NetBuffer_WriteStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_DELETED, 1);    // {<NetIndex>, 1}  sprite deleted
         return;
     }
 
@@ -3264,22 +4132,28 @@ static void NetBuffer_WriteDeltaNetActor(NetBuffer_t* netBuffer, const netactor_
         // write two bits for no change
         // as in, write {0,0} to indicate that the entity still exists,
         // but has not changed.
-        NetBuffer_WriteBits(netBuffer, to->netIndex, NETINDEX_BITS);                    // {<NetIndex>}         sprite index
-        NetBuffer_WriteBits(netBuffer, 0, 1);                                           // {<NetIndex>, 0}      sprite NOT deleted
-        NetBuffer_WriteBits(netBuffer, 0, 1);                                           // {<NetIndex>, 0,0}    sprite has NOT changed.
+        NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_ACTOR, to->netIndex);              // {<NetIndex>}         sprite index
+        NetBuffer_WriteStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_DELETED, 0); // {<NetIndex>, 0}     sprite NOT deleted
+        NetBuffer_WriteStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_CHANGED, 0); // {<NetIndex>, 0,0}   sprite has NOT changed.
 
         return;
 
     }
 
     // if we got to this point, the sprite / actor exists and has changed
-    NetBuffer_WriteBits(netBuffer, to->netIndex, NETINDEX_BITS);                        // {<NetIndex>}         sprite index
-    NetBuffer_WriteBits(netBuffer, 0, 1);                                               // {<NetIndex>, 0}      sprite/actor NOT deleted.
-    NetBuffer_WriteBits(netBuffer, 1, 1);                                               // {<NetIndex>, 0,1}    sprite/actor HAS changed.
+    NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_ACTOR, to->netIndex);                  // {<NetIndex>}         sprite index
+    NetBuffer_WriteStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_DELETED, 0);    // {<NetIndex>, 0}      sprite/actor NOT deleted.
+    NetBuffer_WriteStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_CHANGED, 1);    // {<NetIndex>, 0,1}    sprite/actor HAS changed.
 
                                                                                         //--------------------------------------------------
                                                                                         // then...
 
+    if (netBuffer->Coder != nullptr)
+    {
+        NetBuffer_WriteCodedFields(netBuffer, NETSTRUCT_ACTOR, ActorFields, maxChgIndex, from, to);
+        return;
+    }
+
     NetBuffer_WriteBits(netBuffer, maxChgIndex, STRUCTINDEX_BITS);						// Write Max change index
 
                                                                                         // For each field in struct...
@@ -3328,77 +4202,178 @@ static void NetBuffer_WriteDeltaNetActor(NetBuffer_t* netBuffer, const netactor_
 }
 
 
-static void Net_WriteNetActorsToBuffer(NetBuffer_t* netBuffer, const netmapstate_t* from, const netmapstate_t* to)
+static int Net_CompareActorCandidates(const void *a, const void *b)
 {
-    Bassert(from != nullptr);
-    Bassert(to != nullptr);
+    auto const candidateA = (netactorcandidate_t const *)a;
+    auto const candidateB = (netactorcandidate_t const *)b;
 
-    const netactor_t* fromActor = NULL;
-
-    const netactor_t* toActor = NULL;
-
-    int16_t     actorIndex = 0;
+    if (candidateA->priority != candidateB->priority)
+    {
+        return (candidateA->priority > candidateB->priority) ? -1 : 1;
+    }
 
-    int16_t     fromMaxIndex = 0;
+    return candidateA->actorIndex - candidateB->actorIndex;
+}
 
-    if (!from)
+// returns the distance from the player to an actor they may be able to perceive, or -1 if they can't
+static int32_t Net_GetActorRelevanceDistance(const netactor_t* netActor, const DukePlayer_t* player)
+{
+    if (g_netRelevanceDist <= 0)
     {
-        fromMaxIndex = 0;
+        return 0;
     }
-    else
+
+    int32_t const actorSector  = netActor->spr_sectnum;
+    int32_t const playerSector = player->cursectnum;
+
+    if ((unsigned)actorSector >= (unsigned)numsectors || (unsigned)playerSector >= (unsigned)numsectors || !sectorsareconnected(playerSector, actorSector))
     {
-        fromMaxIndex = from->maxActorIndex;
+        return -1;
     }
 
-    while (
-        actorIndex < to->maxActorIndex
-        ||
-        actorIndex < fromMaxIndex
-        )
+    int32_t const distance = FindDistance3D(netActor->spr_x - player->pos.x, netActor->spr_y - player->pos.y, (netActor->spr_z - player->pos.z) >> 4);
+
+    return (distance <= g_netRelevanceDist) ? distance : -1;
+}
+
+static bool Net_HaveClientView(int32_t playerIndex, uint32_t revisionNumber)
+{
+    netclientview_t const *view = g_netClientView[playerIndex];
+
+    return (revisionNumber != cInitialMapStateRevisionNumber) && (view != nullptr) && (view->revision[revisionNumber % NET_REVISIONS] == revisionNumber);
+}
+
+// Writes the actors a client should get in the update taking it from fromRevisionNumber (which must either be
+// cInitialMapStateRevisionNumber or pass Net_HaveClientView()) to toRevisionNumber, and records what the client
+// will hold once it has that update.
+static void Net_WriteRelevantActorsToBuffer(NetBuffer_t* netBuffer, int32_t playerIndex, uint32_t fromRevisionNumber, uint32_t toRevisionNumber)
+{
+    netclientview_t* const view = g_netClientView[playerIndex];
+
+    Bassert(view != nullptr);
+
+    netactorcandidate_t* const candidates = view->candidates;
+    uint8_t* const             sendActor  = view->sendActor;
+
+    Bassert(fromRevisionNumber == cInitialMapStateRevisionNumber || Net_HaveClientView(playerIndex, fromRevisionNumber));
+    Bassert(toRevisionNumber - fromRevisionNumber <= NET_REVISIONS - NET_MAXDEFERRED || fromRevisionNumber == cInitialMapStateRevisionNumber);
+
+    const uint8_t*       fromAge    = (fromRevisionNumber == cInitialMapStateRevisionNumber) ? nullptr : view->age[fromRevisionNumber % NET_REVISIONS];
+    uint8_t*             toAge      = view->age[toRevisionNumber % NET_REVISIONS];
+    const netmaprevision_t* toRevision = Net_GetMapRevision(toRevisionNumber);
+    const DukePlayer_t*     player     = g_player[playerIndex].ps;
+
+    Bassert(toRevision != nullptr);
+
+    view->revision[toRevisionNumber % NET_REVISIONS] = toRevisionNumber;
+
+    int32_t numCandidates = 0;
+    int32_t numForced     = 0;
+
+    for (int32_t actorIndex = 0; actorIndex < MAXSPRITES; actorIndex++)
     {
+        uint8_t const  age           = fromAge ? fromAge[actorIndex] : cNetActorInitialState;
+        bool const     initialState  = (age == cNetActorInitialState);
+        uint32_t const copyRevision  = initialState ? cInitialMapStateRevisionNumber : fromRevisionNumber - age;
 
-        // load actor pointers using actor indexes
-        if (actorIndex >= to->maxActorIndex)
+        if (g_netActorChangeRevision[actorIndex] <= copyRevision)
         {
-            toActor = NULL;
+            // the client's copy is still current, so it is as good as one from this revision
+            toAge[actorIndex] = initialState ? cNetActorInitialState : 0;
+            continue;
+        }
+
+        const netactor_t* fromActor = Net_GetRevisionActor(Net_GetMapRevision(copyRevision), actorIndex);
+        const netactor_t* toActor   = Net_GetRevisionActor(toRevision, actorIndex);
+
+        uint32_t const newAge   = initialState ? cNetActorInitialState : toRevisionNumber - copyRevision;
+        uint32_t       priority = 0;
+
+        if (toActor->spr_picnum == APLAYER || (player->i >= 0 && toActor->spr_owner == player->i))
+        {
+            // players and whatever this player spawned
+            priority = UINT32_MAX;
+        }
+        else if (!initialState && newAge >= NET_MAXDEFERRED)
+        {
+            priority = UINT32_MAX - 1;
         }
         else
         {
-            toActor = &to->actor[actorIndex];
+            // the actor is relevant if either the copy the client has or the current one is
+            int32_t distance = Net_GetActorRelevanceDistance(toActor, player);
+
+            if (distance < 0)
+            {
+                distance = Net_GetActorRelevanceDistance(fromActor, player);
+            }
 
-            if (toActor->netIndex == cSTOP_PARSING_CODE)
+            if (distance < 0)
             {
-                toActor = NULL;
+                toAge[actorIndex] = newAge;
+                continue;
             }
+
+            // closer and staler actors first
+            uint32_t const staleness = initialState ? NET_MAXDEFERRED : newAge;
+            priority = (staleness << 20) / (uint32_t)(distance + 512);
         }
 
+        numForced += (priority >= UINT32_MAX - 1);
+        candidates[numCandidates++] = { actorIndex, priority };
+    }
+
+    int32_t numToSend = numCandidates;
 
-        if (actorIndex >= fromMaxIndex)
+    if (g_netActorBudget > 0 && numCandidates > max(g_netActorBudget, numForced))
+    {
+        qsort(candidates, numCandidates, sizeof(netactorcandidate_t), Net_CompareActorCandidates);
+        numToSend = max(g_netActorBudget, numForced);
+    }
+
+    for (int32_t candidateIndex = 0; candidateIndex < numCandidates; candidateIndex++)
+    {
+        int32_t const actorIndex = candidates[candidateIndex].actorIndex;
+
+        if (candidateIndex < numToSend)
         {
-            fromActor = NULL;
+            bitmap_set(sendActor, actorIndex);
+            toAge[actorIndex] = 0;
+            continue;
         }
-        else
-        {
-            fromActor = &from->actor[actorIndex];
 
-            if (fromActor->netIndex == cSTOP_PARSING_CODE)
-            {
-                fromActor = NULL;
-            }
+        // deferred, the client keeps its copy
+        uint8_t const age = fromAge ? fromAge[actorIndex] : cNetActorInitialState;
+        toAge[actorIndex] = (age == cNetActorInitialState) ? cNetActorInitialState : toRevisionNumber - (fromRevisionNumber - age);
+    }
+
+    // the client reads actors in index order
+    for (int32_t actorIndex = 0; actorIndex < MAXSPRITES; actorIndex++)
+    {
+        if (!bitmap_test(sendActor, actorIndex))
+        {
+            continue;
         }
 
-        NetBuffer_WriteDeltaNetActor(netBuffer, fromActor, toActor, 0);
+        bitmap_clear(sendActor, actorIndex);
+
+        uint8_t const  age          = fromAge ? fromAge[actorIndex] : cNetActorInitialState;
+        uint32_t const copyRevision = (age == cNetActorInitialState) ? cInitialMapStateRevisionNumber : fromRevisionNumber - age;
 
-        actorIndex++;
+        const netactor_t* fromActor = Net_GetRevisionActor(Net_GetMapRevision(copyRevision), actorIndex);
+        const netactor_t* toActor   = Net_GetRevisionActor(toRevision, actorIndex);
 
+        NetBuffer_WriteDeltaNetActor(netBuffer, (fromActor->netIndex == cSTOP_PARSING_CODE) ? NULL : fromActor,
+                                                (toActor->netIndex == cSTOP_PARSING_CODE) ? NULL : toActor, 0);
     }
 }
 
 
-static void Net_WriteWorldToBuffer(NetBuffer_t* netBuffer, const netmapstate_t* fromSnapshot, const netmapstate_t* toSnapshot)
+// writes everything in a world update that is the same for all clients updated from fromRevision, see Net_WriteWorldPrefix()
+static void Net_WriteMapToBuffer(NetBuffer_t* netBuffer, const netmaprevision_t* fromRevision, const netmaprevision_t* toRevision)
 {
-    Bassert(fromSnapshot != nullptr);
-    Bassert(toSnapshot != nullptr);
+    Bassert(fromRevision != nullptr);
+    Bassert(toRevision != nullptr);
 
     int32_t index = 0;
 
@@ -3406,14 +4381,24 @@ static void Net_WriteWorldToBuffer(NetBuffer_t* netBuffer, const netmapstate_t*
     {
         Bassert(index < MAXWALLS);
 
-        const netWall_t* fromWall = &fromSnapshot->wall[index];
-        const netWall_t* toWall = &toSnapshot->wall[index];
+        const netmappage_t<netWall_t>* fromPage = fromRevision->wallPage[index / NET_MAPPAGE_RECORDS];
+        const netmappage_t<netWall_t>* toPage   = toRevision->wallPage[index / NET_MAPPAGE_RECORDS];
+
+        if (fromPage == toPage)
+        {
+            // a shared page has no changes to write, skip to the last of its walls
+            index |= NET_MAPPAGE_RECORDS - 1;
+            continue;
+        }
+
+        const netWall_t* fromWall = &fromPage->record[index % NET_MAPPAGE_RECORDS];
+        const netWall_t* toWall = &toPage->record[index % NET_MAPPAGE_RECORDS];
 
         NetBuffer_WriteDeltaNetWall(netBuffer, fromWall, toWall);
 
     }
 
-    NetBuffer_WriteBits(netBuffer, cSTOP_PARSING_CODE, NETINDEX_BITS);
+    NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_WALL, cSTOP_PARSING_CODE);
 
 
 
@@ -3421,18 +4406,22 @@ static void Net_WriteWorldToBuffer(NetBuffer_t* netBuffer, const netmapstate_t*
     {
         Bassert(index < MAXSECTORS);
 
-        const netSector_t* fromSector = &fromSnapshot->sector[index];
-        const netSector_t* toSector = &toSnapshot->sector[index];
+        const netmappage_t<netSector_t>* fromPage = fromRevision->sectorPage[index / NET_MAPPAGE_RECORDS];
+        const netmappage_t<netSector_t>* toPage   = toRevision->sectorPage[index / NET_MAPPAGE_RECORDS];
 
-        NetBuffer_WriteDeltaNetSector(netBuffer, fromSector, toSector);
-    }
-
-    NetBuffer_WriteBits(netBuffer, cSTOP_PARSING_CODE, NETINDEX_BITS);
+        if (fromPage == toPage)
+        {
+            index |= NET_MAPPAGE_RECORDS - 1;
+            continue;
+        }
 
-    Net_WriteNetActorsToBuffer(netBuffer, fromSnapshot, toSnapshot);
+        const netSector_t* fromSector = &fromPage->record[index % NET_MAPPAGE_RECORDS];
+        const netSector_t* toSector = &toPage->record[index % NET_MAPPAGE_RECORDS];
 
-    NetBuffer_WriteBits(netBuffer, cSTOP_PARSING_CODE, NETINDEX_BITS); // end of actors/sprites
+        NetBuffer_WriteDeltaNetSector(netBuffer, fromSector, toSector);
+    }
 
+    NetBuffer_WriteNetIndex(netBuffer, NETSTRUCT_SECTOR, cSTOP_PARSING_CODE);
 }
 
 
@@ -3470,6 +4459,17 @@ static void NetBuffer_ReadDeltaWall(NetBuffer_t *netBuffer, const netWall_t *fro
         return;
     }
 
+    if (netBuffer->Coder != nullptr)
+    {
+        if (!NetBuffer_ReadCodedFields(netBuffer, NETSTRUCT_WALL, cFieldsArray, cStructFields, from, to))
+        {
+            Net_Error_Disconnect("NetBuffer_ReadDeltaWall: Invalid delta field count from client.");
+        }
+
+        to->netIndex = netIndex;
+        return;
+    }
+
     maxChgIndex = NetBuffer_ReadBits(netBuffer, STRUCTINDEX_BITS);
 
     if (maxChgIndex  > cStructFields || maxChgIndex < 0)
@@ -3555,6 +4555,17 @@ static void NetBuffer_ReadDeltaSector(NetBuffer_t *netBuffer, const netSector_t
         return;
     }
 
+    if (netBuffer->Coder != nullptr)
+    {
+        if (!NetBuffer_ReadCodedFields(netBuffer, NETSTRUCT_SECTOR, cFieldsArray, cStructFields, from, to))
+        {
+            Net_Error_Disconnect("NetBuffer_ReadDeltaSector: Invalid delta field count from client.");
+        }
+
+        to->netIndex = netIndex;
+        return;
+    }
+
     maxChgIndex = NetBuffer_ReadBits(netBuffer, STRUCTINDEX_BITS);
 
     if (maxChgIndex  > cStructFields || maxChgIndex < 0)
@@ -3650,7 +4661,7 @@ static void NetBuffer_ReadDeltaActor(NetBuffer_t* netBuffer, const netactor_t *f
     }
 
 
-    removeActor = NetBuffer_ReadBits(netBuffer, 1);                                    // read actor deleted bit
+    removeActor = NetBuffer_ReadStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_DELETED);    // read actor deleted bit
 
                                                                                        // if this actor is being deleted, fill it with zeros and set its netIndex to STOP_PARSING_CODE
     if (removeActor == 1)
@@ -3660,7 +4671,7 @@ static void NetBuffer_ReadDeltaActor(NetBuffer_t* netBuffer, const netactor_t *f
         return;
     }
 
-    actorChanged = NetBuffer_ReadBits(netBuffer, 1);                                     // read actor changed bit
+    actorChanged = NetBuffer_ReadStructFlag(netBuffer, NETSTRUCT_ACTOR, NETSTRUCTFLAG_CHANGED);   // read actor changed bit
 
     to->netIndex = actorIndex;
 
@@ -3676,6 +4687,17 @@ static void NetBuffer_ReadDeltaActor(NetBuffer_t* netBuffer, const netactor_t *f
         return;
     }
 
+    if (netBuffer->Coder != nullptr)
+    {
+        if (!NetBuffer_ReadCodedFields(netBuffer, NETSTRUCT_ACTOR, cFieldsArray, cStructFields, from, to))
+        {
+            Net_Error_Disconnect("NetBuffer_ReadDeltaActor: Invalid delta field count from server.");
+        }
+
+        to->netIndex = actorIndex;
+        return;
+    }
+
     maxChgIndex = NetBuffer_ReadBits(netBuffer, STRUCTINDEX_BITS);                          // max change index
 
     if (maxChgIndex  > cStructFields || maxChgIndex < 0)
@@ -3777,7 +4799,7 @@ static void NetBuffer_ReadDeltaActor(NetBuffer_t* netBuffer, const netactor_t *f
 
 // Using oldSnapshot as the "From" snapshot, parse the data in netBuffer as a diff from
 // oldSnapshot to make newSnapshot.
-static void Net_ParseWalls(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot, netmapstate_t *newSnapshot)
+static void Net_ParseWalls(NetBuffer_t *netBuffer, const netmapstate_t *oldSnapshot, netmapstate_t *newSnapshot)
 {
     Bassert(oldSnapshot != nullptr);
     Bassert(newSnapshot != nullptr);
@@ -3787,7 +4809,7 @@ static void Net_ParseWalls(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot, n
 
 
 
-    netWall_t       *oldSnapshotStruct = NULL;
+    const netWall_t *oldSnapshotStruct = NULL;
     netWall_t       *newSnapshotStruct = NULL;
 
     const   int32_t         cMaxStructIndex = numwalls - 1;
@@ -3810,7 +4832,7 @@ static void Net_ParseWalls(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot, n
     while (1)
     {
         // read the netIndex of this struct
-        newSnapshotNetIndex = NetBuffer_ReadBits(netBuffer, NETINDEX_BITS);
+        newSnapshotNetIndex = NetBuffer_ReadNetIndex(netBuffer, NETSTRUCT_WALL);
 
         if (newSnapshotNetIndex < 0)
         {
@@ -3895,7 +4917,7 @@ static void Net_ParseWalls(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot, n
 
 }
 
-static void Net_ParseSectors(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot, netmapstate_t *newSnapshot)
+static void Net_ParseSectors(NetBuffer_t *netBuffer, const netmapstate_t *oldSnapshot, netmapstate_t *newSnapshot)
 {
     Bassert(oldSnapshot != nullptr);
     Bassert(newSnapshot != nullptr);
@@ -3905,8 +4927,8 @@ static void Net_ParseSectors(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot,
 
 
 
-    netSector_t     *oldSnapshotStruct = NULL;
-    netSector_t     *newSnapshotStruct = NULL;
+    const netSector_t *oldSnapshotStruct = NULL;
+    netSector_t       *newSnapshotStruct = NULL;
 
     const   int32_t         cMaxStructIndex = numsectors - 1;
 
@@ -3928,7 +4950,7 @@ static void Net_ParseSectors(NetBuffer_t *netBuffer, netmapstate_t *oldSnapshot,
     while (1)
     {
         // read the netIndex of this struct
-        newSnapshotNetIndex = NetBuffer_ReadBits(netBuffer, NETINDEX_BITS);
+        newSnapshotNetIndex = NetBuffer_ReadNetIndex(netBuffer, NETSTRUCT_SECTOR);
 
         //================================================================
         // DEBUG ONLY
@@ -4063,7 +5085,7 @@ static void Net_ParseActors(NetBuffer_t *netBuffer, const netmapstate_t* oldSnap
     //i.e., for each actor in the actors section of the packet...
     while (1)
     {
-        newActorIndex = NetBuffer_ReadBits(netBuffer, NETINDEX_BITS);
+        newActorIndex = NetBuffer_ReadNetIndex(netBuffer, NETSTRUCT_ACTOR);
 
         //================================================================
         // DEBUG ONLY
@@ -4157,7 +5179,7 @@ static void Net_ParseActors(NetBuffer_t *netBuffer, const netmapstate_t* oldSnap
 
 
 
-static void NetBuffer_ReadWorldSnapshotFromBuffer(NetBuffer_t* netBuffer, netmapstate_t* oldSnapshot, netmapstate_t* newSnapshot)
+static void NetBuffer_ReadWorldSnapshotFromBuffer(NetBuffer_t* netBuffer, const netmapstate_t* oldSnapshot, netmapstate_t* newSnapshot)
 {
     Bassert(oldSnapshot != nullptr);
     Bassert(newSnapshot != nullptr);
@@ -4170,83 +5192,232 @@ static void NetBuffer_ReadWorldSnapshotFromBuffer(NetBuffer_t* netBuffer, netmap
 }
 
 
-static void Net_SendWorldUpdate(uint32_t fromRevisionNumber, uint32_t toRevisionNumber, int32_t sendToPlayerIndex)
+// returns the revision a client's update should be delta encoded from, given the last one it acknowledged
+static uint32_t Net_GetWorldUpdateBase(uint32_t fromRevisionNumber, uint32_t toRevisionNumber, int32_t playerIndex)
+{
+    Bassert(NET_REVISIONS == ARRAY_SIZE(g_mapStateHistory));
+
+    // actors the client has an older copy of may go back another NET_MAXDEFERRED revisions
+    uint32_t        playerRevisionIsTooOld = (toRevisionNumber - fromRevisionNumber) > NET_REVISIONS - NET_MAXDEFERRED;
+
+    // to avoid the client thinking that revision 2 is older than revision 0xFFFF_FFFF,
+    // send packets to take the client from the map's initial state until the client reports back
+    // that it's beyond that rollover threshold.
+    uint32_t        revisionInRolloverState = (fromRevisionNumber > toRevisionNumber);
+
+    NET_75_CHECK++; // during the rollover state it might be a good idea to init the map state history?
+                    // maybe not? I do init map states before using them, so it might not be needed.
+
+    if (playerRevisionIsTooOld || revisionInRolloverState || !Net_HaveClientView(playerIndex, fromRevisionNumber))
+    {
+        return cInitialMapStateRevisionNumber;
+    }
+
+    return fromRevisionNumber;
+}
+
+// encodes the packet type, revision numbers, walls and sectors shared by all updates from prefix->fromRevisionNumber
+static void Net_WriteWorldPrefix(networldprefix_t* prefix, uint32_t toRevisionNumber)
+{
+    const netmaprevision_t* fromRevision = Net_GetMapRevision(prefix->fromRevisionNumber);
+    const netmaprevision_t* toRevision   = Net_GetMapRevision(toRevisionNumber);
+
+    Bassert(fromRevision != nullptr);
+    Bassert(toRevision != nullptr);
+
+    NetBuffer_t buffer;
+
+    prefix->data[0] = prefix->coded ? PACKET_WORLD_UPDATE_CODED : PACKET_WORLD_UPDATE;
+
+    NetBuffer_Init(&buffer, &prefix->data[1], MAX_WORLDBUFFER);
+
+    NetBuffer_WriteDword(&buffer, prefix->fromRevisionNumber);
+    NetBuffer_WriteDword(&buffer, toRevisionNumber);
+
+    if (prefix->coded)
+    {
+        NetBuffer_StartEncoding(&buffer, prefix->coder);
+    }
+
+    Net_WriteMapToBuffer(&buffer, fromRevision, toRevision);
+
+    prefix->bitLength = buffer.Bit;
+}
+
+// copies the shared part of a client's update into its packet buffer and appends the client's actors
+static void Net_WriteWorldUpdate(networldupdate_t* update, uint32_t toRevisionNumber)
+{
+    const networldprefix_t* prefix = &g_netWorldPrefix[update->prefixIndex];
+    uint8_t* const          packet = g_netPacketBuffer[update->playerIndex];
+
+    NetBuffer_t buffer;
+
+    NetBuffer_Init(&buffer, &packet[1], MAX_WORLDBUFFER);
+
+    if (prefix->coded)
+    {
+        // the bytes the coder has yet to output are part of its state
+        netcoder_t* const coder = g_netClientView[update->playerIndex]->coder;
+
+        *coder = *prefix->coder;
+        Bmemcpy(packet, prefix->data, 1 + coder->pos);
+
+        buffer.Coder   = coder;
+        buffer.CurSize = coder->pos;
+    }
+    else
+    {
+        // PutBit() clears each byte as it starts on it, so the unused bits of the last one are zero
+        Bmemcpy(packet, prefix->data, 1 + ((prefix->bitLength + 7) >> 3));
+
+        buffer.Bit     = prefix->bitLength;
+        buffer.CurSize = (buffer.Bit >> 3) + 1;
+    }
+
+    Net_WriteRelevantActorsToBuffer(&buffer, update->playerIndex, update->fromRevisionNumber, toRevisionNumber);
+
+    NetBuffer_WriteNetIndex(&buffer, NETSTRUCT_ACTOR, cSTOP_PARSING_CODE); // end of actors/sprites
+
+    if (prefix->coded)
+    {
+        NetBuffer_FinishEncoding(&buffer);
+    }
+
+    update->packetSize = buffer.CurSize + 1;
+}
+
+static void Net_SetupEncodePool(int32_t const numThreads)
 {
-    if (sendToPlayerIndex == myconnectindex)
+    if (numThreads == g_netEncodePoolThreads)
     {
         return;
     }
 
-    Bassert(tempnetbuf != nullptr);
-    Bassert(NET_REVISIONS == ARRAY_SIZE(g_mapStateHistory));
+    delete g_netEncodePool;
+    g_netEncodePool = nullptr;
 
-    uint32_t        playerRevisionIsTooOld = (toRevisionNumber - fromRevisionNumber) > NET_REVISIONS;
+    // the main thread encodes updates too
+    if ((g_netEncodePoolThreads = numThreads) > 1)
+    {
+        g_netEncodePool = new async::threadpool_scheduler(numThreads - 1);
+    }
+}
 
-    // to avoid the client thinking that revision 2 is older than revision 0xFFFF_FFFF,
-    // send packets to take the client from the map's initial state until the client reports back
-    // that it's beyond that rollover threshold.
-    uint32_t        revisionInRolloverState = (fromRevisionNumber > toRevisionNumber);
+template <typename Func>
+static void Net_RunEncodeJobs(int32_t const numJobs, Func func)
+{
+    if (g_netEncodePool == nullptr || numJobs < 2)
+    {
+        for (int32_t jobIndex = 0; jobIndex < numJobs; jobIndex++)
+        {
+            func(jobIndex);
+        }
 
+        return;
+    }
 
-    NetBuffer_t     buffer;
-    NetBuffer_t*    bufferPtr = &buffer;
+    async::parallel_for(*g_netEncodePool, async::irange(0, numJobs), func);
+}
 
-    // note: not enough stack memory to put the world data as a local variable
-    uint8_t*        byteBuffer = &tempnetbuf[1];
+// encodes this revision's update for every client, concurrently if net_encodethreads allows, and sends them
+static void Net_SendWorldUpdates(uint32_t toRevisionNumber)
+{
+    Bassert(Net_GetMapRevision(toRevisionNumber) != nullptr);
 
+    int32_t numUpdates  = 0;
+    int32_t numPrefixes = 0;
+    int32_t playerIndex = 0;
 
-    uint32_t        fromRevisionNumberToSend = 0x86753090;
+    for (TRAVERSE_CONNECT(playerIndex))
+    {
+        if (playerIndex == myconnectindex)
+        {
+            // there's no point in the server sending itself a snapshot.
+            continue;
+        }
 
-    netmapstate_t*  toMapState = g_mapStateHistory[toRevisionNumber % NET_REVISIONS];
-    netmapstate_t*  fromMapState = NULL;
+        if (playerIndex > ((int32_t) g_netServer->peerCount))
+        {
+            Net_Error_Disconnect("No peer for player.");
+            continue;
+        }
 
-    Bassert(toMapState != nullptr);
+        uint32_t const fromRevisionNumber = Net_GetWorldUpdateBase(g_player[playerIndex].revision, toRevisionNumber, playerIndex);
+        int32_t const  coded              = g_netRangeCoder && (g_netPlayerProtocolFlags[playerIndex] & NETPROTOCOL_RANGECODER);
 
-    NET_75_CHECK++; // during the rollover state it might be a good idea to init the map state history?
-                    // maybe not? I do init map states before using them, so it might not be needed.
+        int32_t prefixIndex = 0;
 
+        while (prefixIndex < numPrefixes
+               && (g_netWorldPrefix[prefixIndex].fromRevisionNumber != fromRevisionNumber || g_netWorldPrefix[prefixIndex].coded != coded))
+        {
+            prefixIndex++;
+        }
 
-    if (playerRevisionIsTooOld || revisionInRolloverState)
-    {
-        fromMapState = g_mapStartState;
-        fromRevisionNumberToSend = cInitialMapStateRevisionNumber;
-    }
-    else
-    {
-        uint32_t tFromRevisionIndex = fromRevisionNumber % NET_REVISIONS;
+        if (prefixIndex == numPrefixes)
+        {
+            networldprefix_t* const prefix = &g_netWorldPrefix[numPrefixes++];
 
-        fromMapState = g_mapStateHistory[tFromRevisionIndex];
-        fromRevisionNumberToSend = fromRevisionNumber;
-    }
+            // note: not enough stack memory to put the world data as a local variable
+            if (prefix->data == nullptr)
+            {
+                prefix->data = (uint8_t *)Xmalloc(MAX_WORLDBUFFER + 1);
+            }
 
-    Bassert(fromMapState != nullptr);
+            if (coded && prefix->coder == nullptr)
+            {
+                prefix->coder = (netcoder_t *)Xmalloc(sizeof(netcoder_t));
+            }
 
-    Bmemset(byteBuffer, 0, sizeof(tempnetbuf) - 1);
+            prefix->fromRevisionNumber = fromRevisionNumber;
+            prefix->coded              = coded;
+        }
 
-    tempnetbuf[0] = PACKET_WORLD_UPDATE;
+        if (g_netPacketBuffer[playerIndex] == nullptr)
+        {
+            g_netPacketBuffer[playerIndex] = (uint8_t *)Xmalloc(MAX_WORLDBUFFER + 1);
+        }
 
-    NetBuffer_Init(bufferPtr, byteBuffer, MAX_WORLDBUFFER);
+        if (g_netClientView[playerIndex] == nullptr)
+        {
+            g_netClientView[playerIndex] = (netclientview_t *)Xcalloc(1, sizeof(netclientview_t));
+        }
 
-    NetBuffer_WriteDword(bufferPtr, fromRevisionNumberToSend);
-    NetBuffer_WriteDword(bufferPtr, toRevisionNumber);
+        if (coded && g_netClientView[playerIndex]->coder == nullptr)
+        {
+            g_netClientView[playerIndex]->coder = (netcoder_t *)Xmalloc(sizeof(netcoder_t));
+        }
 
-    Net_WriteWorldToBuffer(bufferPtr, fromMapState, toMapState);
+        g_netWorldUpdate[numUpdates++] = { playerIndex, fromRevisionNumber, prefixIndex, 0 };
+    }
 
-    if (sendToPlayerIndex > ((int32_t) g_netServer->peerCount))
+    if (numUpdates == 0)
     {
-        Net_Error_Disconnect("No peer for player.");
         return;
     }
 
+    // sectorsareconnected() builds its table on first use, which has to happen before the workers share it
+    if (numsectors > 0)
+    {
+        sectorsareconnected(0, 0);
+    }
+
+    Net_SetupEncodePool(g_netEncodeThreads);
+
+    Net_RunEncodeJobs(numPrefixes, [toRevisionNumber](int const prefixIndex) { Net_WriteWorldPrefix(&g_netWorldPrefix[prefixIndex], toRevisionNumber); });
+    Net_RunEncodeJobs(numUpdates, [toRevisionNumber](int const updateIndex) { Net_WriteWorldUpdate(&g_netWorldUpdate[updateIndex], toRevisionNumber); });
+
     // in the future we could probably use these flags for enet_peer_send, for the world updates
     EDUKE32_UNUSED const ENetPacketFlag optimizedFlags = (ENetPacketFlag)(ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
 
-    NET_75_CHECK++; // HACK: I Really need to keep the peer with the player instead of assuming that the peer index is the same as the (player index - 1)
-    ENetPeer *const tCurrentPeer = &g_netServer->peers[sendToPlayerIndex - 1];
-    enet_peer_send(tCurrentPeer, CHAN_GAMESTATE, enet_packet_create(&tempnetbuf, bufferPtr->CurSize + 1, 0));
-    Dbg_PacketSent(PACKET_WORLD_UPDATE);
-
+    for (int32_t updateIndex = 0; updateIndex < numUpdates; updateIndex++)
+    {
+        networldupdate_t const* update = &g_netWorldUpdate[updateIndex];
 
+        NET_75_CHECK++; // HACK: I Really need to keep the peer with the player instead of assuming that the peer index is the same as the (player index - 1)
+        ENetPeer *const tCurrentPeer = &g_netServer->peers[update->playerIndex - 1];
+        enet_peer_send(tCurrentPeer, CHAN_GAMESTATE, enet_packet_create(g_netPacketBuffer[update->playerIndex], update->packetSize, 0));
+        Dbg_PacketSent((DukePacket_t)g_netPacketBuffer[update->playerIndex][0]);
+    }
 }
 
 static void Net_CopySnapshotToGameArrays(netmapstate_t* srv_snapshot, netmapstate_t* cl_snapshot)
@@ -4336,7 +5507,7 @@ static void Net_ReadWorldUpdate(uint8_t* packetData, int32_t packetSize)
 
     uint32_t clientRevisionIsTooOld = (packetToRevisionNumber - g_netMapRevisionNumber) > NET_REVISIONS;
 
-    netmapstate_t* fromMapState = NULL;
+    const netmapstate_t* fromMapState = NULL;
 
     if (clientRevisionIsTooOld && !from_IsInitialState)
     {
@@ -4368,11 +5539,25 @@ static void Net_ReadWorldUpdate(uint8_t* packetData, int32_t packetSize)
     }
     else
     {
-        fromMapState = g_mapStateHistory[packetFromRevisionNumber % NET_REVISIONS];
+        // usually the update is from the revision the client has now, otherwise rebuild the one it is from
+        if (g_mapCurrentState->revisionNumber != packetFromRevisionNumber)
+        {
+            const netmaprevision_t* fromRevision = Net_GetMapRevision(packetFromRevisionNumber);
+
+            if (fromRevision == nullptr)
+            {
+                Net_Error_Disconnect("Internal Error: Net_ReadWorldUpdate(): Client From map state no longer in the history.");
+                return;
+            }
+
+            Net_LoadMapState(g_mapCurrentState, fromRevision);
+        }
+
+        fromMapState = g_mapCurrentState;
     }
 
 
-    netmapstate_t* toMapState = g_mapStateHistory[packetToRevisionNumber % NET_REVISIONS];
+    netmapstate_t* toMapState = g_cl_NextMapState;
     netmapstate_t* clMapState = g_cl_InterpolatedMapStateHistory[packetToRevisionNumber % NET_REVISIONS];
 
     Bassert(toMapState != nullptr);
@@ -4382,15 +5567,62 @@ static void Net_ReadWorldUpdate(uint8_t* packetData, int32_t packetSize)
 
     NET_DEBUG_VAR uint32_t DEBUG_OldClientRevision = g_netMapRevisionNumber;
 
+    if (packetData[0] == PACKET_WORLD_UPDATE_CODED)
+    {
+        NetBuffer_StartDecoding(bufferPtr, &g_cl_Coder);
+    }
+
     Bassert(fromMapState);
     NetBuffer_ReadWorldSnapshotFromBuffer(bufferPtr, fromMapState, toMapState);
 
+    Net_StoreMapState(&g_mapStateHistory[packetToRevisionNumber % NET_REVISIONS], toMapState, Net_GetMapRevision(packetFromRevisionNumber));
+
+    g_cl_NextMapState = g_mapCurrentState;
+    g_mapCurrentState = toMapState;
+
     g_netMapRevisionNumber = packetToRevisionNumber;
 
     Net_CopySnapshotToGameArrays(toMapState, clMapState);
 
 }
 
+// server only, see Net_WriteRelevantActorsToBuffer()
+static void Net_UpdateActorChangeRevisions(const netmaprevision_t* toRevision, const netmaprevision_t* prevRevision)
+{
+    uint32_t const revisionNumber = toRevision->revisionNumber;
+
+    if (prevRevision == nullptr)
+    {
+        // nothing to compare against, e.g. after a rollover
+        for (int32_t actorIndex = 0; actorIndex < MAXSPRITES; actorIndex++)
+        {
+            g_netActorChangeRevision[actorIndex] = revisionNumber;
+        }
+
+        return;
+    }
+
+    for (int32_t pageIndex = 0; pageIndex < (int32_t)ARRAY_SIZE(toRevision->actorPage); pageIndex++)
+    {
+        const netmappage_t<netactor_t>* toPage   = toRevision->actorPage[pageIndex];
+        const netmappage_t<netactor_t>* prevPage = prevRevision->actorPage[pageIndex];
+
+        if (toPage == prevPage)
+        {
+            // none of the actors in a shared page changed
+            continue;
+        }
+
+        for (int32_t recordIndex = 0; recordIndex < NET_MAPPAGE_RECORDS; recordIndex++)
+        {
+            if (memcmp(&toPage->record[recordIndex], &prevPage->record[recordIndex], sizeof(netactor_t)))
+            {
+                g_netActorChangeRevision[pageIndex * NET_MAPPAGE_RECORDS + recordIndex] = revisionNumber;
+            }
+        }
+    }
+}
+
 // handles revision rollover
 static uint32_t Net_GetNextRevisionNumber(uint32_t currentNumber)
 {
@@ -4582,39 +5814,41 @@ void Net_StoreClientState(void)
 
 }
 
-void Net_SendMapUpdate(void)
+// takes the next revision of the map state from the game arrays
+static void Net_AddMapRevision(void)
 {
-    if (g_netClient || !g_netServer || numplayers < 2)
-    {
-        return;
-    }
+    uint32_t const prevRevisionNumber = g_netMapRevisionNumber;
 
     g_netMapRevisionNumber = Net_GetNextRevisionNumber(g_netMapRevisionNumber);
 
-    netmapstate_t* toMapState = g_mapStateHistory[g_netMapRevisionNumber % NET_REVISIONS];
+    netmapstate_t* toMapState = g_mapCurrentState;
 
     Bassert(toMapState != nullptr);
 
-    Net_InitMapState(toMapState);
+    // the walls and sectors past numwalls and numsectors keep the null states Net_InitMapStateHistory() gave them
     Net_AddWorldToSnapshot(toMapState);
 
     toMapState->revisionNumber = g_netMapRevisionNumber;
 
-    int32_t playerIndex = 0;
+    // revision numbers start over after a rollover, so the actor change revisions have to as well
+    const netmaprevision_t* prevRevision = (g_netMapRevisionNumber == prevRevisionNumber + 1) ? Net_GetMapRevision(prevRevisionNumber) : nullptr;
+    netmaprevision_t*       toRevision   = &g_mapStateHistory[g_netMapRevisionNumber % NET_REVISIONS];
 
-    for (TRAVERSE_CONNECT(playerIndex))
-    {
-        if (playerIndex == myconnectindex)
-        {
-            // there's no point in the server sending itself a snapshot.
-            continue;
-        }
+    Net_StoreMapState(toRevision, toMapState, prevRevision);
 
-        uint32_t playerRevisionNumber = g_player[playerIndex].revision;
+    Net_UpdateActorChangeRevisions(toRevision, prevRevision);
+}
 
-        Net_SendWorldUpdate(playerRevisionNumber, g_netMapRevisionNumber, playerIndex);
+void Net_SendMapUpdate(void)
+{
+    if (g_netClient || !g_netServer || numplayers < 2)
+    {
+        return;
     }
 
+    Net_AddMapRevision();
+
+    Net_SendWorldUpdates(g_netMapRevisionNumber);
 }
 
 
@@ -4636,10 +5870,23 @@ void DumpMapStateHistory()
     // write the null map state (it should never, ever be changed, but just for completeness sake
     // fwrite(&NullMapState, sizeof(NullMapState), 1, mapStatesFile);
 
-    fwrite(g_mapStartState, sizeof(g_mapStartState), 1, mapStatesFile);
+    fwrite(g_mapStartState, sizeof(netmapstate_t), 1, mapStatesFile);
+
+    auto mapState = (netmapstate_t *)Xmalloc(sizeof(netmapstate_t));
 
     for (int mapStateIndex = 0; mapStateIndex < NET_REVISIONS; mapStateIndex++)
-        fwrite(g_mapStateHistory[mapStateIndex], sizeof(netmapstate_t), 1, mapStatesFile);
+    {
+        const netmaprevision_t* revision = &g_mapStateHistory[mapStateIndex];
+
+        if (revision->revisionNumber != cInitialMapStateRevisionNumber)
+            Net_LoadMapState(mapState, revision);
+        else
+            Net_InitMapState(mapState);
+
+        fwrite(mapState, sizeof(netmapstate_t), 1, mapStatesFile);
+    }
+
+    Xfree(mapState);
 
     OSD_Printf("Dumped map states to %s.\n", fileName);
 
@@ -4784,6 +6031,9 @@ void Net_Connect(const char *srvaddr)
 void Net_AddWorldToInitialSnapshot()
 {
     Net_AddWorldToSnapshot(g_mapStartState);
+
+    // most of the map never changes, so the revisions stored against this one mostly consist of its pages
+    Net_StoreMapState(&g_mapStartRevision, g_mapStartState, nullptr);
 }
 
 void Net_SendClientInfo(void)
@@ -5154,34 +6404,60 @@ void Net_SendMessage(void)
 }
 
 
+// the part of Net_InitMapStateHistory() that does not concern the client's interpolation
+static void Net_InitMapRevisions(void)
+{
+    for (netmaprevision_t& revision : g_mapStateHistory)
+    {
+        Net_ClearMapRevision(&revision);
+    }
+
+    if (g_mapStartState == nullptr)
+        g_mapStartState = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
+
+    if (g_mapCurrentState == nullptr)
+        g_mapCurrentState = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
+
+    if (g_cl_NextMapState == nullptr)
+        g_cl_NextMapState = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
+
+    Net_InitMapState(g_mapStartState);
+    Net_InitMapState(g_mapCurrentState);
+    Net_InitMapState(g_cl_NextMapState);
+
+    g_mapStartState->revisionNumber = cInitialMapStateRevisionNumber;
+
+    Net_StoreMapState(&g_mapStartRevision, g_mapStartState, nullptr);
+
+    g_netMapRevisionNumber = cInitialMapStateRevisionNumber;  // Net_InitMapStateHistory()
+
+    Bmemset(g_netActorChangeRevision, 0, sizeof(g_netActorChangeRevision));
+
+    for (netclientview_t* view : g_netClientView)
+    {
+        if (view != nullptr)
+        {
+            Bmemset(view->revision, 0, sizeof(view->revision));
+        }
+    }
+}
+
 void Net_InitMapStateHistory()
 {
     int32_t mapStateIndex = 0;
 
     for (mapStateIndex = 0; mapStateIndex < NET_REVISIONS; mapStateIndex++)
     {
-        if (g_mapStateHistory[mapStateIndex] == nullptr)
-            g_mapStateHistory[mapStateIndex] = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
-
-        netmapstate_t *mapState = g_mapStateHistory[mapStateIndex];
-
         if (g_cl_InterpolatedMapStateHistory[mapStateIndex] == nullptr)
             g_cl_InterpolatedMapStateHistory[mapStateIndex] = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
 
         netmapstate_t *clState  = g_cl_InterpolatedMapStateHistory[mapStateIndex];
 
-        Net_InitMapState(mapState);
         Net_InitMapState(clState);
     }
 
-    if (g_mapStartState == nullptr)
-        g_mapStartState = (netmapstate_t *)Xcalloc(1, sizeof(netmapstate_t));
-
-    Net_InitMapState(g_mapStartState);
-
-    g_mapStartState->revisionNumber = cInitialMapStateRevisionNumber;
+    Net_InitMapRevisions();
 
-    g_netMapRevisionNumber    = cInitialMapStateRevisionNumber;  // Net_InitMapStateHistory()
     g_cl_InterpolatedRevision = cInitialMapStateRevisionNumber;
 }
 
@@ -5235,6 +6511,201 @@ void Net_NotifyNewGame()
     //              The client didn't load the map until G_EnterLevel
 }
 
+// Loopback world update benchmark ("-benchnet", see benchsim.h)
+//
+// Every tic becomes a map revision like on a server, and the update from the previous revision to it is encoded
+// both ways and decoded into client states of their own, which are checked against the server's. Unlike a real
+// server every changed actor is sent, as there is no player to judge relevance by.
+
+netbenchstats_t g_netBenchStats;
+
+static netmapstate_t* g_netBenchClientState[2];
+static netmapstate_t* g_netBenchDecodedState;
+static uint8_t*       g_netBenchBuffer;
+static netcoder_t     g_netBenchCoder;
+
+// returns the size of the packet
+static int32_t Net_BenchEncode(int32_t coded, uint32_t fromRevisionNumber, uint32_t toRevisionNumber)
+{
+    const netmaprevision_t* fromRevision = Net_GetMapRevision(fromRevisionNumber);
+    const netmaprevision_t* toRevision   = Net_GetMapRevision(toRevisionNumber);
+
+    NetBuffer_t buffer;
+
+    g_netBenchBuffer[0] = coded ? PACKET_WORLD_UPDATE_CODED : PACKET_WORLD_UPDATE;
+
+    NetBuffer_Init(&buffer, &g_netBenchBuffer[1], MAX_WORLDBUFFER);
+
+    NetBuffer_WriteDword(&buffer, fromRevisionNumber);
+    NetBuffer_WriteDword(&buffer, toRevisionNumber);
+
+    if (coded)
+    {
+        NetBuffer_StartEncoding(&buffer, &g_netBenchCoder);
+    }
+
+    Net_WriteMapToBuffer(&buffer, fromRevision, toRevision);
+
+    for (int32_t actorIndex = 0; actorIndex < MAXSPRITES; actorIndex++)
+    {
+        if (g_netActorChangeRevision[actorIndex] != toRevisionNumber)
+        {
+            continue;
+        }
+
+        const netactor_t* fromActor = Net_GetRevisionActor(fromRevision, actorIndex);
+        const netactor_t* toActor   = Net_GetRevisionActor(toRevision, actorIndex);
+
+        NetBuffer_WriteDeltaNetActor(&buffer, (fromActor->netIndex == cSTOP_PARSING_CODE) ? NULL : fromActor,
+                                              (toActor->netIndex == cSTOP_PARSING_CODE) ? NULL : toActor, 0);
+    }
+
+    NetBuffer_WriteNetIndex(&buffer, NETSTRUCT_ACTOR, cSTOP_PARSING_CODE);
+
+    if (coded)
+    {
+        NetBuffer_FinishEncoding(&buffer);
+    }
+
+    return buffer.CurSize + 1;
+}
+
+static void Net_BenchDecode(int32_t packetSize, const netmapstate_t* fromMapState, netmapstate_t* toMapState)
+{
+    NetBuffer_t buffer;
+
+    NetBuffer_Init(&buffer, &g_netBenchBuffer[1], MAX_WORLDBUFFER);
+
+    buffer.CurSize = packetSize - 1;
+
+    NetBuffer_ReadDWord(&buffer);
+    NetBuffer_ReadDWord(&buffer);
+
+    if (g_netBenchBuffer[0] == PACKET_WORLD_UPDATE_CODED)
+    {
+        NetBuffer_StartDecoding(&buffer, &g_netBenchCoder);
+    }
+
+    NetBuffer_ReadWorldSnapshotFromBuffer(&buffer, fromMapState, toMapState);
+}
+
+// whether a decoded struct holds what was sent, to the width each field is sent with
+static bool Net_BenchFieldsMatch(const netField_t* fields, int32_t numFields, const void* decoded, const void* sent)
+{
+    for (int32_t fieldIndex = 0; fieldIndex < numFields; fieldIndex++)
+    {
+        const netField_t* field         = &fields[fieldIndex];
+        uint32_t const    decodedValue  = *(const uint32_t *)((const int8_t *)decoded + field->offset);
+        uint32_t const    sentValue     = *(const uint32_t *)((const int8_t *)sent + field->offset);
+
+        if (field->bits == 0 ? Net_FloatBits(decodedValue) != Net_FloatBits(sentValue)
+                             : ((decodedValue ^ sentValue) & (0xffffffff >> (32 - field->bits))) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool Net_BenchStatesMatch(const netmapstate_t* decoded, const netmapstate_t* sent)
+{
+    for (int32_t index = 0; index < numwalls; index++)
+    {
+        if (!Net_BenchFieldsMatch(WallFields, ARRAY_SIZE(WallFields), &decoded->wall[index], &sent->wall[index]))
+        {
+            return false;
+        }
+    }
+
+    for (int32_t index = 0; index < numsectors; index++)
+    {
+        if (!Net_BenchFieldsMatch(SectorFields, ARRAY_SIZE(SectorFields), &decoded->sector[index], &sent->sector[index]))
+        {
+            return false;
+        }
+    }
+
+    for (int32_t index = 0; index < MAXSPRITES; index++)
+    {
+        const netactor_t* decodedActor = &decoded->actor[index];
+        const netactor_t* sentActor    = &sent->actor[index];
+
+        if (decodedActor->netIndex != sentActor->netIndex)
+        {
+            return false;
+        }
+
+        if (sentActor->netIndex != cSTOP_PARSING_CODE && !Net_BenchFieldsMatch(ActorFields, ARRAY_SIZE(ActorFields), decodedActor, sentActor))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Net_BenchReset(void)
+{
+    Net_InitMapRevisions();
+    Net_AddWorldToInitialSnapshot();
+
+    for (netmapstate_t*& clientState : g_netBenchClientState)
+    {
+        if (clientState == nullptr)
+            clientState = (netmapstate_t *)Xmalloc(sizeof(netmapstate_t));
+
+        // the clients load the same map
+        Bmemcpy(clientState, g_mapStartState, sizeof(netmapstate_t));
+    }
+
+    if (g_netBenchDecodedState == nullptr)
+        g_netBenchDecodedState = (netmapstate_t *)Xmalloc(sizeof(netmapstate_t));
+
+    if (g_netBenchBuffer == nullptr)
+        g_netBenchBuffer = (uint8_t *)Xmalloc(MAX_WORLDBUFFER + 1);
+
+    Bmemset(&g_netBenchStats, 0, sizeof(g_netBenchStats));
+}
+
+void Net_BenchWorldUpdate(void)
+{
+    uint32_t const fromRevisionNumber = g_netMapRevisionNumber;
+
+    Net_AddMapRevision();
+
+    for (int32_t coded = 0; coded < 2; coded++)
+    {
+        uint64_t const encodeStart = timerGetPerformanceCounter();
+        int32_t const  packetSize  = Net_BenchEncode(coded, fromRevisionNumber, g_netMapRevisionNumber);
+        uint64_t const decodeStart = timerGetPerformanceCounter();
+
+        Net_BenchDecode(packetSize, g_netBenchClientState[coded], g_netBenchDecodedState);
+
+        g_netBenchStats.decodeTicks[coded] += timerGetPerformanceCounter() - decodeStart;
+        g_netBenchStats.encodeTicks[coded] += decodeStart - encodeStart;
+        g_netBenchStats.bytes[coded]       += packetSize;
+
+        if (!Net_BenchStatesMatch(g_netBenchDecodedState, g_mapCurrentState))
+        {
+            if (g_netBenchStats.mismatches[coded]++ == 0)
+            {
+                LOG_F(WARNING, "benchnet: %s update to revision %u decoded wrong.", coded ? "range coded" : "plain", g_netMapRevisionNumber);
+            }
+
+            // start the next update from the right state again
+            Bmemcpy(g_netBenchDecodedState, g_mapCurrentState, sizeof(netmapstate_t));
+        }
+
+        netmapstate_t* const clientState = g_netBenchDecodedState;
+
+        g_netBenchDecodedState       = g_netBenchClientState[coded];
+        g_netBenchClientState[coded] = clientState;
+    }
+
+    g_netBenchStats.updates++;
+}
+
 #endif
 
 //-------------------------------------------------------------------------------------------------
@@ -34,7 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "enet.h"
 
 // net packet specification/compatibility version
-#define NETVERSION    1
+#define NETVERSION    2
 
 extern ENetHost       *g_netClient;
 extern ENetHost       *g_netServer;
@@ -45,6 +45,10 @@ extern int32_t        g_netPlayersWaiting;
 extern enet_uint16    g_netPort;
 extern int32_t        g_networkMode;
 extern int32_t        g_netIndex;
+extern int32_t        g_netRelevanceDist;
+extern int32_t        g_netActorBudget;
+extern int32_t        g_netEncodeThreads;
+extern int32_t        g_netRangeCoder;
 
 #define NET_REVISIONS 64
 
@@ -73,6 +77,7 @@ enum DukePacket_t
     PACKET_PLAYER_PING,
     PACKET_PLAYER_READY,
     PACKET_WORLD_UPDATE, //[75]
+    PACKET_WORLD_UPDATE_CODED,
 
     // any packet with an ID higher than PACKET_BROADCAST is rebroadcast by server
     // so hacked clients can't create fake server packets and get the server to
@@ -94,6 +99,12 @@ enum DukePacket_t
 
 
 
+// optional features a client supports, sent with PACKET_AUTH
+enum netprotocol_t
+{
+    NETPROTOCOL_RANGECODER = 1, // PACKET_WORLD_UPDATE_CODED
+};
+
 enum netdisconnect_t
 {
     DISC_BAD_PASSWORD = 1,
@@ -294,6 +305,22 @@ void DumpMapStateHistory();
 
 void Net_WaitForInitialSnapshot();
 
+// -benchnet, see benchsim.h; index 1 of the arrays is for range coded updates
+typedef struct
+{
+    int32_t  updates;
+    int32_t  mismatches[2];
+    uint64_t bytes[2];
+    uint64_t encodeTicks[2];
+    uint64_t decodeTicks[2];
+} netbenchstats_t;
+
+extern netbenchstats_t g_netBenchStats;
+
+void Net_BenchReset(void);
+// adds a map revision from the game arrays and times encoding and decoding the update to it
+void Net_BenchWorldUpdate(void);
+
 #else
 
 // note: don't include faketimerhandler in this
@@ -342,6 +369,8 @@ void Net_WaitForInitialSnapshot();
 #define Net_InitMapStateHistory(...) ((void)0)
 #define Net_AddWorldToInitialSnapshot(...) ((void)0)
 #define DumpMapStateHistory(...) ((void)0)
+#define Net_BenchReset(...) ((void)0)
+#define Net_BenchWorldUpdate(...) ((void)0)
 
 
 
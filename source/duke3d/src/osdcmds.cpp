@@ -31,6 +31,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "osdfuncs.h"
 #include "savegame.h"
 #include "sbar.h"
+#include "vmprofile.h"
 
 #ifdef EDUKE32_TOUCH_DEVICES
 #include "in_android.h"
@@ -418,6 +419,15 @@ static int osdcmd_restartsound(osdcmdptr_t UNUSED(parm))
     return OSDCMD_OK;
 }
 
+static int osdcmd_soundcachestats(osdcmdptr_t UNUSED(parm))
+{
+    UNREFERENCED_CONST_PARAMETER(parm);
+
+    S_PrintSoundCacheStats();
+
+    return OSDCMD_OK;
+}
+
 static int osdcmd_music(osdcmdptr_t parm)
 {
     if (parm->numparms == 1)
@@ -1341,6 +1351,47 @@ static int osdcmd_kickban(osdcmdptr_t parm)
 #endif
 #endif
 
+static int osdcmd_vm_profile_dump(osdcmdptr_t parm)
+{
+    if (parm->numparms > 2)
+        return OSDCMD_SHOWHELP;
+
+    char const *fileName = parm->numparms >= 1 ? parm->parms[0] : "vmprofile.txt";
+    int metric = VMPROF_TIME;
+
+    if (parm->numparms == 2)
+    {
+        if (!Bstrcasecmp(parm->parms[1], "instructions"))
+            metric = VMPROF_INSTRUCTIONS;
+        else if (Bstrcasecmp(parm->parms[1], "time"))
+            return OSDCMD_SHOWHELP;
+    }
+
+    int const numLines = VM_ProfileDump(fileName, metric);
+
+    if (numLines < 0)
+        LOG_F(ERROR, "Unable to open %s for writing.", fileName);
+    else
+        LOG_F(INFO, "Wrote %d stacks to %s.", numLines, fileName);
+
+    return OSDCMD_OK;
+}
+
+static int osdcmd_vm_profile_top(osdcmdptr_t parm)
+{
+    VM_ProfilePrintTop(parm->numparms == 1 ? max(Batoi(parm->parms[0]), 1) : 20);
+
+    return OSDCMD_OK;
+}
+
+static int osdcmd_vm_profile_reset(osdcmdptr_t UNUSED(parm))
+{
+    UNREFERENCED_CONST_PARAMETER(parm);
+    VM_ProfileReset();
+
+    return OSDCMD_OK;
+}
+
 static int osdcmd_purgesaves(osdcmdptr_t UNUSED(parm))
 {
     UNREFERENCED_CONST_PARAMETER(parm);
@@ -1384,6 +1435,10 @@ static int osdcmd_cvar_set_game(osdcmdptr_t parm)
             r_ambientlightrecip = 256.f;
         else r_ambientlightrecip = 1.f/r_ambientlight;
     }
+    else if (!Bstrcasecmp(parm->name, "vm_superinstructions"))
+    {
+        C_SetSuperInstructions(g_vm_superinstructions);
+    }
     else if (!Bstrcasecmp(parm->name, "in_mouse"))
     {
         CONTROL_MouseEnabled = (ud.setup.usemouse && CONTROL_MousePresent);
@@ -1607,6 +1662,11 @@ int32_t registerosdcommands(void)
         { "cl_autovote", "automatic vote yes for multiplayer map changes" CVAR_BOOL_OPTSTR, (void *)&ud.autovote, CVAR_BOOL, 0, 1 },
         { "cl_obituaries", "print player death messages in multiplayer" CVAR_BOOL_OPTSTR, (void *)&ud.obituaries, CVAR_BOOL, 0, 1 },
         { "cl_idplayers", "display player names when aiming at opponents in multiplayer" CVAR_BOOL_OPTSTR, (void *)&ud.idplayers, CVAR_BOOL, 0, 1 },
+
+        { "net_relevancedist", "distance within which a multiplayer server sends changed actors to a player right away, 0 to send everything", (void *)&g_netRelevanceDist, CVAR_INT, 0, 1048576 },
+        { "net_actorbudget", "most changed actors a multiplayer server sends to a player per update, 0 for no limit", (void *)&g_netActorBudget, CVAR_INT, 0, MAXSPRITES },
+        { "net_encodethreads", "number of threads a multiplayer server encodes world updates for its players on (0/1: disabled)", (void *)&g_netEncodeThreads, CVAR_INT, 0, 64 },
+        { "net_rangecoder", "range coded world updates, which are smaller but take longer to encode and decode; used when both ends enable it" CVAR_BOOL_OPTSTR, (void *)&g_netRangeCoder, CVAR_BOOL, 0, 1 },
 #endif
 
         { "cl_cheatmask", "bitmask controlling cheats unlocked in menu", (void *)&cl_cheatmask, CVAR_UINT, 0, ~0 },
@@ -1641,7 +1701,7 @@ int32_t registerosdcommands(void)
             "demorec_difftics","sets game tic interval after which a diff is recorded",
             (void *)&demorec_difftics_cvar, CVAR_INT, 2, 60*REALGAMETICSPERSEC
         },
-        { "demorec_diffcompress","Compression method for diffs. (0: none, 1: KSLZW)",(void *)&demorec_diffcompress_cvar, CVAR_BOOL, 0, 1 },
+        { "demorec_diffcompress","Compression method for diffs. (0: none, 1: LZ4)",(void *)&demorec_diffcompress_cvar, CVAR_BOOL, 0, 1 },
         { "demorec_synccompress","Compression method for input. (0: none, 1: KSLZW)",(void *)&demorec_synccompress_cvar, CVAR_BOOL, 0, 1 },
         { "demorec_seeds","record random seed for later sync checking" CVAR_BOOL_OPTSTR,(void *)&demorec_seeds_cvar, CVAR_BOOL, 0, 1 },
         { "demoplay_diffs","use diffs in demo playback" CVAR_BOOL_OPTSTR,(void *)&demoplay_diffs, CVAR_BOOL, 0, 1 },
@@ -1733,6 +1793,8 @@ int32_t registerosdcommands(void)
         { "snd_mixrate", "sound mixing rate", (void *)&ud.config.MixRate, CVAR_INT|CVAR_FUNCPTR, 0, 48000 },
         { "snd_numchannels", "the number of sound channels", (void *)&ud.config.NumChannels, CVAR_INT|CVAR_FUNCPTR, 0, 2 },
         { "snd_numvoices", "the number of concurrent sounds", (void *)&ud.config.NumVoices, CVAR_INT|CVAR_FUNCPTR, 1, MAXVOICES },
+        { "snd_pcmcache", "memory in KiB for keeping Ogg Vorbis and FLAC sound effects decoded, 0 to decode on every play", (void *)&g_soundCacheSize, CVAR_INT, 0, 262144 },
+        { "snd_pcmcachemaxsound", "largest decoded sound in KiB kept by snd_pcmcache", (void *)&g_soundCacheMaxSound, CVAR_INT, 0, 65536 },
 #ifdef ASS_REVERSESTEREO
         { "snd_reversestereo", "reverses the stereo channels", (void *)&ud.config.ReverseStereo, CVAR_BOOL, 0, 1 },
 #endif
@@ -1753,6 +1815,8 @@ int32_t registerosdcommands(void)
         { "touch_invert", "invert look up/down touch input", (void *) &droidinput.invertLook, CVAR_BOOL, 0, 1 },
 #endif
         { "vm_preempt", "drawing preempts CON VM" CVAR_BOOL_OPTSTR, (void *)&g_vm_preempt, CVAR_BOOL|CVAR_NOSAVE, 0, 1 },
+        { "vm_profile", "attribute CON VM time and instructions to events, actors and states" CVAR_BOOL_OPTSTR, (void *)&g_vm_profile, CVAR_BOOL|CVAR_NOSAVE, 0, 1 },
+        { "vm_superinstructions", "fuse common CON instruction sequences into superinstructions" CVAR_BOOL_OPTSTR, (void *)&g_vm_superinstructions, CVAR_BOOL|CVAR_FUNCPTR, 0, 1 },
         { "wchoice","weapon priority for automatically switching on empty or pickup", (void *)ud.wchoice, CVAR_STRING|CVAR_FUNCPTR, 0, MAX_WEAPONS },
     };
 
@@ -1841,6 +1905,7 @@ int32_t registerosdcommands(void)
         OSD_RegisterFunction("restartmap", "restartmap: restarts the current map", osdcmd_restartmap);
 
     OSD_RegisterFunction("restartsound","restartsound: reinitializes the sound system",osdcmd_restartsound);
+    OSD_RegisterFunction("soundcachestats","soundcachestats: prints decoded sound cache statistics",osdcmd_soundcachestats);
     OSD_RegisterFunction("restartvid","restartvid: reinitializes the video mode",osdcmd_restartvid);
     OSD_RegisterFunction("addlogvar","addlogvar <gamevar>: prints the value of a gamevar", osdcmd_addlogvar);
     OSD_RegisterFunction("setvar","setvar <gamevar> <value>: sets the value of a gamevar", osdcmd_setvar);
@@ -1854,6 +1919,9 @@ int32_t registerosdcommands(void)
     OSD_RegisterFunction("unbindall","unbindall: unbinds all keys", osdcmd_unbindall);
     OSD_RegisterFunction("unbound", NULL, osdcmd_unbound);
 
+    OSD_RegisterFunction("vm_profile_dump","vm_profile_dump [file] [time|instructions]: writes the vm_profile data in collapsed stack format for flame graph tools", osdcmd_vm_profile_dump);
+    OSD_RegisterFunction("vm_profile_reset","vm_profile_reset: clears the vm_profile data", osdcmd_vm_profile_reset);
+    OSD_RegisterFunction("vm_profile_top","vm_profile_top [count]: lists the CON code with the most self time", osdcmd_vm_profile_top);
     OSD_RegisterFunction("vidmode","vidmode <xdim> <ydim> <bpp> <fullscreen>: changes the video mode",osdcmd_vidmode);
 #ifdef USE_OPENGL
     baselayer_osdcmd_vidmode_func = osdcmd_vidmode;
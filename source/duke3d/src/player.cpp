@@ -5805,6 +5805,7 @@ HORIZONLY:;
     {
         pPlayer->pos.z += pPlayer->spritezoffset;
         sprite[pPlayer->i].xyz = pPlayer->pos;
+        spriteMarkChanged(pPlayer->i);
         pPlayer->pos.z -= pPlayer->spritezoffset;
 
         changespritesect(pPlayer->i, pPlayer->cursectnum);
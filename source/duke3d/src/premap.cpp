@@ -418,40 +418,52 @@ static void G_DoLoadScreen(const char *statustext, int percent)
     }
 }
 
-static void cacheExtraTextureMaps(int tileNum, int type)
-{
 #ifdef USE_OPENGL
+// cacheFunc is polymost_precache() or polymost_prefetch()
+static void cacheExtraTextureMaps(int tileNum, int type, void (*cacheFunc)(int32_t, int32_t, int32_t))
+{
     for (int i = 0; i < MAXPALOOKUPS-RESERVEDPALS-1; i++)
     {
 #ifdef POLYMER
         if (videoGetRenderMode() != REND_POLYMER || !polymer_havehighpalookup(0, i))
 #endif
-            polymost_precache(tileNum, i, type);
+            cacheFunc(tileNum, i, type);
     }
-#else
-    UNREFERENCED_PARAMETER(tileNum);
-    UNREFERENCED_PARAMETER(type);
-#endif
 
 #ifdef USE_GLEXT
     if (r_detailmapping)
-        polymost_precache(tileNum, DETAILPAL, type);
+        cacheFunc(tileNum, DETAILPAL, type);
 
     if (r_glowmapping)
-        polymost_precache(tileNum, GLOWPAL, type);
+        cacheFunc(tileNum, GLOWPAL, type);
 #endif
 #ifdef POLYMER
     if (videoGetRenderMode() == REND_POLYMER)
     {
         if (pr_specularmapping)
-            polymost_precache(tileNum, SPECULARPAL, type);
+            cacheFunc(tileNum, SPECULARPAL, type);
 
         if (pr_normalmapping)
-            polymost_precache(tileNum, NORMALPAL, type);
+            cacheFunc(tileNum, NORMALPAL, type);
     }
 #endif
 }
 
+// Keeps the worker threads busy decoding the replacement textures of the tiles
+// G_CacheMapData() is going to load next, while it uploads the current one.
+static void prefetchTiles(int *nextTile)
+{
+    for (; *nextTile < MAXTILES && !polymost_prefetchfull(); ++*nextTile)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            if (bitmap_test(precachehightile[j], *nextTile))
+                cacheExtraTextureMaps(*nextTile, j, polymost_prefetch);
+        }
+    }
+}
+#endif
+
 void G_CacheMapData(void)
 {
     if (ud.recstat == 2 || !ud.config.useprecache)
@@ -497,6 +509,9 @@ void G_CacheMapData(void)
     int cntDisplayed = -1;
     int pctDisplayed = -1;
     int i = 0;
+#ifdef USE_OPENGL
+    int prefetchTile = 0;
+#endif
 
     while (cnt < g_precacheCount)
     {
@@ -504,6 +519,14 @@ void G_CacheMapData(void)
         {
             cnt++;
 
+#ifdef USE_OPENGL
+            if (videoGetRenderMode() != REND_CLASSIC)
+            {
+                prefetchTile = max(prefetchTile, i);
+                prefetchTiles(&prefetchTile);
+            }
+#endif
+
             if (waloff[i] == 0)
                 tileLoad((int16_t)i);
 
@@ -512,12 +535,17 @@ void G_CacheMapData(void)
                 if (bitmap_test(precachehightile[j], i))
                 {
                     tileLoadScaled(i);
-
+#ifdef USE_OPENGL
                     if (videoGetRenderMode() != REND_CLASSIC)
-                        cacheExtraTextureMaps(i, j);
+                        cacheExtraTextureMaps(i, j, polymost_precache);
+#endif
                 }
             }
 
+#ifdef USE_OPENGL
+            polymost_prefetchrelease(i);
+#endif
+
             gameHandleEvents();
             if (KB_KeyPressed(sc_Space))
                 break;
@@ -534,6 +562,10 @@ void G_CacheMapData(void)
         }
     }
 
+#ifdef USE_OPENGL
+    polymost_prefetchrelease(MAXTILES);
+#endif
+
     Bmemset(gotpic, 0, sizeof(gotpic));
 
     LOG_F(INFO, "Cache time: %dms.", timerGetTicks() - cacheStartTime);
@@ -25,6 +25,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "prlights.h"
 #include "md4.h"
 #include "savegame.h"
+#include "sectorbvh.h"
+#include "spandiff.h"
+#include "spritegrid.h"
 
 #include "vfs.h"
 
@@ -1003,6 +1006,13 @@ static uint8_t savegame_comprthres;
 #define DS_SAVEFN 256  // .ptr is function that is run when saving
 #define DS_NOCHK 1024  // don't check for diffs (and don't write out in dump) since assumed constant throughout demo
 #define DS_PROTECTFN 512
+// diff only the records whose struct tracker revision moved since the last diff
+#define DS_TRACKSECT 2048
+#define DS_TRACKWALL 4096
+#define DS_TRACKSPRITE 8192
+// indexed by sprite but not tracked: diff the records of sprites in use or whose revision moved
+#define DS_LIVESPRITE 16384
+#define DS_TRACKMASK (DS_TRACKSECT|DS_TRACKWALL|DS_TRACKSPRITE|DS_LIVESPRITE)
 #define DS_END (0x70000000)
 
 static int32_t ds_getcnt(const dataspec_t *spec)
@@ -1169,6 +1179,58 @@ static int32_t readspecdata(const dataspec_t *spec, buildvfs_kfd fil, uint8_t **
 #define VAL(bits,p) (*(UINT(bits) const *)(p))
 #define WVAL(bits,p) (*(UINT(bits) *)(p))
 
+// Arrays are diffed as spans of changed elements, see spandiff.h.
+template <typename Dat>
+static uint8_t *sv_diffrecords(Dat const *p, Dat *op, uint32_t const recelts, uint32_t const cnt, uint8_t const *dirtymap, uint8_t *retdiff)
+{
+    uint32_t spanend = 0;
+
+    if (!dirtymap)
+        retdiff = spandiffEncode(p, op, 0, recelts * cnt, &spanend, retdiff);
+    else
+    {
+        for (uint32_t r = 0; r < cnt; r++)
+        {
+            if (!bitmap_test(dirtymap, r))
+                continue;
+
+            uint32_t const first = r;
+
+            while (r + 1 < cnt && bitmap_test(dirtymap, r + 1))
+                r++;
+
+            retdiff = spandiffEncode(p, op, first * recelts, (r + 1) * recelts, &spanend, retdiff);
+        }
+    }
+
+    *retdiff++ = 0;
+    return retdiff;
+}
+
+// diff an array of cnt records of the given size, only looking at the records set in dirtymap if it isn't NULL
+static void docmparray(const void *ptr, void *dump, uint32_t size, uint32_t cnt, uint8_t const *dirtymap, uint8_t **diffvar)
+{
+#define CPDATA(Datbits)                                                     \
+    do                                                                      \
+    {                                                                       \
+        auto           p       = (UINT(Datbits) const *)ptr;                \
+        auto           op      = (UINT(Datbits) *)dump;                     \
+        uint32_t const recelts = size / BYTES(Datbits);                     \
+        *diffvar = sv_diffrecords(p, op, recelts, cnt, dirtymap, *diffvar); \
+    } while (0)
+
+    if (size == 8)
+        CPDATA(64);
+    else if ((size & 3) == 0)
+        CPDATA(32);
+    else if ((size & 1) == 0)
+        CPDATA(16);
+    else
+        CPDATA(8);
+
+#undef CPDATA
+}
+
 static void docmpsd(const void *ptr, void *dump, uint32_t size, uint32_t cnt, uint8_t **diffvar)
 {
     uint8_t *retdiff = *diffvar;
@@ -1190,56 +1252,75 @@ static void docmpsd(const void *ptr, void *dump, uint32_t size, uint32_t cnt, ui
             case 1: CPSINGLEVAL(8); return;
         }
 
-#define CPELTS(Idxbits, Datbits)             \
-    do                                       \
-    {                                        \
-        for (int i = 0; i < nelts; i++)      \
-        {                                    \
-            if (*p != *op)                   \
-            {                                \
-                *op = *p;                    \
-                WVAL(Idxbits, retdiff) = i;  \
-                retdiff += BYTES(Idxbits);   \
-                WVAL(Datbits, retdiff) = *p; \
-                retdiff += BYTES(Datbits);   \
-            }                                \
-            p++;                             \
-            op++;                            \
-        }                                    \
-        WVAL(Idxbits, retdiff) = -1;         \
-        retdiff += BYTES(Idxbits);           \
-    } while (0)
+    docmparray(ptr, dump, size, cnt, NULL, diffvar);
 
-#define CPDATA(Datbits)                                                  \
-    do                                                                   \
-    {                                                                    \
-        auto p     = (UINT(Datbits) const *)ptr;                         \
-        auto op    = (UINT(Datbits) *)dump;                              \
-        int  nelts = tabledivide32_noinline(size * cnt, BYTES(Datbits)); \
-        if (nelts > 65536)                                               \
-            CPELTS(32, Datbits);                                         \
-        else if (nelts > 256)                                            \
-            CPELTS(16, Datbits);                                         \
-        else                                                             \
-            CPELTS(8, Datbits);                                          \
-    } while (0)
+#undef CPSINGLEVAL
+}
 
-    if (size == 8)
-        CPDATA(64);
-    else if ((size & 3) == 0)
-        CPDATA(32);
-    else if ((size & 1) == 0)
-        CPDATA(16);
-    else
-        CPDATA(8);
+#ifdef USE_STRUCT_TRACKERS
+// Struct tracker revisions as of the last snapshot or diff.  A record whose
+// revision hasn't moved since then still equals its copy in the dump, so the
+// DS_TRACK* specs only visit the records set in the dirty bitmaps.
+static uint32_t sv_sectorrev[MAXSECTORS];
+static uint32_t sv_wallrev[MAXWALLS];
+static uint32_t sv_spriterev[MAXSPRITES];
+static bool     sv_revvalid;
+
+static uint8_t sv_dirtysect[bitmap_size(MAXSECTORS)];
+static uint8_t sv_dirtywall[bitmap_size(MAXWALLS)];
+static uint8_t sv_dirtysprite[bitmap_size(MAXSPRITES)];
+static uint8_t sv_dirtylive[bitmap_size(MAXSPRITES)];
+
+static void sv_takerevisions(void)
+{
+    Bmemcpy(sv_sectorrev, sectorchanged, sizeof(sv_sectorrev));
+    Bmemcpy(sv_wallrev, wallchanged, sizeof(sv_wallrev));
+    Bmemcpy(sv_spriterev, spritechanged, sizeof(sv_spriterev));
+    sv_revvalid = true;
+}
 
-    *diffvar = retdiff;
+static void sv_makedirtymaps(void)
+{
+    Bmemset(sv_dirtysect, 0, sizeof(sv_dirtysect));
+    Bmemset(sv_dirtywall, 0, sizeof(sv_dirtywall));
+    Bmemset(sv_dirtysprite, 0, sizeof(sv_dirtysprite));
+    Bmemset(sv_dirtylive, 0, sizeof(sv_dirtylive));
 
-#undef CPELTS
-#undef CPSINGLEVAL
-#undef CPDATA
+    for (int i = 0; i < numsectors; i++)
+        if (sectorchanged[i] != sv_sectorrev[i])
+            bitmap_set(sv_dirtysect, i);
+
+    for (int i = 0; i < numwalls; i++)
+        if (wallchanged[i] != sv_wallrev[i])
+            bitmap_set(sv_dirtywall, i);
+
+    for (int i = 0; i < MAXSPRITES; i++)
+    {
+        bool const changed = spritechanged[i] != sv_spriterev[i];
+
+        if (changed)
+            bitmap_set(sv_dirtysprite, i);
+
+        // a sprite can only come into use or be freed through a statnum write
+        if (changed || sprite[i].statnum != MAXSTATUS)
+            bitmap_set(sv_dirtylive, i);
+    }
 }
 
+static uint8_t *sv_getdirtymap(int const flags)
+{
+    switch (flags & DS_TRACKMASK)
+    {
+        case DS_TRACKSECT: return sv_dirtysect;
+        case DS_TRACKWALL: return sv_dirtywall;
+        case DS_TRACKSPRITE: return sv_dirtysprite;
+        case DS_LIVESPRITE: return sv_dirtylive;
+    }
+
+    return NULL;
+}
+#endif
+
 // get the number of elements to be monitored for changes
 static int32_t getnumvar(const dataspec_t *spec)
 {
@@ -1257,6 +1338,9 @@ static void cmpspecdata(const dataspec_t *spec, uint8_t **dumpvar, uint8_t **dif
     uint8_t * diff   = *diffvar;
     int       nbytes = bitmap_size(getnumvar(spec));
     int const slen   = Bstrlen((const char *)spec->ptr);
+#if defined USE_STRUCT_TRACKERS && defined DEBUGGINGAIDS
+    auto const name  = (char const *)spec->ptr;
+#endif
 
     Bmemcpy(diff, spec->ptr, slen);
     diff += slen;
@@ -1291,7 +1375,25 @@ static void cmpspecdata(const dataspec_t *spec, uint8_t **dumpvar, uint8_t **dif
 
         uint8_t * const tmptr = diff;
 
-        docmpsd(ptr, dump, spec->size, cnt, &diff);
+#ifdef USE_STRUCT_TRACKERS
+        if ((spec->flags & DS_TRACKMASK) && sv_revvalid && cnt > 1)
+        {
+            uint8_t * const dirtymap = sv_getdirtymap(spec->flags);
+# ifdef DEBUGGINGAIDS
+            for (int i = 0; i < cnt; i++)
+            {
+                if (!bitmap_test(dirtymap, i) && Bmemcmp((uint8_t *)ptr + i * spec->size, dump + i * spec->size, spec->size))
+                {
+                    OSD_Printf("csd: %s spec %d record %d changed without a revision bump!\n", name, eltnum, i);
+                    bitmap_set(dirtymap, i);
+                }
+            }
+# endif
+            docmparray(ptr, dump, spec->size, cnt, dirtymap, &diff);
+        }
+        else
+#endif
+            docmpsd(ptr, dump, spec->size, cnt, &diff);
 
         if (diff != tmptr)
             (*diffvar + slen)[eltnum>>3] |= 1<<(eltnum&7);
@@ -1352,31 +1454,13 @@ static int32_t applydiff(const dataspec_t *spec, uint8_t **dumpvar, uint8_t **di
             }
         }
 
-#define CPELTS(Idxbits, Datbits)                             \
-    do                                                       \
-    {                                                        \
-        UINT(Idxbits) idx;                                   \
-        goto readidx_##Idxbits##_##Datbits;                  \
-        do                                                   \
-        {                                                    \
-            VALOFS(Datbits, dump, idx) = VAL(Datbits, diff); \
-            diff += BYTES(Datbits);                          \
-readidx_##Idxbits##_##Datbits:                               \
-            idx = VAL(Idxbits, diff);                        \
-            diff += BYTES(Idxbits);                          \
-        } while ((int##Idxbits##_t)idx != -1);               \
-    } while (0)
-
-#define CPDATA(Datbits)                                                            \
-    do                                                                             \
-    {                                                                              \
-        int const elts = tabledivide32_noinline(spec->size * cnt, BYTES(Datbits)); \
-        if (elts > 65536)                                                          \
-            CPELTS(32, Datbits);                                                   \
-        else if (elts > 256)                                                       \
-            CPELTS(16, Datbits);                                                   \
-        else                                                                       \
-            CPELTS(8, Datbits);                                                    \
+#define CPDATA(Datbits)                                           \
+    do                                                            \
+    {                                                             \
+        uint32_t const nelts = spec->size / BYTES(Datbits) * cnt; \
+        diff = spandiffApply((UINT(Datbits) *)dump, nelts, diff); \
+        if (!diff)                                                \
+            return 1;                                             \
     } while (0)
 
         if (spec->size == 8)
@@ -1390,7 +1474,6 @@ readidx_##Idxbits##_##Datbits:                               \
         dump += spec->size * cnt;
 // ----------
 
-#undef CPELTS
 #undef CPSINGLEVAL
 #undef CPDATA
     }
@@ -1509,10 +1592,10 @@ static const dataspec_t svgm_secwsp[] =
 {
     { DS_STRING, (void *)svgm_secwsp_string, 0, 1 },
     { DS_NOCHK, &numwalls, sizeof(numwalls), 1 },
-    { DS_MAINAR|DS_CNT(numwalls), &wall, sizeof(walltype), (intptr_t)&numwalls },
+    { DS_MAINAR|DS_TRACKWALL|DS_CNT(numwalls), &wall, sizeof(walltype), (intptr_t)&numwalls },
     { DS_NOCHK, &numsectors, sizeof(numsectors), 1 },
-    { DS_MAINAR|DS_CNT(numsectors), &sector, sizeof(sectortype), (intptr_t)&numsectors },
-    { DS_MAINAR, &sprite, sizeof(spritetype), MAXSPRITES },
+    { DS_MAINAR|DS_TRACKSECT|DS_CNT(numsectors), &sector, sizeof(sectortype), (intptr_t)&numsectors },
+    { DS_MAINAR|DS_TRACKSPRITE, &sprite, sizeof(spritetype), MAXSPRITES },
 #ifdef YAX_ENABLE
     { DS_NOCHK, &numyaxbunches, sizeof(numyaxbunches), 1 },
 # if !defined NEW_MAP_FORMAT
@@ -1547,7 +1630,7 @@ static const dataspec_t svgm_secwsp[] =
     { DS_NOCHK, &g_mirrorWall[0], sizeof(g_mirrorWall[0]), ARRAY_SIZE(g_mirrorWall) },
     { DS_NOCHK, &g_mirrorSector[0], sizeof(g_mirrorSector[0]), ARRAY_SIZE(g_mirrorSector) },
 // projectiles
-    { 0, &SpriteProjectile[0], sizeof(projectile_t), MAXSPRITES },
+    { DS_LIVESPRITE, &SpriteProjectile[0], sizeof(projectile_t), MAXSPRITES },
     { 0, &everyothertime, sizeof(everyothertime), 1 },
     { DS_END, 0, 0, 0 }
 };
@@ -1567,7 +1650,7 @@ static const dataspec_t svgm_script[] =
     { DS_SAVEFN, (void *) &sv_postprojectilesave, 0, 1 },
     { DS_LOADFN, (void *) &sv_postprojectileload, 0, 1 },
     { DS_NOCHK|DS_SAVEFN, (void *) &sv_preactorsave, 0, 1 },
-    { 0, &actor[0], sizeof(actor_t), MAXSPRITES },
+    { DS_LIVESPRITE, &actor[0], sizeof(actor_t), MAXSPRITES },
     { DS_NOCHK|DS_SAVEFN|DS_LOADFN, (void *)&sv_postactordata, 0, 1 },
     { DS_END, 0, 0, 0 }
 };
@@ -1615,6 +1698,9 @@ static uint8_t *svsnapshot;
 static uint8_t *svinitsnap;
 static uint32_t svdiffsiz;
 static uint8_t *svdiff;
+#ifdef DEBUGGINGAIDS
+static uint8_t *svdiffcheck;  // the dump before the last diff, to check that the diff applies back onto it
+#endif
 
 #include "gamedef.h"
 
@@ -1693,6 +1779,9 @@ void sv_freemem()
     DO_FREE_AND_NULL(svsnapshot);
     DO_FREE_AND_NULL(svinitsnap);
     DO_FREE_AND_NULL(svdiff);
+#ifdef DEBUGGINGAIDS
+    DO_FREE_AND_NULL(svdiffcheck);
+#endif
 }
 
 static void SV_AllocSnap(int32_t allocinit)
@@ -1704,6 +1793,9 @@ static void SV_AllocSnap(int32_t allocinit)
         svinitsnap = (uint8_t *)Xmalloc(svsnapsiz);
     svdiffsiz = svsnapsiz;  // theoretically it's less than could be needed in the worst case, but practically it's overkill
     svdiff = (uint8_t *)Xmalloc(svdiffsiz);
+#ifdef DEBUGGINGAIDS
+    svdiffcheck = (uint8_t *)Xmalloc(svsnapsiz);
+#endif
 }
 
 // make snapshot only if spot < 0 (demo)
@@ -1735,7 +1827,7 @@ int32_t sv_saveandmakesnapshot(buildvfs_FILE fil, char const *name, int8_t spot,
 
     Bstrncpyz(h.scriptname, g_scriptFileName, sizeof(h.scriptname));
     h.comprthres   = savegame_comprthres;
-    h.recdiffsp    = recdiffsp;
+    h.recdiffsp    = recdiffsp ? SV_DIFFS_SPANS : SV_DIFFS_NONE;
     h.diffcompress = savegame_diffcompress;
     h.synccompress = synccompress;
 
@@ -1818,6 +1910,10 @@ int32_t sv_saveandmakesnapshot(buildvfs_FILE fil, char const *name, int8_t spot,
             OSD_Printf("sv_saveandmakesnapshot: ptr-(snapshot end)=%d!\n", (int32_t)(p - (svsnapshot + svsnapsiz)));
             return 1;
         }
+
+#ifdef USE_STRUCT_TRACKERS
+        sv_takerevisions();
+#endif
     }
 
     return 0;
@@ -1968,6 +2064,14 @@ uint32_t sv_writediff(buildvfs_FILE fil)
     uint8_t *p = svsnapshot;
     uint8_t *d = svdiff;
 
+#ifdef USE_STRUCT_TRACKERS
+    if (sv_revvalid)
+        sv_makedirtymaps();
+#endif
+#ifdef DEBUGGINGAIDS
+    Bmemcpy(svdiffcheck, svsnapshot, svsnapsiz);
+#endif
+
     cmpspecdata(svgm_udnetw, &p, &d);
     cmpspecdata(svgm_secwsp, &p, &d);
     cmpspecdata(svgm_script, &p, &d);
@@ -1977,8 +2081,25 @@ uint32_t sv_writediff(buildvfs_FILE fil)
     if (p != svsnapshot+svsnapsiz)
         OSD_Printf("sv_writediff: dump+siz=%p, p=%p!\n", svsnapshot+svsnapsiz, p);
 
+#ifdef USE_STRUCT_TRACKERS
+    sv_takerevisions();
+#endif
+
     uint32_t const diffsiz = d - svdiff;
 
+#ifdef DEBUGGINGAIDS
+    {
+        uint8_t *cp = svdiffcheck;
+        uint8_t *cd = svdiff;
+
+        if (applydiff(svgm_udnetw, &cp, &cd) || applydiff(svgm_secwsp, &cp, &cd) || applydiff(svgm_script, &cp, &cd)
+            || applydiff(svgm_anmisc, &cp, &cd) || applydiff((const dataspec_t *)svgm_vars, &cp, &cd))
+            OSD_Printf("sv_writediff: diff failed to apply!\n");
+        else if (cd != d || Bmemcmp(svdiffcheck, svsnapshot, svsnapsiz))
+            OSD_Printf("sv_writediff: diff doesn't reproduce the snapshot!\n");
+    }
+#endif
+
     buildvfs_fwrite("dIfF",4,1,fil);
     buildvfs_fwrite(&diffsiz, sizeof(diffsiz), 1, fil);
 
@@ -2029,6 +2150,25 @@ int32_t sv_readdiff(buildvfs_kfd fil)
     return i;
 }
 
+// read past a diff without applying it, for demos with diffs in an older format
+int32_t sv_skipdiff(buildvfs_kfd fil)
+{
+    uint32_t diffsiz;
+
+    if (kread(fil, &diffsiz, sizeof(uint32_t)) != sizeof(uint32_t))
+        return -1;
+
+    if (savegame_diffcompress)
+    {
+        if (diffsiz > svdiffsiz || kdfread_LZ4(svdiff, 1, diffsiz, fil) != (int32_t)diffsiz)  // cnt and sz swapped
+            return -2;
+    }
+    else if (klseek(fil, diffsiz, SEEK_CUR) < 0)
+        return -2;
+
+    return 0;
+}
+
 // SVGM data description
 static void sv_postudload()
 {
@@ -2569,6 +2709,8 @@ static void postloadplayer(int32_t savegamep)
     Bmemset(sectorchanged, 0, sizeof(sectorchanged));
     Bmemset(spritechanged, 0, sizeof(spritechanged));
     Bmemset(wallchanged, 0, sizeof(wallchanged));
+    // the revisions no longer say anything about what the dump holds
+    sv_revvalid = false;
 #endif
 
 #ifdef USE_OPENGL
@@ -2591,6 +2733,8 @@ static void postloadplayer(int32_t savegamep)
 #endif
 
     calc_sector_reachability();
+    sectorbvhBuild();
+    spritegridRefresh();
     //Bmemset(zhit, 0, sizeof(zhit));
 }
 
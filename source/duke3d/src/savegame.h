@@ -34,6 +34,11 @@ extern "C" {
 #define SV_MAJOR_VER 1
 #define SV_MINOR_VER 7
 
+// savehead_t::recdiffsp of demos: the format of their diffs
+#define SV_DIFFS_NONE     0
+#define SV_DIFFS_ELEMENTS 1  // one index and value per changed element, no longer read
+#define SV_DIFFS_SPANS    2  // see spandiff.h
+
 #define MAXSAVEGAMENAMESTRUCT 32
 #define MAXSAVEGAMENAME (MAXSAVEGAMENAMESTRUCT-1)
 
@@ -135,6 +140,7 @@ extern uint16_t g_nummenusaves;
 
 int32_t sv_updatestate(int32_t frominit);
 int32_t sv_readdiff(buildvfs_kfd fil);
+int32_t sv_skipdiff(buildvfs_kfd fil);
 uint32_t sv_writediff(buildvfs_FILE fil);
 int32_t sv_loadheader(buildvfs_kfd fil, int32_t spot, savehead_t *h);
 int32_t sv_loadsnapshot(buildvfs_kfd fil, int32_t spot, savehead_t *h);
@@ -2441,6 +2441,7 @@ void A_DamageObject_Duke3D(int spriteNum, int const dmgSrc)
                     if ((unsigned)sectNum < MAXSECTORS)
                     {
                         pushmove(&sprite[spriteNum].xyz, &sectNum, 128L, (4L << 8), (4L << 8), CLIPMASK0);
+                        spriteMarkChanged(spriteNum);
                         if (sectNum != SECT(spriteNum) && (unsigned)sectNum < MAXSECTORS)
                             changespritesect(spriteNum, sectNum);
                     }
@@ -2537,6 +2538,7 @@ void A_DamageObject_Generic(int spriteNum, int const dmgSrc)
                         sprite[spriteNum].xvel  = -(sprite[dmgSrc].extra << 2);
                         int16_t sectNum = SECT(spriteNum);
                         pushmove(&sprite[spriteNum].xyz, &sectNum, 128L, (4L << 8), (4L << 8), CLIPMASK0);
+                        spriteMarkChanged(spriteNum);
                         if (sectNum != SECT(spriteNum) && (unsigned)sectNum < MAXSECTORS)
                             changespritesect(spriteNum, sectNum);
                     }
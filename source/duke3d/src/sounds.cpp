@@ -24,7 +24,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "al_midi.h"
 #include "compat.h"
 #include "duke3d.h"
+#include "libasync_config.h"
+#include "lru.h"
 #include "renderlayer.h"  // for win_gethwnd()
+#include "timer.h"
 #include "vfs.h"
 
 #include <atomic>
@@ -51,6 +54,280 @@ sound_t **g_sounds;
 sound_t nullsound;
 voiceinfo_t nullvoice = { -1, FX_Ok, UINT16_MAX };
 
+// Ogg Vorbis and FLAC sounds that are played more than once are decoded in
+// full and kept as in-memory WAV images, so the mixer can play them without
+// spinning up a decoder every time.  The decoding is done by a worker task;
+// the sound keeps playing from the file until the result is picked up.
+int32_t g_soundCacheSize     = 8192;
+int32_t g_soundCacheMaxSound = 512;
+
+struct soundcache_t
+{
+    char *   ptr;
+    uint32_t len;
+};
+
+struct soundcachefree_t
+{
+    int  num;
+    char *ptr;
+};
+
+static LruCache<int, soundcache_t, 1024, 1031> g_soundCache;
+static size_t g_soundCacheBytes;
+
+static uint8_t g_soundCacheSeen[(MAXSOUNDS+7)>>3];     // played since it was defined
+static uint8_t g_soundCacheRefused[(MAXSOUNDS+7)>>3];  // can't be decoded within the limits
+
+// evicted entries still referenced by a playing voice
+static GrowArray<soundcachefree_t> g_soundCacheFreeList;
+
+// a decode running on a worker; the file is copied as the cache may move or free the original
+struct soundcachedecode_t
+{
+    int          num;
+    char *       file;
+    uint32_t     fileLen;
+    uint32_t     maxlength;
+    int          status;
+    soundcache_t entry;
+    uint64_t     ticks;
+
+    async::task<void> task;
+};
+
+static GrowArray<soundcachedecode_t *> g_soundCacheDecodes;
+static uint8_t g_soundCacheDecoding[(MAXSOUNDS+7)>>3];
+
+static struct
+{
+    uint32_t hits, misses, decodes, evictions, refused;
+    uint64_t decodeTicks;
+} g_soundCacheStats;
+
+static void S_ReleaseSoundCacheEntry(int num, soundcache_t const &entry)
+{
+    g_soundCacheBytes -= entry.len;
+
+    if (g_sounds[num]->playing == 0)
+        Xfree(entry.ptr);
+    else
+        g_soundCacheFreeList.append({ num, entry.ptr });
+}
+
+static void S_FreeReleasedSoundCacheEntries(void)
+{
+    for (size_t i = 0; i < g_soundCacheFreeList.size();)
+    {
+        auto &pending = g_soundCacheFreeList[i];
+
+        if (g_sounds[pending.num]->playing)
+        {
+            ++i;
+            continue;
+        }
+
+        Xfree(pending.ptr);
+        pending = g_soundCacheFreeList.last();
+        g_soundCacheFreeList.removeLast();
+    }
+}
+
+static void S_TrimSoundCache(size_t const budget)
+{
+    std::pair<int, soundcache_t> evicted;
+
+    while (g_soundCacheBytes > budget && g_soundCache.evict(&evicted))
+    {
+        S_ReleaseSoundCacheEntry(evicted.first, evicted.second);
+        g_soundCacheStats.evictions++;
+    }
+}
+
+// waits for the decode to finish; the PCM is only freed if discardPCM is set
+static void S_FreeSoundCacheDecode(soundcachedecode_t *const decode, bool const discardPCM)
+{
+    decode->task.wait();
+
+    if (discardPCM && decode->status == FX_Ok)
+        Xfree(decode->entry.ptr);
+
+    bitmap_clear(g_soundCacheDecoding, decode->num);
+
+    Xfree(decode->file);
+    delete decode;
+}
+
+// Moves the decodes that have finished into the cache.  Sounds redefined in
+// the meantime have had theirs dropped by S_ForgetCachedSound().
+static void S_CollectSoundCacheDecodes(void)
+{
+    size_t const budget = (size_t)max(g_soundCacheSize, 0) << 10;
+
+    for (size_t i = 0; i < g_soundCacheDecodes.size();)
+    {
+        auto const decode = g_soundCacheDecodes[i];
+
+        if (!decode->task.ready())
+        {
+            ++i;
+            continue;
+        }
+
+        int const num = decode->num;
+        bool const cached = decode->status == FX_Ok && budget > 0;
+
+        if (decode->status != FX_Ok)
+        {
+            bitmap_set(g_soundCacheRefused, num);
+            g_soundCacheStats.refused++;
+        }
+        else if (cached)
+        {
+            std::pair<int, soundcache_t> evicted;
+
+            g_soundCacheStats.decodes++;
+            g_soundCacheStats.decodeTicks += decode->ticks;
+
+            if (g_soundCache.insert(num, decode->entry, &evicted))
+            {
+                S_ReleaseSoundCacheEntry(evicted.first, evicted.second);
+                g_soundCacheStats.evictions++;
+            }
+
+            g_soundCacheBytes += decode->entry.len;
+            S_TrimSoundCache(budget);
+        }
+
+        S_FreeSoundCacheDecode(decode, !cached);
+        g_soundCacheDecodes[i] = g_soundCacheDecodes.last();
+        g_soundCacheDecodes.removeLast();
+    }
+}
+
+// only once the mixer is gone, as no voice can be reading from them then
+static void S_ClearSoundCache(void)
+{
+    std::pair<int, soundcache_t> evicted;
+
+    for (auto decode : g_soundCacheDecodes)
+        S_FreeSoundCacheDecode(decode, true);
+
+    g_soundCacheDecodes.clear();
+
+    while (g_soundCache.evict(&evicted))
+        Xfree(evicted.second.ptr);
+
+    for (auto &pending : g_soundCacheFreeList)
+        Xfree(pending.ptr);
+
+    g_soundCacheFreeList.clear();
+    g_soundCacheBytes = 0;
+
+    Bmemset(g_soundCacheSeen, 0, sizeof(g_soundCacheSeen));
+    Bmemset(g_soundCacheRefused, 0, sizeof(g_soundCacheRefused));
+}
+
+static void S_ForgetCachedSound(int num)
+{
+    soundcache_t entry;
+
+    if (g_soundCache.remove(num, &entry))
+        S_ReleaseSoundCacheEntry(num, entry);
+
+    for (size_t i = 0; i < g_soundCacheDecodes.size(); i++)
+    {
+        if (g_soundCacheDecodes[i]->num != num)
+            continue;
+
+        S_FreeSoundCacheDecode(g_soundCacheDecodes[i], true);
+        g_soundCacheDecodes[i] = g_soundCacheDecodes.last();
+        g_soundCacheDecodes.removeLast();
+        break;
+    }
+
+    bitmap_clear(g_soundCacheSeen, num);
+    bitmap_clear(g_soundCacheRefused, num);
+}
+
+// Returns the data to hand to the mixer for sound num: its decoded PCM if that
+// is cached, the file as loaded otherwise.  Sounds are only decoded on their
+// second play so that the ones heard once per level don't push out the rest,
+// and that play still gets the file, as the decode is left to a worker.
+static void S_GetSoundData(int num, char **ptr, uint32_t *len)
+{
+    auto const &snd = g_sounds[num];
+
+    *ptr = snd->ptr;
+    *len = snd->len;
+
+    if (g_soundCacheDecodes.size())
+        S_CollectSoundCacheDecodes();
+
+    if (g_soundCacheSize <= 0 || bitmap_test(g_soundCacheRefused, num) || bitmap_test(g_soundCacheDecoding, num))
+        return;
+
+    if (auto const entry = g_soundCache.access(num))
+    {
+        g_soundCacheStats.hits++;
+        *ptr = entry->ptr;
+        *len = entry->len;
+        return;
+    }
+
+    g_soundCacheStats.misses++;
+
+    if (!bitmap_test(g_soundCacheSeen, num))
+    {
+        bitmap_set(g_soundCacheSeen, num);
+        return;
+    }
+
+    // VOC and WAV files are refused here, as they are PCM already
+    if (!FX_IsDecodable(snd->ptr, snd->len))
+    {
+        bitmap_set(g_soundCacheRefused, num);
+        g_soundCacheStats.refused++;
+        return;
+    }
+
+    // retried on a later play
+    if (g_soundCacheDecodes.size() >= (size_t)max<int>(2, async::hardware_concurrency()))
+        return;
+
+    size_t const budget = (size_t)g_soundCacheSize << 10;
+    auto const   decode = new soundcachedecode_t{};
+
+    decode->num       = num;
+    decode->fileLen   = snd->len;
+    decode->file      = (char *)Xmalloc(snd->len);
+    decode->maxlength = (uint32_t)min<size_t>((size_t)max(g_soundCacheMaxSound, 0) << 10, budget);
+
+    Bmemcpy(decode->file, snd->ptr, snd->len);
+
+    decode->task = async::spawn([decode]()
+    {
+        uint64_t const startTicks = timerGetPerformanceCounter();
+        decode->status = FX_DecodeToWAV(decode->file, decode->fileLen, &decode->entry.ptr, &decode->entry.len, decode->maxlength);
+        decode->ticks  = timerGetPerformanceCounter() - startTicks;
+    });
+
+    bitmap_set(g_soundCacheDecoding, num);
+    g_soundCacheDecodes.append(decode);
+}
+
+void S_PrintSoundCacheStats(void)
+{
+    uint32_t const lookups = g_soundCacheStats.hits + g_soundCacheStats.misses;
+
+    LOG_F(INFO, "Sound cache: %d sounds in %.1f of %d KiB, %u hits, %u misses (%.1f%% hit rate)", g_soundCache.size(),
+          g_soundCacheBytes / 1024.0, g_soundCacheSize, g_soundCacheStats.hits, g_soundCacheStats.misses,
+          lookups ? 100.0 * g_soundCacheStats.hits / lookups : 0.0);
+    LOG_F(INFO, "Sound cache: %u decoded in %.2f ms on workers, %d decoding, %u evicted, %u not cacheable, %d awaiting release",
+          g_soundCacheStats.decodes, (double)g_soundCacheStats.decodeTicks * 1000.0 / timerGetPerformanceFrequency(),
+          (int)g_soundCacheDecodes.size(), g_soundCacheStats.evictions, g_soundCacheStats.refused, (int)g_soundCacheFreeList.size());
+}
+
 void S_AllocIndexes(int sndidx)
 {
     Bassert(sndidx < MAXSOUNDS);
@@ -133,6 +410,8 @@ void S_SoundShutdown(void)
         S_MusicShutdown();
 
     int status = FX_Shutdown();
+    S_ClearSoundCache();
+
     if (status != FX_Ok)
     {
         Bsprintf(tempbuf, "Failed tearing down sound subsystem: %s", FX_ErrorString(status));
@@ -510,6 +789,16 @@ void S_Cleanup(void)
         if (!snd->playing && snd->lock != CACHE1D_PERMANENT)
             snd->lock = CACHE1D_UNLOCKED;
     }
+
+    // catches up with snd_pcmcache being lowered
+    if (g_soundCacheBytes > (size_t)max(g_soundCacheSize, 0) << 10)
+        S_TrimSoundCache((size_t)max(g_soundCacheSize, 0) << 10);
+
+    if (g_soundCacheFreeList.size())
+        S_FreeReleasedSoundCacheEntries();
+
+    if (g_soundCacheDecodes.size())
+        S_CollectSoundCacheDecodes();
 }
 
 // returns number of bytes read
@@ -531,6 +820,16 @@ int32_t S_LoadSound(int num)
     int32_t l = kfilelength(fp);
     g_sounds[num]->lock = CACHE1D_PERMANENT;
     snd->len = l;
+
+    // the mixer only reads from snd->ptr, so sounds stored in a mapped group are played in place.
+    // The pointer is never freed and goes stale with uninitgroupfile(), see G_Shutdown().
+    if (auto const data = kfiledata(fp))
+    {
+        snd->ptr = (char *)(intptr_t)data;
+        kclose(fp);
+        return l;
+    }
+
     g_cache.allocateBlock((intptr_t *)&snd->ptr, l, (char *)&g_sounds[num]->lock);
     l = kread(fp, snd->ptr, l);
     kclose(fp);
@@ -602,6 +901,8 @@ int32_t S_DefineSound(int sndidx, const char *name, int minpitch, int maxpitch,
     snd->volume     = volume * fix16_one;
     snd->voices     = &nullvoice;
 
+    S_ForgetCachedSound(sndidx);
+
     if (snd->flags & SF_LOOP)
         snd->flags |= SF_ONEINST_INTERNAL;
 
@@ -928,8 +1229,12 @@ error:
     if (snd->flags & SF_TALK)
         g_dukeTalk = true;
 
+    char *   ptr;
+    uint32_t len;
+    S_GetSoundData(sndNum, &ptr, &len);
+
     fix16_t const volume = fix16_from_float(((snd->flags & SF_TALK) || ((snd->flags & SF_SPEECH) && ud.config.VoiceVolume > ud.config.FXVolume)) ? fix16_to_float(snd->volume) * ((float)ud.config.VoiceVolume / 255.f) : fix16_to_float(snd->volume) * ((float)ud.config.FXVolume / 255.f));
-    int const voice = FX_Play3D(snd->ptr, snd->len, repeatp ? FX_LOOP : FX_ONESHOT, pitch, sndang >> 4, sndist >> 6, snd->priority,
+    int const voice = FX_Play3D(ptr, len, repeatp ? FX_LOOP : FX_ONESHOT, pitch, sndang >> 4, sndist >> 6, snd->priority,
                                 volume, (sndNum * MAXSOUNDINSTANCES) + sndSlot);
 
     if (voice <= FX_Ok)
@@ -985,10 +1290,14 @@ error:
     if (snd->flags & SF_TALK)
         g_dukeTalk = true;
 
+    char *   ptr;
+    uint32_t len;
+    S_GetSoundData(num, &ptr, &len);
+
     fix16_t const volume = fix16_from_float(((snd->flags & SF_TALK) || ((snd->flags & SF_SPEECH) && ud.config.VoiceVolume > ud.config.FXVolume)) ? fix16_to_float(snd->volume) * ((float)ud.config.VoiceVolume / 255.f) : fix16_to_float(snd->volume) * ((float)ud.config.FXVolume / 255.f));
-    int const voice = (snd->flags & SF_LOOP) ? FX_Play(snd->ptr, snd->len, 0, -1, pitch, LOUDESTVOLUME, LOUDESTVOLUME,
+    int const voice = (snd->flags & SF_LOOP) ? FX_Play(ptr, len, 0, -1, pitch, LOUDESTVOLUME, LOUDESTVOLUME,
                                                   LOUDESTVOLUME, snd->len, volume, (num * MAXSOUNDINSTANCES) + sndnum)
-                                        : FX_Play3D(snd->ptr, snd->len, FX_ONESHOT, pitch, 0, 255 - LOUDESTVOLUME, snd->priority, volume,
+                                        : FX_Play3D(ptr, len, FX_ONESHOT, pitch, 0, 255 - LOUDESTVOLUME, snd->priority, volume,
                                                     (num * MAXSOUNDINSTANCES) + sndnum);
 
     if (voice <= FX_Ok)
@@ -1069,6 +1378,8 @@ void S_StopAllSounds(void)
             snd->lock = CACHE1D_UNLOCKED;
     }
 
+    S_FreeReleasedSoundCacheEntries();
+
     g_dukeTalk = false;
 }
 
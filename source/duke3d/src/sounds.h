@@ -55,6 +55,8 @@ typedef struct
 {
     voiceinfo_t *voices;
 
+    // may point into a memory mapped group (see S_LoadSound()), which is only valid until
+    // uninitgroupfile(): the sound system has to be shut down before the groups are
     char *  ptr;
     char *  filename;
     int32_t len;
@@ -75,6 +77,9 @@ extern int32_t g_numEnvSoundsPlaying, g_highestSoundIdx;
 
 extern int32_t MusicIsWaveform, MusicVoice;
 
+// decoded sound cache budget and per-sound limit, in KiB
+extern int32_t g_soundCacheSize, g_soundCacheMaxSound;
+
 static FORCE_INLINE bool S_SoundIsValid(int soundNum)
 {
     return (unsigned)soundNum <= (unsigned)g_highestSoundIdx && g_sounds[soundNum] && g_sounds[soundNum] != &nullsound && g_sounds[soundNum]->ptr;
@@ -104,6 +109,7 @@ bool S_TryPlayLevelMusic(unsigned int m);
 void S_PlayLevelMusicOrNothing(unsigned int);
 int S_TryPlaySpecialMusic(unsigned int);
 void S_PlaySpecialMusicOrNothing(unsigned int);
+void S_PrintSoundCacheStats(void);
 void S_ContinueLevelMusic(void);
 int S_PlaySound(int num);
 int S_PlaySound3D(int num, int spriteNum, const vec3_t &pos);
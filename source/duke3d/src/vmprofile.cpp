@@ -0,0 +1,290 @@
+// CON VM profiler
+// See vmprofile.h for an overview.
+
+#include "duke3d.h"
+#include "vfs.h"
+#include "vmprofile.h"
+
+int32_t g_vm_profile;
+uint64_t g_vmInstructionCount;
+
+#define VMPROF_MAXDEPTH 256
+
+typedef struct
+{
+    int32_t  parent, type, id;
+    uint32_t calls;
+    uint64_t ticks, instructions;  // excluding children
+} vmprofnode_t;
+
+typedef struct
+{
+    int32_t  node;
+    uint64_t startTicks, startInstructions;
+    uint64_t childTicks, childInstructions;
+} vmprofframe_t;
+
+static GrowArray<vmprofnode_t, 1024> vmprofNodes;
+
+// open addressing, (parent, type, id) -> node index + 1
+static int32_t *vmprofHash;
+static uint32_t vmprofHashSize;
+
+static vmprofframe_t vmprofStack[VMPROF_MAXDEPTH];
+static int32_t vmprofDepth;
+static uint32_t vmprofOverflow;
+static bool vmprofResetPending;
+
+static FORCE_INLINE uint32_t vmprofHashKey(int32_t const parent, int32_t const type, int32_t const id)
+{
+    return ((uint32_t)parent * 0x9E3779B1u) ^ ((uint32_t)id * 0x85EBCA6Bu) ^ (uint32_t)type;
+}
+
+static void vmprofRehash(void)
+{
+    DO_FREE_AND_NULL(vmprofHash);
+    vmprofHashSize = vmprofHashSize ? vmprofHashSize << 1 : 1024;
+    vmprofHash = (int32_t *)Xcalloc(vmprofHashSize, sizeof(int32_t));
+
+    for (int i = 0, n = vmprofNodes.size(); i < n; i++)
+    {
+        auto const &node = vmprofNodes[i];
+        uint32_t slot = vmprofHashKey(node.parent, node.type, node.id) & (vmprofHashSize - 1);
+
+        while (vmprofHash[slot])
+            slot = (slot + 1) & (vmprofHashSize - 1);
+
+        vmprofHash[slot] = i + 1;
+    }
+}
+
+static int32_t vmprofGetNode(int32_t const parent, int32_t const type, int32_t const id)
+{
+    if ((vmprofNodes.size() + 1) * 2 > vmprofHashSize)
+        vmprofRehash();
+
+    uint32_t slot = vmprofHashKey(parent, type, id) & (vmprofHashSize - 1);
+
+    for (; vmprofHash[slot]; slot = (slot + 1) & (vmprofHashSize - 1))
+    {
+        auto const &node = vmprofNodes[vmprofHash[slot] - 1];
+
+        if (node.parent == parent && node.type == type && node.id == id)
+            return vmprofHash[slot] - 1;
+    }
+
+    vmprofnode_t const node = { parent, type, id, 0, 0, 0 };
+    vmprofNodes.append(node);
+
+    return (vmprofHash[slot] = vmprofNodes.size()) - 1;
+}
+
+void VM_ProfileEnter(int const type, int const id)
+{
+    if (EDUKE32_PREDICT_FALSE(vmprofDepth >= VMPROF_MAXDEPTH))
+    {
+        // anything deeper is charged to the innermost frame we kept
+        vmprofDepth++;
+        vmprofOverflow++;
+        return;
+    }
+
+    int32_t const parent = vmprofDepth ? vmprofStack[vmprofDepth - 1].node : -1;
+    auto &frame = vmprofStack[vmprofDepth++];
+
+    frame.node              = vmprofGetNode(parent, type, id);
+    frame.childTicks        = 0;
+    frame.childInstructions = 0;
+    frame.startInstructions = g_vmInstructionCount;
+    frame.startTicks        = timerGetPerformanceCounter();
+}
+
+void VM_ProfileLeave(void)
+{
+    uint64_t const ticks = timerGetPerformanceCounter();
+
+    if (EDUKE32_PREDICT_FALSE(vmprofDepth > VMPROF_MAXDEPTH))
+    {
+        vmprofDepth--;
+        return;
+    }
+
+    auto const &frame = vmprofStack[--vmprofDepth];
+    auto &node = vmprofNodes[frame.node];
+
+    uint64_t const totalTicks        = ticks - frame.startTicks;
+    uint64_t const totalInstructions = g_vmInstructionCount - frame.startInstructions;
+
+    node.calls++;
+    node.ticks        += totalTicks - frame.childTicks;
+    node.instructions += totalInstructions - frame.childInstructions;
+
+    if (vmprofDepth)
+    {
+        auto &parent = vmprofStack[vmprofDepth - 1];
+        parent.childTicks        += totalTicks;
+        parent.childInstructions += totalInstructions;
+    }
+    else if (vmprofResetPending)
+        VM_ProfileReset();
+}
+
+void VM_ProfileReset(void)
+{
+    // frames on the stack still refer to their nodes
+    if (vmprofDepth)
+    {
+        vmprofResetPending = true;
+        return;
+    }
+
+    vmprofNodes.clear();
+    DO_FREE_AND_NULL(vmprofHash);
+    vmprofHashSize     = 0;
+    vmprofOverflow     = 0;
+    vmprofResetPending = false;
+}
+
+static char const *vmprofStateName(int const offset)
+{
+    for (int i = 0; i < g_labelCnt; i++)
+    {
+        if ((labeltype[i] & LABEL_STATE) == LABEL_STATE && labelcode[i] == offset)
+            return &label[i << 6];
+    }
+
+    return nullptr;
+}
+
+static void vmprofGetFrameName(vmprofnode_t const &node, char *buf, size_t const size)
+{
+    switch (node.type)
+    {
+        case VMPROF_EVENT:
+            Bsnprintf(buf, size, "%s", EventNames[node.id]);
+            break;
+        case VMPROF_ACTOR:
+            if (g_tileLabels[node.id])
+                Bsnprintf(buf, size, "actor:%s", g_tileLabels[node.id]);
+            else
+                Bsnprintf(buf, size, "actor:%d", node.id);
+            break;
+        case VMPROF_STATE:
+        {
+            auto const name = vmprofStateName(node.id);
+            if (name)
+                Bsnprintf(buf, size, "state:%s", name);
+            else
+                Bsnprintf(buf, size, "state:%d", node.id);
+            break;
+        }
+    }
+
+    buf[size - 1] = 0;
+}
+
+// root first, separated by semicolons
+static void vmprofGetStack(int32_t nodeNum, char *buf, size_t const size)
+{
+    int32_t path[VMPROF_MAXDEPTH];
+    int     depth = 0;
+
+    for (; nodeNum >= 0 && depth < VMPROF_MAXDEPTH; nodeNum = vmprofNodes[nodeNum].parent)
+        path[depth++] = nodeNum;
+
+    size_t len = 0;
+    buf[0] = 0;
+
+    while (depth-- > 0 && len + 2 < size)
+    {
+        if (len)
+            buf[len++] = ';';
+
+        vmprofGetFrameName(vmprofNodes[path[depth]], &buf[len], size - len);
+        len += Bstrlen(&buf[len]);
+    }
+}
+
+static uint64_t vmprofMicroseconds(uint64_t const ticks)
+{
+    return (uint64_t)(ticks * 1000000.0 / timerGetPerformanceFrequency());
+}
+
+int VM_ProfileDump(char const *fileName, int const metric)
+{
+    buildvfs_FILE fp = buildvfs_fopen_write_text(fileName);
+
+    if (!fp)
+        return -1;
+
+    char stack[4096];
+    char line[4096 + 32];
+    int  numLines = 0;
+
+    for (int i = 0, n = vmprofNodes.size(); i < n; i++)
+    {
+        auto const &node = vmprofNodes[i];
+        uint64_t const value = (metric == VMPROF_INSTRUCTIONS) ? node.instructions : vmprofMicroseconds(node.ticks);
+
+        if (!value)
+            continue;
+
+        vmprofGetStack(i, stack, sizeof(stack));
+        Bsnprintf(line, sizeof(line), "%s %" PRIu64 "\n", stack, value);
+        line[sizeof(line) - 1] = 0;
+        buildvfs_fputstrptr(fp, line);
+        numLines++;
+    }
+
+    buildvfs_fclose(fp);
+
+    return numLines;
+}
+
+static int vmprofCompareTicks(void const *a, void const *b)
+{
+    uint64_t const ticksA = vmprofNodes[*(int32_t const *)a].ticks;
+    uint64_t const ticksB = vmprofNodes[*(int32_t const *)b].ticks;
+
+    return (ticksA < ticksB) - (ticksA > ticksB);
+}
+
+void VM_ProfilePrintTop(int const numEntries)
+{
+    int const numNodes = vmprofNodes.size();
+
+    if (!numNodes)
+    {
+        LOG_F(INFO, "No CON VM profile data, set vm_profile 1 to collect some.");
+        return;
+    }
+
+    auto sorted = (int32_t *)Xmalloc(numNodes * sizeof(int32_t));
+    uint64_t totalTicks = 0;
+
+    for (int i = 0; i < numNodes; i++)
+    {
+        sorted[i] = i;
+        totalTicks += vmprofNodes[i].ticks;
+    }
+
+    qsort(sorted, numNodes, sizeof(int32_t), vmprofCompareTicks);
+
+    LOG_F(INFO, "%10s %6s %10s %12s  %s", "self ms", "%", "calls", "instructions", "stack");
+
+    char stack[4096];
+
+    for (int i = 0, n = min(numEntries, numNodes); i < n; i++)
+    {
+        auto const &node = vmprofNodes[sorted[i]];
+
+        vmprofGetStack(sorted[i], stack, sizeof(stack));
+        LOG_F(INFO, "%10.3f %6.2f %10u %12" PRIu64 "  %s", vmprofMicroseconds(node.ticks) * 0.001,
+              totalTicks ? node.ticks * 100.0 / totalTicks : 0.0, node.calls, node.instructions, stack);
+    }
+
+    if (vmprofOverflow)
+        LOG_F(WARNING, "%u state calls nested deeper than %d were charged to their callers.", vmprofOverflow, VMPROF_MAXDEPTH);
+
+    Xfree(sorted);
+}
@@ -0,0 +1,44 @@
+// CON VM profiler
+//
+// Attributes the time and the number of instructions spent in the CON VM to
+// the event, actor and state that executed them.  Frames are pushed where the
+// VM is entered for an event or an actor and where a state is called, and are
+// kept as a call tree so the same state called from two actors shows up twice.
+// Each node accumulates its exclusive (self) cost, which is exactly what the
+// collapsed stack format read by flamegraph.pl and speedscope expects.
+//
+// Nothing but the instruction counter is touched while vm_profile is 0.
+
+#pragma once
+
+#ifndef vmprofile_h_
+#define vmprofile_h_
+
+#include "compat.h"
+
+enum
+{
+    VMPROF_EVENT,
+    VMPROF_ACTOR,
+    VMPROF_STATE,
+};
+
+enum
+{
+    VMPROF_TIME,
+    VMPROF_INSTRUCTIONS,
+};
+
+extern int32_t g_vm_profile;
+extern uint64_t g_vmInstructionCount;
+
+// for VMPROF_STATE, id is the offset of the state's code in apScript
+void VM_ProfileEnter(int type, int id);
+void VM_ProfileLeave(void);
+
+void VM_ProfileReset(void);
+// writes one "frame;frame;frame value" line per call tree node, returns the number of lines or -1
+int VM_ProfileDump(char const *fileName, int metric);
+void VM_ProfilePrintTop(int numEntries);
+
+#endif
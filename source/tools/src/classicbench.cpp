@@ -0,0 +1,367 @@
+// Microbenchmark for the classic renderer column/span kernels in a-c.cpp
+//
+// Every kernel is run over a synthetic frame with each instruction set the
+// CPU and build support.  The output of the SIMD variants is compared
+// byte for byte against the scalar C code before they are timed.
+//
+// Usage: classicbench [passes]
+
+#include "compat.h"
+#include "a.h"
+#include "build_cpuid.h"
+#include "pragmas.h"
+
+#include <chrono>
+
+#ifndef ENGINE_USING_A_C
+int main(void)
+{
+    puts("classicbench: the engine is built with the assembly kernels, nothing to do.");
+    return 0;
+}
+#else
+
+// engine.cpp state the kernels read
+intptr_t asm1, asm2, asm3, asm4;
+int32_t globalx3, globaly3;
+int32_t globaltilesizy;
+int32_t sloptable[SLOPTABLESIZ];
+int32_t reciptable[2048];
+intptr_t palookupoffse[4];
+uint32_t vplce[4];
+int32_t vince[4];
+intptr_t bufplce[4];
+
+extern int32_t gpinc;
+
+#define BENCH_XDIM 1024
+#define BENCH_YDIM 768
+#define BENCH_BPL (BENCH_XDIM + 64)
+#define BENCH_LOGSIZ 6
+#define BENCH_TILESIZ (1 << BENCH_LOGSIZ)
+
+static char frame[BENCH_BPL * BENCH_YDIM];
+static char reference[BENCH_BPL * BENCH_YDIM];
+static char tile[BENCH_TILESIZ * BENCH_TILESIZ];
+static char palookup[2][256];
+static char transluc[65536];
+static intptr_t slopalookup[BENCH_YDIM];
+
+static uint32_t benchseed;
+
+static uint32_t benchrand(void)
+{
+    benchseed = benchseed * 1664525 + 1013904223;
+    return benchseed >> 8;
+}
+
+static char *framepix(int x, int y) { return &frame[y * BENCH_BPL + x]; }
+
+// Random lengths so that short spans and the scalar tails get checked as well.
+static int64_t benchpixels;
+
+static int benchlen(int const maxlen, int const numcols = 1, int const minlen = 1)
+{
+    int const len = minlen + benchrand() % (maxlen - minlen + 1);
+    benchpixels += len * numcols;
+    return len;
+}
+
+static void bench_hlineasm4(void)
+{
+    sethlinesizes(BENCH_LOGSIZ, BENCH_LOGSIZ, (intptr_t)tile);
+    setpalookupaddress(palookup[0]);
+
+    for (int y = 0; y < BENCH_YDIM; y++)
+    {
+        asm1 = (int32_t)(benchrand() << 12);
+        asm2 = (int32_t)(benchrand() << 12);
+        hlineasm4(benchlen(BENCH_XDIM) - 1, 0, 0, benchrand() << 8, benchrand() << 8, (intptr_t)framepix(BENCH_XDIM - 1, y));
+    }
+}
+
+static void bench_slopevlin(void)
+{
+    sethlinesizes(BENCH_LOGSIZ, BENCH_LOGSIZ, (intptr_t)tile);
+    gpinc = -BENCH_BPL;
+
+    for (int y = 0; y < BENCH_YDIM; y++)
+        slopalookup[y] = (intptr_t)palookup[y & 1];
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+    {
+        globalx3 = (int32_t)benchrand() >> 10;
+        globaly3 = (int32_t)benchrand() >> 10;
+        asm1 = (int32_t)(benchrand() & 1023) << 3;
+        asm3 = -(1 << 20) + (int32_t)(benchrand() & 0xffff);
+        slopevlin((intptr_t)framepix(x, BENCH_YDIM - 1), 0, (intptr_t)&slopalookup[BENCH_YDIM - 1], benchlen(BENCH_YDIM),
+                  benchrand() << 8, benchrand() << 8);
+    }
+}
+
+static int32_t benchvinc(void) { return (int32_t)(benchrand() & ((1 << 22) - 1)) + (1 << 16); }
+
+static void bench_vlineasm1(void)
+{
+    setupvlineasm(32 - BENCH_LOGSIZ);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+        vlineasm1(benchvinc(), (intptr_t)palookup[x & 1], benchlen(BENCH_YDIM) - 1, benchrand() << 8,
+                  (intptr_t)&tile[(x & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ], (intptr_t)framepix(x, 0));
+}
+
+static void bench_setup4(int const x)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        palookupoffse[i] = (intptr_t)palookup[i & 1];
+        bufplce[i] = (intptr_t)&tile[((x + i) & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ];
+        vince[i] = benchvinc();
+        vplce[i] = benchrand() << 8;
+    }
+}
+
+static void bench_vlineasm4(void)
+{
+    setupvlineasm(32 - BENCH_LOGSIZ);
+
+    for (int x = 0; x < BENCH_XDIM; x += 4)
+    {
+        bench_setup4(x);
+        vlineasm4(benchlen(BENCH_YDIM, 4), framepix(x, 0));
+    }
+}
+
+// Saturation is on, and with the random vplc/vinc a good part of the columns wraps around.
+static void bench_mvlineasm1(void)
+{
+    setupmvlineasm(32 - BENCH_LOGSIZ, 1);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+        mvlineasm1(benchvinc(), (intptr_t)palookup[x & 1], benchlen(BENCH_YDIM) - 1, benchrand() << 8,
+                   (intptr_t)&tile[(x & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ], (intptr_t)framepix(x, 0));
+}
+
+static void bench_mvlineasm4(void)
+{
+    setupmvlineasm(32 - BENCH_LOGSIZ, 1);
+
+    for (int x = 0; x < BENCH_XDIM; x += 4)
+    {
+        bench_setup4(x);
+        mvlineasm4(benchlen(BENCH_YDIM, 4), framepix(x, 0));
+    }
+}
+
+static void bench_tvlineasm1(void)
+{
+    setuptvlineasm(32 - BENCH_LOGSIZ, 0);
+    fixtransluscence((intptr_t)transluc);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+    {
+        if (x & 1)
+            settransreverse();
+        else
+            settransnormal();
+
+        tvlineasm1(benchvinc(), (intptr_t)palookup[x & 1], benchlen(BENCH_YDIM) - 1, benchrand() << 8,
+                   (intptr_t)&tile[(x & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ], (intptr_t)framepix(x, 0));
+    }
+
+    settransnormal();
+}
+
+static void bench_tvlineasm2(void)
+{
+    setuptvlineasm2(32 - BENCH_LOGSIZ, (intptr_t)palookup[0], (intptr_t)palookup[1]);
+    fixtransluscence((intptr_t)transluc);
+
+    for (int x = 0; x < BENCH_XDIM; x += 2)
+    {
+        asm1 = benchvinc();
+        asm2 = (intptr_t)framepix(x, benchlen(BENCH_YDIM, 2, 2) - 1) + 1;
+        tvlineasm2(benchrand() << 8, benchvinc(), (intptr_t)&tile[(x & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ],
+                   (intptr_t)&tile[((x + 1) & (BENCH_TILESIZ - 1)) << BENCH_LOGSIZ], benchrand() << 8,
+                   (intptr_t)framepix(x, 0));
+    }
+}
+
+static void bench_mhline(void)
+{
+    msethlineshift(BENCH_LOGSIZ, BENCH_LOGSIZ);
+    asm3 = (intptr_t)palookup[0];
+
+    for (int y = 0; y < BENCH_YDIM; y++)
+    {
+        asm1 = (int32_t)(benchrand() << 12);
+        asm2 = (int32_t)(benchrand() << 12);
+        mhline((intptr_t)tile, benchrand() << 8, (benchlen(BENCH_XDIM) - 1) << 16, 0, benchrand() << 8, (intptr_t)framepix(0, y));
+    }
+}
+
+static void bench_thline(void)
+{
+    tsethlineshift(BENCH_LOGSIZ, BENCH_LOGSIZ);
+    fixtransluscence((intptr_t)transluc);
+    asm3 = (intptr_t)palookup[1];
+
+    for (int y = 0; y < BENCH_YDIM; y++)
+    {
+        asm1 = (int32_t)(benchrand() << 12);
+        asm2 = (int32_t)(benchrand() << 12);
+        thline((intptr_t)tile, benchrand() << 8, (benchlen(BENCH_XDIM) - 1) << 16, 0, benchrand() << 8, (intptr_t)framepix(0, y));
+    }
+}
+
+// Stays inside the tile: at most BENCH_TILESIZ texels are stepped over per column.
+static int32_t benchspriteinc(void) { return (int32_t)(benchrand() % ((BENCH_TILESIZ << 16) / BENCH_YDIM)); }
+
+static void bench_spritevline(void)
+{
+    setvlinebpl(BENCH_BPL);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+    {
+        setupspritevline((intptr_t)palookup[x & 1], benchspriteinc(), benchspriteinc(), BENCH_TILESIZ);
+        spritevline(0, 0, benchlen(BENCH_YDIM) + 1, (intptr_t)tile, (intptr_t)framepix(x, 0));
+    }
+}
+
+static void bench_mspritevline(void)
+{
+    setvlinebpl(BENCH_BPL);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+    {
+        msetupspritevline((intptr_t)palookup[x & 1], benchspriteinc(), benchspriteinc(), BENCH_TILESIZ);
+        mspritevline(0, 0, benchlen(BENCH_YDIM) + 1, (intptr_t)tile, (intptr_t)framepix(x, 0));
+    }
+}
+
+static void bench_tspritevline(void)
+{
+    setvlinebpl(BENCH_BPL);
+    fixtransluscence((intptr_t)transluc);
+
+    for (int x = 0; x < BENCH_XDIM; x++)
+    {
+        tsetupspritevline((intptr_t)palookup[x & 1], benchspriteinc(), benchspriteinc(), BENCH_TILESIZ);
+        tspritevline(0, 0, benchlen(BENCH_YDIM) + 1, (intptr_t)tile, (intptr_t)framepix(x, 0));
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    void (*func)(void);
+} benchkernel_t;
+
+static benchkernel_t const kernels[] = {
+    { "hlineasm4", bench_hlineasm4 },
+    { "slopevlin", bench_slopevlin },
+    { "vlineasm1", bench_vlineasm1 },
+    { "vlineasm4", bench_vlineasm4 },
+    { "mvlineasm1", bench_mvlineasm1 },
+    { "mvlineasm4", bench_mvlineasm4 },
+    { "tvlineasm1", bench_tvlineasm1 },
+    { "tvlineasm2", bench_tvlineasm2 },
+    { "mhline", bench_mhline },
+    { "thline", bench_thline },
+    { "spritevline", bench_spritevline },
+    { "mspritevline", bench_mspritevline },
+    { "tspritevline", bench_tspritevline },
+};
+
+// Same seed and starting frame for every run, so that all ISAs see the same input.
+static void runkernel(benchkernel_t const &k, int const passes)
+{
+    benchseed = 0x1234567;
+    benchpixels = 0;
+
+    for (int i = 0; i < BENCH_BPL * BENCH_YDIM; i++)
+        frame[i] = (char)i;
+
+    for (int i = 0; i < passes; i++)
+        k.func();
+}
+
+int main(int argc, char **argv)
+{
+    int const passes = argc > 1 ? max(1, Batoi(argv[1])) : 20;
+    int mismatches = 0;
+
+    engineCreateAllocator();
+    initdivtables();
+
+    sysReadCPUID();
+    a_c_init();
+
+    for (int i = 0; i < 2048; i++)
+        reciptable[i] = divscale30(2048, i + 2048);
+
+    for (int i = 0; i < SLOPTABLESIZ; i++)
+        sloptable[i] = krecipasm(i - HALFSLOPTABLESIZ);
+
+    benchseed = 1;
+
+    for (auto &texel : tile)
+        texel = (benchrand() & 7) ? benchrand() % 255 : 255;
+
+    for (int i = 0; i < 256; i++)
+    {
+        palookup[0][i] = i ^ 0x55;
+        palookup[1][i] = 255 - i;
+    }
+
+    for (int i = 0; i < 65536; i++)
+        transluc[i] = ((i >> 8) + (i & 255)) >> 1;
+
+    setvlinebpl(BENCH_BPL);
+
+    printf("%d x %d frame, %d passes per kernel\n\n", BENCH_XDIM, BENCH_YDIM, passes);
+    printf("%-14s", "kernel");
+
+    for (int isa = 0; isa < A_C_ISA_COUNT; isa++)
+        if (a_c_isasupported(isa))
+            printf("%14s", a_c_isaname(isa));
+
+    printf("   (Mpixels/s)\n");
+
+    for (auto const &k : kernels)
+    {
+        printf("%-14s", k.name);
+
+        for (int isa = 0; isa < A_C_ISA_COUNT; isa++)
+        {
+            if (a_c_setisa(isa) < 0)
+                continue;
+
+            runkernel(k, 1);
+
+            if (isa == A_C_ISA_SCALAR)
+                Bmemcpy(reference, frame, sizeof(frame));
+            else if (Bmemcmp(reference, frame, sizeof(frame)))
+            {
+                printf("%14s", "MISMATCH");
+                mismatches++;
+                continue;
+            }
+
+            auto const start = std::chrono::high_resolution_clock::now();
+            runkernel(k, passes);
+            std::chrono::duration<double> const elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            printf("%14.1f", (double)benchpixels / elapsed.count() * 1e-6);
+        }
+
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (mismatches)
+        printf("\n%d kernel/ISA combinations differ from the C code!\n", mismatches);
+
+    return mismatches != 0;
+}
+#endif
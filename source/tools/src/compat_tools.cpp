@@ -2,6 +2,10 @@
 
 #include "compat.h"
 
+// kpdecodemulti() runs on the thread pool
+#define LIBASYNC_IMPLEMENTATION
+#include "libasync_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
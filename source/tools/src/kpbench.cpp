@@ -0,0 +1,355 @@
+// Decode throughput benchmark for the PNG/JPG decoders in kplib.cpp
+//
+// Every picture is decoded with each instruction set the CPU and build
+// support, and the pixels are compared byte for byte against those of the
+// scalar C code before the decoder is timed.  Without any files, a set of
+// synthetic PNGs is made up: random lines with every filter type, in every
+// colour type, at widths that leave the vector code with a scalar tail, and
+// interlaced.  Those are stored rather than compressed, so the
+// timings are mostly unfiltering; pass real hightile PNGs and JPGs for the
+// whole picture.  The last row decodes all pictures at once with
+// kpdecodemulti().
+//
+// Usage: kpbench [-passes N] [file ...]
+
+#include "compat.h"
+#include "build_cpuid.h"
+#include "crc32.h"
+#include "kplib.h"
+#include "libasync_config.h"
+
+#include <chrono>
+#include <vector>
+
+typedef struct
+{
+    char name[32];
+    std::vector<char> data;
+    int32_t xsiz, ysiz;
+    intptr_t reference;
+} benchpic_t;
+
+static std::vector<benchpic_t> pics;
+
+static uint32_t benchseed = 1;
+
+static uint32_t benchrand(void)
+{
+    benchseed = benchseed * 1664525 + 1013904223;
+    return benchseed >> 8;
+}
+
+static void putbe32(std::vector<char> &buf, uint32_t const v)
+{
+    for (int i = 24; i >= 0; i -= 8)
+        buf.push_back((char)(v >> i));
+}
+
+static void putchunk(std::vector<char> &png, char const *type, std::vector<char> const &data)
+{
+    std::vector<char> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+
+    putbe32(png, data.size());
+    png.insert(png.end(), chunk.begin(), chunk.end());
+    putbe32(png, Bcrc32(chunk.data(), chunk.size(), 0));
+}
+
+// Random lines with random filter types.  The pixel data isn't meant to look like anything; the
+// decoder does the same work whatever the bytes are.
+static void makelines(std::vector<char> &raw, int const numlines, int const linebytes)
+{
+    for (int y = 0; y < numlines; y++)
+    {
+        raw.push_back(benchrand() % 5);
+
+        for (int x = 0; x < linebytes; x++)
+            raw.push_back((char)benchrand());
+    }
+}
+
+static void makepng(int const xsiz, int const ysiz, int const coltype, int const interlaced)
+{
+    static int const channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    static char const *const coltypenames[7] = { "gray", "", "rgb", "pal", "graya", "", "rgba" };
+    int const bpp = channels[coltype];
+
+    benchpic_t pic;
+    Bsnprintf(pic.name, sizeof(pic.name), "%dx%d %s%s", xsiz, ysiz, coltypenames[coltype], interlaced ? " adam7" : "");
+
+    std::vector<char> &png = pic.data;
+    char const signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+    png.assign(signature, signature + 8);
+
+    std::vector<char> chunk;
+    putbe32(chunk, xsiz);
+    putbe32(chunk, ysiz);
+    chunk.push_back(8);
+    chunk.push_back(coltype);
+    chunk.push_back(0);
+    chunk.push_back(0);
+    chunk.push_back(interlaced);
+    putchunk(png, "IHDR", chunk);
+
+    if (coltype == 3)
+    {
+        chunk.clear();
+
+        for (int i = 0; i < 256*3; i++)
+            chunk.push_back((char)benchrand());
+
+        putchunk(png, "PLTE", chunk);
+    }
+
+    std::vector<char> raw;
+
+    if (interlaced)
+    {
+        static int const adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+                                         { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+        for (auto const &pass : adam7)
+        {
+            int const passxsiz = (xsiz - pass[0] + pass[2] - 1) / pass[2];
+            int const passysiz = (ysiz - pass[1] + pass[3] - 1) / pass[3];
+
+            if (passxsiz > 0 && passysiz > 0)
+                makelines(raw, passysiz, passxsiz * bpp);
+        }
+    }
+    else
+        makelines(raw, ysiz, xsiz * bpp);
+
+    // zlib stream of stored deflate blocks
+    chunk.clear();
+    chunk.push_back(0x78);
+    chunk.push_back(0x01);
+
+    uint32_t adler_a = 1, adler_b = 0;
+
+    for (size_t pos = 0; pos < raw.size();)
+    {
+        size_t const leng = min<size_t>(raw.size() - pos, 65535);
+
+        chunk.push_back(pos + leng == raw.size());
+        chunk.push_back(leng & 255);
+        chunk.push_back(leng >> 8);
+        chunk.push_back(~leng & 255);
+        chunk.push_back((~leng >> 8) & 255);
+
+        for (size_t i = pos; i < pos + leng; i++)
+        {
+            adler_a = (adler_a + (uint8_t)raw[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+
+        chunk.insert(chunk.end(), raw.begin() + pos, raw.begin() + pos + leng);
+        pos += leng;
+    }
+
+    putbe32(chunk, (adler_b << 16) | adler_a);
+    putchunk(png, "IDAT", chunk);
+
+    chunk.clear();
+    putchunk(png, "IEND", chunk);
+
+    pics.push_back(std::move(pic));
+}
+
+static int loadpic(char const *filename)
+{
+    BFILE *fil = Bfopen(filename, "rb");
+
+    if (!fil)
+    {
+        printf("kpbench: can't open %s\n", filename);
+        return -1;
+    }
+
+    char const *basename = filename;
+
+    for (char const *p = filename; *p; p++)
+        if (*p == '/' || *p == '\\')
+            basename = p+1;
+
+    benchpic_t pic;
+    Bstrncpyz(pic.name, basename, sizeof(pic.name));
+
+    Bfseek(fil, 0, SEEK_END);
+    pic.data.resize(Bftell(fil));
+    Bfseek(fil, 0, SEEK_SET);
+
+    size_t const leng = Bfread(pic.data.data(), 1, pic.data.size(), fil);
+    Bfclose(fil);
+
+    if (leng != pic.data.size())
+    {
+        printf("kpbench: can't read %s\n", filename);
+        return -1;
+    }
+
+    pics.push_back(std::move(pic));
+    return 0;
+}
+
+static kpimage_t decodepic(benchpic_t const &pic)
+{
+    kpimage_t img = { pic.data.data(), (int32_t)pic.data.size(), 0, 0, 0 };
+    kpdecode(&img);
+    return img;
+}
+
+static double elapsedsince(std::chrono::high_resolution_clock::time_point const start)
+{
+    std::chrono::duration<double> const elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    int passes = 10;
+    int mismatches = 0;
+
+    engineCreateAllocator();
+    initcrc32table();
+
+    sysReadCPUID();
+    kpinit();
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!Bstrcasecmp(argv[i], "-passes") && i+1 < argc)
+            passes = max(1, Batoi(argv[++i]));
+        else if (loadpic(argv[i]))
+            return 1;
+    }
+
+    if (pics.empty())
+    {
+        makepng(1024, 1024, 6, 0);
+        makepng(1024, 1024, 2, 0);
+        makepng(2048, 256, 6, 0);
+        makepng(1023, 97, 2, 0);
+        makepng(1021, 97, 6, 0);
+        makepng(517, 93, 4, 0);
+        makepng(517, 93, 0, 0);
+        makepng(517, 93, 3, 0);
+        makepng(301, 203, 6, 1);
+        makepng(301, 203, 2, 1);
+    }
+
+    int64_t totalpixels = 0;
+
+    // The scalar code is the reference for all the others.
+    kpsetisa(KPLIB_ISA_SCALAR);
+
+    for (auto &pic : pics)
+    {
+        kpimage_t const img = decodepic(pic);
+
+        if (!img.pic)
+        {
+            printf("kpbench: can't decode %s\n", pic.name);
+            return 1;
+        }
+
+        pic.xsiz = img.xsiz;
+        pic.ysiz = img.ysiz;
+        pic.reference = img.pic;
+        totalpixels += (int64_t)img.xsiz * img.ysiz;
+    }
+
+    printf("%d pictures, %d passes each\n\n", (int)pics.size(), passes);
+    printf("%-32s", "picture");
+
+    for (int isa = 0; isa < KPLIB_ISA_COUNT; isa++)
+        if (kpisasupported(isa))
+            printf("%10s", kpisaname(isa));
+
+    printf("   (Mpixels/s)\n");
+
+    for (auto const &pic : pics)
+    {
+        printf("%-32s", pic.name);
+
+        for (int isa = 0; isa < KPLIB_ISA_COUNT; isa++)
+        {
+            if (kpsetisa(isa) < 0)
+                continue;
+
+            kpimage_t img = decodepic(pic);
+            bool const match = img.pic && img.xsiz == pic.xsiz && img.ysiz == pic.ysiz &&
+                               !Bmemcmp((void *)img.pic, (void *)pic.reference, pic.xsiz * pic.ysiz * sizeof(int32_t));
+            Xfree((void *)img.pic);
+
+            if (!match)
+            {
+                printf("%10s", "MISMATCH");
+                mismatches++;
+                continue;
+            }
+
+            auto const start = std::chrono::high_resolution_clock::now();
+
+            for (int i = 0; i < passes; i++)
+            {
+                img = decodepic(pic);
+                Xfree((void *)img.pic);
+            }
+
+            printf("%10.1f", (double)pic.xsiz * pic.ysiz * passes / elapsedsince(start) * 1e-6);
+        }
+
+        printf("\n");
+        fflush(stdout);
+    }
+
+    printf("%-32s", "all, kpdecodemulti");
+
+    std::vector<kpimage_t> images(pics.size());
+
+    for (int isa = 0; isa < KPLIB_ISA_COUNT; isa++)
+    {
+        if (kpsetisa(isa) < 0)
+            continue;
+
+        double elapsed = 0;
+        bool match = true;
+
+        for (int i = 0; i < passes; i++)
+        {
+            for (size_t j = 0; j < pics.size(); j++)
+                images[j] = { pics[j].data.data(), (int32_t)pics[j].data.size(), 0, 0, 0 };
+
+            auto const start = std::chrono::high_resolution_clock::now();
+            kpdecodemulti(images.data(), images.size());
+            elapsed += elapsedsince(start);
+
+            for (size_t j = 0; j < pics.size(); j++)
+            {
+                match &= images[j].pic && !Bmemcmp((void *)images[j].pic, (void *)pics[j].reference,
+                                                   pics[j].xsiz * pics[j].ysiz * sizeof(int32_t));
+
+                Xfree((void *)images[j].pic);
+            }
+        }
+
+        if (match)
+            printf("%10.1f", (double)totalpixels * passes / elapsed * 1e-6);
+        else
+        {
+            printf("%10s", "MISMATCH");
+            mismatches++;
+        }
+    }
+
+    printf("   (%d threads)\n", (int)async::hardware_concurrency());
+
+    for (auto &pic : pics)
+        Xfree((void *)pic.reference);
+
+    if (mismatches)
+        printf("\n%d picture/ISA combinations differ from the C code!\n", mismatches);
+
+    return mismatches != 0;
+}
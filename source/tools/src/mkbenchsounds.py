@@ -0,0 +1,393 @@
+#!/usr/bin/env python3
+#
+# Writes the sounds used by package/sdk/samples/benchaudio.txt, see
+# benchaudio.h, into the given directory:
+#
+#   bench.wav   16-bit stereo PCM, 22050 Hz
+#   bench.voc   8-bit unsigned mono Creative Voice File, 11025 Hz
+#   bench.ogg   mono Ogg Vorbis, 22050 Hz
+#   bench.flac  16-bit mono FLAC, 44100 Hz
+#
+# Everything is made with integer arithmetic only, so the files come out the
+# same byte for byte everywhere and the golden hashes in the script stay
+# valid.  No encoder libraries are needed: the FLAC frames are stored
+# verbatim, and the Vorbis stream is written by hand with a single
+# floor-and-residue setup whose spectral lines are placed directly instead of
+# coming out of an MDCT of some input.  The streams are valid and decode the
+# same with any conforming decoder, they just don't compress.
+#
+# Usage: mkbenchsounds.py [directory]
+
+import os
+import struct
+import sys
+
+seed = 1
+
+
+def rand():
+    global seed
+    seed = (seed * 1664525 + 1013904223) & 0xffffffff
+    return seed >> 8
+
+
+def triangle(phase, amp):
+    # phase is 16.16 fixed point turns
+    p = phase & 0xffff
+    v = p * 4 - 0x10000 if p < 0x8000 else 0x30000 - p * 4
+    return v * amp >> 16
+
+
+def square(phase, amp):
+    return amp if phase & 0x8000 else -amp
+
+
+def tone(rate, hz):
+    # per-sample phase increment in 16.16 turns
+    return hz * 65536 // rate
+
+
+def clamp16(v):
+    return max(-32768, min(32767, v))
+
+
+# --- WAV ---
+
+def makewav(path):
+    rate, frames = 22050, 22050
+    l, r = tone(rate, 220), tone(rate, 331)
+    data = bytearray()
+
+    for i in range(frames):
+        env = 0x10000 - i * 0x10000 // frames
+        left = triangle(i * l, 12000) + square(i * l * 2, 1500)
+        right = triangle(i * r, 12000) + (rand() & 0x3ff) - 0x200
+        data += struct.pack('<hh', clamp16(left * env >> 16), clamp16(right * env >> 16))
+
+    fmt = struct.pack('<HHIIHH', 1, 2, rate, rate * 4, 4, 16)
+
+    with open(path, 'wb') as f:
+        f.write(b'RIFF' + struct.pack('<I', 4 + 8 + len(fmt) + 8 + len(data)) + b'WAVE')
+        f.write(b'fmt ' + struct.pack('<I', len(fmt)) + fmt)
+        f.write(b'data' + struct.pack('<I', len(data)) + data)
+
+
+# --- VOC ---
+
+def makevoc(path):
+    rate, frames = 11025, 8820
+    step = tone(rate, 440)
+    data = bytearray()
+
+    for i in range(frames):
+        # a falling sweep with a bit of noise
+        v = square(i * (step - i * step // (frames * 2)), 40) + (rand() & 15) - 8
+        data.append(128 + v)
+
+    with open(path, 'wb') as f:
+        f.write(b'Creative Voice File\x1a' + struct.pack('<HHH', 26, 0x010a, 0x1129))
+        # sound data block: time constant and codec (8-bit unsigned PCM)
+        block = struct.pack('<BB', 256 - 1000000 // rate, 0) + bytes(data)
+        f.write(struct.pack('<B', 1) + struct.pack('<I', len(block))[:3] + block)
+        f.write(b'\x00')
+
+
+# --- FLAC ---
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xff if crc & 0x80 else (crc << 1) & 0xff
+    return crc
+
+
+def crc16(data):
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x8005) & 0xffff if crc & 0x8000 else (crc << 1) & 0xffff
+    return crc
+
+
+class MSBWriter:
+    def __init__(self):
+        self.bits = []
+
+    def put(self, value, n):
+        for i in range(n - 1, -1, -1):
+            self.bits.append((value >> i) & 1)
+
+    def tobytes(self):
+        while len(self.bits) & 7:
+            self.bits.append(0)
+        return bytes(int(''.join(map(str, self.bits[i:i + 8])), 2) for i in range(0, len(self.bits), 8))
+
+
+def flacutf8(n):
+    # frame numbers are UTF-8 coded; the files here have fewer than 128 frames
+    assert n < 0x80
+    return bytes([n])
+
+
+def makeflac(path):
+    rate, frames, blocksize = 44100, 33075, 4096
+    a, b = tone(rate, 523), tone(rate, 659)
+    samples = []
+
+    for i in range(frames):
+        env = min(i, frames - i, 2048) * 0x10000 // 2048
+        samples.append(clamp16((triangle(i * a, 9000) + triangle(i * b, 7000)) * env >> 16))
+
+    w = MSBWriter()
+    w.put(blocksize, 16)  # min block size
+    w.put(blocksize, 16)  # max block size
+    w.put(0, 24)          # min frame size, unknown
+    w.put(0, 24)          # max frame size, unknown
+    w.put(rate, 20)
+    w.put(0, 3)           # channels - 1
+    w.put(15, 5)          # bits per sample - 1
+    w.put(frames, 36)
+    w.put(0, 128)         # no MD5
+    streaminfo = w.tobytes()
+
+    out = bytearray(b'fLaC')
+    out += bytes([0x80]) + struct.pack('>I', len(streaminfo))[1:] + streaminfo
+
+    for num, start in enumerate(range(0, frames, blocksize)):
+        block = samples[start:start + blocksize]
+        w = MSBWriter()
+        w.put(0x3ffe, 14)     # sync
+        w.put(0, 1)
+        w.put(0, 1)           # fixed block size
+        w.put(12 if len(block) == blocksize else 7, 4)  # 4096, or 16 bits at the end of the header
+        w.put(9, 4)           # 44100 Hz
+        w.put(0, 4)           # mono
+        w.put(4, 3)           # 16 bits per sample
+        w.put(0, 1)
+        header = w.tobytes() + flacutf8(num)
+        if len(block) != blocksize:
+            header += struct.pack('>H', len(block) - 1)
+        header += bytes([crc8(header)])
+
+        w = MSBWriter()
+        w.put(0, 1)
+        w.put(1, 6)           # verbatim subframe
+        w.put(0, 1)           # no wasted bits
+        for s in block:
+            w.put(s & 0xffff, 16)
+        frame = header + w.tobytes()
+        out += frame + struct.pack('>H', crc16(frame))
+
+    with open(path, 'wb') as f:
+        f.write(out)
+
+
+# --- Ogg Vorbis ---
+
+class LSBWriter:
+    def __init__(self):
+        self.acc = 0
+        self.n = 0
+
+    def put(self, value, n):
+        self.acc |= (value & ((1 << n) - 1)) << self.n
+        self.n += n
+
+    def putbytes(self, data):
+        for b in data:
+            self.put(b, 8)
+
+    def tobytes(self):
+        return self.acc.to_bytes((self.n + 7) // 8, 'little')
+
+
+def vorbisfloat(mantissa, exponent):
+    # value = mantissa * 2^exponent
+    sign = 0x80000000 if mantissa < 0 else 0
+    return sign | ((exponent + 788) << 21) | abs(mantissa)
+
+
+def oggcrc(data):
+    crc = 0
+    for b in data:
+        crc ^= b << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04c11db7) & 0xffffffff if crc & 0x80000000 else (crc << 1) & 0xffffffff
+    return crc
+
+
+def oggpage(packets, granule, seq, flags):
+    lacing = bytearray()
+    for p in packets:
+        lacing += bytes([255] * (len(p) // 255) + [len(p) % 255])
+    page = bytearray(b'OggS' + struct.pack('<BBqIII', 0, flags, granule, 0x42454e43, seq, 0))
+    page += bytes([len(lacing)]) + lacing + b''.join(packets)
+    page[22:26] = struct.pack('<I', oggcrc(page))
+    return bytes(page)
+
+
+VORBIS_SHORT = 8          # log2 of the block size, only short blocks are used
+VORBIS_HALF = 1 << (VORBIS_SHORT - 1)
+VORBIS_PARTITION = 8      # residue partition size
+VORBIS_FLOORY = 184       # floor level, an index into the decoder's dB table
+
+
+def vorbisheaders(rate):
+    w = LSBWriter()
+    w.put(1, 8)
+    w.putbytes(b'vorbis')
+    w.put(0, 32)          # version
+    w.put(1, 8)           # channels
+    w.put(rate, 32)
+    w.put(0, 32)
+    w.put(0, 32)
+    w.put(0, 32)
+    w.put(VORBIS_SHORT, 4)
+    w.put(11, 4)          # long blocks, unused
+    w.put(1, 1)
+    ident = w.tobytes()
+
+    vendor = b'mkbenchsounds'
+    w = LSBWriter()
+    w.put(3, 8)
+    w.putbytes(b'vorbis')
+    w.put(len(vendor), 32)
+    w.putbytes(vendor)
+    w.put(0, 32)          # no comments
+    w.put(1, 1)
+    comment = w.tobytes()
+
+    w = LSBWriter()
+    w.put(5, 8)
+    w.putbytes(b'vorbis')
+
+    # book 0 picks the residue class of a partition, book 1 holds residue values -8..7
+    w.put(2 - 1, 8)
+    for entries, bits, lookup in ((2, 1, False), (16, 4, True)):
+        w.put(0x564342, 24)
+        w.put(1, 16)      # dimensions
+        w.put(entries, 24)
+        w.put(0, 1)       # not ordered
+        w.put(0, 1)       # not sparse
+        for _ in range(entries):
+            w.put(bits - 1, 5)
+        if lookup:
+            w.put(1, 4)
+            w.put(vorbisfloat(-8, 0), 32)
+            w.put(vorbisfloat(1, 0), 32)
+            w.put(4 - 1, 4)  # value bits
+            w.put(0, 1)      # not a sequence
+            for i in range(entries):
+                w.put(i, 4)
+        else:
+            w.put(0, 4)
+
+    w.put(1 - 1, 6)       # time domain transforms
+    w.put(0, 16)
+
+    w.put(1 - 1, 6)       # floors: type 1 with just the two end points
+    w.put(1, 16)
+    w.put(0, 5)           # partitions
+    w.put(1 - 1, 2)       # multiplier
+    w.put(VORBIS_SHORT - 1, 4)  # range bits, the last point is at the end of a short block
+
+    w.put(1 - 1, 6)       # residues: type 1, class 0 is silent, class 1 uses book 1
+    w.put(1, 16)
+    w.put(0, 24)
+    w.put(VORBIS_HALF, 24)
+    w.put(VORBIS_PARTITION - 1, 24)
+    w.put(2 - 1, 6)
+    w.put(0, 8)           # classification book
+    w.put(0, 3); w.put(0, 1)
+    w.put(1, 3); w.put(0, 1)
+    w.put(1, 8)
+
+    w.put(1 - 1, 6)       # mappings
+    w.put(0, 16)
+    w.put(0, 1)           # one submap
+    w.put(0, 1)           # no coupling
+    w.put(0, 2)
+    w.put(0, 8)
+    w.put(0, 8)           # floor
+    w.put(0, 8)           # residue
+
+    w.put(1 - 1, 6)       # modes
+    w.put(0, 1)           # short blocks
+    w.put(0, 16)
+    w.put(0, 16)
+    w.put(0, 8)
+
+    w.put(1, 1)
+    setup = w.tobytes()
+
+    return ident, comment, setup
+
+
+def vorbispacket(lines):
+    w = LSBWriter()
+    w.put(0, 1)           # audio packet; one mode, so no mode bits
+    w.put(1, 1)           # floor in use
+    w.put(VORBIS_FLOORY, 8)
+    w.put(VORBIS_FLOORY, 8)
+
+    res = [0] * VORBIS_HALF
+    for bin, value in lines:
+        res[bin] = value
+
+    for start in range(0, VORBIS_HALF, VORBIS_PARTITION):
+        part = res[start:start + VORBIS_PARTITION]
+        used = any(part)
+        w.put(int(used), 1)
+        if used:
+            for v in part:
+                # codewords are read MSB first
+                c = v + 8
+                for i in range(3, -1, -1):
+                    w.put((c >> i) & 1, 1)
+
+    return w.tobytes()
+
+
+def makeogg(path):
+    rate, packets = 22050, 520
+    ident, comment, setup = vorbisheaders(rate)
+
+    pages = [oggpage([ident], 0, 0, 0x02), oggpage([comment, setup], 0, 1, 0)]
+    audio = []
+
+    for p in range(packets):
+        note = (p // 40) % 6
+        base = (4, 5, 6, 8, 6, 5)[note]
+        lines = [(base, 7 if p & 1 else -7), (base * 2, 4 if p & 2 else -4), (base * 3, 2)]
+        if p % 40 < 4:
+            # a short burst of noise at every note
+            lines += [(12 + (rand() % 100), (rand() % 15) - 7) for _ in range(6)]
+        audio.append(vorbispacket(lines))
+
+    seq = 2
+    for first in range(0, packets, 16):
+        chunk = audio[first:first + 16]
+        last = first + len(chunk) == packets
+        # every packet after the first one finishes VORBIS_HALF samples
+        granule = (first + len(chunk) - 1) * VORBIS_HALF
+        pages.append(oggpage(chunk, granule, seq, 0x04 if last else 0))
+        seq += 1
+
+    with open(path, 'wb') as f:
+        f.write(b''.join(pages))
+
+
+def main():
+    outdir = sys.argv[1] if len(sys.argv) > 1 else '.'
+
+    makewav(os.path.join(outdir, 'bench.wav'))
+    makevoc(os.path.join(outdir, 'bench.voc'))
+    makeflac(os.path.join(outdir, 'bench.flac'))
+    makeogg(os.path.join(outdir, 'bench.ogg'))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,219 @@
+// Round-trip check for the span diffs in spandiff.h
+//
+// For each element size, a few hand-made cases (no change, a single element,
+// changes close enough to share a span, changes at the very end of the array,
+// spans written in several pieces the way the savegame code does for dirty
+// records) and a few thousand random ones are diffed, and the diff is applied
+// to a copy of the old array, which must then match the new one.  The number
+// of spans is checked where the case makes it obvious, and spans that run past
+// the end of the array must be rejected.
+//
+// Usage: spandiffcheck [-random N]
+
+#include "compat.h"
+#include "spandiff.h"
+
+#include <vector>
+
+static int failures;
+
+static uint32_t checkseed = 1;
+
+static uint32_t checkrand(void)
+{
+    checkseed = checkseed * 1664525 + 1013904223;
+    return checkseed >> 8;
+}
+
+#define CHECK(cond, ...)                   \
+    do                                     \
+    {                                      \
+        if (!(cond))                       \
+        {                                  \
+            printf("spandiffcheck: ");     \
+            printf(__VA_ARGS__);           \
+            printf("\n");                  \
+            failures++;                    \
+        }                                  \
+    } while (0)
+
+// the number of spans in a diff that applies cleanly
+template <typename Dat>
+static int countspans(uint8_t *diff)
+{
+    int spans = 0;
+    uint32_t len, gap;
+
+    while ((diff = spandiffGetVarint(diff, &len)) != NULL && len)
+    {
+        diff = spandiffGetVarint(diff, &gap) + len * sizeof(Dat);
+        spans++;
+    }
+
+    return spans;
+}
+
+// Diff newarr against oldarr in the pieces given by ranges (pairs of start and end elements, the whole
+// array if empty), apply the diff to another copy of oldarr and compare.  Returns the number of spans.
+template <typename Dat>
+static int roundtrip(char const *name, std::vector<Dat> const &oldarr, std::vector<Dat> const &newarr,
+                     std::vector<uint32_t> const &ranges = std::vector<uint32_t>())
+{
+    uint32_t const nelts = oldarr.size();
+    std::vector<Dat> dump(oldarr), applied(oldarr);
+    std::vector<uint8_t> diff(nelts * (sizeof(Dat) + 10) + 16);
+
+    uint32_t spanend = 0;
+    uint8_t *d = diff.data();
+
+    if (ranges.empty())
+        d = spandiffEncode(newarr.data(), dump.data(), 0, nelts, &spanend, d);
+    else
+        for (size_t i = 0; i < ranges.size(); i += 2)
+            d = spandiffEncode(newarr.data(), dump.data(), ranges[i], ranges[i+1], &spanend, d);
+
+    *d++ = 0;
+
+    CHECK((size_t)(d - diff.data()) <= diff.size(), "%s, %d-bit: diff overran its buffer", name, (int)sizeof(Dat)*8);
+
+    // without ranges, the dump must have been brought up to date completely
+    if (ranges.empty())
+        CHECK(dump == newarr, "%s, %d-bit: the encoder didn't update the dump", name, (int)sizeof(Dat)*8);
+
+    uint8_t const *const end = spandiffApply(applied.data(), nelts, diff.data());
+
+    CHECK(end == d, "%s, %d-bit: diff of %d bytes applied up to byte %d", name, (int)sizeof(Dat)*8,
+          (int)(d - diff.data()), end ? (int)(end - diff.data()) : -1);
+    CHECK(applied == dump, "%s, %d-bit: applied diff doesn't reproduce the new array", name, (int)sizeof(Dat)*8);
+
+    return countspans<Dat>(diff.data());
+}
+
+template <typename Dat>
+static void checkcases(int const randomcases)
+{
+    int const bits = sizeof(Dat)*8;
+    uint32_t const nelts = 301;  // not a whole number of blocks for any element size
+    uint32_t const maxgap = 2 / sizeof(Dat);
+
+    std::vector<Dat> oldarr(nelts);
+
+    for (auto &v : oldarr)
+        v = (Dat)checkrand();
+
+    std::vector<Dat> newarr(oldarr);
+
+    CHECK(roundtrip("no change", oldarr, newarr) == 0, "no change, %d-bit: spans written", bits);
+
+    std::vector<Dat> emptyarr;
+    CHECK(roundtrip("empty array", emptyarr, emptyarr) == 0, "empty array, %d-bit: spans written", bits);
+
+    newarr[0] ^= 1;
+    CHECK(roundtrip("first element", oldarr, newarr) == 1, "first element, %d-bit: not one span", bits);
+    newarr = oldarr;
+
+    newarr[150] ^= 1;
+    CHECK(roundtrip("single element", oldarr, newarr) == 1, "single element, %d-bit: not one span", bits);
+
+    // as far apart as can still share a span
+    newarr[150 + maxgap + 1] ^= 1;
+    CHECK(roundtrip("coalesced", oldarr, newarr) == 1, "coalesced, %d-bit: not one span", bits);
+
+    newarr[150 + 2*maxgap + 3] ^= 1;
+    CHECK(roundtrip("coalesced and apart", oldarr, newarr) == 2, "coalesced and apart, %d-bit: not two spans", bits);
+    newarr = oldarr;
+
+    newarr[nelts-1] ^= 1;
+    CHECK(roundtrip("last element", oldarr, newarr) == 1, "last element, %d-bit: not one span", bits);
+
+    newarr[nelts-2] ^= 1;
+    newarr[nelts-40] ^= 1;
+    CHECK(roundtrip("end of array", oldarr, newarr) == 2, "end of array, %d-bit: not two spans", bits);
+
+    for (auto &v : newarr)
+        v = ~v;
+    CHECK(roundtrip("everything", oldarr, newarr) == 1, "everything, %d-bit: not one span", bits);
+
+    // dirty records: only the ranges are looked at, and the gaps are counted from the end of the last span
+    std::vector<uint32_t> const ranges = { 10, 20, 21, 22, 100, 300 };
+    roundtrip("ranges", oldarr, newarr, ranges);
+
+    // spans that don't fit the array
+    {
+        std::vector<Dat> arr(oldarr);
+        uint8_t diff[32], *d = diff;
+
+        d = spandiffPutVarint(d, 2);
+        d = spandiffPutVarint(d, nelts-1);
+        Bmemset(d, 0, 2*sizeof(Dat));
+        d += 2*sizeof(Dat);
+        *d = 0;
+
+        CHECK(spandiffApply(arr.data(), nelts, diff) == NULL, "past the end, %d-bit: not rejected", bits);
+        CHECK(arr == oldarr, "past the end, %d-bit: array written", bits);
+
+        d = spandiffPutVarint(diff, 1);
+        d = spandiffPutVarint(d, nelts);
+        *d = 0;
+
+        CHECK(spandiffApply(arr.data(), nelts, diff) == NULL, "gap past the end, %d-bit: not rejected", bits);
+    }
+
+    for (int i = 0; i < randomcases; i++)
+    {
+        newarr = oldarr;
+
+        int const changes = checkrand() % 40;
+        bool const clustered = checkrand() & 1;
+        uint32_t const base = checkrand() % nelts;
+
+        for (int j = 0; j < changes; j++)
+        {
+            uint32_t const idx = clustered ? (base + checkrand() % 8) % nelts : checkrand() % nelts;
+            newarr[idx] = (Dat)checkrand();
+        }
+
+        std::vector<uint32_t> randranges;
+
+        if (checkrand() & 1)
+        {
+            for (uint32_t start = checkrand() % 16; start < nelts; start += 1 + checkrand() % 32)
+            {
+                uint32_t const end = min<uint32_t>(nelts, start + 1 + checkrand() % 24);
+                randranges.push_back(start);
+                randranges.push_back(end);
+                start = end;
+            }
+        }
+
+        roundtrip("random", oldarr, newarr, randranges);
+    }
+
+    printf("%2d-bit elements checked\n", bits);
+}
+
+int main(int argc, char **argv)
+{
+    int randomcases = 5000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!Bstrcasecmp(argv[i], "-random") && i+1 < argc)
+            randomcases = max(0, Batoi(argv[++i]));
+        else
+        {
+            printf("Usage: spandiffcheck [-random N]\n");
+            return 1;
+        }
+    }
+
+    checkcases<uint8_t>(randomcases);
+    checkcases<uint16_t>(randomcases);
+    checkcases<uint32_t>(randomcases);
+    checkcases<uint64_t>(randomcases);
+
+    if (failures)
+        printf("\n%d checks failed!\n", failures);
+
+    return failures != 0;
+}